@@ -1,13 +1,17 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <type_traits>
 
 namespace OpenShock::Checksum {
   constexpr std::uint8_t CRC8(const std::uint8_t* data, std::size_t size, std::uint8_t checksum = 0) {
      return size == 0 ? checksum : CRC8(data + 1, size - 1, checksum + *data);
    }
+  // Sum of the bytes of an unsigned integer, written with shifts so it can be evaluated at compile time
   template<typename T>
-  constexpr std::uint8_t CRC8(T data) {
-    return CRC8(reinterpret_cast<std::uint8_t*>(&data), sizeof(T));
+  constexpr std::uint8_t CRC8(T data, std::size_t size = sizeof(T), std::uint8_t checksum = 0) {
+    static_assert(std::is_unsigned<T>::value, "T must be an unsigned integer");
+    return size == 0 ? checksum : CRC8<T>(data >> 8, size - 1, checksum + static_cast<std::uint8_t>(data & 0xFF));
   }
 }  // namespace OpenShock::Checksum
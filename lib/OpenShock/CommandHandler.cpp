@@ -6,6 +6,7 @@
 #include "Logging.h"
 #include "radio/RFTransmitter.h"
 #include "Time.h"
+#include "util/QuiescentPtr.h"
 #include "util/TaskUtils.h"
 #include "AltTime.h"
 
@@ -13,13 +14,19 @@
 #include <freertos/queue.h>
 #include <freertos/semphr.h>
 
-#include <memory>
+#include <algorithm>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 const char* const TAG = "CommandHandler";
 
 const std::int64_t KEEP_ALIVE_INTERVAL  = 60000;
 const std::uint16_t KEEP_ALIVE_DURATION = 300;
+// Keep-alives due within this window are sent together, so many shockers cost few wakeups
+const std::int64_t KEEP_ALIVE_BATCH_WINDOW = 5000;
+// Retry delay when the transmitter has no free command slot
+const std::int64_t KEEP_ALIVE_RETRY_DELAY = 1000;
 
 using namespace OpenShock;
 
@@ -39,111 +46,174 @@ struct KnownShocker {
   std::int64_t lastActivityTimestamp;
 };
 
-static SemaphoreHandle_t s_rfTransmitterMutex         = nullptr;
-static std::unique_ptr<RFTransmitter> s_rfTransmitter = nullptr;
+// Min-heap entry, stale once the shocker's deadline moved on
+struct KeepAliveDeadline {
+  std::int64_t deadline;
+  std::uint16_t shockerId;
+
+  // std heap functions build a max-heap, invert so the earliest deadline is on top
+  bool operator<(const KeepAliveDeadline& other) const { return deadline > other.deadline; }
+};
+
+struct KeepAliveEntry {
+  ShockerModelType model;
+  std::int64_t deadline;
+};
+
+// Producers use the transmitter and the keep-alive queue without a lock, the mutexes only serialize
+// the pin change and enabling or disabling the keep-alive task
+static SemaphoreHandle_t s_rfTransmitterMutex = nullptr;
+static QuiescentPtr<RFTransmitter> s_rfTransmitter;
+static std::uint8_t s_rfTxPin = 21;
 
 static SemaphoreHandle_t s_keepAliveMutex = nullptr;
-static QueueHandle_t s_keepAliveQueue     = nullptr;
+typedef QuiescentPtr<std::remove_pointer<QueueHandle_t>::type> KeepAliveQueuePtr;
+static KeepAliveQueuePtr s_keepAliveQueue;
 static TaskHandle_t s_keepAliveTaskHandle = nullptr;
 
-void _keepAliveTask(void* arg) {
-  (void)arg;
-
-  std::int64_t timeToKeepAlive = KEEP_ALIVE_INTERVAL;
+// Waits out the producers still holding a retired transmitter or queue
+static void _waitForProducers() {
+  vTaskDelay(1);
+}
 
-  // Map of shocker IDs to time of next keep-alive
-  std::unordered_map<std::uint16_t, KnownShocker> activityMap;
+void _keepAliveTask(void* arg) {
+  QueueHandle_t queue = reinterpret_cast<QueueHandle_t>(arg);
+
+  // Current deadline per shocker, and a heap of deadlines with lazy deletion of stale ones.
+  // Recording activity pushes a new deadline in O(log n) instead of searching the heap.
+  std::unordered_map<std::uint16_t, KeepAliveEntry> shockers;
+  std::vector<KeepAliveDeadline> deadlines;
+  // Due keep-alives of one wakeup, kept across wakeups so it only allocates while growing
+  std::vector<ShockerCommand> batch;
+
+  auto schedule = [&](std::uint16_t shockerId, std::int64_t deadline) {
+    shockers[shockerId].deadline = deadline;
+    deadlines.push_back({deadline, shockerId});
+    std::push_heap(deadlines.begin(), deadlines.end());
+
+    // Bound the stale entries, rebuilding from the map is O(n)
+    if (deadlines.size() > shockers.size() * 4) {
+      deadlines.clear();
+      for (auto it = shockers.begin(); it != shockers.end(); ++it) {
+        deadlines.push_back({it->second.deadline, it->first});
+      }
+      std::make_heap(deadlines.begin(), deadlines.end());
+    }
+  };
 
   while (true) {
-    // Calculate eepyTime based on the timeToKeepAlive
-    std::uint32_t eepyTime = calculateEepyTime(timeToKeepAlive);
+    std::int64_t next = deadlines.empty() ? OpenShock::millis() + KEEP_ALIVE_INTERVAL : deadlines.front().deadline;
 
     KnownShocker cmd;
-    while (xQueueReceive(s_keepAliveQueue, &cmd, pdMS_TO_TICKS(eepyTime)) == pdTRUE) {
+    while (xQueueReceive(queue, &cmd, pdMS_TO_TICKS(calculateEepyTime(next))) == pdTRUE) {
       if (cmd.killTask) {
         ESP_LOGI(TAG, "Received kill command, exiting keep-alive task");
         vTaskDelete(nullptr);
         break;  // This should never be reached
       }
 
-      activityMap[cmd.shockerId] = cmd;
+      shockers[cmd.shockerId].model = cmd.model;
+      schedule(cmd.shockerId, cmd.lastActivityTimestamp + KEEP_ALIVE_INTERVAL);
 
-      eepyTime = calculateEepyTime(std::min(timeToKeepAlive, cmd.lastActivityTimestamp + KEEP_ALIVE_INTERVAL));
+      next = deadlines.front().deadline;
     }
 
-    // Update the time to now
     std::int64_t now = OpenShock::millis();
 
-    // Keep track of the minimum activity time, so we know when to wake up
-    timeToKeepAlive = now + KEEP_ALIVE_INTERVAL;
-
-    // For every entry that has a keep-alive time less than now, send a keep-alive
-    for (auto it = activityMap.begin(); it != activityMap.end(); ++it) {
-      auto& cmdRef = it->second;
+    // Collect every keep-alive due within the batch window, they go out as one transmitter batch
+    batch.clear();
+    while (!deadlines.empty() && deadlines.front().deadline <= now + KEEP_ALIVE_BATCH_WINDOW) {
+      KeepAliveDeadline due = deadlines.front();
+      std::pop_heap(deadlines.begin(), deadlines.end());
+      deadlines.pop_back();
 
-      if (cmdRef.lastActivityTimestamp + KEEP_ALIVE_INTERVAL < now) {
-        ESP_LOGV(TAG, "Sending keep-alive for shocker %u", cmdRef.shockerId);
+      auto it = shockers.find(due.shockerId);
+      if (it == shockers.end() || it->second.deadline != due.deadline) {
+        continue;  // Stale, the shocker had activity since
+      }
 
-        if (s_rfTransmitter == nullptr) {
-          ESP_LOGW(TAG, "RF Transmitter is not initialized, ignoring keep-alive");
-          break;
-        }
+      batch.push_back({.model = it->second.model, .shockerId = due.shockerId, .intensity = 0});
+    }
 
-        if (!s_rfTransmitter->SendCommand(cmdRef.model, cmdRef.shockerId, ShockerCommandType::Vibrate, 0, KEEP_ALIVE_DURATION, false)) {
-          ESP_LOGW(TAG, "Failed to send keep-alive for shocker %u", cmdRef.shockerId);
-        }
+    if (batch.empty()) {
+      continue;
+    }
 
-        cmdRef.lastActivityTimestamp = now;
+    ESP_LOGV(TAG, "Sending keep-alive for %zu shockers", batch.size());
+
+    std::size_t sent = 0;
+    {
+      QuiescentPtr<RFTransmitter>::Ref transmitter(s_rfTransmitter);
+      if (!transmitter) {
+        ESP_LOGW(TAG, "RF Transmitter is not initialized, ignoring keep-alive");
+        sent = batch.size();  // Nothing to retry, the next one is due in a full interval
+      } else {
+        // A keep-alive never replaces a real command, the transmitter interleaves it with everything else
+        sent = transmitter->SendKeepAlives(batch.data(), batch.size(), KEEP_ALIVE_DURATION);
       }
+    }
 
-      timeToKeepAlive = std::min(timeToKeepAlive, cmdRef.lastActivityTimestamp + KEEP_ALIVE_INTERVAL);
+    if (sent < batch.size()) {
+      ESP_LOGW(TAG, "Failed to send keep-alive for %zu shockers", batch.size() - sent);
+    }
+
+    // Out of command slots, the rest of the batch is retried shortly
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+      schedule(batch[i].shockerId, now + (i < sent ? KEEP_ALIVE_INTERVAL : KEEP_ALIVE_RETRY_DELAY));
     }
   }
 }
 
 bool _internalSetKeepAliveEnabled(bool enabled) {
-  bool wasEnabled = s_keepAliveQueue != nullptr && s_keepAliveTaskHandle != nullptr;
+  xSemaphoreTake(s_keepAliveMutex, portMAX_DELAY);
+
+  bool wasEnabled = s_keepAliveTaskHandle != nullptr;
 
   if (enabled == wasEnabled) {
     ESP_LOGV(TAG, "keep-alive task is already %s", enabled ? "enabled" : "disabled");
+
+    xSemaphoreGive(s_keepAliveMutex);
     return true;
   }
 
-  xSemaphoreTake(s_keepAliveMutex, portMAX_DELAY);
-
   if (enabled) {
     ESP_LOGV(TAG, "Enabling keep-alive task");
 
-    s_keepAliveQueue = xQueueCreate(32, sizeof(KnownShocker));
-    if (s_keepAliveQueue == nullptr) {
+    QueueHandle_t queue = xQueueCreate(32, sizeof(KnownShocker));
+    if (queue == nullptr) {
       ESP_LOGE(TAG, "Failed to create keep-alive task");
 
       xSemaphoreGive(s_keepAliveMutex);
       return false;
     }
 
-    if (TaskUtils::TaskCreateExpensive(_keepAliveTask, "KeepAliveTask", 4096, nullptr, 1, &s_keepAliveTaskHandle) != pdPASS) {  // PROFILED: 1.5KB stack usage
+    if (TaskUtils::TaskCreateExpensive(_keepAliveTask, "KeepAliveTask", 4096, queue, 1, &s_keepAliveTaskHandle) != pdPASS) {  // PROFILED: 1.5KB stack usage
       ESP_LOGE(TAG, "Failed to create keep-alive task");
 
-      vQueueDelete(s_keepAliveQueue);
-      s_keepAliveQueue = nullptr;
+      vQueueDelete(queue);
+      s_keepAliveTaskHandle = nullptr;
 
       xSemaphoreGive(s_keepAliveMutex);
       return false;
     }
+
+    s_keepAliveQueue.Publish(queue);
   } else {
     ESP_LOGV(TAG, "Disabling keep-alive task");
-    if (s_keepAliveTaskHandle != nullptr && s_keepAliveQueue != nullptr) {
+
+    // Producers stop recording activity first, then nobody but the task uses the queue
+    QueueHandle_t queue = s_keepAliveQueue.Retire(_waitForProducers);
+    if (queue != nullptr) {
       // Wait for the task to stop
       KnownShocker cmd {.killTask = true};
       while (eTaskGetState(s_keepAliveTaskHandle) != eDeleted) {
         vTaskDelay(pdMS_TO_TICKS(10));
 
         // Send nullptr to stop the task gracefully
-        xQueueSend(s_keepAliveQueue, &cmd, pdMS_TO_TICKS(10));
+        xQueueSend(queue, &cmd, pdMS_TO_TICKS(10));
       }
-      vQueueDelete(s_keepAliveQueue);
-      s_keepAliveQueue = nullptr;
+      vQueueDelete(queue);
+      s_keepAliveTaskHandle = nullptr;
     } else {
       ESP_LOGW(TAG, "keep-alive task is already disabled? Something might be wrong.");
     }
@@ -185,14 +255,15 @@ bool CommandHandler::Init() {
   // }
 
 
-  s_rfTransmitter = std::unique_ptr<OpenShock::RFTransmitter>(new OpenShock::RFTransmitter(GetRfTxPin()));
-  // s_rfTransmitter = std::make_unique<RFTransmitter>(GetRfTxPin());
-  if (!s_rfTransmitter->ok()) {
+  RFTransmitter* transmitter = new OpenShock::RFTransmitter(GetRfTxPin());
+  if (!transmitter->ok()) {
     ESP_LOGE(TAG, "Failed to initialize RF Transmitter");
-    s_rfTransmitter = nullptr;
+    delete transmitter;
     return false;
   }
 
+  s_rfTransmitter.Publish(transmitter);
+
   if (false) {
     _internalSetKeepAliveEnabled(true);
   }
@@ -201,7 +272,7 @@ bool CommandHandler::Init() {
 }
 
 bool CommandHandler::Ok() {
-  return s_rfTransmitter != nullptr;
+  return static_cast<bool>(QuiescentPtr<RFTransmitter>::Ref(s_rfTransmitter));
 }
 
 SetRfPinResultCode CommandHandler::SetRfTxPin(std::uint8_t txPin) {
@@ -211,15 +282,18 @@ SetRfPinResultCode CommandHandler::SetRfTxPin(std::uint8_t txPin) {
 
   xSemaphoreTake(s_rfTransmitterMutex, portMAX_DELAY);
 
-  if (s_rfTransmitter != nullptr) {
+  // Producers that still hold the old transmitter finish their push before it goes away, new ones see none
+  RFTransmitter* old = s_rfTransmitter.Retire(_waitForProducers);
+  if (old != nullptr) {
     ESP_LOGV(TAG, "Destroying existing RF transmitter");
-    s_rfTransmitter = nullptr;
+    delete old;
   }
 
   ESP_LOGV(TAG, "Creating new RF transmitter");
-  auto rfxmit = std::unique_ptr<OpenShock::RFTransmitter>(new OpenShock::RFTransmitter(txPin));
+  RFTransmitter* rfxmit = new OpenShock::RFTransmitter(txPin);
   if (!rfxmit->ok()) {
     ESP_LOGE(TAG, "Failed to initialize RF transmitter");
+    delete rfxmit;
 
     xSemaphoreGive(s_rfTransmitterMutex);
     return SetRfPinResultCode::InternalError;
@@ -232,7 +306,8 @@ SetRfPinResultCode CommandHandler::SetRfTxPin(std::uint8_t txPin) {
   //   return SetRfPinResultCode::InternalError;
   // }
 
-  s_rfTransmitter = std::move(rfxmit);
+  s_rfTransmitter.Publish(rfxmit);
+  s_rfTxPin = txPin;
 
   xSemaphoreGive(s_rfTransmitterMutex);
   return SetRfPinResultCode::Success;
@@ -276,45 +351,78 @@ std::uint8_t CommandHandler::GetRfTxPin() {
   //   txPin = Constants::GPIO_INVALID;
   // }
 
-  return 21;
+  return s_rfTxPin;
 }
 
-bool CommandHandler::HandleCommand(ShockerModelType model, std::uint16_t shockerId, ShockerCommandType type, std::uint8_t intensity, std::uint16_t durationMs) {
-  xSemaphoreTake(s_rfTransmitterMutex, portMAX_DELAY);
+void CommandHandler::SetTransmitHook(TransmitHook hook) {
+  RFTransmitter::SetTransmitHook(hook);
+}
 
-  if (s_rfTransmitter == nullptr) {
-    ESP_LOGW(TAG, "RF Transmitter is not initialized, ignoring command");
+void CommandHandler::SetStopHook(StopHook hook) {
+  RFTransmitter::SetStopHook(hook);
+}
 
-    xSemaphoreGive(s_rfTransmitterMutex);
+bool CommandHandler::GetTransmitterCounters(std::uint32_t& queued, std::uint32_t& dropped) {
+  QuiescentPtr<RFTransmitter>::Ref transmitter(s_rfTransmitter);
+  if (!transmitter) {
     return false;
   }
 
+  queued  = transmitter->GetQueuedCount();
+  dropped = transmitter->GetDroppedCount();
+
+  return true;
+}
+
+bool CommandHandler::HandleCommand(ShockerModelType model, std::uint16_t shockerId, ShockerCommandType type, std::uint8_t intensity, std::uint16_t durationMs, std::int64_t sampleTimestamp) {
+  ShockerCommand command {.model = model, .shockerId = shockerId, .intensity = intensity};
+
+  return HandleGroupCommand(&command, 1, type, durationMs, sampleTimestamp);
+}
+
+bool CommandHandler::HandleGroupCommand(const ShockerCommand* commands, std::size_t count, ShockerCommandType type, std::uint16_t durationMs, std::int64_t sampleTimestamp) {
+  // Never blocks, the transmitter takes commands from any number of producers through its rings
+  QuiescentPtr<RFTransmitter>::Ref transmitter(s_rfTransmitter);
+  if (!transmitter) {
+    ESP_LOGW(TAG, "RF Transmitter is not initialized, ignoring command");
+    return false;
+  }
+
+  std::size_t sent = 0;
+
   // Stop logic
   if (type == ShockerCommandType::Stop) {
-    ESP_LOGV(TAG, "Stop command received, clearing pending commands");
+    ESP_LOGV(TAG, "Stop command received, cancelling all commands");
+
+    // Cancels queued and transmitting commands without waiting behind the queue
+    transmitter->Stop();
 
-    type       = ShockerCommandType::Vibrate;
-    intensity  = 0;
     durationMs = 300;
 
-    s_rfTransmitter->ClearPendingCommands();
+    sent = transmitter->SendStops(commands, count, durationMs, sampleTimestamp);
   } else {
-    ESP_LOGD(TAG, "Command received: %u %u %u %u", model, shockerId, type, intensity);
-  }
-
-  bool ok = s_rfTransmitter->SendCommand(model, shockerId, type, intensity, durationMs);
+    ESP_LOGD(TAG, "Command received: %u for %zu devices", type, count);
 
-  xSemaphoreGive(s_rfTransmitterMutex);
-  xSemaphoreTake(s_keepAliveMutex, portMAX_DELAY);
+    sent = transmitter->SendCommands(commands, count, type, durationMs, true, sampleTimestamp);
+  }
 
-  if (ok && s_keepAliveQueue != nullptr) {
-    KnownShocker cmd {.model = model, .shockerId = shockerId, .lastActivityTimestamp = OpenShock::millis() + durationMs};
-    if (xQueueSend(s_keepAliveQueue, &cmd, pdMS_TO_TICKS(10)) != pdTRUE) {
-      ESP_LOGE(TAG, "Failed to send keep-alive command to queue");
+  KeepAliveQueuePtr::Ref keepAliveQueue(s_keepAliveQueue);
+  if (keepAliveQueue) {
+    for (std::size_t i = 0; i < sent; ++i) {
+      KnownShocker cmd {.model = commands[i].model, .shockerId = commands[i].shockerId, .lastActivityTimestamp = OpenShock::millis() + durationMs};
+      // Never wait here, a full queue only delays a keep-alive
+      if (xQueueSend(keepAliveQueue.get(), &cmd, 0) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to send keep-alive command to queue");
+      }
     }
   }
 
-  xSemaphoreGive(s_keepAliveMutex);
+  // An empty group, e.g. every shocker disabled, reaches nobody and must not report success. A stop still
+  // cancelled what was on air above.
+  if (count == 0) {
+    ESP_LOGW(TAG, "Command %u has no devices", type);
+    return false;
+  }
 
-  return ok;
+  return sent == count;
 }
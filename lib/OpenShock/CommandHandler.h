@@ -2,7 +2,9 @@
 
 #include "ShockerCommandType.h"
 #include "ShockerModelType.h"
+#include "radio/RFTransmitter.h"
 
+#include <cstddef>
 #include <cstdint>
 
 // TODO: This is horrible architecture. Fix it.
@@ -34,5 +36,13 @@ namespace OpenShock::CommandHandler {
   bool SetKeepAliveEnabled(bool enabled);
   bool SetKeepAlivePaused(bool paused);
 
-  bool HandleCommand(ShockerModelType shockerModel, std::uint16_t shockerId, ShockerCommandType type, std::uint8_t intensity, std::uint16_t durationMs);
+  // sampleTimestamp is the esp_timer time of the input that caused the command, 0 if unknown
+  bool HandleCommand(ShockerModelType shockerModel, std::uint16_t shockerId, ShockerCommandType type, std::uint8_t intensity, std::uint16_t durationMs, std::int64_t sampleTimestamp = 0);
+  // Sends one command to every device in a single transmitter batch, the intensity is per device
+  bool HandleGroupCommand(const ShockerCommand* commands, std::size_t count, ShockerCommandType type, std::uint16_t durationMs, std::int64_t sampleTimestamp = 0);
+
+  void SetTransmitHook(TransmitHook hook);
+  void SetStopHook(StopHook hook);
+  // Commands queued to and rejected by the current transmitter, false if there is none
+  bool GetTransmitterCounters(std::uint32_t& queued, std::uint32_t& dropped);
 }  // namespace OpenShock::CommandHandler
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "EStopManager.h"
+
+#include <atomic>
+#include <cstdint>
+
+// E-stop status with the interrupt latch and the debounced button state machine.
+//
+// The interrupt latches the e-stop on the edge itself, the debounce only applies to leaving it. The state
+// machine is fed raw samples of the button by the e-stop task. It is free of RTOS and GPIO calls, so the
+// interleaving of interrupt and task can be exercised on the host.
+
+namespace OpenShock {
+  class EStopLatch {
+  public:
+    // A level has to be stable this long before the state machine acts on it
+    static constexpr std::int64_t DEBOUNCE_MS = 50;
+    // How long the button has to be held to clear the e-stop
+    static constexpr std::int64_t HOLD_TO_CLEAR_MS = 5000;
+
+    /// @brief Takes the button level the samples start from
+    void Begin(bool pressed, std::int64_t now) {
+      m_level      = pressed;
+      m_pressed    = pressed;
+      m_levelSince = now;
+      m_pressedAt  = 0;
+    }
+
+    /// @brief Lock free, safe to call from the interrupt. Always inlined, so it runs from the interrupt's IRAM.
+    /// @return true if this call latched the e-stop, false if it already was
+    __attribute__((always_inline)) bool Latch() {
+      std::uint8_t expected = static_cast<std::uint8_t>(EStopManager::EStopStatus::ALL_CLEAR);
+      return m_status.compare_exchange_strong(expected, static_cast<std::uint8_t>(EStopManager::EStopStatus::ESTOPPED_AND_HELD));
+    }
+
+    /// @brief Feeds one raw sample of the button
+    /// @return true if the sample changed the status
+    bool Update(bool sample, std::int64_t now) {
+      if (sample != m_level) {
+        m_level      = sample;
+        m_levelSince = now;
+      }
+
+      // The debounced state only follows the raw level once it has been stable, the interrupt already latched the press
+      bool wasPressed = m_pressed;
+      if (now - m_levelSince >= DEBOUNCE_MS) {
+        m_pressed = m_level;
+      }
+
+      switch (Status()) {
+        case EStopManager::EStopStatus::ALL_CLEAR:
+          // An edge missed by the interrupt, the debounced level still triggers the e-stop
+          if (m_pressed && !wasPressed) {
+            return Latch();
+          }
+          break;
+        case EStopManager::EStopStatus::ESTOPPED_AND_HELD:
+          if (!m_pressed && now - m_levelSince >= DEBOUNCE_MS) {
+            return set(EStopManager::EStopStatus::ESTOPPED);
+          }
+          break;
+        case EStopManager::EStopStatus::ESTOPPED:
+          if (m_pressed && !wasPressed) {
+            m_pressedAt = m_levelSince;
+          }
+          // Only a long press clears the e-stop, a shorter one leaves it as it is
+          if (m_pressed && now - m_pressedAt >= HOLD_TO_CLEAR_MS) {
+            return set(EStopManager::EStopStatus::ESTOPPED_CLEARED);
+          }
+          break;
+        case EStopManager::EStopStatus::ESTOPPED_CLEARED:
+          // Cleared only once the button is let go, so the same press can not trigger it again
+          if (!m_pressed) {
+            return set(EStopManager::EStopStatus::ALL_CLEAR);
+          }
+          break;
+      }
+
+      return false;
+    }
+
+    EStopManager::EStopStatus Status() const { return static_cast<EStopManager::EStopStatus>(m_status.load()); }
+    bool IsEStopped() const { return Status() != EStopManager::EStopStatus::ALL_CLEAR; }
+    /// @brief Nothing to debounce, the task can wait for the next interrupt
+    bool IsIdle() const { return !IsEStopped() && !m_pressed; }
+
+  private:
+    bool set(EStopManager::EStopStatus status) {
+      // The interrupt only writes while all clear, so past the latch the task is the only writer
+      m_status.store(static_cast<std::uint8_t>(status));
+      return true;
+    }
+
+    // Read before every RF frame, written by the interrupt and the e-stop task
+    std::atomic<std::uint8_t> m_status {static_cast<std::uint8_t>(EStopManager::EStopStatus::ALL_CLEAR)};
+
+    // Only touched by the e-stop task
+    bool m_level              = false;
+    bool m_pressed            = false;
+    std::int64_t m_levelSince = 0;
+    std::int64_t m_pressedAt  = 0;
+  };
+}  // namespace OpenShock
@@ -0,0 +1,108 @@
+#include "EStopManager.h"
+
+#include "EStopLatch.h"
+
+#include "Logging.h"
+#include "AltTime.h"
+#include "util/TaskUtils.h"
+
+#include <Arduino.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// E-stop button, active LOW with the internal pull-up, -1 disables the e-stop
+#ifndef ESTOP_PIN
+#define ESTOP_PIN -1
+#endif
+
+const char* const TAG = "EStopManager";
+
+const std::uint32_t ESTOP_TASK_STACK_SIZE = 2048;
+const BaseType_t ESTOP_TASK_PRIORITY      = 2;
+
+using namespace OpenShock;
+
+// The transmit task reads the status before every frame
+static EStopLatch s_latch;
+static portMUX_TYPE s_estoppedAtMux = portMUX_INITIALIZER_UNLOCKED;
+static std::int64_t s_estoppedAt    = 0;
+
+static std::uint8_t s_pin             = 0;
+static std::uint16_t s_updateInterval = 0;
+static TaskHandle_t s_taskHandle      = nullptr;
+
+static void IRAM_ATTR _estopIsr() {
+  if (s_latch.Latch()) {
+    portENTER_CRITICAL_ISR(&s_estoppedAtMux);
+    s_estoppedAt = OpenShock::millis();
+    portEXIT_CRITICAL_ISR(&s_estoppedAtMux);
+  }
+
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(s_taskHandle, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+static void _estopTask(void* arg) {
+  (void)arg;
+
+  s_latch.Begin(digitalRead(s_pin) == LOW, OpenShock::millis());
+
+  while (true) {
+    // Nothing to debounce while idle, the interrupt wakes the task on the next press
+    ulTaskNotifyTake(pdTRUE, s_latch.IsIdle() ? portMAX_DELAY : pdMS_TO_TICKS(s_updateInterval));
+
+    std::int64_t now = OpenShock::millis();
+    if (!s_latch.Update(digitalRead(s_pin) == LOW, now)) {
+      continue;
+    }
+
+    EStopManager::EStopStatus status = s_latch.Status();
+    // Latched from the debounced level, an edge the interrupt missed
+    if (status == EStopManager::EStopStatus::ESTOPPED_AND_HELD) {
+      portENTER_CRITICAL(&s_estoppedAtMux);
+      s_estoppedAt = now;
+      portEXIT_CRITICAL(&s_estoppedAtMux);
+    }
+    ESP_LOGI(TAG, "E-stop status changed to %u", static_cast<std::uint8_t>(status));
+  }
+}
+
+void EStopManager::Init(std::uint16_t updateIntervalMs) {
+  if (s_taskHandle != nullptr) {
+    ESP_LOGW(TAG, "E-stop manager is already initialized");
+    return;
+  }
+
+  if (ESTOP_PIN < 0 || !GPIO_IS_VALID_GPIO(ESTOP_PIN)) {
+    ESP_LOGI(TAG, "No valid e-stop pin configured, e-stop is disabled");
+    return;
+  }
+
+  s_pin            = ESTOP_PIN;
+  s_updateInterval = updateIntervalMs;
+
+  pinMode(s_pin, INPUT_PULLUP);
+
+  if (TaskUtils::TaskCreateExpensive(_estopTask, "EStopManager", ESTOP_TASK_STACK_SIZE, nullptr, ESTOP_TASK_PRIORITY, &s_taskHandle) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create e-stop task");
+    return;
+  }
+
+  attachInterrupt(s_pin, _estopIsr, FALLING);
+
+  ESP_LOGI(TAG, "E-stop initialized on pin %u", s_pin);
+}
+
+bool EStopManager::IsEStopped() {
+  return s_latch.IsEStopped();
+}
+
+std::int64_t EStopManager::WhenEStopped() {
+  portENTER_CRITICAL(&s_estoppedAtMux);
+  std::int64_t estoppedAt = s_estoppedAt;
+  portEXIT_CRITICAL(&s_estoppedAtMux);
+
+  return estoppedAt;
+}
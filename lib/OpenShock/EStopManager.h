@@ -10,7 +10,10 @@ namespace OpenShock::EStopManager {
     ESTOPPED_CLEARED    // The EStop has been cleared by the user, but we're waiting for the user to release the button (to avoid incidental estops)
   };
 
+  /// @brief Latches the e-stop from the ESTOP_PIN interrupt and runs the debounced state machine every updateIntervalMs
   void Init(std::uint16_t updateIntervalMs);
+  /// @brief Lock free, safe to call before every RF frame
   bool IsEStopped();
+  /// @return The OpenShock::millis() time the e-stop was triggered
   std::int64_t WhenEStopped();
 }  // namespace OpenShock::EStopManager
@@ -3,31 +3,43 @@
 
 #include "Logging.h"
 #include "radio/rmt/MainEncoder.h"
+#include "radio/TransmitEngine.h"
 #include "AltTime.h"
 #include "util/TaskUtils.h"
 
 #include <freertos/FreeRTOS.h>
-#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <climits>
+#include <limits>
 
 const char* const TAG = "RFTransmitter";
 
-const UBaseType_t RFTRANSMITTER_QUEUE_SIZE        = 64;
+const std::size_t RFTRANSMITTER_QUEUE_SIZE        = 16;
 const BaseType_t RFTRANSMITTER_TASK_PRIORITY      = 1;
 const std::uint32_t RFTRANSMITTER_TASK_STACK_SIZE = 4096;  // PROFILED: 1.4KB stack usage
 const float RFTRANSMITTER_TICKRATE_NS             = 1000;
-const std::int64_t TRANSMIT_END_DURATION          = 300;
+// Silence between two frames of the same shocker, on top of the frame air time
+const std::uint32_t RFTRANSMITTER_FRAME_GAP_US    = 0;
+
+// Task notification bits
+const std::uint32_t NOTIFY_COMMAND = 1 << 0;
+const std::uint32_t NOTIFY_STOP    = 1 << 1;
 
 using namespace OpenShock;
 
-struct command_t {
-  std::int64_t until;
-  std::vector<rmt_data_t> sequence;
-  std::vector<rmt_data_t> zeroSequence;
-  std::uint16_t shockerId;
-  bool overwrite;
-};
+static TransmitHook s_transmitHook = nullptr;
+static StopHook s_stopHook         = nullptr;
 
-RFTransmitter::RFTransmitter(std::uint8_t gpioPin) : m_txPin(gpioPin), m_rmtHandle(nullptr), m_queueHandle(nullptr), m_taskHandle(nullptr) {
+void RFTransmitter::SetTransmitHook(TransmitHook hook) {
+  s_transmitHook = hook;
+}
+
+void RFTransmitter::SetStopHook(StopHook hook) {
+  s_stopHook = hook;
+}
+
+RFTransmitter::RFTransmitter(std::uint8_t gpioPin) : m_txPin(gpioPin), m_rmtHandle(nullptr), m_pool(nullptr), m_free(), m_queue(), m_taskHandle(nullptr), m_queued(0), m_dropped(0), m_stopRequestedAt(0) {
   ESP_LOGD(TAG, "[pin-%u] Creating RFTransmitter", m_txPin);
 
   m_rmtHandle = rmtInit(gpioPin, RMT_TX_MODE, RMT_MEM_64);
@@ -40,11 +52,11 @@ RFTransmitter::RFTransmitter(std::uint8_t gpioPin) : m_txPin(gpioPin), m_rmtHand
   float realTick = rmtSetTick(m_rmtHandle, RFTRANSMITTER_TICKRATE_NS);
   ESP_LOGD(TAG, "[pin-%u] real tick set to: %fns", m_txPin, realTick);
 
-  m_queueHandle = xQueueCreate(RFTRANSMITTER_QUEUE_SIZE, sizeof(command_t*));
-  if (m_queueHandle == nullptr) {
-    ESP_LOGE(TAG, "[pin-%u] Failed to create queue", m_txPin);
-    destroy();
-    return;
+  // Every slot is either free, queued or held by the task, so the rings can never overflow
+  static_assert(CommandRing::capacity() == RFTRANSMITTER_QUEUE_SIZE, "The rings must hold every slot");
+  m_pool = new command_t[RFTRANSMITTER_QUEUE_SIZE];
+  for (std::size_t i = 0; i < RFTRANSMITTER_QUEUE_SIZE; ++i) {
+    m_free.push(&m_pool[i]);
   }
 
   char name[32];
@@ -61,40 +73,99 @@ RFTransmitter::~RFTransmitter() {
   destroy();
 }
 
-bool RFTransmitter::SendCommand(ShockerModelType model, std::uint16_t shockerId, ShockerCommandType type, std::uint8_t intensity, std::uint16_t durationMs, bool overwriteExisting) {
-  if (m_queueHandle == nullptr) {
-    ESP_LOGE(TAG, "[pin-%u] Queue is null", m_txPin);
-    return false;
+bool RFTransmitter::SendCommand(ShockerModelType model, std::uint16_t shockerId, ShockerCommandType type, std::uint8_t intensity, std::uint16_t durationMs, bool overwriteExisting, std::int64_t sampleTimestamp) {
+  ShockerCommand command {.model = model, .shockerId = shockerId, .intensity = intensity};
+
+  return SendCommands(&command, 1, type, durationMs, overwriteExisting, sampleTimestamp) == 1;
+}
+
+std::size_t RFTransmitter::SendCommands(const ShockerCommand* commands, std::size_t count, ShockerCommandType type, std::uint16_t durationMs, bool overwriteExisting, std::int64_t sampleTimestamp) {
+  return enqueue(commands, count, type, durationMs, overwriteExisting, sampleTimestamp, false, false);
+}
+
+std::size_t RFTransmitter::SendKeepAlives(const ShockerCommand* commands, std::size_t count, std::uint16_t durationMs) {
+  return enqueue(commands, count, ShockerCommandType::Vibrate, durationMs, false, 0, true, true);
+}
+
+std::size_t RFTransmitter::SendStops(const ShockerCommand* commands, std::size_t count, std::uint16_t durationMs, std::int64_t sampleTimestamp) {
+  return enqueue(commands, count, ShockerCommandType::Vibrate, durationMs, true, sampleTimestamp, false, true);
+}
+
+std::size_t RFTransmitter::enqueue(const ShockerCommand* commands, std::size_t count, ShockerCommandType type, std::uint16_t durationMs, bool overwriteExisting, std::int64_t sampleTimestamp, bool keepAlive, bool zeroIntensity) {
+  if (m_pool == nullptr) {
+    ESP_LOGE(TAG, "[pin-%u] Command pool is null", m_txPin);
+    return 0;
   }
 
-  command_t* cmd = new command_t {.until = OpenShock::millis() + durationMs, .sequence = Rmt::GetSequence(model, shockerId, type, intensity), .zeroSequence = Rmt::GetZeroSequence(model, shockerId), .shockerId = shockerId, .overwrite = overwriteExisting};
+  // The whole group shares one deadline and one queue time, so it is scheduled as a single batch
+  std::int64_t until    = OpenShock::millis() + durationMs;
+  std::int64_t queuedAt = OpenShock::micros();
 
-  // We will use nullptr commands to end the task, if we got a nullptr here, we are out of memory... :(
-  if (cmd == nullptr) {
-    ESP_LOGE(TAG, "[pin-%u] Failed to allocate command", m_txPin);
-    return false;
+  std::size_t sent = 0;
+  for (; sent < count; ++sent) {
+    const ShockerCommand& command = commands[sent];
+
+    // Overflow policy: the newest command is rejected and counted, queued commands are never evicted
+    command_t* cmd = nullptr;
+    if (!m_free.pop(cmd)) {
+      m_dropped.fetch_add(count - sent, std::memory_order_relaxed);
+      ESP_LOGE(TAG, "[pin-%u] No free command slot", m_txPin);
+      break;
+    }
+
+    cmd->until           = until;
+    cmd->model           = command.model;
+    cmd->shockerId       = command.shockerId;
+    cmd->overwrite       = overwriteExisting;
+    cmd->keepAlive       = keepAlive;
+    cmd->sampleTimestamp = sampleTimestamp;
+    cmd->queuedAt        = queuedAt;
+    cmd->transmitted     = false;
+    Rmt::GetSequence(cmd->sequence, command.model, command.shockerId, type, zeroIntensity ? 0 : command.intensity);
+    // The tick is 1us, so the duration in ticks is the air time in microseconds
+    cmd->repeatUs = cmd->sequence.durationTicks() + RFTRANSMITTER_FRAME_GAP_US;
+
+    // Never fails, the ring has room for every slot
+    m_queue.push(cmd);
   }
 
-  // Add the command to the queue, wait max 10 ms (Adjust this)
-  if (xQueueSend(m_queueHandle, &cmd, pdMS_TO_TICKS(10)) != pdTRUE) {
-    ESP_LOGE(TAG, "[pin-%u] Failed to send command to queue", m_txPin);
-    delete cmd;
-    return false;
+  m_queued.fetch_add(sent, std::memory_order_relaxed);
+
+  // Wake the task once, it drains the whole group in one pass
+  if (sent > 0) {
+    xTaskNotify(m_taskHandle, NOTIFY_COMMAND, eSetBits);
   }
 
-  return true;
+  return sent;
 }
 
 void RFTransmitter::ClearPendingCommands() {
-  if (m_queueHandle == nullptr) {
+  if (m_pool == nullptr) {
     return;
   }
 
   ESP_LOGI(TAG, "[pin-%u] Clearing pending commands", m_txPin);
 
   command_t* command;
-  while (xQueueReceive(m_queueHandle, &command, 0) == pdPASS) {
-    delete command;
+  while (m_queue.pop(command)) {
+    release(command);
+  }
+}
+
+void RFTransmitter::Stop() {
+  if (m_taskHandle == nullptr) {
+    return;
+  }
+
+  ESP_LOGI(TAG, "[pin-%u] Stopping all commands", m_txPin);
+
+  m_stopRequestedAt.store(OpenShock::micros());
+  xTaskNotify(m_taskHandle, NOTIFY_STOP, eSetBits);
+}
+
+void RFTransmitter::release(command_t* cmd) {
+  if (cmd != nullptr) {
+    m_free.push(cmd);
   }
 }
 
@@ -108,7 +179,9 @@ void RFTransmitter::destroy() {
       vTaskDelay(pdMS_TO_TICKS(10));
 
       // Send nullptr to stop the task gracefully
-      xQueueSend(m_queueHandle, &cmd, pdMS_TO_TICKS(10));
+      if (m_queue.push(cmd)) {
+        xTaskNotify(m_taskHandle, NOTIFY_COMMAND, eSetBits);
+      }
     }
 
     ESP_LOGD(TAG, "[pin-%u] Task stopped", m_txPin);
@@ -118,9 +191,9 @@ void RFTransmitter::destroy() {
 
     m_taskHandle = nullptr;
   }
-  if (m_queueHandle != nullptr) {
-    vQueueDelete(m_queueHandle);
-    m_queueHandle = nullptr;
+  if (m_pool != nullptr) {
+    delete[] m_pool;
+    m_pool = nullptr;
   }
   if (m_rmtHandle != nullptr) {
     rmtDeinit(m_rmtHandle);
@@ -131,95 +204,83 @@ void RFTransmitter::destroy() {
 void RFTransmitter::TransmitTask(void* arg) {
   RFTransmitter* transmitter = reinterpret_cast<RFTransmitter*>(arg);
   std::uint8_t m_txPin       = transmitter->m_txPin;  // This must be defined here, because the THIS_LOG macro uses it
-  rmt_obj_t* rmtHandle       = transmitter->m_rmtHandle;
-  QueueHandle_t queueHandle  = transmitter->m_queueHandle;
 
   ESP_LOGD(TAG, "[pin-%u] RMT loop running on core %d", m_txPin, xPortGetCoreID());
 
-  std::vector<command_t*> commands;
+  // The RMT peripheral and the pool behind the schedule
+  class RmtBackend : public TransmitEngine::Backend {
+  public:
+    explicit RmtBackend(RFTransmitter* transmitter) : m_transmitter(transmitter) { }
+
+    bool Write(Rmt::Sequence& frame) override { return rmtWrite(m_transmitter->m_rmtHandle, frame.pulses, frame.length); }
+    void Release(command_t* cmd) override { m_transmitter->release(cmd); }
+    void OnTransmitted(const command_t* cmd, std::int64_t now) override {
+      TransmitHook hook = s_transmitHook;
+      if (hook != nullptr) {
+        hook(cmd->sampleTimestamp, cmd->queuedAt, now);
+      }
+    }
+    void OnStopped(std::int64_t requestedAt, std::int64_t now) override {
+      StopHook hook = s_stopHook;
+      if (hook != nullptr) {
+        hook(requestedAt, now);
+      }
+    }
+
+  private:
+    RFTransmitter* m_transmitter;
+  };
+
+  RmtBackend backend(transmitter);
+  TransmitEngine engine(backend, RFTRANSMITTER_QUEUE_SIZE);
+
   while (true) {
+    // Sleep until a command arrives, or until the frame on air is done and the next frame is due
+    std::int64_t now    = OpenShock::micros();
+    std::int64_t wakeAt = engine.WakeAt();
+
+    TickType_t timeout = portMAX_DELAY;
+    if (wakeAt != std::numeric_limits<std::int64_t>::max()) {
+      timeout = wakeAt <= now ? 0 : pdMS_TO_TICKS((wakeAt - now + 999) / 1000);
+    }
+
+    std::uint32_t notification = 0;
+    xTaskNotifyWait(0, ULONG_MAX, &notification, timeout);
+
+    now = OpenShock::micros();
+
+    // Stop lane, checked before the queue so nothing issued before the stop gets on air again
+    if (notification & NOTIFY_STOP) {
+      engine.Stop(transmitter->m_stopRequestedAt.load(), now);
+    }
+
     // Receive commands
     command_t* cmd = nullptr;
-    while (xQueueReceive(queueHandle, &cmd, commands.empty() ? portMAX_DELAY : 0) == pdTRUE) {
+    while (transmitter->m_queue.pop(cmd)) {
       if (cmd == nullptr) {
         ESP_LOGD(TAG, "[pin-%u] Received nullptr (stop command), cleaning up...", m_txPin);
 
-        for (auto it = commands.begin(); it != commands.end(); ++it) {
-          delete *it;
+        // Let the frame on air finish before the buffer goes away
+        if (engine.BusyUntil() > now) {
+          vTaskDelay(pdMS_TO_TICKS((engine.BusyUntil() - now + 999) / 1000));
         }
 
+        engine.ReleaseAll();
+
         ESP_LOGD(TAG, "[pin-%u] Cleanup done, stopping task", m_txPin);
 
         vTaskDelete(nullptr);
         return;
       }
 
-      // Replace the command if it already exists
-      for (auto it = commands.begin(); it != commands.end(); ++it) {
-        const command_t* existingCmd = *it;
-
-        if (existingCmd->shockerId == cmd->shockerId) {
-          // Only replace the command if it should be overwritten
-          if (existingCmd->overwrite) {
-            delete *it;
-            *it = cmd;
-          } else {
-            delete cmd;
-          }
-
-          cmd = nullptr;
-
-          break;
-        }
-      }
-
-      // If the command was not replaced, add it to the queue
-      if (cmd != nullptr) {
-        commands.push_back(cmd);
-      }
+      engine.Add(cmd, now);
     }
 
-    // if(OpenShock::EStopManager::IsEStopped()) {
-
-    //   std::int64_t whenEStoppedTime = EStopManager::WhenEStopped();
-
-    //   for (auto it = commands.begin(); it != commands.end(); ++it) {
-    //     cmd = *it;
-
-    //     cmd->until = whenEStoppedTime;
-    //   }
-    // }
-
-    // Send queued commands
-    for (auto it = commands.begin(); it != commands.end();) {
-      cmd = *it;
-
-      bool expired = cmd->until < OpenShock::millis();
-      bool empty   = cmd->sequence.empty();
-
-      // Remove expired or empty commands, else send the command.
-      // After sending/receiving a command, move to the next one.
-      if (expired || empty) {
-        // If the command is not empty, send the zero sequence to stop the shocker
-        if (!empty) {
-          rmtWriteBlocking(rmtHandle, cmd->zeroSequence.data(), cmd->zeroSequence.size());
-        }
-
-        if(cmd->until + TRANSMIT_END_DURATION < OpenShock::millis()) {
-          // Remove the command and move to the next one
-          it = commands.erase(it);
-          delete cmd;
-        } else {
-          // Move to the next command
-          ++it;
-        }
-      } else {
-        // Send the command
-        rmtWriteBlocking(rmtHandle, cmd->sequence.data(), cmd->sequence.size());
-
-        // Move to the next command
-        ++it;
-      }
+    // Checked before every frame, so at most the frame already on air goes out after an e-stop
+    if (OpenShock::EStopManager::IsEStopped()) {
+      engine.EStop(EStopManager::WhenEStopped());
     }
+
+    engine.Service(now);
   }
 }
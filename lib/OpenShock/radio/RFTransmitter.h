@@ -2,17 +2,32 @@
 
 #include "ShockerCommandType.h"
 #include "ShockerModelType.h"
+#include "util/MpmcRing.h"
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 
 // Forward definitions to remove clutter
 struct rmt_obj_s;
 typedef rmt_obj_s rmt_obj_t;
-struct QueueDefinition;
-typedef QueueDefinition* QueueHandle_t;
 typedef void* TaskHandle_t;
+struct command_t;
 
 namespace OpenShock {
+  // Called from the transmit task when a command is first written to the RMT peripheral.
+  // All times are esp_timer microseconds, sampleTimestamp is the one passed to SendCommand.
+  typedef void (*TransmitHook)(std::int64_t sampleTimestamp, std::int64_t queuedAt, std::int64_t transmittedAt);
+  // Called from the transmit task when the first frame after a Stop is written to the RMT peripheral.
+  typedef void (*StopHook)(std::int64_t requestedAt, std::int64_t transmittedAt);
+
+  // One device of a group command
+  struct ShockerCommand {
+    ShockerModelType model;
+    std::uint16_t shockerId;
+    std::uint8_t intensity;
+  };
+
   class RFTransmitter {
   public:
     RFTransmitter(std::uint8_t gpioPin);
@@ -20,18 +35,50 @@ namespace OpenShock {
 
     inline std::uint8_t GetTxPin() const { return m_txPin; }
 
-    inline bool ok() const { return m_rmtHandle != nullptr && m_queueHandle != nullptr && m_taskHandle != nullptr; }
+    inline bool ok() const { return m_rmtHandle != nullptr && m_pool != nullptr && m_taskHandle != nullptr; }
 
-    bool SendCommand(ShockerModelType model, std::uint16_t shockerId, ShockerCommandType type, std::uint8_t intensity, std::uint16_t durationMs, bool overwriteExisting = true);
+    // Commands handed to the transmit task, and commands rejected because every slot was in use
+    inline std::uint32_t GetQueuedCount() const { return m_queued.load(std::memory_order_relaxed); }
+    inline std::uint32_t GetDroppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    bool SendCommand(ShockerModelType model, std::uint16_t shockerId, ShockerCommandType type, std::uint8_t intensity, std::uint16_t durationMs, bool overwriteExisting = true, std::int64_t sampleTimestamp = 0);
+    /// @brief Encodes the command for every device and queues them as one batch with a single task wakeup
+    /// @return The number of devices queued, fewer than count if the command slots ran out
+    std::size_t SendCommands(const ShockerCommand* commands, std::size_t count, ShockerCommandType type, std::uint16_t durationMs, bool overwriteExisting = true, std::int64_t sampleTimestamp = 0);
+    /// @brief Queues a zero intensity vibrate for every device as one batch. A keep-alive never replaces a command
+    /// of its shocker and is itself replaced by any real command, regardless of overwriteExisting.
+    /// @return The number of devices queued, fewer than count if the command slots ran out
+    std::size_t SendKeepAlives(const ShockerCommand* commands, std::size_t count, std::uint16_t durationMs);
+    /// @brief Queues a zero intensity vibrate for every device as one batch, replacing their queued commands.
+    /// The intensities in commands are ignored, so the caller's group can be passed as is.
+    /// @return The number of devices queued, fewer than count if the command slots ran out
+    std::size_t SendStops(const ShockerCommand* commands, std::size_t count, std::uint16_t durationMs, std::int64_t sampleTimestamp = 0);
     void ClearPendingCommands();
+    /// @brief Cancels every command queued before this call, including the ones being transmitted.
+    /// Bypasses the command queue, the shockers get their zero sequence from the next frame on.
+    void Stop();
+
+    static void SetTransmitHook(TransmitHook hook);
+    static void SetStopHook(StopHook hook);
 
   private:
     void destroy();
+    void release(command_t* cmd);
+    std::size_t enqueue(const ShockerCommand* commands, std::size_t count, ShockerCommandType type, std::uint16_t durationMs, bool overwriteExisting, std::int64_t sampleTimestamp, bool keepAlive, bool zeroIntensity);
     static void TransmitTask(void* arg);
 
     std::uint8_t m_txPin;
     rmt_obj_t* m_rmtHandle;
-    QueueHandle_t m_queueHandle;
+    // Commands live in a pool allocated once, the free ring hands out unused slots.
+    // Both rings hold every slot at most once, so pushing a slot can never fail.
+    typedef MpmcRing<command_t*, 16> CommandRing;
+    command_t* m_pool;
+    CommandRing m_free;
+    CommandRing m_queue;
     TaskHandle_t m_taskHandle;
+    std::atomic<std::uint32_t> m_queued;
+    std::atomic<std::uint32_t> m_dropped;
+    // Time of the latest Stop, read by the task when it sees the stop notification
+    std::atomic<std::int64_t> m_stopRequestedAt;
   };
 }  // namespace OpenShock
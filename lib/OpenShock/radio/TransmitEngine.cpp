@@ -0,0 +1,144 @@
+#include "radio/TransmitEngine.h"
+
+#include "radio/rmt/MainEncoder.h"
+#include "radio/TransmitSchedule.h"
+
+#include <limits>
+
+using namespace OpenShock;
+
+TransmitEngine::TransmitEngine(Backend& backend, std::size_t capacity) : m_backend(backend), m_commands(), m_inflight(), m_busyUntil(0), m_stopAt(std::numeric_limits<std::int64_t>::min()), m_stopPending(false) {
+  m_commands.reserve(capacity);
+}
+
+void TransmitEngine::Stop(std::int64_t requestedAt, std::int64_t now) {
+  m_stopAt      = requestedAt;
+  m_stopPending = true;
+
+  // Expire everything in flight, the zero sequence goes out on the very next frame
+  std::int64_t nowMs = now / 1000;
+  for (auto it = m_commands.begin(); it != m_commands.end(); ++it) {
+    command_t* stopped = *it;
+
+    stopped->until     = nowMs - 1;
+    stopped->overwrite = true;
+    stopped->nextDue   = now;
+  }
+}
+
+void TransmitEngine::Add(command_t* cmd, std::int64_t now) {
+  if (cmd->queuedAt <= m_stopAt) {
+    m_backend.Release(cmd);
+    return;
+  }
+
+  TransmitSchedule::Start(cmd, now);
+
+  // Replace the command if it already exists
+  for (auto it = m_commands.begin(); it != m_commands.end(); ++it) {
+    const command_t* existingCmd = *it;
+
+    if (existingCmd->shockerId == cmd->shockerId) {
+      // A keep-alive never displaces anything, a real command always displaces a keep-alive,
+      // and between real commands the existing one decides
+      bool replace = !cmd->keepAlive && (existingCmd->keepAlive || existingCmd->overwrite);
+      if (replace) {
+        // Keep the cadence of the shocker
+        cmd->nextDue = existingCmd->nextDue;
+        m_backend.Release(*it);
+        *it = cmd;
+      } else {
+        m_backend.Release(cmd);
+      }
+
+      return;
+    }
+  }
+
+  m_commands.push_back(cmd);
+}
+
+void TransmitEngine::EStop(std::int64_t estoppedAtMs) {
+  // A command is live up to and including its until, so it has to end before the millisecond of the e-stop
+  for (auto it = m_commands.begin(); it != m_commands.end(); ++it) {
+    command_t* cmd = *it;
+
+    if (cmd->until >= estoppedAtMs) {
+      cmd->until = estoppedAtMs - 1;
+    }
+  }
+}
+
+void TransmitEngine::Service(std::int64_t now) {
+  std::int64_t nowMs = now / 1000;
+
+  // Remove commands that are done, including their zero sequence tail
+  for (auto it = m_commands.begin(); it != m_commands.end();) {
+    command_t* cmd = *it;
+
+    if (cmd->sequence.empty() || cmd->until + END_DURATION_MS < nowMs) {
+      it = m_commands.erase(it);
+      m_backend.Release(cmd);
+    } else {
+      ++it;
+    }
+  }
+
+  if (now < m_busyUntil) {
+    return;
+  }
+
+  // Send the frame with the oldest deadline
+  auto due = TransmitSchedule::PickDue(m_commands.begin(), m_commands.end(), now);
+  if (due == m_commands.end()) {
+    return;
+  }
+  command_t* cmd = *due;
+
+  // Expired commands send the zero sequence to stop the shocker until they are removed
+  if (cmd->until < nowMs) {
+    // Without a zero sequence the command just ends, its live frame must never go out after it expired
+    if (!Rmt::GetZeroSequence(m_inflight, cmd->model, cmd->shockerId)) {
+      m_commands.erase(due);
+      m_backend.Release(cmd);
+      return;
+    }
+  } else {
+    m_inflight = cmd->sequence;
+
+    // Report when the first frame of a command goes out
+    if (!cmd->transmitted) {
+      cmd->transmitted = true;
+      m_backend.OnTransmitted(cmd, now);
+    }
+  }
+
+  // Start the frame without waiting for it, the air time is known so the task sleeps until it is done
+  if (m_backend.Write(m_inflight)) {
+    // The tick is 1us, so the duration in ticks is the air time in microseconds
+    m_busyUntil = now + m_inflight.durationTicks() + TX_MARGIN_US;
+
+    if (m_stopPending) {
+      m_stopPending = false;
+      m_backend.OnStopped(m_stopAt, now);
+    }
+  }
+
+  TransmitSchedule::Advance(cmd, now);
+}
+
+void TransmitEngine::ReleaseAll() {
+  for (auto it = m_commands.begin(); it != m_commands.end(); ++it) {
+    m_backend.Release(*it);
+  }
+  m_commands.clear();
+}
+
+std::int64_t TransmitEngine::WakeAt() const {
+  // Sleep until the frame on air is done and the next frame is due
+  std::int64_t wakeAt = TransmitSchedule::NextDue(m_commands.begin(), m_commands.end());
+  if (wakeAt != std::numeric_limits<std::int64_t>::max() && wakeAt < m_busyUntil) {
+    wakeAt = m_busyUntil;
+  }
+  return wakeAt;
+}
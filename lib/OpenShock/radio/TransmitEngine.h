@@ -0,0 +1,85 @@
+#pragma once
+
+#include "ShockerModelType.h"
+#include "radio/rmt/Sequence.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A slot of the transmitter's command pool
+struct command_t {
+  std::int64_t until;
+  OpenShock::Rmt::Sequence sequence;
+  OpenShock::ShockerModelType model;
+  std::uint16_t shockerId;
+  bool overwrite;
+  // Keep-alives only fill gaps, see RFTransmitter::SendKeepAlives
+  bool keepAlive;
+  std::int64_t sampleTimestamp;
+  std::int64_t queuedAt;
+  bool transmitted;
+  // Schedule state, see TransmitSchedule
+  std::int64_t nextDue;
+  std::uint32_t repeatUs;
+};
+
+namespace OpenShock {
+  /// @brief The schedule of the transmit task, free of RTOS and RMT calls so it runs against a simulated peripheral on the host.
+  ///
+  /// After every wakeup the task hands it the stop request, the received commands and the e-stop state, then calls
+  /// Service, which writes at most one frame. Frames are written without waiting for them, the engine knows their
+  /// air time and keeps the peripheral's busy time itself. All times are microseconds unless noted otherwise.
+  class TransmitEngine {
+  public:
+    // Extra time given to the peripheral after the air time of a frame before the next one is written
+    static constexpr std::int64_t TX_MARGIN_US = 100;
+    // How long an expired command keeps sending its zero sequence, in milliseconds
+    static constexpr std::int64_t END_DURATION_MS = 300;
+
+    class Backend {
+    public:
+      /// @brief Starts the frame, it has to stay valid until BusyUntil
+      /// @return false if the peripheral did not take the frame
+      virtual bool Write(Rmt::Sequence& frame) = 0;
+      /// @brief Hands a slot back to the pool
+      virtual void Release(command_t* cmd) = 0;
+      /// @brief Called when the first frame of a command was written
+      virtual void OnTransmitted(const command_t* cmd, std::int64_t now) { }
+      /// @brief Called when the first frame after a stop was written
+      virtual void OnStopped(std::int64_t requestedAt, std::int64_t now) { }
+
+    protected:
+      ~Backend() = default;
+    };
+
+    /// @param capacity The pool size, reserved up front so the engine never allocates afterwards
+    TransmitEngine(Backend& backend, std::size_t capacity);
+
+    /// @brief Drops every command queued up to requestedAt, the active ones send their zero sequence from the next frame on
+    void Stop(std::int64_t requestedAt, std::int64_t now);
+    /// @brief Takes a command received from the queue, replacing the one of its shocker where the rules allow it
+    void Add(command_t* cmd, std::int64_t now);
+    /// @brief Ends every command at the e-stop, called before every frame while the e-stop is active
+    void EStop(std::int64_t estoppedAtMs);
+    /// @brief Removes finished commands and writes the most overdue frame if the peripheral is free
+    void Service(std::int64_t now);
+    /// @brief Hands every active command back, the caller has to wait for BusyUntil before the frame buffer goes away
+    void ReleaseAll();
+
+    /// @return When the task has to wake up for the next frame, INT64_MAX if there is nothing to send
+    std::int64_t WakeAt() const;
+    std::int64_t BusyUntil() const { return m_busyUntil; }
+    std::size_t ActiveCount() const { return m_commands.size(); }
+
+  private:
+    Backend& m_backend;
+    std::vector<command_t*> m_commands;
+    // The frame on air, it has to stay valid until the peripheral is done with it
+    Rmt::Sequence m_inflight;
+    std::int64_t m_busyUntil;
+    // Commands queued up to this time were issued before the latest Stop and are dropped
+    std::int64_t m_stopAt;
+    bool m_stopPending;
+  };
+}  // namespace OpenShock
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+// Earliest deadline first scheduling of repeated RF frames.
+//
+// Every active command repeats its frame every repeatUs. The transmitter always sends the frame whose
+// deadline is the oldest, so with several shockers the frames interleave and every shocker keeps an even
+// cadence instead of each one waiting for all others to finish back to back.
+//
+// Entries are pointers to any type with `std::int64_t nextDue` and `std::uint32_t repeatUs` members, the
+// functions are free of RTOS calls so they can be exercised on the host.
+
+namespace OpenShock::TransmitSchedule {
+  template<typename T>
+  inline void Start(T* entry, std::int64_t now) {
+    entry->nextDue = now;
+  }
+
+  /// @brief Moves the deadline one interval ahead, a late entry is not allowed to burst to catch up
+  template<typename T>
+  inline void Advance(T* entry, std::int64_t now) {
+    entry->nextDue += entry->repeatUs;
+    if (entry->nextDue < now) {
+      entry->nextDue = now;
+    }
+  }
+
+  /// @return The due entry with the oldest deadline, or end if nothing is due yet
+  template<typename It>
+  inline It PickDue(It begin, It end, std::int64_t now) {
+    It best = end;
+    for (It it = begin; it != end; ++it) {
+      if ((*it)->nextDue <= now && (best == end || (*it)->nextDue < (*best)->nextDue)) {
+        best = it;
+      }
+    }
+    return best;
+  }
+
+  /// @return The earliest deadline, or INT64_MAX if there are no entries
+  template<typename It>
+  inline std::int64_t NextDue(It begin, It end) {
+    std::int64_t next = std::numeric_limits<std::int64_t>::max();
+    for (It it = begin; it != end; ++it) {
+      if ((*it)->nextDue < next) {
+        next = (*it)->nextDue;
+      }
+    }
+    return next;
+  }
+}  // namespace OpenShock::TransmitSchedule
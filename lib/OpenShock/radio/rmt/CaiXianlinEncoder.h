@@ -1,12 +1,60 @@
 #pragma once
 
+#include "Checksum.h"
 #include "ShockerCommandType.h"
+#include "radio/rmt/internal/Shared.h"
 
 #include <esp32-hal-rmt.h>
 
+#include <array>
 #include <cstdint>
-#include <vector>
+
+// This is the encoder for the CaiXianlin shocker.
+//
+// It is based on the following documentation:
+// https://wiki.openshock.org/hardware/shockers/caixianlin/#rf-specification
 
 namespace OpenShock::Rmt::CaiXianlinEncoder {
-  std::vector<rmt_data_t> GetSequence(std::uint16_t transmitterId, std::uint8_t channelId, OpenShock::ShockerCommandType type, std::uint8_t intensity);
+  constexpr std::size_t kSequenceLength = 44;
+  typedef std::array<rmt_data_t, kSequenceLength> Pulses;
+
+  constexpr rmt_data_t kRmtPreamble = {1400, 1, 800, 0};
+  constexpr rmt_data_t kRmtOne      = {800, 1, 300, 0};
+  constexpr rmt_data_t kRmtZero     = {300, 1, 800, 0};
+
+  constexpr std::uint8_t GetTypeValue(OpenShock::ShockerCommandType type) {
+    switch (type) {
+    case ShockerCommandType::Shock:
+      return 0x01;
+    case ShockerCommandType::Vibrate:
+      return 0x02;
+    case ShockerCommandType::Sound:
+      return 0x03;
+    default:
+      return 0x00; // Invalid type
+    }
+  }
+
+  /// @brief The 43 transmitted bits: payload, checksum and postamble
+  constexpr std::uint64_t GetPayload(std::uint16_t transmitterId, std::uint8_t channelId, OpenShock::ShockerCommandType type, std::uint8_t intensity) {
+    // Payload layout: [transmitterId:16][channelId:4][type:4][intensity:8]
+    std::uint32_t payload = (static_cast<std::uint32_t>(transmitterId & 0xFFFF) << 16) | (static_cast<std::uint32_t>(channelId & 0xF) << 12) | (static_cast<std::uint32_t>(GetTypeValue(type)) << 8) | static_cast<std::uint32_t>(std::min(intensity, static_cast<std::uint8_t>(99)) & 0xFF);
+
+    // Add the checksum of the payload
+    std::uint64_t data = (static_cast<std::uint64_t>(payload) << 8) | static_cast<std::uint64_t>(Checksum::CRC8(payload));
+
+    // Shift the data left by 3 bits to add the postamble (3 bits of 0)
+    return data << 3;
+  }
+
+  constexpr bool GetSequence(Pulses& pulses, std::uint16_t transmitterId, std::uint8_t channelId, OpenShock::ShockerCommandType type, std::uint8_t intensity) {
+    if (GetTypeValue(type) == 0x00) {
+      return false;
+    }
+
+    pulses[0] = kRmtPreamble;
+    Internal::EncodeBits<43>(pulses, 1, GetPayload(transmitterId, channelId, type, intensity), kRmtOne, kRmtZero);
+
+    return true;
+  }
 }
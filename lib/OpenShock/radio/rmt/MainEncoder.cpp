@@ -5,51 +5,82 @@
 #include "radio/rmt/PetrainerEncoder.h"
 #include "radio/rmt/Petrainer998DREncoder.h"
 
-#include <unordered_map>
+#include <freertos/FreeRTOS.h>
 
 const char* const TAG = "RmtMainEncoder";
 
+// Zero sequences of a few shockers plus their recent commands
+const std::size_t SEQUENCE_CACHE_SIZE = 8;
+
 using namespace OpenShock;
 
-std::vector<rmt_data_t> Rmt::GetSequence(ShockerModelType model, std::uint16_t shockerId, ShockerCommandType type, std::uint8_t intensity) {
+struct CachedSequence {
+  bool valid;
+  ShockerModelType model;
+  std::uint16_t shockerId;
+  ShockerCommandType type;
+  std::uint8_t intensity;
+  Rmt::Sequence sequence;
+};
+
+static CachedSequence s_cache[SEQUENCE_CACHE_SIZE];
+static std::size_t s_cacheNext   = 0;
+static portMUX_TYPE s_cacheMutex = portMUX_INITIALIZER_UNLOCKED;
+
+template<typename Pulses, typename Encode>
+static bool encodeInto(Rmt::Sequence& out, Encode encode) {
+  Pulses pulses {};
+  if (!encode(pulses)) {
+    return false;
+  }
+  out.assign(pulses);
+  return true;
+}
+
+static bool encodeSequence(Rmt::Sequence& out, ShockerModelType model, std::uint16_t shockerId, ShockerCommandType type, std::uint8_t intensity) {
   switch (model) {
     case ShockerModelType::Petrainer:
-      return Rmt::PetrainerEncoder::GetSequence(shockerId, type, intensity);
+      return encodeInto<Rmt::PetrainerEncoder::Pulses>(out, [&](Rmt::PetrainerEncoder::Pulses& pulses) { return Rmt::PetrainerEncoder::GetSequence(pulses, shockerId, type, intensity); });
     case ShockerModelType::Petrainer998DR:
-      return Rmt::Petrainer998DREncoder::GetSequence(shockerId, type, intensity);
+      return encodeInto<Rmt::Petrainer998DREncoder::Pulses>(out, [&](Rmt::Petrainer998DREncoder::Pulses& pulses) { return Rmt::Petrainer998DREncoder::GetSequence(pulses, shockerId, type, intensity); });
     case ShockerModelType::CaiXianlin:
-      return Rmt::CaiXianlinEncoder::GetSequence(shockerId, 0, type, intensity);
+      return encodeInto<Rmt::CaiXianlinEncoder::Pulses>(out, [&](Rmt::CaiXianlinEncoder::Pulses& pulses) { return Rmt::CaiXianlinEncoder::GetSequence(pulses, shockerId, 0, type, intensity); });
     default:
       ESP_LOGE(TAG, "Unknown shocker model: %u", model);
-      return {};
+      return false;
   }
 }
-/*
-std::shared_ptr<std::vector<rmt_data_t>> Rmt::GetZeroSequence(ShockerModelType model, std::uint16_t shockerId) {
-  static std::unordered_map<std::uint16_t, std::shared_ptr<std::vector<rmt_data_t>>> _sequences;
 
-  auto it = _sequences.find(shockerId);
-  if (it != _sequences.end()) return it->second; // FIXME: This is not thread-safe, and does not check if model is the same, causing a protocol mismatch
+bool Rmt::GetSequence(Sequence& out, ShockerModelType model, std::uint16_t shockerId, ShockerCommandType type, std::uint8_t intensity) {
+  // The key covers every encoder input, so two models sharing a shocker id never collide
+  portENTER_CRITICAL(&s_cacheMutex);
+  for (std::size_t i = 0; i < SEQUENCE_CACHE_SIZE; ++i) {
+    const CachedSequence& entry = s_cache[i];
+    if (entry.valid && entry.model == model && entry.shockerId == shockerId && entry.type == type && entry.intensity == intensity) {
+      out = entry.sequence;
+      portEXIT_CRITICAL(&s_cacheMutex);
+      return true;
+    }
+  }
+  portEXIT_CRITICAL(&s_cacheMutex);
 
-  std::shared_ptr<std::vector<rmt_data_t>> sequence;
-  switch (model) {
-    case ShockerModelType::Petrainer:
-      sequence = std::make_shared<std::vector<rmt_data_t>>(Rmt::PetrainerEncoder::GetSequence(shockerId, ShockerCommandType::Vibrate, 0));
-      break;
-    case ShockerModelType::Petrainer998DR:
-      sequence = std::make_shared<std::vector<rmt_data_t>>(Rmt::Petrainer998DREncoder::GetSequence(shockerId, ShockerCommandType::Vibrate, 0));
-      break;
-    case ShockerModelType::CaiXianlin:
-      sequence = std::make_shared<std::vector<rmt_data_t>>(Rmt::CaiXianlinEncoder::GetSequence(shockerId, 0, ShockerCommandType::Vibrate, 0));
-      break;
-    default:
-      ESP_LOGE(TAG, "Unknown shocker model: %u", model);
-      sequence = nullptr;
-      break;
+  // Encode outside of the critical section, it only touches out
+  out.clear();
+  if (!encodeSequence(out, model, shockerId, type, intensity)) {
+    out.clear();
+    return false;
   }
 
-  _sequences[shockerId] = sequence;
+  portENTER_CRITICAL(&s_cacheMutex);
+  CachedSequence& slot = s_cache[s_cacheNext];
+  s_cacheNext          = (s_cacheNext + 1) % SEQUENCE_CACHE_SIZE;
+  slot.valid           = true;
+  slot.model           = model;
+  slot.shockerId       = shockerId;
+  slot.type            = type;
+  slot.intensity       = intensity;
+  slot.sequence        = out;
+  portEXIT_CRITICAL(&s_cacheMutex);
 
-  return sequence;
+  return true;
 }
-*/
@@ -2,16 +2,17 @@
 
 #include "ShockerCommandType.h"
 #include "ShockerModelType.h"
+#include "radio/rmt/Sequence.h"
 
 #include <esp32-hal-rmt.h>
 
 #include <cstdint>
-#include <memory>
-#include <vector>
 
 namespace OpenShock::Rmt {
-  std::vector<rmt_data_t> GetSequence(ShockerModelType model, std::uint16_t shockerId, OpenShock::ShockerCommandType type, std::uint8_t intensity);
-  inline std::vector<rmt_data_t> GetZeroSequence(ShockerModelType model, std::uint16_t shockerId) {
-    return GetSequence(model, shockerId, ShockerCommandType::Vibrate, 0);
+  /// @brief Writes the sequence for the command into out, served from a small thread-safe cache
+  /// @return false if the model or command type can not be encoded, out is empty in that case
+  bool GetSequence(Sequence& out, ShockerModelType model, std::uint16_t shockerId, OpenShock::ShockerCommandType type, std::uint8_t intensity);
+  inline bool GetZeroSequence(Sequence& out, ShockerModelType model, std::uint16_t shockerId) {
+    return GetSequence(out, model, shockerId, ShockerCommandType::Vibrate, 0);
   }
 }
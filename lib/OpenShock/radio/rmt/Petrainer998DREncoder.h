@@ -1,12 +1,71 @@
 #pragma once
 
 #include "ShockerCommandType.h"
+#include "radio/rmt/internal/Shared.h"
 
 #include <esp32-hal-rmt.h>
 
+#include <array>
 #include <cstdint>
-#include <vector>
 
 namespace OpenShock::Rmt::Petrainer998DREncoder {
-  std::vector<rmt_data_t> GetSequence(std::uint16_t shockerId, OpenShock::ShockerCommandType type, std::uint8_t intensity);
+  constexpr std::size_t kSequenceLength = 42;
+  typedef std::array<rmt_data_t, kSequenceLength> Pulses;
+
+  constexpr rmt_data_t kRmtPreamble = {1500, 1, 750, 0};
+  constexpr rmt_data_t kRmtOne      = {750, 1, 250, 0};
+  constexpr rmt_data_t kRmtZero     = {250, 1, 750, 0};
+
+  constexpr std::uint8_t GetTypeValue(OpenShock::ShockerCommandType type) {
+    switch (type) {
+    case ShockerCommandType::Shock:
+      return 0b0001;
+    case ShockerCommandType::Vibrate:
+      return 0b0010;
+    case ShockerCommandType::Sound:
+      return 0b0100;
+    // case ShockerCommandType::Light:
+    //   return 0b1000;
+    default:
+      return 0b0000; // Invalid type
+    }
+  }
+
+  /// @brief The 38 data bits following the preamble and leading one
+  constexpr std::uint64_t GetPayload(std::uint16_t shockerId, OpenShock::ShockerCommandType type, std::uint8_t intensity) {
+    std::uint8_t typeVal = GetTypeValue(type);
+
+    // typeInvert has the value of typeVal but bits are reversed and inverted
+    std::uint8_t typeInvert = 0;
+    for (std::uint8_t bit = 0; bit < 4; ++bit) {
+      if (((typeVal >> bit) & 1) == 0) {
+        typeInvert |= 1 << (3 - bit);
+      }
+    }
+
+    // TODO: Channel argument?
+    // Can be [000] or [111], 3 bits wide
+    std::uint8_t channel       = 0b000;
+    std::uint8_t channelInvert = 0b111;
+
+    // Intensity must be between 0 and 100
+    intensity = std::min(intensity, static_cast<std::uint8_t>(100));
+
+    // Payload layout: [channel:3][typeVal:4][shockerID:17][intensity:7][typeInvert:4][channelInvert:3]
+    return (static_cast<std::uint64_t>(channel & 0b111) << 35 | static_cast<std::uint64_t>(typeVal & 0b1111) << 31 | static_cast<std::uint64_t>(shockerId & 0x1FFFF) << 14 | static_cast<std::uint64_t>(intensity & 0x7F) << 7 | static_cast<std::uint64_t>(typeInvert & 0b1111) << 3 | static_cast<std::uint64_t>(channelInvert & 0b111));
+  }
+
+  constexpr bool GetSequence(Pulses& pulses, std::uint16_t shockerId, OpenShock::ShockerCommandType type, std::uint8_t intensity) {
+    if (GetTypeValue(type) == 0b0000) {
+      return false;
+    }
+
+    pulses[0] = kRmtPreamble;
+    pulses[1] = kRmtOne;
+    Internal::EncodeBits<38>(pulses, 2, GetPayload(shockerId, type, intensity), kRmtOne, kRmtZero);
+    pulses[40] = kRmtZero;
+    pulses[41] = kRmtZero;
+
+    return true;
+  }
 }
@@ -1,49 +1,25 @@
 #include "radio/rmt/PetrainerEncoder.h"
 
-#include "radio/rmt/internal/Shared.h"
-
-const rmt_data_t kRmtPreamble  = {750, 1, 750, 0};
-const rmt_data_t kRmtOne       = {200, 1, 1500, 0};
-const rmt_data_t kRmtZero      = {200, 1, 750, 0};
-const rmt_data_t kRmtPostamble = {200, 1, 7000, 0};
+// The encoder is constexpr and lives in the header, these golden values pin its output at compile time.
 
 using namespace OpenShock;
+using namespace OpenShock::Rmt;
 
-std::vector<rmt_data_t> Rmt::PetrainerEncoder::GetSequence(std::uint16_t shockerId, ShockerCommandType type, std::uint8_t intensity) {
-  // Intensity must be between 0 and 100
-  intensity = std::min(intensity, static_cast<std::uint8_t>(100));
-
-  std::uint8_t nShift = 0;
-  switch (type) {
-  case ShockerCommandType::Shock:
-    nShift = 0;
-    break;
-  case ShockerCommandType::Vibrate:
-    nShift = 1;
-    break;
-  case ShockerCommandType::Sound:
-    nShift = 2;
-    break;
-  default:
-    return {}; // Invalid type
-  }
-
-  // Type is 0x80 | (0x01 << nShift)
-  std::uint8_t typeVal = (0x80 | (0x01 << nShift)) & 0xFF;
-
-  // TypeSum is NOT(0x01 | (0x80 >> nShift))
-  std::uint8_t typeSum = (~(0x01 | (0x80 >> nShift))) & 0xFF;
+static_assert(PetrainerEncoder::GetPayload(0x1234, ShockerCommandType::Shock, 50) == 0x811234327e, "Petrainer shock payload changed");
+static_assert(PetrainerEncoder::GetPayload(0x1234, ShockerCommandType::Vibrate, 50) == 0x82123432be, "Petrainer vibrate payload changed");
+static_assert(PetrainerEncoder::GetPayload(0x1234, ShockerCommandType::Sound, 50) == 0x84123432de, "Petrainer sound payload changed");
+static_assert(PetrainerEncoder::GetPayload(0x1234, ShockerCommandType::Vibrate, 255) == PetrainerEncoder::GetPayload(0x1234, ShockerCommandType::Vibrate, 100), "Petrainer intensity is not clamped");
 
-  // Payload layout: [methodBit:8][shockerId:16][intensity:8][methodChecksum:8]
-  std::uint64_t data = (static_cast<std::uint64_t>(typeVal) << 32) | (static_cast<std::uint64_t>(shockerId) << 16) | (static_cast<std::uint64_t>(intensity) << 8) | static_cast<std::uint64_t>(typeSum);
+// The timings are spelled out rather than taken from the header, so a changed pulse constant fails too.
+// P is the preamble, then type, id, intensity and type checksum, E is the postamble
+static constexpr char kSymbols[]       = "P10E";
+static constexpr rmt_data_t kTimings[] = {{750, 1, 750, 0}, {200, 1, 1500, 0}, {200, 1, 750, 0}, {200, 1, 7000, 0}};
 
-  std::vector<rmt_data_t> pulses;
-  pulses.reserve(42);
-
-  // Generate the sequence
-  pulses.push_back(kRmtPreamble);
-  Internal::EncodeBits<40>(pulses, data, kRmtOne, kRmtZero);
-  pulses.push_back(kRmtPostamble);
-
-  return pulses;
+static constexpr bool MatchesGolden(ShockerCommandType type, std::uint8_t intensity, const char* golden) {
+  PetrainerEncoder::Pulses pulses {};
+  return PetrainerEncoder::GetSequence(pulses, 0x1234, type, intensity) && Internal::MatchesGolden(pulses, golden, kSymbols, kTimings);
 }
+
+static_assert(MatchesGolden(ShockerCommandType::Shock, 50, "P 10000001 0001001000110100 00110010 01111110 E"), "Petrainer shock frame changed");
+static_assert(MatchesGolden(ShockerCommandType::Vibrate, 50, "P 10000010 0001001000110100 00110010 10111110 E"), "Petrainer vibrate frame changed");
+static_assert(MatchesGolden(ShockerCommandType::Sound, 50, "P 10000100 0001001000110100 00110010 11011110 E"), "Petrainer sound frame changed");
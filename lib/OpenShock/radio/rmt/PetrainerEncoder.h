@@ -1,12 +1,62 @@
 #pragma once
 
 #include "ShockerCommandType.h"
+#include "radio/rmt/internal/Shared.h"
 
 #include <esp32-hal-rmt.h>
 
+#include <array>
 #include <cstdint>
-#include <vector>
 
 namespace OpenShock::Rmt::PetrainerEncoder {
-  std::vector<rmt_data_t> GetSequence(std::uint16_t shockerId, OpenShock::ShockerCommandType type, std::uint8_t intensity);
+  constexpr std::size_t kSequenceLength = 42;
+  typedef std::array<rmt_data_t, kSequenceLength> Pulses;
+
+  constexpr rmt_data_t kRmtPreamble  = {750, 1, 750, 0};
+  constexpr rmt_data_t kRmtOne       = {200, 1, 1500, 0};
+  constexpr rmt_data_t kRmtZero      = {200, 1, 750, 0};
+  constexpr rmt_data_t kRmtPostamble = {200, 1, 7000, 0};
+
+  /// @return The bit shift of the command type, or -1 if the type is invalid
+  constexpr int GetTypeShift(OpenShock::ShockerCommandType type) {
+    switch (type) {
+    case ShockerCommandType::Shock:
+      return 0;
+    case ShockerCommandType::Vibrate:
+      return 1;
+    case ShockerCommandType::Sound:
+      return 2;
+    default:
+      return -1; // Invalid type
+    }
+  }
+
+  /// @brief The 40 data bits between preamble and postamble
+  constexpr std::uint64_t GetPayload(std::uint16_t shockerId, OpenShock::ShockerCommandType type, std::uint8_t intensity) {
+    std::uint8_t nShift = GetTypeShift(type) < 0 ? 0 : GetTypeShift(type);
+
+    // Type is 0x80 | (0x01 << nShift)
+    std::uint8_t typeVal = (0x80 | (0x01 << nShift)) & 0xFF;
+
+    // TypeSum is NOT(0x01 | (0x80 >> nShift))
+    std::uint8_t typeSum = (~(0x01 | (0x80 >> nShift))) & 0xFF;
+
+    // Intensity must be between 0 and 100
+    intensity = std::min(intensity, static_cast<std::uint8_t>(100));
+
+    // Payload layout: [methodBit:8][shockerId:16][intensity:8][methodChecksum:8]
+    return (static_cast<std::uint64_t>(typeVal) << 32) | (static_cast<std::uint64_t>(shockerId) << 16) | (static_cast<std::uint64_t>(intensity) << 8) | static_cast<std::uint64_t>(typeSum);
+  }
+
+  constexpr bool GetSequence(Pulses& pulses, std::uint16_t shockerId, OpenShock::ShockerCommandType type, std::uint8_t intensity) {
+    if (GetTypeShift(type) < 0) {
+      return false;
+    }
+
+    pulses[0]  = kRmtPreamble;
+    Internal::EncodeBits<40>(pulses, 1, GetPayload(shockerId, type, intensity), kRmtOne, kRmtZero);
+    pulses[41] = kRmtPostamble;
+
+    return true;
+  }
 }
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <esp32-hal-rmt.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace OpenShock::Rmt {
+  // Longest sequence of any supported model (CaiXianlin: preamble + 43 bits)
+  constexpr std::size_t kMaxSequenceLength = 44;
+
+  /// @brief Fixed capacity pulse sequence, lives inline so building one never touches the heap
+  struct Sequence {
+    rmt_data_t pulses[kMaxSequenceLength];
+    std::uint8_t length = 0;
+
+    inline bool empty() const { return length == 0; }
+    inline void clear() { length = 0; }
+
+    /// @brief Air time of the sequence in RMT ticks
+    inline std::uint32_t durationTicks() const {
+      std::uint32_t ticks = 0;
+      for (std::uint8_t i = 0; i < length; ++i) {
+        ticks += pulses[i].duration0 + pulses[i].duration1;
+      }
+      return ticks;
+    }
+
+    template<std::size_t N>
+    inline void assign(const std::array<rmt_data_t, N>& source) {
+      static_assert(N <= kMaxSequenceLength, "Sequence is too long");
+      for (std::size_t i = 0; i < N; ++i) {
+        pulses[i] = source[i];
+      }
+      length = N;
+    }
+  };
+}  // namespace OpenShock::Rmt
@@ -2,21 +2,54 @@
 
 #include <esp32-hal-rmt.h>
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <limits>
 #include <type_traits>
-#include <vector>
 
 namespace OpenShock::Rmt::Internal {
-  template<std::size_t N, typename T>
-  inline void EncodeBits(std::vector<rmt_data_t>& pulses, T data, const rmt_data_t& rmtOne, const rmt_data_t& rmtZero) {
+  /// @brief Writes the N lowest bits of data, most significant first, starting at offset
+  /// @return The offset after the last written pulse
+  template<std::size_t N, typename T, std::size_t Size>
+  constexpr std::size_t EncodeBits(std::array<rmt_data_t, Size>& pulses, std::size_t offset, T data, const rmt_data_t& rmtOne, const rmt_data_t& rmtZero) {
     static_assert(std::is_unsigned<T>::value, "T must be an unsigned integer");
     static_assert(N > 0, "N must be greater than 0");
     static_assert(N < std::numeric_limits<T>::digits, "N must be less or equal to the number of bits in T");
+    static_assert(N <= Size, "N must fit in the sequence");
 
-    pulses.reserve(pulses.size() + N);
-    for (std::int64_t bit_pos = N - 1; bit_pos >= 0; --bit_pos) {
-      pulses.push_back((data >> bit_pos) & 1 ? rmtOne : rmtZero);
+    for (std::size_t i = 0; i < N; ++i) {
+      pulses[offset + i] = (data >> (N - 1 - i)) & 1 ? rmtOne : rmtZero;
     }
+    return offset + N;
+  }
+
+  /// @brief Compares a whole sequence with a golden frame spelled out with one symbol per pulse, spaces only group the fields
+  /// @param symbols The symbol standing for each entry of timings
+  /// @return true if every pulse matches and the golden has exactly Size symbols
+  template<std::size_t Size, std::size_t N>
+  constexpr bool MatchesGolden(const std::array<rmt_data_t, Size>& pulses, const char* golden, const char* symbols, const rmt_data_t (&timings)[N]) {
+    std::size_t index = 0;
+    for (; *golden != '\0'; ++golden) {
+      if (*golden == ' ') {
+        continue;
+      }
+
+      std::size_t symbol = 0;
+      while (symbol < N && symbols[symbol] != *golden) {
+        ++symbol;
+      }
+      if (symbol == N || index == Size) {
+        return false;
+      }
+
+      const rmt_data_t& expected = timings[symbol];
+      const rmt_data_t& actual   = pulses[index++];
+      if (actual.duration0 != expected.duration0 || actual.level0 != expected.level0 || actual.duration1 != expected.duration1 || actual.level1 != expected.level1) {
+        return false;
+      }
+    }
+    return index == Size;
   }
 }
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace OpenShock {
+  /// @brief Bounded lock free ring of values, safe for any number of producers and consumers.
+  ///
+  /// Every cell carries a sequence number telling whose turn it is, so push and pop only contend on a
+  /// single compare-exchange and never block or disable interrupts. FIFO order holds per producer.
+  /// Free of RTOS calls, it can be exercised on the host.
+  template<typename T, std::size_t N>
+  class MpmcRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "Capacity must be a power of two");
+
+  public:
+    MpmcRing() : m_head(0), m_tail(0) {
+      for (std::size_t i = 0; i < N; ++i) {
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    MpmcRing(const MpmcRing&)            = delete;
+    MpmcRing& operator=(const MpmcRing&) = delete;
+
+    static constexpr std::size_t capacity() { return N; }
+
+    /// @return false if the ring is full, the value is not stored then
+    bool push(const T& value) {
+      Cell* cell;
+      std::size_t pos = m_tail.load(std::memory_order_relaxed);
+      while (true) {
+        cell              = &m_cells[pos & (N - 1)];
+        std::size_t seq   = cell->sequence.load(std::memory_order_acquire);
+        std::intptr_t dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+        if (dif == 0) {
+          if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            break;
+          }
+        } else if (dif < 0) {
+          return false;
+        } else {
+          pos = m_tail.load(std::memory_order_relaxed);
+        }
+      }
+
+      cell->value = value;
+      cell->sequence.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+
+    /// @return false if the ring is empty
+    bool pop(T& value) {
+      Cell* cell;
+      std::size_t pos = m_head.load(std::memory_order_relaxed);
+      while (true) {
+        cell              = &m_cells[pos & (N - 1)];
+        std::size_t seq   = cell->sequence.load(std::memory_order_acquire);
+        std::intptr_t dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+
+        if (dif == 0) {
+          if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            break;
+          }
+        } else if (dif < 0) {
+          return false;
+        } else {
+          pos = m_head.load(std::memory_order_relaxed);
+        }
+      }
+
+      value = cell->value;
+      cell->sequence.store(pos + N, std::memory_order_release);
+      return true;
+    }
+
+  private:
+    struct Cell {
+      std::atomic<std::size_t> sequence;
+      T value;
+    };
+
+    Cell m_cells[N];
+    std::atomic<std::size_t> m_head;
+    std::atomic<std::size_t> m_tail;
+  };
+}  // namespace OpenShock
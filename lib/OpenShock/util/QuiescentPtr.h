@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace OpenShock {
+  /// @brief Pointer that readers use without a lock, while a writer can still swap and free the pointee.
+  ///
+  /// Readers count themselves in under the current epoch before they load the pointer. The writer
+  /// unpublishes the pointer, moves to the next epoch and waits until the readers of the previous epoch are
+  /// gone, after that none can still hold the old pointee. Readers arriving meanwhile count under the new
+  /// epoch, so a steady stream of them never holds the writer up. Readers never block. Writers have to be
+  /// serialized by the caller. Free of RTOS calls, it can be exercised on the host.
+  template<typename T>
+  class QuiescentPtr {
+  public:
+    /// @brief Holds the published pointer for as long as it lives, keep it short since a writer waits for it
+    class Ref {
+    public:
+      explicit Ref(QuiescentPtr& owner) : m_owner(owner) {
+        // Only a reader that saw the epoch unchanged after counting itself in is waited for by the writer
+        while (true) {
+          m_epoch = m_owner.m_epoch.load() & 1;
+          m_owner.m_readers[m_epoch].fetch_add(1);
+          if ((m_owner.m_epoch.load() & 1) == m_epoch) {
+            break;
+          }
+          m_owner.m_readers[m_epoch].fetch_sub(1);
+        }
+        m_ptr = m_owner.m_ptr.load();
+      }
+      ~Ref() { m_owner.m_readers[m_epoch].fetch_sub(1); }
+
+      Ref(const Ref&)            = delete;
+      Ref& operator=(const Ref&) = delete;
+
+      T* get() const { return m_ptr; }
+      T* operator->() const { return m_ptr; }
+      explicit operator bool() const { return m_ptr != nullptr; }
+
+    private:
+      QuiescentPtr& m_owner;
+      std::uint32_t m_epoch;
+      T* m_ptr;
+    };
+
+    QuiescentPtr() : m_ptr(nullptr), m_epoch(0), m_readers {{0}, {0}} { }
+
+    QuiescentPtr(const QuiescentPtr&)            = delete;
+    QuiescentPtr& operator=(const QuiescentPtr&) = delete;
+
+    /// @brief Makes the pointer visible to readers, the previous one must have been retired
+    void Publish(T* ptr) { m_ptr.store(ptr); }
+
+    /// @brief Unpublishes the pointer and waits until no reader holds it anymore
+    /// @param wait Called while readers remain, it should give up the CPU
+    /// @return The old pointer, the caller owns it again
+    T* Retire(void (*wait)()) {
+      T* old = m_ptr.exchange(nullptr);
+
+      std::uint32_t previous = m_epoch.fetch_add(1) & 1;
+      while (m_readers[previous].load() != 0) {
+        wait();
+      }
+
+      return old;
+    }
+
+  private:
+    std::atomic<T*> m_ptr;
+    std::atomic<std::uint32_t> m_epoch;
+    std::atomic<std::uint32_t> m_readers[2];
+  };
+}  // namespace OpenShock
@@ -32,6 +32,11 @@ void AudioAnalysis::computeFFT(int32_t *samples, int sampleSize, int sampleRate)
   _FFT->complexToMagnitude();                                        /* Compute magnitudes */
 }
 
+float AudioAnalysis::getMajorPeak()
+{
+  return _FFT == nullptr ? 0 : _FFT->majorPeak();
+}
+
 float *AudioAnalysis::getReal()
 {
   return _real;
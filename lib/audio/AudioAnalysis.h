@@ -79,6 +79,8 @@ public:
   float getVolumeUnitMax();     // value of the highest value volume unit
   float getVolumeUnitPeakMax(); // value of the highest value volume unit
 
+  float getMajorPeak(); // frequency with the highest magnitude of the last computeFFT()
+
 protected:
   /* Library Settings */
   bool _isAutoLevel = false;
@@ -24,7 +24,7 @@ APSettingsService::APSettingsService(PsychicHttpServer *server,
                                                                          _lastManaged(0),
                                                                          _reconfigureAp(false)
 {
-    addUpdateHandler([&](const String &originId)
+    addUpdateHandler([&](const StateOrigin &origin)
                      { reconfigureAP(); },
                      false);
 }
@@ -18,18 +18,24 @@
 #include <ESPFS.h>
 #include <EventSocket.h>
 
+#include <functional>
+#include <vector>
+
 #define MAX_ESP_ANALYTICS_SIZE 1024
 #define EVENT_ANALYTICS "analytics"
 #define ANALYTICS_INTERVAL 2000
 
+// Adds application specific values to each analytics event
+typedef std::function<void(JsonObject &root)> AnalyticsCallback;
+
 class AnalyticsService
 {
 public:
-    AnalyticsService(EventSocket *socket) : _socket(socket){};
+    AnalyticsService(EventSocket *socket) : _socket(socket), _callbacksMutex(xSemaphoreCreateMutex()){};
 
     void begin()
     {
-        _socket->registerEvent(EVENT_ANALYTICS);
+        _socket->registerEvent(EVENT_ANALYTICS, true);
 
         xTaskCreatePinnedToCore(
             this->_loopImpl,            // Function that should be called
@@ -42,8 +48,19 @@ public:
         );
     };
 
+    // Callbacks run on the analytics task, they can be added before or after begin()
+    void addAnalytics(AnalyticsCallback callback)
+    {
+        xSemaphoreTake(_callbacksMutex, portMAX_DELAY);
+        _callbacks.push_back(callback);
+        xSemaphoreGive(_callbacksMutex);
+    };
+
 protected:
     EventSocket *_socket;
+    std::vector<AnalyticsCallback> _callbacks;
+    // held while the task runs the callbacks, a push_back may reallocate the vector
+    SemaphoreHandle_t _callbacksMutex;
 
     static void _loopImpl(void *_this) { static_cast<AnalyticsService *>(_this)->_loop(); }
     void _loop()
@@ -63,6 +80,14 @@ protected:
             doc["fs_total"] = ESPFS.totalBytes();
             doc["core_temp"] = temperatureRead();
 
+            JsonObject root = doc.as<JsonObject>();
+            xSemaphoreTake(_callbacksMutex, portMAX_DELAY);
+            for (AnalyticsCallback &callback : _callbacks)
+            {
+                callback(root);
+            }
+            xSemaphoreGive(_callbacksMutex);
+
             serializeJson(doc, message);
             _socket->emit(EVENT_ANALYTICS, message);
 
@@ -19,7 +19,7 @@ BatteryService::BatteryService(EventSocket *socket) : _socket(socket)
 
 void BatteryService::begin()
 {
-    _socket->registerEvent(EVENT_BATTERY);
+    _socket->registerEvent(EVENT_BATTERY, true);
 }
 
 void BatteryService::batteryEvent()
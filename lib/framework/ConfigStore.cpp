@@ -0,0 +1,248 @@
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <ConfigStore.h>
+#include <FactoryResetService.h>
+
+FS *ConfigStore::_fs = nullptr;
+SemaphoreHandle_t ConfigStore::_mutex = nullptr;
+std::vector<ConfigStore::Slice> ConfigStore::_slices;
+std::vector<ConfigStore::LoadStat> ConfigStore::_loadStats;
+uint32_t ConfigStore::_storeLoadUs = 0;
+bool ConfigStore::_sealed = false;
+
+void ConfigStore::begin(FS *fs)
+{
+    if (_fs != nullptr)
+    {
+        return;
+    }
+
+    _mutex = xSemaphoreCreateMutex();
+    if (_mutex == nullptr)
+    {
+        ESP_LOGE("ConfigStore", "Failed to create mutex, settings stay in their own files");
+        return;
+    }
+
+    if (!fs->exists(FS_CONFIG_DIRECTORY))
+    {
+        fs->mkdir(FS_CONFIG_DIRECTORY);
+    }
+
+    // power was lost before the rename, the old store is still valid
+    String tempPath = String(CONFIG_STORE_FILE) + ".tmp";
+    if (fs->exists(tempPath))
+    {
+        fs->remove(tempPath);
+    }
+
+    _fs = fs;
+    unsigned long startedAt = micros();
+    if (!load())
+    {
+        _slices.clear();
+    }
+    _storeLoadUs = micros() - startedAt;
+    ESP_LOGI("ConfigStore", "Loaded %u slices in %u us", _slices.size(), _storeLoadUs);
+}
+
+bool ConfigStore::load()
+{
+    File file = _fs->open(CONFIG_STORE_FILE, "r");
+    if (!file)
+    {
+        return true;
+    }
+
+    std::vector<uint8_t> buffer(file.size());
+    bool ok = file.read(buffer.data(), buffer.size()) == buffer.size();
+    file.close();
+
+    const size_t headerSize = 6;
+    if (!ok || buffer.size() < headerSize || memcmp(buffer.data(), CONFIG_STORE_MAGIC, 4) != 0 || buffer[4] != CONFIG_STORE_VERSION)
+    {
+        ESP_LOGW("ConfigStore", "Ignoring unreadable store, settings fall back to their own files or defaults");
+        return false;
+    }
+
+    // entries are a key length byte, the key, a little endian 16 bit data length and the data
+    size_t offset = headerSize;
+    for (uint8_t i = 0; i < buffer[5]; i++)
+    {
+        if (offset + 1 > buffer.size() || offset + 1 + buffer[offset] + 2 > buffer.size())
+        {
+            return false;
+        }
+        uint8_t keyLength = buffer[offset++];
+        Slice slice;
+        slice.key.concat((const char *)&buffer[offset], keyLength);
+        offset += keyLength;
+        size_t dataLength = buffer[offset] | (buffer[offset + 1] << 8);
+        offset += 2;
+        if (offset + dataLength > buffer.size())
+        {
+            return false;
+        }
+        slice.data.assign(buffer.begin() + offset, buffer.begin() + offset + dataLength);
+        offset += dataLength;
+        _slices.push_back(std::move(slice));
+    }
+    return true;
+}
+
+bool ConfigStore::get(const char *key, std::vector<uint8_t> &slice)
+{
+    if (_fs == nullptr)
+    {
+        return false;
+    }
+
+    bool found = false;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (const Slice &entry : _slices)
+    {
+        if (entry.key == key)
+        {
+            slice = entry.data;
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(_mutex);
+    return found;
+}
+
+size_t ConfigStore::put(const char *key, const uint8_t *data, size_t length)
+{
+    if (_fs == nullptr || length > UINT16_MAX || strlen(key) > UINT8_MAX)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    // a write that was already pending when the factory reset ran must not bring the old settings back
+    if (_sealed)
+    {
+        xSemaphoreGive(_mutex);
+        return 0;
+    }
+    Slice *target = nullptr;
+    for (Slice &entry : _slices)
+    {
+        if (entry.key == key)
+        {
+            target = &entry;
+            break;
+        }
+    }
+    if (target == nullptr && _slices.size() < UINT8_MAX)
+    {
+        _slices.push_back(Slice{key, {}});
+        target = &_slices.back();
+    }
+    size_t written = 0;
+    if (target != nullptr)
+    {
+        target->data.assign(data, data + length);
+        written = commit();
+    }
+    xSemaphoreGive(_mutex);
+    return written;
+}
+
+void ConfigStore::reset()
+{
+    if (_fs == nullptr)
+    {
+        return;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _sealed = true;
+    _slices.clear();
+    _fs->remove(CONFIG_STORE_FILE);
+    _fs->remove(String(CONFIG_STORE_FILE) + ".tmp");
+    xSemaphoreGive(_mutex);
+    ESP_LOGI("ConfigStore", "Store cleared");
+}
+
+size_t ConfigStore::commit()
+{
+    std::vector<uint8_t> buffer;
+    buffer.insert(buffer.end(), CONFIG_STORE_MAGIC, CONFIG_STORE_MAGIC + 4);
+    buffer.push_back(CONFIG_STORE_VERSION);
+    buffer.push_back(_slices.size());
+    for (const Slice &slice : _slices)
+    {
+        buffer.push_back(slice.key.length());
+        buffer.insert(buffer.end(), slice.key.c_str(), slice.key.c_str() + slice.key.length());
+        buffer.push_back(slice.data.size() & 0xFF);
+        buffer.push_back(slice.data.size() >> 8);
+        buffer.insert(buffer.end(), slice.data.begin(), slice.data.end());
+    }
+
+    String tempPath = String(CONFIG_STORE_FILE) + ".tmp";
+    File file = _fs->open(tempPath, "w");
+    if (!file)
+    {
+        return 0;
+    }
+    size_t written = file.write(buffer.data(), buffer.size());
+    file.close();
+
+    if (written != buffer.size() || !_fs->rename(tempPath, CONFIG_STORE_FILE))
+    {
+        _fs->remove(tempPath);
+        return 0;
+    }
+    return written;
+}
+
+void ConfigStore::recordLoad(const char *key, bool fromStore, size_t bytes, uint32_t loadUs)
+{
+    if (_mutex != nullptr)
+    {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+    }
+    _loadStats.push_back(LoadStat{key, fromStore, bytes, loadUs});
+    if (_mutex != nullptr)
+    {
+        xSemaphoreGive(_mutex);
+    }
+}
+
+void ConfigStore::readLoadStats(JsonObject &root)
+{
+    if (_mutex == nullptr)
+    {
+        return;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    uint32_t totalUs = _storeLoadUs;
+    root["store_us"] = _storeLoadUs;
+    JsonArray slices = root.createNestedArray("slices");
+    for (const LoadStat &stat : _loadStats)
+    {
+        JsonObject slice = slices.createNestedObject();
+        slice["file"] = stat.key;
+        slice["source"] = stat.fromStore ? "store" : "file";
+        slice["bytes"] = stat.bytes;
+        slice["load_us"] = stat.loadUs;
+        totalUs += stat.loadUs;
+    }
+    root["total_us"] = totalUs;
+    xSemaphoreGive(_mutex);
+}
@@ -0,0 +1,80 @@
+#ifndef ConfigStore_h
+#define ConfigStore_h
+
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <FS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <vector>
+
+#define CONFIG_STORE_FILE "/config/store.bin"
+#define CONFIG_STORE_MAGIC "SKCS"
+#define CONFIG_STORE_VERSION 1
+
+/**
+ * All settings in one indexed file, read with a single open at boot.
+ *
+ * Every slice holds exactly what FSPersistence would otherwise write to its own file and is keyed by
+ * that file's path. The store is read once in begin(), each service decodes its slice when it loads.
+ * A write replaces one slice and rewrites the store through a temporary file and rename.
+ */
+class ConfigStore
+{
+public:
+    static void begin(FS *fs);
+    static bool ready() { return _fs != nullptr; }
+
+    // false if the store has no slice for the key
+    static bool get(const char *key, std::vector<uint8_t> &slice);
+    // returns the bytes written to flash, 0 on failure
+    static size_t put(const char *key, const uint8_t *data, size_t length);
+
+    // drops all slices and deletes the store, later puts are refused until the restart that follows
+    static void reset();
+
+    // boot time breakdown, fromStore is false for settings still read from their own file
+    static void recordLoad(const char *key, bool fromStore, size_t bytes, uint32_t loadUs);
+    static void readLoadStats(JsonObject &root);
+
+private:
+    struct Slice
+    {
+        String key;
+        std::vector<uint8_t> data;
+    };
+
+    struct LoadStat
+    {
+        const char *key;
+        bool fromStore;
+        uint32_t bytes;
+        uint32_t loadUs;
+    };
+
+    static FS *_fs;
+    static SemaphoreHandle_t _mutex;
+    static std::vector<Slice> _slices;
+    static std::vector<LoadStat> _loadStats;
+    static uint32_t _storeLoadUs;
+    static bool _sealed;
+
+    static bool load();
+    static size_t commit();
+};
+
+#endif // end ConfigStore_h
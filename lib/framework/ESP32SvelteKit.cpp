@@ -61,6 +61,12 @@ void ESP32SvelteKit::begin()
     ESP_LOGV("ESP32SvelteKit", "Loading settings from files system");
     ESPFS.begin(true);
 
+    // every settings service reads its slice from here instead of opening its own file
+    ConfigStore::begin(&ESPFS);
+
+    // asynchronous update handlers run on the dispatcher from here on
+    UpdateDispatcher::begin();
+
     _wifiSettingsService.initWiFi();
 
     // SvelteKit uses a lot of handlers, so we need to increase the max_uri_handlers
@@ -140,6 +140,13 @@ public:
     }
 #endif
 
+#if FT_ENABLED(FT_ANALYTICS)
+    AnalyticsService *getAnalyticsService()
+    {
+        return &_analyticsService;
+    }
+#endif
+
     FeaturesService *getFeatureService()
     {
         return &_featureService;
@@ -19,6 +19,7 @@
 #include <PsychicHttp.h>
 #include <SecurityManager.h>
 #include <StatefulService.h>
+#include <JsonArena.h>
 
 template <class T>
 class EventEndpoint
@@ -32,17 +33,19 @@ public:
                                                              _stateUpdater(stateUpdater),
                                                              _statefulService(statefulService),
                                                              _socket(socket),
-                                                             _bufferSize(bufferSize),
-                                                             _event(event)
+                                                             _event(event),
+                                                             _eventId(EVENT_SOCKET_NO_EVENT),
+                                                             _arenaStats(event, bufferSize)
     {
-        _statefulService->addUpdateHandler([&](const String &originId)
-                                           { syncState(originId); },
+        // clients of the event socket are told apart by socket, every other origin reaches all of them
+        _statefulService->addUpdateHandler([&](const StateOrigin &origin)
+                                           { syncState(origin.transport == OriginTransport::EVENT_SOCKET ? origin.id : -1); },
                                            false);
     }
 
     void begin()
     {
-        _socket->registerEvent(_event);
+        _eventId = _socket->registerEvent(_event, true);
         _socket->onEvent(_event, std::bind(&EventEndpoint::updateState, this, std::placeholders::_1, std::placeholders::_2));
         _socket->onSubscribe(_event, std::bind(&EventEndpoint::syncState, this, std::placeholders::_1, std::placeholders::_2));
     }
@@ -53,22 +56,24 @@ private:
     StatefulService<T> *_statefulService;
     EventSocket *_socket;
     const char *_event;
-    size_t _bufferSize;
+    EventId _eventId;
+    JsonArenaStats _arenaStats;
 
     void updateState(JsonObject &root, int originId)
     {
-        _statefulService->update(root, _stateUpdater, String(originId));
+        _statefulService->update(root, _stateUpdater, StateOrigin(OriginTransport::EVENT_SOCKET, originId));
     }
 
-    void syncState(const String &originId, bool sync = false)
+    void syncState(int originId, bool sync = false)
     {
-        DynamicJsonDocument jsonDocument{_bufferSize};
-        JsonObject root = jsonDocument.to<JsonObject>();
-        String output;
-        _statefulService->read(root, _stateReader);
-        serializeJson(root, output);
-        ESP_LOGV("EventEndpoint", "Syncing state: %s", output.c_str());
-        _socket->emit(_event, output.c_str(), originId.c_str(), sync);
+        // no serialization for an event nobody listens to
+        if (!_socket->hasSubscribers(_eventId))
+        {
+            return;
+        }
+        SerializedState payload = _statefulService->serialize(_stateReader, _arenaStats);
+        ESP_LOGV("EventEndpoint", "Syncing state: %s", payload->c_str());
+        _socket->emit(_eventId, payload->c_str(), originId, sync);
     }
 };
 
@@ -7,7 +7,8 @@ EventSocket::EventSocket(PsychicHttpServer *server,
                          AuthenticationPredicate authenticationPredicate) : _server(server),
                                                                             _securityManager(securityManager),
                                                                             _authenticationPredicate(authenticationPredicate),
-                                                                            _bufferSize(1024)
+                                                                            _arenaStats("EventSocket", 1024),
+                                                                            _broadcaster(EVENT_SERVICE_PATH)
 {
 }
 
@@ -27,30 +28,79 @@ void EventSocket::begin()
     ESP_LOGV("EventSocket", "Registered event socket endpoint: %s", EVENT_SERVICE_PATH);
 }
 
-void EventSocket::registerEvent(String event)
+EventId EventSocket::registerEvent(String event, bool latestOnly)
 {
-    if (!isEventValid(event))
+    EventId id = eventId(event.c_str());
+    if (id != EVENT_SOCKET_NO_EVENT)
     {
-        ESP_LOGV("EventSocket", "Registering event: %s", event.c_str());
-        events.push_back(event);
+        ESP_LOGW("EventSocket", "Event already registered: %s", event.c_str());
+        return id;
     }
-    else
+    if (events.size() >= EVENT_SOCKET_MAX_EVENTS)
     {
-        ESP_LOGW("EventSocket", "Event already registered: %s", event.c_str());
+        ESP_LOGE("EventSocket", "Too many events, cannot register: %s", event.c_str());
+        return EVENT_SOCKET_NO_EVENT;
+    }
+
+    ESP_LOGV("EventSocket", "Registering event: %s", event.c_str());
+    events.push_back(event);
+    event_hashes.push_back(hashEvent(event.c_str()));
+    event_callbacks.emplace_back();
+    subscribe_callbacks.emplace_back();
+    id = events.size() - 1;
+    if (latestOnly)
+    {
+        latest_only_events |= (EventMask)1 << id;
     }
+    return id;
+}
+
+EventId EventSocket::eventId(const char *event)
+{
+    uint32_t hash = hashEvent(event);
+    for (size_t i = 0; i < event_hashes.size(); i++)
+    {
+        if (event_hashes[i] == hash && events[i] == event)
+        {
+            return i;
+        }
+    }
+    return EVENT_SOCKET_NO_EVENT;
+}
+
+bool EventSocket::hasSubscribers(EventId event)
+{
+    if (event >= events.size())
+    {
+        return false;
+    }
+    EventMask bit = (EventMask)1 << event;
+    bool subscribed = false;
+    xSemaphoreTake(clientSubscriptionsMutex, portMAX_DELAY);
+    for (auto &subscription : client_subscriptions)
+    {
+        if (subscription.second & bit)
+        {
+            subscribed = true;
+            break;
+        }
+    }
+    xSemaphoreGive(clientSubscriptionsMutex);
+    return subscribed;
 }
 
 void EventSocket::onWSOpen(PsychicWebSocketClient *client)
 {
+    _broadcaster.addClient(client);
     ESP_LOGI("EventSocket", "ws[%s][%u] connect", client->remoteIP().toString().c_str(), client->socket());
 }
 
 void EventSocket::onWSClose(PsychicWebSocketClient *client)
 {
-    for (auto &event_subscriptions : client_subscriptions)
-    {
-        event_subscriptions.second.remove(client->socket());
-    }
+    xSemaphoreTake(clientSubscriptionsMutex, portMAX_DELAY);
+    client_subscriptions.erase(client->socket());
+    xSemaphoreGive(clientSubscriptionsMutex);
+    _broadcaster.removeClient(client->socket());
     ESP_LOGI("EventSocket", "ws[%s][%u] disconnect", client->remoteIP().toString().c_str(), client->socket());
 }
 
@@ -64,97 +114,129 @@ esp_err_t EventSocket::onFrame(PsychicWebSocketRequest *request, httpd_ws_frame
         ESP_LOGV("EventSocket", "ws[%s][%u] request: %s", request->client()->remoteIP().toString().c_str(),
                  request->client()->socket(), (char *)frame->payload);
 
-        DynamicJsonDocument doc = DynamicJsonDocument(_bufferSize);
-        DeserializationError error = deserializeJson(doc, (char *)frame->payload, frame->len);
-
-        if (!error && doc.is<JsonObject>())
-        {
-            String event = doc["event"];
-            if (event == "subscribe")
+        JsonArena::deserialize(_arenaStats, (char *)frame->payload, frame->len, [&](JsonDocument &doc)
+                               {
+            if (!doc.is<JsonObject>())
             {
+                return;
+            }
+            const char *event = doc["event"] | "";
+            int socket = request->client()->socket();
+            if (strcmp(event, "subscribe") == 0 || strcmp(event, "unsubscribe") == 0)
+            {
+                const char *name = doc["data"] | "";
+                EventId id = eventId(name);
                 // only subscribe to events that are registered
-                if (isEventValid(doc["data"].as<String>()))
+                if (id == EVENT_SOCKET_NO_EVENT)
+                {
+                    ESP_LOGW("EventSocket", "Client tried to %s unregistered event: %s", event, name);
+                    return;
+                }
+                EventMask bit = (EventMask)1 << id;
+                bool subscribe = event[0] == 's';
+                xSemaphoreTake(clientSubscriptionsMutex, portMAX_DELAY);
+                if (subscribe)
                 {
-                    client_subscriptions[doc["data"]].push_back(request->client()->socket());
-                    handleSubscribeCallbacks(doc["data"], String(request->client()->socket()));
+                    client_subscriptions[socket] |= bit;
                 }
                 else
                 {
-                    ESP_LOGW("EventSocket", "Client tried to subscribe to unregistered event: %s", doc["data"].as<String>().c_str());
+                    auto subscription = client_subscriptions.find(socket);
+                    if (subscription != client_subscriptions.end() && !(subscription->second &= ~bit))
+                    {
+                        client_subscriptions.erase(subscription);
+                    }
+                }
+                xSemaphoreGive(clientSubscriptionsMutex);
+                if (subscribe)
+                {
+                    handleSubscribeCallbacks(id, socket);
                 }
-            }
-            else if (event == "unsubscribe")
-            {
-                client_subscriptions[doc["data"]].remove(request->client()->socket());
             }
             else
             {
+                EventId id = eventId(event);
+                if (id == EVENT_SOCKET_NO_EVENT)
+                {
+                    ESP_LOGW("EventSocket", "Client sent unregistered event: %s", event);
+                    return;
+                }
                 JsonObject jsonObject = doc["data"].as<JsonObject>();
-                handleEventCallbacks(event, jsonObject, request->client()->socket());
-            }
-            return ESP_OK;
-        }
+                handleEventCallbacks(id, jsonObject, socket);
+            } });
     }
     return ESP_OK;
 }
 
 void EventSocket::emit(String event, String payload)
 {
-    emit(event.c_str(), payload.c_str(), "");
+    emit(event.c_str(), payload.c_str(), -1);
 }
 
 void EventSocket::emit(const char *event, const char *payload)
 {
-    emit(event, payload, "");
+    emit(event, payload, -1);
 }
 
 void EventSocket::emit(const char *event, const char *payload, const char *originId, bool onlyToSameOrigin)
 {
+    emit(event, payload, originId[0] ? atoi(originId) : -1, onlyToSameOrigin);
+}
+
+void EventSocket::emit(const char *event, const char *payload, int originId, bool onlyToSameOrigin)
+{
+    EventId id = eventId(event);
     // Only process valid events
-    if (!isEventValid(String(event)))
+    if (id == EVENT_SOCKET_NO_EVENT)
     {
         ESP_LOGW("EventSocket", "Method tried to emit unregistered event: %s", event);
         return;
     }
+    emit(id, payload, originId, onlyToSameOrigin);
+}
 
-    int originSubscriptionId = originId[0] ? atoi(originId) : -1;
-    xSemaphoreTake(clientSubscriptionsMutex, portMAX_DELAY);
-    auto &subscriptions = client_subscriptions[event];
-    if (subscriptions.empty())
+void EventSocket::emit(EventId event, const char *payload, int originId, bool onlyToSameOrigin)
+{
+    if (event >= events.size())
     {
-        xSemaphoreGive(clientSubscriptionsMutex);
+        ESP_LOGW("EventSocket", "Method tried to emit unregistered event id: %u", event);
         return;
     }
-    String msg = "[\"" + String(event) + "\"," + String(payload) + "]";
 
-    // if onlyToSameOrigin == true, send the message back to the origin
-    if (onlyToSameOrigin && originSubscriptionId > 0)
+    EventMask bit = (EventMask)1 << event;
+    int topic = latest_only_events & bit ? event : WEB_SOCKET_NO_TOPIC;
+    SerializedState frame;
+    xSemaphoreTake(clientSubscriptionsMutex, portMAX_DELAY);
+
+    // if onlyToSameOrigin == true, the message only goes back to the origin
+    bool toOrigin = onlyToSameOrigin && originId > 0;
+    for (auto subscription = client_subscriptions.begin(); subscription != client_subscriptions.end();)
     {
-        auto *client = _socket.getClient(originSubscriptionId);
-        if (client)
+        int socket = subscription->first;
+        if (!(subscription->second & bit) || (toOrigin ? socket != originId : socket == originId))
         {
-            ESP_LOGV("EventSocket", "Emitting event: %s to %s, Message: %s", event, client->remoteIP().toString().c_str(),
-                     msg.c_str());
-            client->sendMessage(msg.c_str());
+            ++subscription;
+            continue;
         }
-    }
-    else
-    { // else send the message to all other clients
-
-        for (int subscription : client_subscriptions[event])
+        // formatted for the first receiver only
+        if (!frame)
         {
-            if (subscription == originSubscriptionId)
-                continue;
-            auto *client = _socket.getClient(subscription);
-            if (!client)
-            {
-                subscriptions.remove(subscription);
-                continue;
-            }
-            ESP_LOGV("EventSocket", "Emitting event: %s to %s, Message: %s", event, client->remoteIP().toString().c_str(),
-                     msg.c_str());
-            client->sendMessage(msg.c_str());
+            String message;
+            message.reserve(events[event].length() + strlen(payload) + 5);
+            message = "[\"";
+            message += events[event];
+            message += "\",";
+            message += payload;
+            message += ']';
+            frame = std::make_shared<const String>(std::move(message));
         }
+        ESP_LOGV("EventSocket", "Emitting event: %s to ws[%u], Message: %s", events[event].c_str(), socket, frame->c_str());
+        if (!_broadcaster.send(socket, frame, topic))
+        {
+            subscription = client_subscriptions.erase(subscription);
+            continue;
+        }
+        ++subscription;
     }
     xSemaphoreGive(clientSubscriptionsMutex);
 }
@@ -183,7 +265,7 @@ void EventSocket::pushNotification(String message, pushEvent event)
     emit(eventType.c_str(), message.c_str());
 }
 
-void EventSocket::handleEventCallbacks(String event, JsonObject &jsonObject, int originId)
+void EventSocket::handleEventCallbacks(EventId event, JsonObject &jsonObject, int originId)
 {
     for (auto &callback : event_callbacks[event])
     {
@@ -191,7 +273,7 @@ void EventSocket::handleEventCallbacks(String event, JsonObject &jsonObject, int
     }
 }
 
-void EventSocket::handleSubscribeCallbacks(String event, const String &originId)
+void EventSocket::handleSubscribeCallbacks(EventId event, int originId)
 {
     for (auto &callback : subscribe_callbacks[event])
     {
@@ -201,26 +283,34 @@ void EventSocket::handleSubscribeCallbacks(String event, const String &originId)
 
 void EventSocket::onEvent(String event, EventCallback callback)
 {
-    if (!isEventValid(event))
+    EventId id = eventId(event.c_str());
+    if (id == EVENT_SOCKET_NO_EVENT)
     {
         ESP_LOGW("EventSocket", "Method tried to register unregistered event: %s", event.c_str());
         return;
     }
-    event_callbacks[event].push_back(callback);
+    event_callbacks[id].push_back(callback);
 }
 
 void EventSocket::onSubscribe(String event, SubscribeCallback callback)
 {
-    if (!isEventValid(event))
+    EventId id = eventId(event.c_str());
+    if (id == EVENT_SOCKET_NO_EVENT)
     {
         ESP_LOGW("EventSocket", "Method tried to subscribe to unregistered event: %s", event.c_str());
         return;
     }
-    subscribe_callbacks[event].push_back(callback);
+    subscribe_callbacks[id].push_back(callback);
     ESP_LOGI("EventSocket", "onSubscribe for event: %s", event.c_str());
 }
 
-bool EventSocket::isEventValid(String event)
+// FNV-1a
+uint32_t EventSocket::hashEvent(const char *event)
 {
-    return std::find(events.begin(), events.end(), event) != events.end();
+    uint32_t hash = 2166136261UL;
+    while (*event)
+    {
+        hash = (hash ^ (uint8_t)*event++) * 16777619UL;
+    }
+    return hash;
 }
@@ -4,14 +4,27 @@
 #include <PsychicHttp.h>
 #include <SecurityManager.h>
 #include <StatefulService.h>
+#include <JsonArena.h>
+#include <WebSocketBroadcaster.h>
 #include <list>
 #include <map>
 #include <vector>
 
 #define EVENT_SERVICE_PATH "/ws/events"
 
+// subscriptions of a client are a bitset with one bit per registered event
+#ifndef EVENT_SOCKET_MAX_EVENTS
+#define EVENT_SOCKET_MAX_EVENTS 32
+#endif
+
+#define EVENT_SOCKET_NO_EVENT 0xFF
+
+// small integer an event name is interned to when it is registered
+typedef uint8_t EventId;
+typedef uint32_t EventMask;
+
 typedef std::function<void(JsonObject &root, int originId)> EventCallback;
-typedef std::function<void(const String &originId, bool sync)> SubscribeCallback;
+typedef std::function<void(int originId, bool sync)> SubscribeCallback;
 
 enum pushEvent
 {
@@ -28,7 +41,15 @@ public:
 
   void begin();
 
-  void registerEvent(String event);
+  // returns the id of the event, or EVENT_SOCKET_NO_EVENT if no more events can be registered
+  // a latestOnly event replaces its unsent message to a lagging client instead of queueing behind it
+  EventId registerEvent(String event, bool latestOnly = false);
+
+  // EVENT_SOCKET_NO_EVENT if the event is not registered
+  EventId eventId(const char *event);
+
+  // true if any client is subscribed to the event, lets callers skip formatting a payload nobody receives
+  bool hasSubscribers(EventId event);
 
   void onEvent(String event, EventCallback callback);
 
@@ -38,8 +59,14 @@ public:
 
   void emit(const char *event, const char *payload);
 
-  void emit(const char *event, const char *payload, const char *originId, bool onlyToSameOrigin = false);
+  void emit(const char *event, const char *payload, int originId, bool onlyToSameOrigin = false);
   // if onlyToSameOrigin == true, the message will be sent to the originId only, otherwise it will be broadcasted to all clients except the originId
+  // originId is the client socket, -1 for none
+
+  // socket number as a string, kept for existing callers
+  void emit(const char *event, const char *payload, const char *originId, bool onlyToSameOrigin = false);
+
+  void emit(EventId event, const char *payload, int originId = -1, bool onlyToSameOrigin = false);
 
   void pushNotification(String message, pushEvent event);
 
@@ -49,16 +76,22 @@ private:
   SecurityManager *_securityManager;
   AuthenticationPredicate _authenticationPredicate;
 
+  // indexed by EventId, the hashes spare comparing names on lookup
   std::vector<String> events;
-  std::map<String, std::list<int>> client_subscriptions;
-  std::map<String, std::list<EventCallback>> event_callbacks;
-  std::map<String, std::list<SubscribeCallback>> subscribe_callbacks;
-  void handleEventCallbacks(String event, JsonObject &jsonObject, int originId);
-  void handleSubscribeCallbacks(String event, const String &originId);
-
-  bool isEventValid(String event);
-
-  size_t _bufferSize;
+  std::vector<uint32_t> event_hashes;
+  std::vector<std::list<EventCallback>> event_callbacks;
+  std::vector<std::list<SubscribeCallback>> subscribe_callbacks;
+  EventMask latest_only_events = 0;
+  // socket -> subscribed events, clients without subscriptions have no entry
+  std::map<int, EventMask> client_subscriptions;
+  void handleEventCallbacks(EventId event, JsonObject &jsonObject, int originId);
+  void handleSubscribeCallbacks(EventId event, int originId);
+
+  static uint32_t hashEvent(const char *event);
+
+  JsonArenaStats _arenaStats;
+  // formatted once per emit, every subscriber's queue holds a reference to the same frame
+  WebSocketBroadcaster _broadcaster;
   void onWSOpen(PsychicWebSocketClient *client);
   void onWSClose(PsychicWebSocketClient *client);
   esp_err_t onFrame(PsychicWebSocketRequest *request, httpd_ws_frame *frame);
@@ -0,0 +1,66 @@
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <FSPersistence.h>
+
+FSPersistenceBase *FSPersistenceBase::_instances = nullptr;
+portMUX_TYPE FSPersistenceBase::_listMux = portMUX_INITIALIZER_UNLOCKED;
+bool FSPersistenceBase::_discarded = false;
+
+FSPersistenceBase::FSPersistenceBase(const char *filePath) : _filePath(filePath)
+{
+    portENTER_CRITICAL(&_listMux);
+    _next = _instances;
+    _instances = this;
+    portEXIT_CRITICAL(&_listMux);
+}
+
+void FSPersistenceBase::flushAll()
+{
+    portENTER_CRITICAL(&_listMux);
+    FSPersistenceBase *instances = _instances;
+    portEXIT_CRITICAL(&_listMux);
+
+    for (FSPersistenceBase *persistence = instances; persistence != nullptr; persistence = persistence->_next)
+    {
+        persistence->flush();
+    }
+}
+
+void FSPersistenceBase::discardAll()
+{
+    _discarded = true;
+
+    portENTER_CRITICAL(&_listMux);
+    FSPersistenceBase *instances = _instances;
+    portEXIT_CRITICAL(&_listMux);
+
+    for (FSPersistenceBase *persistence = instances; persistence != nullptr; persistence = persistence->_next)
+    {
+        persistence->discard();
+    }
+}
+
+void FSPersistenceBase::readAllStats(JsonObject &root)
+{
+    portENTER_CRITICAL(&_listMux);
+    FSPersistenceBase *instances = _instances;
+    portEXIT_CRITICAL(&_listMux);
+
+    for (FSPersistenceBase *persistence = instances; persistence != nullptr; persistence = persistence->_next)
+    {
+        JsonObject file = root.createNestedObject(persistence->_filePath);
+        persistence->readStats(file);
+    }
+}
@@ -16,10 +16,82 @@
  **/
 
 #include <StatefulService.h>
+#include <ConfigStore.h>
 #include <FS.h>
+#include <esp_timer.h>
+#include <vector>
 
+// a write happens once updates paused for the quiet period, but no later than the max delay after the first one
+#ifndef FS_PERSISTENCE_QUIET_MS
+#define FS_PERSISTENCE_QUIET_MS 1000
+#endif
+
+#ifndef FS_PERSISTENCE_MAX_DELAY_MS
+#define FS_PERSISTENCE_MAX_DELAY_MS 5000
+#endif
+
+// LittleFS block size, used to estimate the erases caused by a write
+#ifndef FS_PERSISTENCE_BLOCK_SIZE
+#define FS_PERSISTENCE_BLOCK_SIZE 4096
+#endif
+
+// binary files start with this magic followed by the format version, JSON files start with '{'
+#define FS_PERSISTENCE_BINARY_MAGIC "SKP"
+#define FS_PERSISTENCE_BINARY_VERSION 1
+
+enum class PersistenceFormat
+{
+    JSON,
+    // MessagePack behind a versioned header, about a third smaller and faster to parse than JSON
+    BINARY
+};
+
+/**
+ * Part of FSPersistence that does not depend on the state type. Every instance is kept in a list, so
+ * pending writes can be flushed before a restart and the wear statistics reported in one place.
+ */
+class FSPersistenceBase : public UpdateDispatchTarget
+{
+public:
+    // writes every pending debounced update right away, call before restarting
+    static void flushAll();
+    // drops pending updates and refuses further writes until the restart, for the factory reset
+    static void discardAll();
+    // one object per file, keyed by its path
+    static void readAllStats(JsonObject &root);
+
+    virtual void flush() = 0;
+    virtual void readStats(JsonObject &root) = 0;
+
+protected:
+    explicit FSPersistenceBase(const char *filePath);
+
+    const char *_filePath;
+    static bool _discarded;
+
+    virtual void discard() = 0;
+
+private:
+    FSPersistenceBase *_next;
+    static FSPersistenceBase *_instances;
+    static portMUX_TYPE _listMux;
+};
+
+/**
+ * Keeps a stateful service in a JSON file.
+ *
+ * Updates are debounced per file and written from the update dispatcher, so a burst of changes costs
+ * one flash write. The file is written to a temporary file first and renamed over the old one, a power
+ * loss therefore leaves either the old or the new settings, never a truncated file.
+ *
+ * Once ConfigStore is running the settings live in its single file instead, keyed by the file path,
+ * and an existing file is moved into the store the first time it is read.
+ *
+ * The format is detected from the file content, so a file in the other format is still read and then
+ * rewritten in the configured one. This migrates existing JSON files to the binary format and back.
+ */
 template <class T>
-class FSPersistence
+class FSPersistence : public FSPersistenceBase
 {
 public:
     FSPersistence(JsonStateReader<T> stateReader,
@@ -27,33 +99,62 @@ public:
                   StatefulService<T> *statefulService,
                   FS *fs,
                   const char *filePath,
-                  size_t bufferSize = DEFAULT_BUFFER_SIZE) : _stateReader(stateReader),
+                  size_t bufferSize = DEFAULT_BUFFER_SIZE,
+                  PersistenceFormat format = PersistenceFormat::JSON) : FSPersistenceBase(filePath),
+                                                             _stateReader(stateReader),
                                                              _stateUpdater(stateUpdater),
                                                              _statefulService(statefulService),
                                                              _fs(fs),
-                                                             _filePath(filePath),
                                                              _bufferSize(bufferSize),
-                                                             _updateHandlerId(0)
+                                                             _format(format),
+                                                             _updateHandlerId(0),
+                                                             _quietMs(FS_PERSISTENCE_QUIET_MS),
+                                                             _maxDelayMs(FS_PERSISTENCE_MAX_DELAY_MS)
     {
         enableUpdateHandler();
     }
 
     void readFromFS()
     {
-        File settingsFile = _fs->open(_filePath, "r");
+        unsigned long startedAt = micros();
 
-        if (settingsFile)
+        // settings not yet in the config store are still read from their own file and migrated below
+        std::vector<uint8_t> data;
+        bool fromStore = ConfigStore::get(_filePath, data);
+        if (!fromStore)
+        {
+            readFile(data);
+        }
+
+        if (!data.empty())
         {
             DynamicJsonDocument jsonDocument = DynamicJsonDocument(_bufferSize);
-            DeserializationError error = deserializeJson(jsonDocument, settingsFile);
+            PersistenceFormat format;
+            DeserializationError error = deserialize(jsonDocument, data, format);
             if (error == DeserializationError::Ok && jsonDocument.is<JsonObject>())
             {
                 JsonObject jsonObject = jsonDocument.as<JsonObject>();
                 _statefulService->updateWithoutPropagation(jsonObject, _stateUpdater);
-                settingsFile.close();
+                ConfigStore::recordLoad(_filePath, fromStore, data.size(), micros() - startedAt);
+                if (!fromStore && ConfigStore::ready())
+                {
+                    ESP_LOGI("FSPersistence", "Migrating %s into the config store", _filePath);
+                    if (writeToFS())
+                    {
+                        _fs->remove(_filePath);
+                    }
+                }
+                else if (format != _format)
+                {
+                    ESP_LOGI("FSPersistence", "Migrating %s to the %s format", _filePath, _format == PersistenceFormat::BINARY ? "binary" : "JSON");
+                    writeToFS();
+                }
                 return;
             }
-            settingsFile.close();
+            if (error == DeserializationError::NoMemory)
+            {
+                ESP_LOGE("FSPersistence", "%s does not fit into %u bytes, falling back to defaults", _filePath, _bufferSize);
+            }
         }
 
         // If we reach here we have not been successful in loading the config and hard-coded defaults are now applied.
@@ -65,29 +166,93 @@ public:
 
     bool writeToFS()
     {
+        // the files are being deleted for a factory reset
+        if (_discarded)
+        {
+            return false;
+        }
+
+        unsigned long startedAt = micros();
+
         // create and populate a new json object
         DynamicJsonDocument jsonDocument = DynamicJsonDocument(_bufferSize);
         JsonObject jsonObject = jsonDocument.to<JsonObject>();
         _statefulService->read(jsonObject, _stateReader);
 
-        // make directories if required
-        mkdirs();
+        // a truncated document would silently drop settings, keep the old file instead
+        if (jsonDocument.overflowed())
+        {
+            ESP_LOGE("FSPersistence", "%s does not fit into %u bytes, not writing it", _filePath, _bufferSize);
+            return false;
+        }
 
-        // serialize it to filesystem
-        File settingsFile = _fs->open(_filePath, "w");
+        // serialize the data, with one spare byte for the terminator the serializers append
+        std::vector<uint8_t> data;
+        if (_format == PersistenceFormat::BINARY)
+        {
+            const uint8_t header[] = {FS_PERSISTENCE_BINARY_MAGIC[0], FS_PERSISTENCE_BINARY_MAGIC[1], FS_PERSISTENCE_BINARY_MAGIC[2], FS_PERSISTENCE_BINARY_VERSION};
+            data.resize(sizeof(header) + measureMsgPack(jsonDocument) + 1);
+            memcpy(data.data(), header, sizeof(header));
+            data.resize(sizeof(header) + serializeMsgPack(jsonDocument, data.data() + sizeof(header), data.size() - sizeof(header)));
+        }
+        else
+        {
+            data.resize(measureJson(jsonDocument) + 1);
+            data.resize(serializeJson(jsonDocument, (char *)data.data(), data.size()));
+        }
 
-        // failed to open file, return false
-        if (!settingsFile)
+        // the store rewrites all slices, written counts what actually went to flash
+        size_t written = ConfigStore::ready() ? ConfigStore::put(_filePath, data.data(), data.size()) : writeFile(data);
+        if (written == 0)
         {
             return false;
         }
 
-        // serialize the data to the file
-        serializeJson(jsonDocument, settingsFile);
-        settingsFile.close();
+        _writes++;
+        _bytesWritten += written;
+        // data blocks plus the metadata block updated by the rename
+        _estimatedErases += (written + FS_PERSISTENCE_BLOCK_SIZE - 1) / FS_PERSISTENCE_BLOCK_SIZE + 1;
+        ESP_LOGV("FSPersistence", "Wrote %u bytes for %s in %lu us, %u writes and %u coalesced updates so far", written, _filePath, micros() - startedAt, _writes, _coalesced);
         return true;
     }
 
+    // 0 as quiet period writes synchronously on every update
+    void setWriteDelay(uint32_t quietMs, uint32_t maxDelayMs)
+    {
+        _quietMs = quietMs;
+        _maxDelayMs = maxDelayMs;
+    }
+
+    // writes a pending debounced update right away, e.g. before a restart
+    void flush() override
+    {
+        if (takePending())
+        {
+            if (_timer)
+            {
+                esp_timer_stop(_timer);
+            }
+            writeToFS();
+        }
+    }
+
+    // runs on the update dispatcher once the debounce timer expired
+    void dispatchUpdate() override
+    {
+        if (takePending())
+        {
+            writeToFS();
+        }
+    }
+
+    void readStats(JsonObject &root) override
+    {
+        root["writes"] = _writes;
+        root["coalesced"] = _coalesced;
+        root["bytes"] = _bytesWritten;
+        root["erases"] = _estimatedErases;
+    }
+
     void disableUpdateHandler()
     {
         if (_updateHandlerId)
@@ -101,8 +266,17 @@ public:
     {
         if (!_updateHandlerId)
         {
-            _updateHandlerId = _statefulService->addUpdateHandler([&](const String &originId)
-                                                                  { writeToFS(); });
+            _updateHandlerId = _statefulService->addUpdateHandler([&](const StateOrigin &origin)
+                                                                  { scheduleWrite(); });
+        }
+    }
+
+protected:
+    void discard() override
+    {
+        if (takePending() && _timer)
+        {
+            esp_timer_stop(_timer);
         }
     }
 
@@ -111,10 +285,156 @@ private:
     JsonStateUpdater<T> _stateUpdater;
     StatefulService<T> *_statefulService;
     FS *_fs;
-    const char *_filePath;
     size_t _bufferSize;
+    PersistenceFormat _format;
     update_handler_id_t _updateHandlerId;
 
+    uint32_t _quietMs;
+    uint32_t _maxDelayMs;
+    esp_timer_handle_t _timer = nullptr;
+    portMUX_TYPE _pendingMux = portMUX_INITIALIZER_UNLOCKED;
+    bool _pending = false;
+    int64_t _pendingSince = 0;
+
+    // wear accounting, erases are estimated from the LittleFS block size
+    uint32_t _writes = 0;
+    uint32_t _coalesced = 0;
+    uint32_t _bytesWritten = 0;
+    uint32_t _estimatedErases = 0;
+
+    void scheduleWrite()
+    {
+        if (_quietMs == 0 || !UpdateDispatcher::running() || !createTimer())
+        {
+            writeToFS();
+            return;
+        }
+
+        int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&_pendingMux);
+        if (_pending)
+        {
+            _coalesced++;
+        }
+        else
+        {
+            _pending = true;
+            _pendingSince = now;
+        }
+        int64_t due = now + _quietMs * 1000LL;
+        int64_t deadline = _pendingSince + _maxDelayMs * 1000LL;
+        portEXIT_CRITICAL(&_pendingMux);
+
+        if (due > deadline)
+        {
+            due = deadline;
+        }
+        esp_timer_stop(_timer);
+        esp_timer_start_once(_timer, due > now ? due - now : 0);
+    }
+
+    // created on first use, the persistence objects are constructed before esp_timer is guaranteed to run
+    bool createTimer()
+    {
+        if (_timer)
+        {
+            return true;
+        }
+        esp_timer_create_args_t args = {};
+        args.callback = onTimer;
+        args.arg = this;
+        args.name = "FSPersistence";
+        return esp_timer_create(&args, &_timer) == ESP_OK;
+    }
+
+    // runs on the esp_timer task, the write itself happens on the dispatcher
+    static void onTimer(void *arg)
+    {
+        FSPersistence *persistence = static_cast<FSPersistence *>(arg);
+        if (!UpdateDispatcher::enqueue(persistence))
+        {
+            esp_timer_start_once(persistence->_timer, 100000);
+        }
+    }
+
+    DeserializationError deserialize(JsonDocument &jsonDocument, const std::vector<uint8_t> &data, PersistenceFormat &format)
+    {
+        if (data[0] != FS_PERSISTENCE_BINARY_MAGIC[0])
+        {
+            format = PersistenceFormat::JSON;
+            return deserializeJson(jsonDocument, (const char *)data.data(), data.size());
+        }
+
+        format = PersistenceFormat::BINARY;
+        if (data.size() < 4 || memcmp(data.data(), FS_PERSISTENCE_BINARY_MAGIC, 3) != 0)
+        {
+            return DeserializationError::InvalidInput;
+        }
+        if (data[3] != FS_PERSISTENCE_BINARY_VERSION)
+        {
+            ESP_LOGW("FSPersistence", "%s has unknown binary version %u", _filePath, data[3]);
+            return DeserializationError::NotSupported;
+        }
+        return deserializeMsgPack(jsonDocument, (const char *)data.data() + 4, data.size() - 4);
+    }
+
+    void readFile(std::vector<uint8_t> &data)
+    {
+        // a temporary file left behind means power was lost before the rename, the old file is still valid
+        String tempPath = String(_filePath) + ".tmp";
+        if (_fs->exists(tempPath))
+        {
+            _fs->remove(tempPath);
+        }
+
+        File settingsFile = _fs->open(_filePath, "r");
+        if (!settingsFile)
+        {
+            return;
+        }
+        data.resize(settingsFile.size());
+        if (settingsFile.read(data.data(), data.size()) != data.size())
+        {
+            data.clear();
+        }
+        settingsFile.close();
+    }
+
+    // used when the config store is not available, same temporary file and rename as the store
+    size_t writeFile(const std::vector<uint8_t> &data)
+    {
+        // make directories if required
+        mkdirs();
+
+        String tempPath = String(_filePath) + ".tmp";
+        File settingsFile = _fs->open(tempPath, "w");
+
+        // failed to open file
+        if (!settingsFile)
+        {
+            return 0;
+        }
+
+        size_t written = settingsFile.write(data.data(), data.size());
+        settingsFile.close();
+
+        if (written != data.size() || !_fs->rename(tempPath, _filePath))
+        {
+            _fs->remove(tempPath);
+            return 0;
+        }
+        return written;
+    }
+
+    bool takePending()
+    {
+        portENTER_CRITICAL(&_pendingMux);
+        bool pending = _pending;
+        _pending = false;
+        portEXIT_CRITICAL(&_pendingMux);
+        return pending;
+    }
+
     // We assume we have a _filePath with format "/directory1/directory2/filename"
     // We create a directory for each missing parent
     void mkdirs()
@@ -13,6 +13,8 @@
  **/
 
 #include <FactoryResetService.h>
+#include <ConfigStore.h>
+#include <FSPersistence.h>
 
 using namespace std::placeholders;
 
@@ -46,6 +48,10 @@ esp_err_t FactoryResetService::handleRequest(PsychicRequest *request)
  */
 void FactoryResetService::factoryReset()
 {
+    // pending writes and the slices the store keeps in memory would bring the settings back
+    FSPersistenceBase::discardAll();
+    ConfigStore::reset();
+
     File root = fs->open(FS_CONFIG_DIRECTORY);
     File file;
     while (file = root.openNextFile())
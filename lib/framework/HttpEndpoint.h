@@ -7,6 +7,7 @@
 
 #include <SecurityManager.h>
 #include <StatefulService.h>
+#include <JsonArena.h>
 
 #define HTTP_ENDPOINT_ORIGIN_ID "http"
 #define HTTPS_ENDPOINT_ORIGIN_ID "https"
@@ -20,7 +21,7 @@ protected:
     JsonStateReader<T> _stateReader;
     JsonStateUpdater<T> _stateUpdater;
     StatefulService<T> *_statefulService;
-    size_t _bufferSize;
+    JsonArenaStats _arenaStats;
     SecurityManager *_securityManager;
     AuthenticationPredicate _authenticationPredicate;
     PsychicHttpServer *_server;
@@ -35,7 +36,7 @@ public:
                  SecurityManager *securityManager,
                  AuthenticationPredicate authenticationPredicate = AuthenticationPredicates::IS_ADMIN,
                  size_t bufferSize = DEFAULT_BUFFER_SIZE)
-        : _stateReader(stateReader), _stateUpdater(stateUpdater), _statefulService(statefulService), _server(server), _servicePath(servicePath), _securityManager(securityManager), _authenticationPredicate(authenticationPredicate), _bufferSize(bufferSize)
+        : _stateReader(stateReader), _stateUpdater(stateUpdater), _statefulService(statefulService), _server(server), _servicePath(servicePath), _securityManager(securityManager), _authenticationPredicate(authenticationPredicate), _arenaStats(servicePath, bufferSize)
     {
     }
 
@@ -61,10 +62,7 @@ public:
                     _securityManager->wrapRequest(
                         [this](PsychicRequest *request)
                         {
-                            PsychicJsonResponse response = PsychicJsonResponse(request, false, _bufferSize);
-                            JsonObject jsonObject = response.getRoot();
-                            _statefulService->read(jsonObject, _stateReader);
-                            return response.send();
+                            return sendState(request);
                         },
                         _authenticationPredicate));
         ESP_LOGV("HttpEndpoint", "Registered GET endpoint: %s", _servicePath);
@@ -90,20 +88,23 @@ public:
                             else if ((outcome == StateUpdateResult::CHANGED))
                             {
                                 // persist the changes to the FS
-                                _statefulService->callUpdateHandlers(HTTP_ENDPOINT_ORIGIN_ID);
+                                _statefulService->callUpdateHandlers(StateOrigin(OriginTransport::HTTP));
                             }
 
-                            PsychicJsonResponse response = PsychicJsonResponse(request, false, _bufferSize);
-                            jsonObject = response.getRoot();
-
-                            _statefulService->read(jsonObject, _stateReader);
-
-                            return response.send();
+                            return sendState(request);
                         },
                         _authenticationPredicate));
 
         ESP_LOGV("HttpEndpoint", "Registered POST endpoint: %s", _servicePath);
     }
+
+protected:
+    // shares the payload the other transports serialized for the current state
+    esp_err_t sendState(PsychicRequest *request)
+    {
+        SerializedState payload = _statefulService->serialize(_stateReader, _arenaStats);
+        return request->reply(200, "application/json", payload->c_str());
+    }
 };
 
 #endif
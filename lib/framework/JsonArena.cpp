@@ -0,0 +1,232 @@
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <JsonArena.h>
+
+JsonArena::Slot JsonArena::_slots[JSON_ARENA_POOL_SIZE] = {};
+portMUX_TYPE JsonArena::_mux = portMUX_INITIALIZER_UNLOCKED;
+size_t JsonArena::_pooledBytes = 0;
+uint32_t JsonArena::_temporaries = 0;
+uint32_t JsonArena::_trims = 0;
+JsonArenaStats *JsonArena::_services = nullptr;
+
+JsonArenaStats::JsonArenaStats(const char *name, size_t capacity) : name(name), capacity(capacity)
+{
+    // services live as long as the firmware, the list is never pruned
+    portENTER_CRITICAL(&JsonArena::_mux);
+    _next = JsonArena::_services;
+    JsonArena::_services = this;
+    portEXIT_CRITICAL(&JsonArena::_mux);
+}
+
+JsonArena::JsonArena(JsonArenaStats &stats) : _stats(stats), _slot(nullptr), _document(nullptr)
+{
+    portENTER_CRITICAL(&_mux);
+    size_t capacity = _stats.capacity;
+    // the smallest free document that fits, then an unused slot, and only then the largest free one is regrown
+    Slot *fitting = nullptr;
+    Slot *unused = nullptr;
+    Slot *largest = nullptr;
+    for (Slot &slot : _slots)
+    {
+        if (slot.busy)
+        {
+            continue;
+        }
+        if (slot.document == nullptr)
+        {
+            unused = unused != nullptr ? unused : &slot;
+        }
+        else if (slot.document->capacity() >= capacity)
+        {
+            if (fitting == nullptr || slot.document->capacity() < fitting->document->capacity())
+            {
+                fitting = &slot;
+            }
+        }
+        else if (largest == nullptr || slot.document->capacity() > largest->document->capacity())
+        {
+            largest = &slot;
+        }
+    }
+    _slot = fitting != nullptr ? fitting : unused != nullptr ? unused : largest;
+    DynamicJsonDocument *replaced = nullptr;
+    if (_slot != nullptr)
+    {
+        _slot->busy = true;
+        if (_slot->document != nullptr && _slot->document->capacity() < capacity)
+        {
+            replaced = _slot->document;
+            _slot->document = nullptr;
+            _pooledBytes -= replaced->capacity();
+        }
+    }
+    else
+    {
+        _temporaries++;
+    }
+    portEXIT_CRITICAL(&_mux);
+
+    if (_slot == nullptr)
+    {
+        _document = new DynamicJsonDocument(capacity);
+        return;
+    }
+
+    // the slot is busy, nobody else touches its document until the lease ends
+    delete replaced;
+    if (_slot->document == nullptr)
+    {
+        DynamicJsonDocument *document = new DynamicJsonDocument(capacity);
+        portENTER_CRITICAL(&_mux);
+        _slot->document = document;
+        _pooledBytes += document->capacity();
+        portEXIT_CRITICAL(&_mux);
+    }
+    _document = _slot->document;
+    _document->clear();
+}
+
+JsonArena::~JsonArena()
+{
+    fits();
+
+    if (_slot == nullptr)
+    {
+        delete _document;
+        return;
+    }
+
+    DynamicJsonDocument *trimmed = nullptr;
+    portENTER_CRITICAL(&_mux);
+    if (_pooledBytes > JSON_ARENA_POOL_BUDGET)
+    {
+        trimmed = _slot->document;
+        _slot->document = nullptr;
+        _pooledBytes -= trimmed->capacity();
+        _trims++;
+    }
+    _slot->busy = false;
+    portEXIT_CRITICAL(&_mux);
+
+    delete trimmed;
+}
+
+bool JsonArena::fits()
+{
+    bool overflowed = _document->overflowed();
+    if (_checked)
+    {
+        return !overflowed;
+    }
+    _checked = true;
+
+    size_t used = _document->memoryUsage();
+    size_t grown = min((size_t)JSON_ARENA_MAX_SIZE, _document->capacity() * 2);
+    portENTER_CRITICAL(&_mux);
+    if (used > _stats.highWater)
+    {
+        _stats.highWater = used;
+    }
+    if (overflowed)
+    {
+        _stats.overflows++;
+        if (grown > _stats.capacity)
+        {
+            _stats.capacity = grown;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+
+    if (overflowed)
+    {
+        ESP_LOGW("JsonArena", "%s overflowed %u bytes, growing to %u", _stats.name, _document->capacity(), grown);
+    }
+    return !overflowed;
+}
+
+size_t JsonArena::capacityOf(JsonArenaStats &stats)
+{
+    portENTER_CRITICAL(&_mux);
+    size_t capacity = stats.capacity;
+    portEXIT_CRITICAL(&_mux);
+    return capacity;
+}
+
+bool JsonArena::serialize(JsonArenaStats &stats, std::function<void(JsonObject &root)> reader, String &output)
+{
+    while (true)
+    {
+        JsonArena arena(stats);
+        JsonObject root = arena.document().to<JsonObject>();
+        reader(root);
+        // out of room to grow, a truncated document is still better than none
+        size_t capacity = capacityOf(stats);
+        if (arena.fits() || capacityOf(stats) == capacity)
+        {
+            output.clear();
+            serializeJson(arena.document(), output);
+            return !arena.document().overflowed();
+        }
+    }
+}
+
+DeserializationError JsonArena::deserialize(JsonArenaStats &stats, const char *input, size_t length, std::function<void(JsonDocument &document)> handler)
+{
+    while (true)
+    {
+        JsonArena arena(stats);
+        DeserializationError error = deserializeJson(arena.document(), input, length);
+        size_t capacity = capacityOf(stats);
+        if (error == DeserializationError::NoMemory && !arena.fits() && capacityOf(stats) != capacity)
+        {
+            continue;
+        }
+        if (!error)
+        {
+            handler(arena.document());
+        }
+        return error;
+    }
+}
+
+void JsonArena::readStats(JsonObject &root)
+{
+    portENTER_CRITICAL(&_mux);
+    size_t pooled = _pooledBytes;
+    uint32_t temporaries = _temporaries;
+    uint32_t trims = _trims;
+    JsonArenaStats *first = _services;
+    portEXIT_CRITICAL(&_mux);
+
+    root["pooled_bytes"] = pooled;
+    root["temporaries"] = temporaries;
+    root["trims"] = trims;
+    JsonArray services = root.createNestedArray("services");
+    // entries are only ever prepended, the list behind the first one does not change
+    for (JsonArenaStats *stats = first; stats != nullptr; stats = stats->_next)
+    {
+        portENTER_CRITICAL(&_mux);
+        size_t capacity = stats->capacity;
+        size_t highWater = stats->highWater;
+        uint32_t overflows = stats->overflows;
+        portEXIT_CRITICAL(&_mux);
+
+        JsonObject service = services.createNestedObject();
+        service["name"] = stats->name;
+        service["capacity"] = capacity;
+        service["high_water"] = highWater;
+        service["overflows"] = overflows;
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef JsonArena_h
+#define JsonArena_h
+
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+#include <freertos/FreeRTOS.h>
+
+// documents kept between leases, enough for the httpd, update dispatcher, MQTT and loop tasks at once
+#ifndef JSON_ARENA_POOL_SIZE
+#define JSON_ARENA_POOL_SIZE 6
+#endif
+
+// a service never grows its documents beyond this
+#ifndef JSON_ARENA_MAX_SIZE
+#define JSON_ARENA_MAX_SIZE 16384
+#endif
+
+// the pooled documents together never keep more than this once their leases ended
+#ifndef JSON_ARENA_POOL_BUDGET
+#define JSON_ARENA_POOL_BUDGET 24576
+#endif
+
+/**
+ * Document size of one service. Starts at the configured buffer size and doubles whenever a document
+ * overflowed, so it settles at what the service actually needs.
+ *
+ * Leases on several tasks update the same stats, the fields are only written under the arena lock.
+ */
+class JsonArenaStats
+{
+public:
+    JsonArenaStats(const char *name, size_t capacity);
+
+    const char *name;
+    size_t capacity;
+    size_t highWater = 0;
+    uint32_t overflows = 0;
+
+private:
+    friend class JsonArena;
+    JsonArenaStats *_next;
+};
+
+/**
+ * Lease of a pooled JSON document.
+ *
+ * A lease takes the smallest free document that holds the capacity of its service, or regrows the
+ * largest free one, so after warm-up the per-message paths do not touch the heap for their documents.
+ * Documents belong to the pool, not to a task, a task that is deleted leaves nothing behind and a
+ * nested lease simply takes another document. With every document leased, a temporary one is used
+ * instead.
+ *
+ * Releasing the lease records the memory usage in the service's stats. An overflow is counted, logged
+ * and raises the capacity the service asks for next time. A released document that takes the pool
+ * past JSON_ARENA_POOL_BUDGET goes back to the heap, so one large service does not pin its peak size.
+ */
+class JsonArena
+{
+public:
+    explicit JsonArena(JsonArenaStats &stats);
+    ~JsonArena();
+
+    JsonArena(const JsonArena &) = delete;
+    JsonArena &operator=(const JsonArena &) = delete;
+
+    JsonDocument &document() { return *_document; }
+
+    // false if the document overflowed, the service asks for a larger arena from now on
+    bool fits();
+
+    // fills a document through reader and serializes it, retrying with a larger arena after an overflow
+    static bool serialize(JsonArenaStats &stats, std::function<void(JsonObject &root)> reader, String &output);
+    // parses input and hands the document to handler, retrying with a larger arena after an overflow
+    static DeserializationError deserialize(JsonArenaStats &stats, const char *input, size_t length, std::function<void(JsonDocument &document)> handler);
+
+    static void readStats(JsonObject &root);
+
+private:
+    struct Slot
+    {
+        bool busy;
+        DynamicJsonDocument *document;
+    };
+
+    static Slot _slots[JSON_ARENA_POOL_SIZE];
+    static portMUX_TYPE _mux;
+    static size_t _pooledBytes;
+    static uint32_t _temporaries;
+    static uint32_t _trims;
+    static JsonArenaStats *_services;
+
+    static size_t capacityOf(JsonArenaStats &stats);
+
+    JsonArenaStats &_stats;
+    Slot *_slot;
+    DynamicJsonDocument *_document;
+    bool _checked = false;
+
+    friend class JsonArenaStats;
+};
+
+#endif // end JsonArena_h
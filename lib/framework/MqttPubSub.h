@@ -17,6 +17,7 @@
 
 #include <StatefulService.h>
 #include <PsychicMqttClient.h>
+#include <JsonArena.h>
 
 #define MQTT_ORIGIN_ID "mqtt"
 
@@ -38,10 +39,10 @@ public:
                                                           _pubTopic(pubTopic),
                                                           _subTopic(subTopic),
                                                           _retain(retain),
-                                                          _bufferSize(bufferSize)
+                                                          _arenaStats("MqttPubSub", bufferSize)
 
     {
-        _statefulService->addUpdateHandler([&](const String &originId)
+        _statefulService->addUpdateHandler([&](const StateOrigin &origin)
                                            { publish(); },
                                            false);
 
@@ -94,17 +95,11 @@ public:
     {
         if (_pubTopic.length() > 0 && _mqttClient->connected())
         {
-            // serialize to json doc
-            DynamicJsonDocument json(_bufferSize);
-            JsonObject jsonObject = json.to<JsonObject>();
-            _statefulService->read(jsonObject, _stateReader);
-
-            // serialize to string
-            String payload;
-            serializeJson(json, payload);
+            // serialized once per state version, shared with the other transports
+            SerializedState payload = _statefulService->serialize(_stateReader, _arenaStats);
 
             // publish the payload
-            _mqttClient->publish(_pubTopic.c_str(), 0, _retain, payload.c_str());
+            _mqttClient->publish(_pubTopic.c_str(), 0, _retain, payload->c_str());
         }
     }
 
@@ -116,7 +111,7 @@ public:
 protected:
     StatefulService<T> *_statefulService;
     PsychicMqttClient *_mqttClient;
-    int _bufferSize;
+    JsonArenaStats _arenaStats;
     JsonStateUpdater<T> _stateUpdater;
     JsonStateReader<T> _stateReader;
     String _subTopic;
@@ -136,13 +131,13 @@ protected:
         }
 
         // deserialize from string
-        DynamicJsonDocument json(_bufferSize);
-        DeserializationError error = deserializeJson(json, payload);
-        if (!error && json.is<JsonObject>())
-        {
-            JsonObject jsonObject = json.as<JsonObject>();
-            _statefulService->update(jsonObject, _stateUpdater, MQTT_ORIGIN_ID);
-        }
+        JsonArena::deserialize(_arenaStats, payload, strlen(payload), [&](JsonDocument &json)
+                               {
+            if (json.is<JsonObject>())
+            {
+                JsonObject jsonObject = json.as<JsonObject>();
+                _statefulService->update(jsonObject, _stateUpdater, StateOrigin(OriginTransport::MQTT));
+            } });
     }
 
     void onConnect()
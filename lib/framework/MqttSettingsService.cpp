@@ -52,7 +52,7 @@ MqttSettingsService::MqttSettingsService(PsychicHttpServer *server,
                                                                              _mqttClient(),
                                                                              _lastError("None")
 {
-    addUpdateHandler([&](const String &originId)
+    addUpdateHandler([&](const StateOrigin &origin)
                      { onConfigUpdated(); },
                      false);
 
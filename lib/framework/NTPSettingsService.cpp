@@ -21,7 +21,7 @@ NTPSettingsService::NTPSettingsService(PsychicHttpServer *server,
                                                                            _httpEndpoint(NTPSettings::read, NTPSettings::update, this, server, NTP_SETTINGS_SERVICE_PATH, securityManager),
                                                                            _fsPersistence(NTPSettings::read, NTPSettings::update, this, fs, NTP_SETTINGS_FILE)
 {
-    addUpdateHandler([&](const String &originId)
+    addUpdateHandler([&](const StateOrigin &origin)
                      { configureNTP(); },
                      false);
 }
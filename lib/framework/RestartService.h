@@ -19,6 +19,7 @@
 
 #include <PsychicHttp.h>
 #include <SecurityManager.h>
+#include <FSPersistence.h>
 
 #define RESTART_SERVICE_PATH "/rest/restart"
 
@@ -31,6 +32,8 @@ public:
 
     static void restartNow()
     {
+        // settings changed within the write debounce would otherwise be lost
+        FSPersistenceBase::flushAll();
         WiFi.disconnect(true);
         delay(500);
         ESP.restart();
@@ -21,9 +21,11 @@ SecuritySettingsService::SecuritySettingsService(PsychicHttpServer *server, FS *
                                                                                       _fsPersistence(SecuritySettings::read, SecuritySettings::update, this, fs, SECURITY_SETTINGS_FILE),
                                                                                       _jwtHandler(FACTORY_JWT_SECRET)
 {
-    addUpdateHandler([&](const String &originId)
+    // synchronous, the next request must already be checked against the new secret
+    addUpdateHandler([&](const StateOrigin &origin)
                      { configureJWTHandler(); },
-                     false);
+                     false,
+                     true);
 }
 
 void SecuritySettingsService::begin()
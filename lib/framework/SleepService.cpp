@@ -12,6 +12,7 @@
  **/
 
 #include <SleepService.h>
+#include <FSPersistence.h>
 
 // Definition of static member variable
 void (*SleepService::_callbackSleep)() = nullptr;
@@ -63,6 +64,8 @@ void SleepService::sleepNow()
     {
         _callbackSleep();
     }
+    // deep sleep ends in a reset, pending settings would be lost
+    FSPersistenceBase::flushAll();
     delay(100);
 
     MDNS.end();
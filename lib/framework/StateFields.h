@@ -0,0 +1,263 @@
+#ifndef StateFields_h
+#define StateFields_h
+
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <ArduinoJson.h>
+#include <array>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+enum class FieldAccess
+{
+    READ_WRITE,
+    // published to clients, but never taken from an update
+    READ_ONLY
+};
+
+template <class T, typename V>
+struct StateField
+{
+    const char *name;
+    V T::*member;
+    FieldAccess access;
+};
+
+template <class T, typename V>
+constexpr StateField<T, V> stateField(const char *name, V T::*member, FieldAccess access = FieldAccess::READ_WRITE)
+{
+    return {name, member, access};
+}
+
+namespace StateFieldsDetail
+{
+    // FNV-1a, usable at compile time to build the table and at run time to look keys up. The low bits of the
+    // product only depend on the low bits of the seed and the key, the high half is folded in so every seed
+    // gives another table.
+    constexpr uint32_t hash(const char *key, uint32_t seed)
+    {
+        uint32_t value = 2166136261UL ^ seed;
+        while (*key)
+        {
+            value = (value ^ static_cast<uint8_t>(*key++)) * 16777619UL;
+        }
+        return value ^ (value >> 16);
+    }
+
+    constexpr size_t tableSize(size_t count)
+    {
+        size_t size = 1;
+        while (size < count * 4)
+        {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    template <size_t N>
+    struct PerfectHash
+    {
+        uint32_t seed = 0;
+        // field index + 1, 0 marks an empty slot
+        std::array<uint8_t, tableSize(N)> slots{};
+
+        // the only candidate for the key, -1 if there is none; the caller still compares the name
+        constexpr int find(const char *key) const
+        {
+            return slots[hash(key, seed) & (slots.size() - 1)] - 1;
+        }
+    };
+
+    // tries seeds until every name lands in its own slot, at four times the field count this takes at most a few hundred rounds
+    template <size_t N>
+    constexpr PerfectHash<N> buildHash(const std::array<const char *, N> &names)
+    {
+        for (uint32_t seed = 0;; seed++)
+        {
+            PerfectHash<N> table{};
+            table.seed = seed;
+            bool collision = false;
+            for (size_t i = 0; i < N && !collision; i++)
+            {
+                uint8_t &slot = table.slots[hash(names[i], seed) & (table.slots.size() - 1)];
+                collision = slot != 0;
+                slot = i + 1;
+            }
+            if (!collision)
+            {
+                return table;
+            }
+        }
+    }
+}
+
+/**
+ * JSON codec and diffing generated from one list of field descriptors.
+ *
+ * A state class declares its scalar fields once in a static constexpr fields() function, returning a
+ * tuple of stateField(name, member, access). read() writes them in declaration order, update() makes a
+ * single pass over the input object and dispatches every key through a perfect hash built at compile
+ * time, instead of searching the object once per field. Enums travel as their integer value.
+ *
+ * Only scalar fields are described, nested arrays stay hand-written next to the generated part.
+ */
+template <class T>
+class StateFields
+{
+    typedef decltype(T::fields()) Fields;
+    static constexpr size_t COUNT = std::tuple_size<Fields>::value;
+    static_assert(COUNT > 0 && COUNT <= 32, "diff() reports changes as a 32 bit mask");
+
+    static constexpr Fields FIELDS = T::fields();
+
+    template <size_t... I>
+    static constexpr std::array<const char *, COUNT> names(std::index_sequence<I...>)
+    {
+        return {std::get<I>(FIELDS).name...};
+    }
+
+    static constexpr StateFieldsDetail::PerfectHash<COUNT> HASH = StateFieldsDetail::buildHash<COUNT>(names(std::make_index_sequence<COUNT>()));
+
+public:
+    static void read(T &state, JsonObject &root)
+    {
+        forEach([&](const auto &field)
+                { root[field.name] = toJson(state.*field.member); });
+    }
+
+    // true if any field changed, keys that are unknown, read only or of the wrong type are ignored
+    static bool update(JsonObject &root, T &state)
+    {
+        bool changed = false;
+        for (JsonPair pair : root)
+        {
+            const char *key = pair.key().c_str();
+            int index = HASH.find(key);
+            if (index < 0)
+            {
+                continue;
+            }
+            visit(index, [&](const auto &field)
+                  {
+                if (field.access == FieldAccess::READ_WRITE && strcmp(field.name, key) == 0)
+                {
+                    changed |= assign(state.*field.member, pair.value());
+                } });
+        }
+        return changed;
+    }
+
+    // bit i is set if the i-th declared field differs
+    static uint32_t diff(const T &before, const T &after)
+    {
+        uint32_t changed = 0;
+        size_t index = 0;
+        forEach([&](const auto &field)
+                {
+            if (!(before.*field.member == after.*field.member))
+            {
+                changed |= 1UL << index;
+            }
+            index++; });
+        return changed;
+    }
+
+    // the diff() bit of the named field, 0 for names that are not declared
+    static uint32_t mask(const char *name)
+    {
+        int index = HASH.find(name);
+        uint32_t bit = 0;
+        if (index >= 0)
+        {
+            visit(index, [&](const auto &field)
+                  {
+                if (strcmp(field.name, name) == 0)
+                {
+                    bit = 1UL << index;
+                } });
+        }
+        return bit;
+    }
+
+private:
+    template <typename F, size_t... I>
+    static void forEach(F &&f, std::index_sequence<I...>)
+    {
+        (f(std::get<I>(FIELDS)), ...);
+    }
+
+    template <typename F>
+    static void forEach(F &&f)
+    {
+        forEach(std::forward<F>(f), std::make_index_sequence<COUNT>());
+    }
+
+    template <typename F, size_t... I>
+    static void visit(int index, F &&f, std::index_sequence<I...>)
+    {
+        ((index == static_cast<int>(I) ? f(std::get<I>(FIELDS)) : void()), ...);
+    }
+
+    template <typename F>
+    static void visit(int index, F &&f)
+    {
+        visit(index, std::forward<F>(f), std::make_index_sequence<COUNT>());
+    }
+
+    template <typename V>
+    static auto toJson(const V &value)
+    {
+        if constexpr (std::is_enum<V>::value)
+        {
+            return static_cast<int>(value);
+        }
+        else
+        {
+            return value;
+        }
+    }
+
+    template <typename V>
+    static bool assign(V &target, JsonVariant value)
+    {
+        V next;
+        if constexpr (std::is_enum<V>::value)
+        {
+            if (!value.is<int>())
+            {
+                return false;
+            }
+            next = static_cast<V>(value.as<int>());
+        }
+        else
+        {
+            if (!value.is<V>())
+            {
+                return false;
+            }
+            next = value.as<V>();
+        }
+        if (next == target)
+        {
+            return false;
+        }
+        target = next;
+        return true;
+    }
+};
+
+#endif // end StateFields_h
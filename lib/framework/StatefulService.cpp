@@ -14,5 +14,98 @@
 
 #include <StatefulService.h>
 
+#ifndef ESP32SVELTEKIT_RUNNING_CORE
+#define ESP32SVELTEKIT_RUNNING_CORE -1
+#endif
+
 update_handler_id_t StateUpdateHandlerInfo::currentUpdatedHandlerId = 0;
 hook_handler_id_t StateHookHandlerInfo::currentHookHandlerId = 0;
+
+QueueHandle_t UpdateDispatcher::_queue = nullptr;
+
+String StateOrigin::toString() const
+{
+    switch (transport)
+    {
+    case OriginTransport::HTTP:
+        return "http";
+    case OriginTransport::HTTPS:
+        return "https";
+    case OriginTransport::WEB_SOCKET:
+        return id < 0 ? String("wsserver") : "wsserver:" + String(id);
+    case OriginTransport::EVENT_SOCKET:
+        return String(id);
+    case OriginTransport::MQTT:
+        return "mqtt";
+    default:
+        return name;
+    }
+}
+
+void UpdateDispatcher::begin()
+{
+    if (_queue != nullptr)
+    {
+        return;
+    }
+
+    QueueHandle_t queue = xQueueCreate(UPDATE_DISPATCHER_QUEUE_SIZE, sizeof(UpdateDispatchTarget *));
+    if (queue == nullptr)
+    {
+        ESP_LOGE("UpdateDispatcher", "Failed to create queue, update handlers stay synchronous");
+        return;
+    }
+
+    if (xTaskCreatePinnedToCore(task, "Update Dispatcher", UPDATE_DISPATCHER_STACK_SIZE, queue, (tskIDLE_PRIORITY + 1), NULL, ESP32SVELTEKIT_RUNNING_CORE) != pdPASS)
+    {
+        ESP_LOGE("UpdateDispatcher", "Failed to create task, update handlers stay synchronous");
+        vQueueDelete(queue);
+        return;
+    }
+
+    _queue = queue;
+}
+
+bool UpdateDispatcher::enqueue(UpdateDispatchTarget *target)
+{
+    return _queue != nullptr && xQueueSend(_queue, &target, 0) == pdTRUE;
+}
+
+void UpdateDispatcher::task(void *arg)
+{
+    QueueHandle_t queue = (QueueHandle_t)arg;
+    UpdateDispatchTarget *target;
+    while (true)
+    {
+        if (xQueueReceive(queue, &target, portMAX_DELAY) == pdTRUE)
+        {
+            target->dispatchUpdate();
+        }
+    }
+}
+
+StatefulServiceBase *StatefulServiceBase::_services = nullptr;
+portMUX_TYPE StatefulServiceBase::_listMux = portMUX_INITIALIZER_UNLOCKED;
+
+StatefulServiceBase::StatefulServiceBase()
+{
+    portENTER_CRITICAL(&_listMux);
+    _next = _services;
+    _services = this;
+    portEXIT_CRITICAL(&_listMux);
+}
+
+void StatefulServiceBase::readAllHandlerStats(JsonArray &root)
+{
+    portENTER_CRITICAL(&_listMux);
+    StatefulServiceBase *services = _services;
+    portEXIT_CRITICAL(&_listMux);
+
+    for (StatefulServiceBase *service = services; service != nullptr; service = service->_next)
+    {
+        JsonObject entry = root.createNestedObject();
+        entry["state"] = service->stateName();
+        JsonArray handlers = entry.createNestedArray("handlers");
+        service->readHandlerStats(handlers);
+    }
+}
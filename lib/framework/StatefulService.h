@@ -18,15 +18,40 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 
+#include <atomic>
+#include <cstring>
 #include <list>
 #include <functional>
+#include <type_traits>
+#include <memory>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <freertos/queue.h>
+#include <esp_timer.h>
+#include <JsonArena.h>
 
 #ifndef DEFAULT_BUFFER_SIZE
 #define DEFAULT_BUFFER_SIZE 1024
 #endif
 
+#ifndef UPDATE_DISPATCHER_QUEUE_SIZE
+#define UPDATE_DISPATCHER_QUEUE_SIZE 16
+#endif
+
+#ifndef UPDATE_DISPATCHER_STACK_SIZE
+#define UPDATE_DISPATCHER_STACK_SIZE 8192
+#endif
+
+// handlers running longer than this are logged
+#ifndef UPDATE_HANDLER_SLOW_US
+#define UPDATE_HANDLER_SLOW_US 20000
+#endif
+
+// snapshot reads retry this often against a concurrent writer before falling back to the mutex
+#ifndef STATEFUL_SERVICE_SNAPSHOT_RETRIES
+#define STATEFUL_SERVICE_SNAPSHOT_RETRIES 8
+#endif
+
 enum class StateUpdateResult
 {
     CHANGED = 0, // The update changed the state and propagation should take place if required
@@ -42,8 +67,48 @@ using JsonStateReader = std::function<void(T &settings, JsonObject &root)>;
 
 typedef size_t update_handler_id_t;
 typedef size_t hook_handler_id_t;
-typedef std::function<void(const String &originId)> StateUpdateCallback;
-typedef std::function<void(const String &originId, StateUpdateResult &result)> StateHookCallback;
+enum class OriginTransport : uint8_t
+{
+    // raised by the firmware itself, identified by its name
+    INTERNAL,
+    HTTP,
+    HTTPS,
+    WEB_SOCKET,
+    EVENT_SOCKET,
+    MQTT
+};
+
+/**
+ * Where an update came from, a transport plus the client socket where there is one. Internal origins
+ * carry a static name instead. Passed by value through the update path, it never touches the heap.
+ */
+struct StateOrigin
+{
+    OriginTransport transport;
+    int32_t id;
+    const char *name;
+
+    constexpr StateOrigin(OriginTransport transport, int32_t id = -1) : transport(transport), id(id), name("") {}
+    // string literals of existing call sites, the pointer is kept so it must outlive the update
+    constexpr StateOrigin(const char *name) : transport(OriginTransport::INTERNAL), id(-1), name(name) {}
+
+    bool operator==(const StateOrigin &other) const
+    {
+        return transport == other.transport && id == other.id && (transport != OriginTransport::INTERNAL || strcmp(name, other.name) == 0);
+    }
+    bool operator!=(const StateOrigin &other) const { return !(*this == other); }
+
+    // the String origin ids used before, e.g. "wsserver:3"
+    String toString() const;
+};
+
+typedef std::function<void(const StateOrigin &origin)> StateUpdateCallback;
+typedef std::function<void(const StateOrigin &origin, StateUpdateResult &result)> StateHookCallback;
+// handlers written against the String origin ids, converted on every call
+typedef std::function<void(const String &originId)> LegacyStateUpdateCallback;
+typedef std::function<void(const String &originId, StateUpdateResult &result)> LegacyStateHookCallback;
+// serialized JSON of a state, shared read-only between transports
+typedef std::shared_ptr<const String> SerializedState;
 
 typedef struct StateUpdateHandlerInfo
 {
@@ -51,51 +116,121 @@ typedef struct StateUpdateHandlerInfo
     update_handler_id_t _id;
     StateUpdateCallback _cb;
     bool _allowRemove;
-    StateUpdateHandlerInfo(StateUpdateCallback cb, bool allowRemove) : _id(++currentUpdatedHandlerId), _cb(cb), _allowRemove(allowRemove){};
+    bool _synchronous;
+    // removed while a walk was running, erased once the last walk finished
+    bool _removed;
+    // run time of the handler
+    uint32_t _calls;
+    uint32_t _maxUs;
+    uint64_t _totalUs;
+    StateUpdateHandlerInfo(StateUpdateCallback cb, bool allowRemove, bool synchronous) : _id(++currentUpdatedHandlerId), _cb(cb), _allowRemove(allowRemove), _synchronous(synchronous), _removed(false), _calls(0), _maxUs(0), _totalUs(0){};
 } StateUpdateHandlerInfo_t;
 
+class UpdateDispatchTarget
+{
+public:
+    virtual void dispatchUpdate() = 0;
+};
+
+/**
+ * Runs the asynchronous update handlers of all stateful services on one task, off the thread that
+ * updated the state. A service is queued at most once, so a burst of updates collapses into a single
+ * dispatch. It carries the origin of the burst, or a neutral internal origin if the updates came from
+ * different origins.
+ */
+class UpdateDispatcher
+{
+public:
+    static void begin();
+    static bool running() { return _queue != nullptr; }
+    // false if the dispatcher is not running or its queue is full
+    static bool enqueue(UpdateDispatchTarget *target);
+
+private:
+    static QueueHandle_t _queue;
+    static void task(void *arg);
+};
+
 typedef struct StateHookHandlerInfo
 {
     static hook_handler_id_t currentHookHandlerId;
     hook_handler_id_t _id;
     StateHookCallback _cb;
     bool _allowRemove;
-    StateHookHandlerInfo(StateHookCallback cb, bool allowRemove) : _id(++currentHookHandlerId), _cb(cb), _allowRemove(allowRemove){};
+    bool _removed;
+    StateHookHandlerInfo(StateHookCallback cb, bool allowRemove) : _id(++currentHookHandlerId), _cb(cb), _allowRemove(allowRemove), _removed(false){};
 } StateHookHandlerInfo_t;
 
+/**
+ * Type independent part of StatefulService. Every service is kept in a list, so the run time of all
+ * update handlers can be reported in one place.
+ */
+class StatefulServiceBase : public UpdateDispatchTarget
+{
+public:
+    // one entry per service with the state type and its handlers
+    static void readAllHandlerStats(JsonArray &root);
+
+    virtual void readHandlerStats(JsonArray &root) = 0;
+
+protected:
+    StatefulServiceBase();
+
+    virtual String stateName() const = 0;
+
+private:
+    StatefulServiceBase *_next;
+    static StatefulServiceBase *_services;
+    static portMUX_TYPE _listMux;
+};
+
 template <class T>
-class StatefulService
+class StatefulService : public StatefulServiceBase
 {
 public:
     template <typename... Args>
     StatefulService(Args &&...args) : _state(std::forward<Args>(args)...), _accessMutex(xSemaphoreCreateRecursiveMutex())
     {
+        publishSnapshot();
     }
 
-    update_handler_id_t addUpdateHandler(StateUpdateCallback cb, bool allowRemove = true)
+    // handlers run on the update dispatcher unless synchronous is set, or the dispatcher is not running
+    update_handler_id_t addUpdateHandler(StateUpdateCallback cb, bool allowRemove = true, bool synchronous = false)
     {
         if (!cb)
         {
             return 0;
         }
-        StateUpdateHandlerInfo_t updateHandler(cb, allowRemove);
+        StateUpdateHandlerInfo_t updateHandler(cb, allowRemove, synchronous);
+        beginTransaction();
         _updateHandlers.push_back(updateHandler);
+        endTransaction();
         return updateHandler._id;
     }
 
+    update_handler_id_t addUpdateHandler(LegacyStateUpdateCallback cb, bool allowRemove = true, bool synchronous = false)
+    {
+        if (!cb)
+        {
+            return 0;
+        }
+        return addUpdateHandler([cb](const StateOrigin &origin)
+                                { cb(origin.toString()); },
+                                allowRemove, synchronous);
+    }
+
     void removeUpdateHandler(update_handler_id_t id)
     {
-        for (auto i = _updateHandlers.begin(); i != _updateHandlers.end();)
+        beginTransaction();
+        for (StateUpdateHandlerInfo_t &updateHandler : _updateHandlers)
         {
-            if ((*i)._allowRemove && (*i)._id == id)
-            {
-                i = _updateHandlers.erase(i);
-            }
-            else
+            if (updateHandler._allowRemove && updateHandler._id == id)
             {
-                ++i;
+                updateHandler._removed = true;
             }
         }
+        purgeRemoved();
+        endTransaction();
     }
 
     hook_handler_id_t addHookHandler(StateHookCallback cb, bool allowRemove = true)
@@ -105,34 +240,48 @@ public:
             return 0;
         }
         StateHookHandlerInfo_t hookHandler(cb, allowRemove);
+        beginTransaction();
         _hookHandlers.push_back(hookHandler);
+        endTransaction();
         return hookHandler._id;
     }
 
+    hook_handler_id_t addHookHandler(LegacyStateHookCallback cb, bool allowRemove = true)
+    {
+        if (!cb)
+        {
+            return 0;
+        }
+        return addHookHandler([cb](const StateOrigin &origin, StateUpdateResult &result)
+                              { cb(origin.toString(), result); },
+                              allowRemove);
+    }
+
     void removeHookHandler(hook_handler_id_t id)
     {
-        for (auto i = _hookHandlers.begin(); i != _hookHandlers.end();)
+        beginTransaction();
+        for (StateHookHandlerInfo_t &hookHandler : _hookHandlers)
         {
-            if ((*i)._allowRemove && (*i)._id == id)
+            if (hookHandler._allowRemove && hookHandler._id == id)
             {
-                i = _hookHandlers.erase(i);
-            }
-            else
-            {
-                ++i;
+                hookHandler._removed = true;
             }
         }
+        purgeRemoved();
+        endTransaction();
     }
 
-    StateUpdateResult update(std::function<StateUpdateResult(T &)> stateUpdater, const String &originId)
+    StateUpdateResult update(std::function<StateUpdateResult(T &)> stateUpdater, const StateOrigin &origin)
     {
         beginTransaction();
         StateUpdateResult result = stateUpdater(_state);
+        publishSnapshot();
+        bumpVersion(result);
         endTransaction();
-        callHookHandlers(originId, result);
+        callHookHandlers(origin, result);
         if (result == StateUpdateResult::CHANGED)
         {
-            callUpdateHandlers(originId);
+            callUpdateHandlers(origin);
         }
         return result;
     }
@@ -141,19 +290,23 @@ public:
     {
         beginTransaction();
         StateUpdateResult result = stateUpdater(_state);
+        publishSnapshot();
+        bumpVersion(result);
         endTransaction();
         return result;
     }
 
-    StateUpdateResult update(JsonObject &jsonObject, JsonStateUpdater<T> stateUpdater, const String &originId)
+    StateUpdateResult update(JsonObject &jsonObject, JsonStateUpdater<T> stateUpdater, const StateOrigin &origin)
     {
         beginTransaction();
         StateUpdateResult result = stateUpdater(jsonObject, _state);
+        publishSnapshot();
+        bumpVersion(result);
         endTransaction();
-        callHookHandlers(originId, result);
+        callHookHandlers(origin, result);
         if (result == StateUpdateResult::CHANGED)
         {
-            callUpdateHandlers(originId);
+            callUpdateHandlers(origin);
         }
         return result;
     }
@@ -162,6 +315,8 @@ public:
     {
         beginTransaction();
         StateUpdateResult result = stateUpdater(jsonObject, _state);
+        publishSnapshot();
+        bumpVersion(result);
         endTransaction();
         return result;
     }
@@ -175,25 +330,156 @@ public:
 
     void read(JsonObject &jsonObject, JsonStateReader<T> stateReader)
     {
+        // serializing can be slow, do it on a snapshot so writers are not held up
+        if constexpr (std::is_trivially_copyable<T>::value)
+        {
+            T state;
+            readSnapshot(state);
+            stateReader(state, jsonObject);
+            return;
+        }
+
         beginTransaction();
         stateReader(_state, jsonObject);
         endTransaction();
     }
 
-    void callUpdateHandlers(const String &originId)
+    /**
+     * Serialized state shared by all transports until the next change.
+     *
+     * The payload is cached per state version and handed out by reference count, so every transport
+     * broadcasting the same update reuses one read and one serialization. Readers are recognized by
+     * their function pointer, a reader that is not a plain function is serialized on every call.
+     */
+    SerializedState serialize(JsonStateReader<T> stateReader, JsonArenaStats &arenaStats)
     {
-        for (const StateUpdateHandlerInfo_t &updateHandler : _updateHandlers)
+        typedef void (*ReaderFunction)(T &, JsonObject &);
+        ReaderFunction *function = stateReader.template target<ReaderFunction>();
+        uint32_t version = _version.load(std::memory_order_acquire);
+
+        if (function)
+        {
+            portENTER_CRITICAL(&_payloadMux);
+            SerializedState cached = _payloadVersion == version && _payloadReader == *function ? _payload : nullptr;
+            portEXIT_CRITICAL(&_payloadMux);
+            if (cached)
+            {
+                return cached;
+            }
+        }
+
+        // read after the version was taken, the payload is never older than the version it is cached for
+        std::shared_ptr<String> payload = std::make_shared<String>();
+        JsonArena::serialize(arenaStats, [&](JsonObject &root)
+                             { read(root, stateReader); },
+                             *payload);
+
+        if (function)
+        {
+            SerializedState previous = payload;
+            portENTER_CRITICAL(&_payloadMux);
+            std::swap(_payload, previous);
+            _payloadVersion = version;
+            _payloadReader = *function;
+            portEXIT_CRITICAL(&_payloadMux);
+            // the replaced payload is freed here, outside the critical section
+        }
+        return payload;
+    }
+
+    /**
+     * Copies the state without taking the mutex, only available for trivially copyable states.
+     *
+     * Every update publishes a copy guarded by a sequence counter (a seqlock), readers retry while a
+     * write is in progress. After STATEFUL_SERVICE_SNAPSHOT_RETRIES attempts the reader takes the mutex,
+     * so a reader preempting the writer on the same core cannot spin forever.
+     */
+    void readSnapshot(T &state)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "readSnapshot requires a trivially copyable state");
+
+        for (uint8_t i = 0; i < STATEFUL_SERVICE_SNAPSHOT_RETRIES; i++)
         {
-            updateHandler._cb(originId);
+            uint32_t before = _snapshotSequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                continue;
+            }
+            memcpy(&state, &_snapshot, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_snapshotSequence.load(std::memory_order_relaxed) == before)
+            {
+                return;
+            }
+        }
+
+        beginTransaction();
+        memcpy(&state, &_state, sizeof(T));
+        endTransaction();
+    }
+
+    void callUpdateHandlers(const StateOrigin &origin)
+    {
+        bool dispatcher = UpdateDispatcher::running();
+        bool deferred = false;
+        walkHandlers(_updateHandlers, [&](StateUpdateHandlerInfo_t &updateHandler)
+                     {
+            if (updateHandler._synchronous || !dispatcher)
+            {
+                callUpdateHandler(updateHandler, origin);
+            }
+            else
+            {
+                deferred = true;
+            } });
+        if (deferred)
+        {
+            queueDispatch(origin);
         }
     }
 
-    void callHookHandlers(const String &originId, StateUpdateResult &result)
+    // runs on the dispatcher task
+    void dispatchUpdate() override
+    {
+        beginTransaction();
+        StateOrigin origin = _dispatchOrigin;
+        _dispatchQueued = false;
+        endTransaction();
+
+        walkHandlers(_updateHandlers, [&](StateUpdateHandlerInfo_t &updateHandler)
+                     {
+            if (!updateHandler._synchronous)
+            {
+                callUpdateHandler(updateHandler, origin);
+            } });
+    }
+
+    void readHandlerStats(JsonArray &root) override
     {
-        for (const StateHookHandlerInfo_t &hookHandler : _hookHandlers)
+        beginTransaction();
+        for (const StateUpdateHandlerInfo_t &updateHandler : _updateHandlers)
         {
-            hookHandler._cb(originId, result);
+            if (updateHandler._removed)
+            {
+                continue;
+            }
+            JsonObject handler = root.createNestedObject();
+            handler["id"] = updateHandler._id;
+            handler["sync"] = updateHandler._synchronous;
+            handler["calls"] = updateHandler._calls;
+            handler["avg_us"] = updateHandler._calls ? (uint32_t)(updateHandler._totalUs / updateHandler._calls) : 0;
+            handler["max_us"] = updateHandler._maxUs;
         }
+        endTransaction();
+    }
+
+    void callHookHandlers(const StateOrigin &origin, StateUpdateResult &result)
+    {
+        walkHandlers(_hookHandlers, [&](StateHookHandlerInfo_t &hookHandler)
+                     {
+            endTransaction();
+            hookHandler._cb(origin, result);
+            beginTransaction(); });
     }
 
 protected:
@@ -209,7 +495,146 @@ protected:
         xSemaphoreGiveRecursive(_accessMutex);
     }
 
+    // called with the mutex held, so writers never race each other here
+    inline void publishSnapshot()
+    {
+        if constexpr (std::is_trivially_copyable<T>::value)
+        {
+            uint32_t sequence = _snapshotSequence.load(std::memory_order_relaxed);
+            _snapshotSequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            memcpy(&_snapshot, &_state, sizeof(T));
+            _snapshotSequence.store(sequence + 2, std::memory_order_release);
+        }
+    }
+
+    // called with the mutex held, an unchanged state keeps its cached payload
+    inline void bumpVersion(StateUpdateResult result)
+    {
+        if (result != StateUpdateResult::UNCHANGED)
+        {
+            _version.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    String stateName() const override
+    {
+        // names the instantiation, e.g. "... [with T = WiFiSettings; ...]"
+        String name = __PRETTY_FUNCTION__;
+        int start = name.indexOf("T = ");
+        if (start < 0)
+        {
+            return name;
+        }
+        start += 4;
+        int end = start;
+        while (end < (int)name.length() && name[end] != ';' && name[end] != ']')
+        {
+            end++;
+        }
+        return name.substring(start, end);
+    }
+
 private:
+    // handler walks in progress, guarded by the access mutex
+    uint8_t _handlerWalks = 0;
+
+    /**
+     * Visits every handler with the access mutex held between calls, visit releases it around the call
+     * itself. A handler removed meanwhile is only marked, the last walk to finish erases it, so no walk is
+     * ever left on an erased node.
+     */
+    template <typename Handler, typename Visit>
+    void walkHandlers(std::list<Handler> &handlers, Visit visit)
+    {
+        beginTransaction();
+        _handlerWalks++;
+        for (Handler &handler : handlers)
+        {
+            if (!handler._removed)
+            {
+                visit(handler);
+            }
+        }
+        _handlerWalks--;
+        purgeRemoved();
+        endTransaction();
+    }
+
+    // with the access mutex held
+    void purgeRemoved()
+    {
+        if (_handlerWalks > 0)
+        {
+            return;
+        }
+        _updateHandlers.remove_if([](const StateUpdateHandlerInfo_t &handler)
+                                  { return handler._removed; });
+        _hookHandlers.remove_if([](const StateHookHandlerInfo_t &handler)
+                                { return handler._removed; });
+    }
+
+    // pending asynchronous dispatch, guarded by the access mutex
+    bool _dispatchQueued = false;
+    StateOrigin _dispatchOrigin{OriginTransport::INTERNAL};
+
+    void queueDispatch(const StateOrigin &origin)
+    {
+        beginTransaction();
+        bool queued = _dispatchQueued;
+        // a dispatch covering updates from several origins must not be mistaken for an echo of one of them,
+        // e.g. the event socket skips the full state sync for the client an update came from
+        _dispatchOrigin = queued && _dispatchOrigin != origin ? StateOrigin(OriginTransport::INTERNAL) : origin;
+        _dispatchQueued = true;
+        endTransaction();
+
+        // already queued, the pending dispatch picks up this update too
+        if (queued)
+        {
+            return;
+        }
+
+        if (!UpdateDispatcher::enqueue(this))
+        {
+            ESP_LOGW("StatefulService", "Update dispatcher queue full, running handlers inline");
+            dispatchUpdate();
+        }
+    }
+
+    // called during a walk, the mutex is released for the handler and held for its stats
+    void callUpdateHandler(StateUpdateHandlerInfo_t &updateHandler, const StateOrigin &origin)
+    {
+        endTransaction();
+        int64_t start = esp_timer_get_time();
+        updateHandler._cb(origin);
+        uint32_t elapsed = esp_timer_get_time() - start;
+        beginTransaction();
+
+        updateHandler._calls++;
+        updateHandler._totalUs += elapsed;
+        if (elapsed > updateHandler._maxUs)
+        {
+            updateHandler._maxUs = elapsed;
+        }
+        if (elapsed > UPDATE_HANDLER_SLOW_US)
+        {
+            ESP_LOGW("StatefulService", "Update handler %u took %u us", updateHandler._id, elapsed);
+        }
+    }
+
+    // published copy of the state, empty unless the state is trivially copyable
+    struct NoSnapshot
+    {
+    };
+    typename std::conditional<std::is_trivially_copyable<T>::value, T, NoSnapshot>::type _snapshot;
+    std::atomic<uint32_t> _snapshotSequence{0};
+
+    // serialized payload of the latest version, see serialize()
+    std::atomic<uint32_t> _version{0};
+    portMUX_TYPE _payloadMux = portMUX_INITIALIZER_UNLOCKED;
+    SerializedState _payload;
+    uint32_t _payloadVersion = 0;
+    void (*_payloadReader)(T &, JsonObject &) = nullptr;
     SemaphoreHandle_t _accessMutex;
     std::list<StateUpdateHandlerInfo_t> _updateHandlers;
     std::list<StateHookHandlerInfo_t> _hookHandlers;
@@ -136,6 +136,16 @@ esp_err_t SystemStatus::systemStatus(PsychicRequest *request)
     root["core_temp"] = temperatureRead();
     root["cpu_reset_reason"] = verbosePrintResetReason(rtc_get_reset_reason(0));
     root["uptime"] = millis() / 1000;
+    JsonObject configLoad = root.createNestedObject("config_load");
+    ConfigStore::readLoadStats(configLoad);
+    JsonObject persistence = root.createNestedObject("persistence");
+    FSPersistenceBase::readAllStats(persistence);
+    JsonObject jsonArenas = root.createNestedObject("json_arenas");
+    JsonArena::readStats(jsonArenas);
+    JsonObject webSockets = root.createNestedObject("web_sockets");
+    WebSocketBroadcaster::readStats(webSockets);
+    JsonArray updateHandlers = root.createNestedArray("update_handlers");
+    StatefulServiceBase::readAllHandlerStats(updateHandlers);
 
     return response.send();
 }
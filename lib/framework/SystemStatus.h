@@ -21,8 +21,12 @@
 #include <PsychicHttp.h>
 #include <SecurityManager.h>
 #include <ESPFS.h>
+#include <ConfigStore.h>
+#include <FSPersistence.h>
+#include <JsonArena.h>
+#include <WebSocketBroadcaster.h>
 
-#define MAX_ESP_STATUS_SIZE 1024
+#define MAX_ESP_STATUS_SIZE 8192
 #define SYSTEM_STATUS_SERVICE_PATH "/rest/systemStatus"
 
 class SystemStatus
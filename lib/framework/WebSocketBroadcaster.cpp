@@ -0,0 +1,318 @@
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <WebSocketBroadcaster.h>
+
+WebSocketBroadcaster *WebSocketBroadcaster::_broadcasters = nullptr;
+portMUX_TYPE WebSocketBroadcaster::_listMux = portMUX_INITIALIZER_UNLOCKED;
+
+WebSocketBroadcaster::WebSocketBroadcaster(const char *name) : _name(name),
+                                                               _mutex(xSemaphoreCreateMutex())
+{
+    for (Client &client : _clients)
+    {
+        client.owner = this;
+    }
+    portENTER_CRITICAL(&_listMux);
+    _next = _broadcasters;
+    _broadcasters = this;
+    portEXIT_CRITICAL(&_listMux);
+}
+
+WebSocketBroadcaster::~WebSocketBroadcaster()
+{
+    portENTER_CRITICAL(&_listMux);
+    for (WebSocketBroadcaster **link = &_broadcasters; *link != nullptr; link = &(*link)->_next)
+    {
+        if (*link == this)
+        {
+            *link = _next;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_listMux);
+
+    if (_retryTimer)
+    {
+        esp_timer_stop(_retryTimer);
+        esp_timer_delete(_retryTimer);
+    }
+    vSemaphoreDelete(_mutex);
+}
+
+bool WebSocketBroadcaster::addClient(PsychicWebSocketClient *client)
+{
+    bool added = false;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (Client &candidate : _clients)
+    {
+        if (candidate.socket == -1)
+        {
+            candidate.socket = client->socket();
+            candidate.server = client->server();
+            candidate.closing = false;
+            added = true;
+            break;
+        }
+    }
+    xSemaphoreGive(_mutex);
+
+    if (!added)
+    {
+        ESP_LOGW("WebSocketBroadcaster", "%s: no free slot, ws[%u] will not receive messages", _name, client->socket());
+        return false;
+    }
+
+    // the socket keeps the server's send timeout otherwise, seconds the http server task would be blocked
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = WEB_SOCKET_BROADCAST_SEND_TIMEOUT_MS * 1000};
+    if (setsockopt(client->socket(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0)
+    {
+        ESP_LOGW("WebSocketBroadcaster", "%s: failed to set the send timeout of ws[%u]", _name, client->socket());
+    }
+    return true;
+}
+
+void WebSocketBroadcaster::removeClient(int socket)
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (Client &client : _clients)
+    {
+        if (client.socket == socket)
+        {
+            // a drain that is still queued finds the slot empty, so pending is left to it
+            client.socket = -1;
+            clear(client);
+        }
+    }
+    xSemaphoreGive(_mutex);
+}
+
+bool WebSocketBroadcaster::send(int socket, SerializedState frame, int topic)
+{
+    bool found = false;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (Client &client : _clients)
+    {
+        if (client.socket != -1 && client.socket == socket && !client.closing)
+        {
+            enqueue(client, frame, topic);
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(_mutex);
+    return found;
+}
+
+void WebSocketBroadcaster::sendAll(SerializedState frame, int topic, int exceptSocket)
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (Client &client : _clients)
+    {
+        // a client that is being disconnected takes no more frames
+        if (client.socket != -1 && client.socket != exceptSocket && !client.closing)
+        {
+            enqueue(client, frame, topic);
+        }
+    }
+    xSemaphoreGive(_mutex);
+}
+
+void WebSocketBroadcaster::enqueue(Client &client, SerializedState &frame, int topic)
+{
+    if (topic != WEB_SOCKET_NO_TOPIC)
+    {
+        for (uint8_t i = 0; i < client.count; i++)
+        {
+            Entry &entry = client.queue[(client.head + i) % WEB_SOCKET_BROADCAST_QUEUE_SIZE];
+            if (entry.topic == topic)
+            {
+                entry.frame = frame;
+                _coalesced++;
+                return;
+            }
+        }
+    }
+
+    if (client.count == WEB_SOCKET_BROADCAST_QUEUE_SIZE)
+    {
+        client.queue[client.head].frame.reset();
+        client.head = (client.head + 1) % WEB_SOCKET_BROADCAST_QUEUE_SIZE;
+        client.count--;
+        _dropped++;
+    }
+
+    Entry &entry = client.queue[(client.head + client.count) % WEB_SOCKET_BROADCAST_QUEUE_SIZE];
+    entry.frame = frame;
+    entry.topic = topic;
+    client.count++;
+    if (client.count > _maxQueued)
+    {
+        _maxQueued = client.count;
+    }
+    schedule(client);
+}
+
+void WebSocketBroadcaster::clear(Client &client)
+{
+    for (; client.count > 0; client.count--)
+    {
+        client.queue[client.head].frame.reset();
+        client.head = (client.head + 1) % WEB_SOCKET_BROADCAST_QUEUE_SIZE;
+    }
+}
+
+void WebSocketBroadcaster::schedule(Client &client)
+{
+    if (client.pending)
+    {
+        return;
+    }
+    client.pending = true;
+    if (httpd_queue_work(client.server, drain, &client) != ESP_OK)
+    {
+        client.pending = false;
+        _queueFailures++;
+        retryLater();
+    }
+}
+
+void WebSocketBroadcaster::retryLater()
+{
+    if (!_retryTimer)
+    {
+        esp_timer_create_args_t args = {};
+        args.callback = onRetry;
+        args.arg = this;
+        args.name = "WebSocketBroadcaster";
+        if (esp_timer_create(&args, &_retryTimer) != ESP_OK)
+        {
+            _retryTimer = nullptr;
+            return;
+        }
+    }
+    // fails while the timer is armed, that retry covers every client of the broadcaster
+    esp_timer_start_once(_retryTimer, WEB_SOCKET_BROADCAST_RETRY_MS * 1000);
+}
+
+void WebSocketBroadcaster::onRetry(void *arg)
+{
+    WebSocketBroadcaster *broadcaster = static_cast<WebSocketBroadcaster *>(arg);
+
+    xSemaphoreTake(broadcaster->_mutex, portMAX_DELAY);
+    for (Client &client : broadcaster->_clients)
+    {
+        if (client.socket != -1 && !client.closing && client.count > 0)
+        {
+            broadcaster->schedule(client);
+        }
+    }
+    xSemaphoreGive(broadcaster->_mutex);
+}
+
+void WebSocketBroadcaster::drain(void *arg)
+{
+    Client *client = static_cast<Client *>(arg);
+    WebSocketBroadcaster *owner = client->owner;
+
+    xSemaphoreTake(owner->_mutex, portMAX_DELAY);
+    client->pending = false;
+    int socket = client->socket;
+    httpd_handle_t server = client->server;
+    if (socket == -1 || client->count == 0)
+    {
+        xSemaphoreGive(owner->_mutex);
+        return;
+    }
+    SerializedState frame = std::move(client->queue[client->head].frame);
+    client->head = (client->head + 1) % WEB_SOCKET_BROADCAST_QUEUE_SIZE;
+    client->count--;
+    xSemaphoreGive(owner->_mutex);
+
+    // producers keep queueing while the frame goes out
+    httpd_ws_frame_t ws_pkt;
+    memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+    ws_pkt.payload = (uint8_t *)frame->c_str();
+    ws_pkt.len = frame->length();
+    ws_pkt.type = HTTPD_WS_TYPE_TEXT;
+    esp_err_t result = httpd_ws_send_frame_async(server, socket, &ws_pkt);
+
+    bool disconnect = false;
+    xSemaphoreTake(owner->_mutex, portMAX_DELAY);
+    if (client->socket == socket)
+    {
+        if (result != ESP_OK)
+        {
+            owner->_disconnected++;
+            client->closing = true;
+            owner->clear(*client);
+            disconnect = true;
+        }
+        else
+        {
+            owner->_sent++;
+            if (client->count > 0)
+            {
+                // one frame per work item, so the other clients get their turn in between
+                owner->schedule(*client);
+            }
+        }
+    }
+    xSemaphoreGive(owner->_mutex);
+
+    if (disconnect)
+    {
+        ESP_LOGW("WebSocketBroadcaster", "%s: send to ws[%u] failed, disconnecting", owner->_name, socket);
+        httpd_sess_trigger_close(server, socket);
+    }
+}
+
+void WebSocketBroadcaster::readStats(JsonObject &root)
+{
+    portENTER_CRITICAL(&_listMux);
+    WebSocketBroadcaster *broadcasters = _broadcasters;
+    portEXIT_CRITICAL(&_listMux);
+
+    for (WebSocketBroadcaster *broadcaster = broadcasters; broadcaster != nullptr; broadcaster = broadcaster->_next)
+    {
+        JsonObject entry = root.createNestedObject(broadcaster->_name);
+        xSemaphoreTake(broadcaster->_mutex, portMAX_DELAY);
+        uint8_t clients = 0;
+        uint16_t queued = 0;
+        uint8_t stranded = 0;
+        for (Client &client : broadcaster->_clients)
+        {
+            if (client.socket != -1)
+            {
+                clients++;
+                queued += client.count;
+                // frames without a drain on the server task wait for the retry timer
+                if (client.count > 0 && !client.pending)
+                {
+                    stranded++;
+                }
+            }
+        }
+        entry["clients"] = clients;
+        entry["queued"] = queued;
+        entry["max_queued"] = broadcaster->_maxQueued;
+        entry["sent"] = broadcaster->_sent;
+        entry["coalesced"] = broadcaster->_coalesced;
+        entry["dropped"] = broadcaster->_dropped;
+        entry["disconnected"] = broadcaster->_disconnected;
+        entry["queue_failures"] = broadcaster->_queueFailures;
+        entry["stranded"] = stranded;
+        xSemaphoreGive(broadcaster->_mutex);
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef WebSocketBroadcaster_h
+#define WebSocketBroadcaster_h
+
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <PsychicHttp.h>
+#include <StatefulService.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+
+#ifndef WEB_SOCKET_BROADCAST_MAX_CLIENTS
+#define WEB_SOCKET_BROADCAST_MAX_CLIENTS 8
+#endif
+
+// frames a client can lag behind before the oldest ones are dropped
+#ifndef WEB_SOCKET_BROADCAST_QUEUE_SIZE
+#define WEB_SOCKET_BROADCAST_QUEUE_SIZE 8
+#endif
+
+// how long a send may block the http server task before the client counts as stalled
+#ifndef WEB_SOCKET_BROADCAST_SEND_TIMEOUT_MS
+#define WEB_SOCKET_BROADCAST_SEND_TIMEOUT_MS 100
+#endif
+
+// how long frames wait when the http server's work queue is full before their drain is queued again
+#ifndef WEB_SOCKET_BROADCAST_RETRY_MS
+#define WEB_SOCKET_BROADCAST_RETRY_MS 20
+#endif
+
+// frames without a topic are never coalesced
+#define WEB_SOCKET_NO_TOPIC -1
+
+/**
+ * Outbound side of a web socket handler with a bounded queue per client.
+ *
+ * Sending only queues a reference to the frame, so one formatted frame serves every client. The
+ * queues are drained on the http server task one frame per work item, so clients take turns and a
+ * client that lags behind only grows its own queue. A frame with a topic replaces a frame of the same
+ * topic the client has not been sent yet, so telemetry arrives as its latest value instead of a
+ * backlog. When a queue is full the oldest frame is dropped.
+ *
+ * Sends run on the http server task, so a client's socket gets a send timeout of
+ * WEB_SOCKET_BROADCAST_SEND_TIMEOUT_MS instead of the server's. A client whose send fails is
+ * disconnected right away, a timed out send may have left part of a frame on the socket.
+ *
+ * When the http server's work queue is full a drain cannot be queued. A timer retries after
+ * WEB_SOCKET_BROADCAST_RETRY_MS, so the frames do not wait for the next send, which may never come at
+ * the end of a burst. The stats count the failures and the clients waiting for the retry.
+ */
+class WebSocketBroadcaster
+{
+public:
+    explicit WebSocketBroadcaster(const char *name);
+    ~WebSocketBroadcaster();
+
+    // call from the handler's onOpen, false if all client slots are taken
+    bool addClient(PsychicWebSocketClient *client);
+    // call from the handler's onClose, unsent frames are discarded
+    void removeClient(int socket);
+
+    // false if the socket is not a client of this broadcaster
+    bool send(int socket, SerializedState frame, int topic = WEB_SOCKET_NO_TOPIC);
+    // queues the frame for every client except the given socket
+    void sendAll(SerializedState frame, int topic = WEB_SOCKET_NO_TOPIC, int exceptSocket = -1);
+
+    static void readStats(JsonObject &root);
+
+private:
+    struct Entry
+    {
+        SerializedState frame;
+        int topic;
+    };
+
+    struct Client
+    {
+        WebSocketBroadcaster *owner = nullptr;
+        httpd_handle_t server = nullptr;
+        int socket = -1;
+        // a drain is queued on the http server task
+        bool pending = false;
+        // a send failed, the client takes no more frames until it is closed
+        bool closing = false;
+        uint8_t head = 0;
+        uint8_t count = 0;
+        Entry queue[WEB_SOCKET_BROADCAST_QUEUE_SIZE];
+    };
+
+    const char *_name;
+    SemaphoreHandle_t _mutex;
+    Client _clients[WEB_SOCKET_BROADCAST_MAX_CLIENTS];
+
+    uint32_t _sent = 0;
+    uint32_t _coalesced = 0;
+    uint32_t _dropped = 0;
+    uint32_t _disconnected = 0;
+    uint8_t _maxQueued = 0;
+    uint32_t _queueFailures = 0;
+
+    // created on first use, broadcasters are constructed before esp_timer is guaranteed to run
+    esp_timer_handle_t _retryTimer = nullptr;
+
+    WebSocketBroadcaster *_next;
+    static WebSocketBroadcaster *_broadcasters;
+    static portMUX_TYPE _listMux;
+
+    // with the mutex held
+    void enqueue(Client &client, SerializedState &frame, int topic);
+    void schedule(Client &client);
+    void clear(Client &client);
+    void retryLater();
+
+    // runs on the http server task
+    static void drain(void *arg);
+    // runs on the esp_timer task
+    static void onRetry(void *arg);
+};
+
+#endif
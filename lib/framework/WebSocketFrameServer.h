@@ -0,0 +1,207 @@
+#ifndef WebSocketFrameServer_h
+#define WebSocketFrameServer_h
+
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <StatefulService.h>
+#include <PsychicHttp.h>
+#include <SecurityManager.h>
+
+#ifndef WEB_SOCKET_FRAME_MAX_CLIENTS
+#define WEB_SOCKET_FRAME_MAX_CLIENTS 4
+#endif
+
+template <class T, class F>
+using FrameStateReader = std::function<void(T &state, F &frame)>;
+
+/**
+ * Read only counterpart of WebSocketServer which streams the state as a fixed layout binary frame F.
+ *
+ * Update handlers only copy the frame into a per client slot, the send itself is queued as work on the
+ * http server task. A client that has not been served yet keeps a single pending slot, so a lagging
+ * client only ever receives the latest frame.
+ */
+template <class T, class F>
+class WebSocketFrameServer
+{
+public:
+    WebSocketFrameServer(FrameStateReader<T, F> frameReader,
+                         StatefulService<T> *statefulService,
+                         PsychicHttpServer *server,
+                         const char *webSocketPath,
+                         SecurityManager *securityManager,
+                         AuthenticationPredicate authenticationPredicate = AuthenticationPredicates::IS_ADMIN) : _frameReader(frameReader),
+                                                                                                                _statefulService(statefulService),
+                                                                                                                _server(server),
+                                                                                                                _webSocketPath(webSocketPath),
+                                                                                                                _authenticationPredicate(authenticationPredicate),
+                                                                                                                _securityManager(securityManager)
+    {
+        for (Slot &slot : _slots)
+        {
+            slot.owner = this;
+        }
+        _statefulService->addUpdateHandler(
+            [&](const StateOrigin &origin)
+            { transmitFrame(-1); },
+            false);
+    }
+
+    void begin()
+    {
+        _webSocket.setFilter(_securityManager->filterRequest(_authenticationPredicate));
+        _webSocket.onOpen(std::bind(&WebSocketFrameServer::onWSOpen,
+                                    this,
+                                    std::placeholders::_1));
+        _webSocket.onClose(std::bind(&WebSocketFrameServer::onWSClose,
+                                     this,
+                                     std::placeholders::_1));
+        _server->on(_webSocketPath.c_str(), &_webSocket);
+
+        ESP_LOGV("WebSocketFrameServer", "Registered WebSocket handler: %s", _webSocketPath.c_str());
+    }
+
+    void onWSOpen(PsychicWebSocketClient *client)
+    {
+        Slot *slot = nullptr;
+        portENTER_CRITICAL(&_mux);
+        for (Slot &candidate : _slots)
+        {
+            if (candidate.socket == -1)
+            {
+                // pending is left alone, a send still queued for the previous client clears it and serves this one
+                candidate.socket = client->socket();
+                candidate.server = client->server();
+                slot = &candidate;
+                break;
+            }
+        }
+        portEXIT_CRITICAL(&_mux);
+
+        if (!slot)
+        {
+            ESP_LOGW("WebSocketFrameServer", "ws[%s][%u] no free slot, client will not receive frames", client->remoteIP().toString().c_str(), client->socket());
+            return;
+        }
+
+        transmitFrame(client->socket());
+        ESP_LOGI("WebSocketFrameServer", "ws[%s][%u] connect", client->remoteIP().toString().c_str(), client->socket());
+    }
+
+    void onWSClose(PsychicWebSocketClient *client)
+    {
+        portENTER_CRITICAL(&_mux);
+        for (Slot &slot : _slots)
+        {
+            if (slot.socket == client->socket())
+            {
+                slot.socket = -1;
+            }
+        }
+        portEXIT_CRITICAL(&_mux);
+        ESP_LOGI("WebSocketFrameServer", "ws[%s][%u] disconnect", client->remoteIP().toString().c_str(), client->socket());
+    }
+
+private:
+    struct Slot
+    {
+        WebSocketFrameServer *owner = nullptr;
+        httpd_handle_t server = nullptr;
+        int socket = -1;
+        // a send is queued and has not picked up the frame yet
+        bool pending = false;
+        F frame;
+    };
+
+    FrameStateReader<T, F> _frameReader;
+    StatefulService<T> *_statefulService;
+    AuthenticationPredicate _authenticationPredicate;
+    SecurityManager *_securityManager;
+    PsychicHttpServer *_server;
+    PsychicWebSocketHandler _webSocket;
+    String _webSocketPath;
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+    Slot _slots[WEB_SOCKET_FRAME_MAX_CLIENTS];
+
+    /**
+     * Stores the current frame for the given socket, or for all clients if socket is -1, and queues a send
+     * for every slot that does not already have one pending.
+     */
+    void transmitFrame(int socket)
+    {
+        F frame;
+        if constexpr (std::is_trivially_copyable<T>::value)
+        {
+            T state;
+            _statefulService->readSnapshot(state);
+            _frameReader(state, frame);
+        }
+        else
+        {
+            _statefulService->read([&](T &state)
+                                   { _frameReader(state, frame); });
+        }
+
+        for (Slot &slot : _slots)
+        {
+            bool queue = false;
+            portENTER_CRITICAL(&_mux);
+            if (slot.socket != -1 && (socket == -1 || slot.socket == socket))
+            {
+                slot.frame = frame;
+                queue = !slot.pending;
+                slot.pending = true;
+            }
+            httpd_handle_t server = slot.server;
+            portEXIT_CRITICAL(&_mux);
+
+            if (queue && httpd_queue_work(server, sendFrame, &slot) != ESP_OK)
+            {
+                portENTER_CRITICAL(&_mux);
+                slot.pending = false;
+                portEXIT_CRITICAL(&_mux);
+            }
+        }
+    }
+
+    // runs on the http server task
+    static void sendFrame(void *arg)
+    {
+        Slot *slot = static_cast<Slot *>(arg);
+        WebSocketFrameServer *owner = slot->owner;
+
+        F frame;
+        portENTER_CRITICAL(&owner->_mux);
+        int socket = slot->socket;
+        httpd_handle_t server = slot->server;
+        frame = slot->frame;
+        slot->pending = false;
+        portEXIT_CRITICAL(&owner->_mux);
+
+        if (socket == -1)
+        {
+            return;
+        }
+
+        httpd_ws_frame_t ws_pkt;
+        memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+        ws_pkt.payload = (uint8_t *)&frame;
+        ws_pkt.len = sizeof(F);
+        ws_pkt.type = HTTPD_WS_TYPE_BINARY;
+        httpd_ws_send_frame_async(server, socket, &ws_pkt);
+    }
+};
+
+#endif
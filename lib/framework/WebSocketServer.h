@@ -18,12 +18,17 @@
 #include <StatefulService.h>
 #include <PsychicHttp.h>
 #include <SecurityManager.h>
+#include <JsonArena.h>
+#include <WebSocketBroadcaster.h>
 
 #define WEB_SOCKET_CLIENT_ID_MSG_SIZE 128
 
 #define WEB_SOCKET_ORIGIN "wsserver"
 #define WEB_SOCKET_ORIGIN_CLIENT_ID_PREFIX "wsserver:"
 
+// the state is a single topic, a lagging client only receives its latest version
+#define WEB_SOCKET_STATE_TOPIC 0
+
 template <class T>
 class WebSocketServer
 {
@@ -39,14 +44,15 @@ public:
                                                                _stateUpdater(stateUpdater),
                                                                _statefulService(statefulService),
                                                                _server(server),
-                                                               _bufferSize(bufferSize),
                                                                _webSocketPath(webSocketPath),
+                                                               _arenaStats(webSocketPath, bufferSize),
+                                                               _broadcaster(webSocketPath),
                                                                _authenticationPredicate(authenticationPredicate),
                                                                _securityManager(securityManager)
     {
         _statefulService->addUpdateHandler(
-            [&](const String &originId)
-            { transmitData(nullptr, originId); },
+            [&](const StateOrigin &origin)
+            { transmitData(nullptr, origin); },
             false);
     }
 
@@ -70,15 +76,16 @@ public:
 
     void onWSOpen(PsychicWebSocketClient *client)
     {
-
+        _broadcaster.addClient(client);
         // when a client connects, we transmit it's id and the current payload
         transmitId(client);
-        transmitData(client, WEB_SOCKET_ORIGIN);
+        transmitData(client, StateOrigin(OriginTransport::WEB_SOCKET));
         ESP_LOGI("WebSocketServer", "ws[%s][%u] connect", client->remoteIP().toString().c_str(), client->socket());
     }
 
     void onWSClose(PsychicWebSocketClient *client)
     {
+        _broadcaster.removeClient(client->socket());
         ESP_LOGI("WebSocketServer", "ws[%s][%u] disconnect", client->remoteIP().toString().c_str(), client->socket());
     }
 
@@ -90,22 +97,20 @@ public:
         {
             ESP_LOGV("WebSocketServer", "ws[%s][%u] request: %s", request->client()->remoteIP().toString().c_str(), request->client()->socket(), (char *)frame->payload);
 
-            DynamicJsonDocument jsonDocument = DynamicJsonDocument(_bufferSize);
-            DeserializationError error = deserializeJson(jsonDocument, (char *)frame->payload, frame->len);
-
-            if (!error && jsonDocument.is<JsonObject>())
-            {
-                JsonObject jsonObject = jsonDocument.as<JsonObject>();
-                _statefulService->update(jsonObject, _stateUpdater, clientId(request->client()));
-                return ESP_OK;
-            }
+            JsonArena::deserialize(_arenaStats, (char *)frame->payload, frame->len, [&](JsonDocument &jsonDocument)
+                                   {
+                if (jsonDocument.is<JsonObject>())
+                {
+                    JsonObject jsonObject = jsonDocument.as<JsonObject>();
+                    _statefulService->update(jsonObject, _stateUpdater, clientId(request->client()));
+                } });
         }
         return ESP_OK;
     }
 
-    String clientId(PsychicWebSocketClient *client)
+    StateOrigin clientId(PsychicWebSocketClient *client)
     {
-        return WEB_SOCKET_ORIGIN_CLIENT_ID_PREFIX + String(client->socket());
+        return StateOrigin(OriginTransport::WEB_SOCKET, client->socket());
     }
 
 private:
@@ -117,19 +122,20 @@ private:
     PsychicHttpServer *_server;
     PsychicWebSocketHandler _webSocket;
     String _webSocketPath;
-    size_t _bufferSize;
+    JsonArenaStats _arenaStats;
+    WebSocketBroadcaster _broadcaster;
 
     void transmitId(PsychicWebSocketClient *client)
     {
         DynamicJsonDocument jsonDocument = DynamicJsonDocument(WEB_SOCKET_CLIENT_ID_MSG_SIZE);
         JsonObject root = jsonDocument.to<JsonObject>();
         root["type"] = "id";
-        root["id"] = clientId(client);
+        root["id"] = clientId(client).toString();
 
         // serialize the json to a string
         String buffer;
         serializeJson(jsonDocument, buffer);
-        client->sendMessage(buffer.c_str());
+        _broadcaster.send(client->socket(), std::make_shared<const String>(std::move(buffer)));
     }
 
     /**
@@ -139,23 +145,16 @@ private:
      * Original implementation sent clients their own IDs so they could ignore updates they initiated. This approach
      * simplifies the client and the server implementation but may not be sufficient for all use-cases.
      */
-    void transmitData(PsychicWebSocketClient *client, const String &originId)
+    void transmitData(PsychicWebSocketClient *client, const StateOrigin &origin)
     {
-        DynamicJsonDocument jsonDocument = DynamicJsonDocument(_bufferSize);
-        JsonObject root = jsonDocument.to<JsonObject>();
-        String buffer;
-
-        _statefulService->read(root, _stateReader);
-
-        // serialize the json to a string
-        serializeJson(jsonDocument, buffer);
+        SerializedState payload = _statefulService->serialize(_stateReader, _arenaStats);
         if (client)
         {
-            client->sendMessage(buffer.c_str());
+            _broadcaster.send(client->socket(), payload, WEB_SOCKET_STATE_TOPIC);
         }
         else
         {
-            _webSocket.sendAll(buffer.c_str());
+            _broadcaster.sendAll(payload, WEB_SOCKET_STATE_TOPIC);
         }
     }
 };
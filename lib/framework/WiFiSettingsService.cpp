@@ -24,7 +24,7 @@ WiFiSettingsService::WiFiSettingsService(PsychicHttpServer *server,
                                                                 _fsPersistence(WiFiSettings::read, WiFiSettings::update, this, fs, WIFI_SETTINGS_FILE), _lastConnectionAttempt(0),
                                                                 _socket(socket)
 {
-    addUpdateHandler([&](const String &originId)
+    addUpdateHandler([&](const StateOrigin &origin)
                      { reconfigureWiFiConnection(); },
                      false);
 }
@@ -49,7 +49,7 @@ void WiFiSettingsService::initWiFi()
 
 void WiFiSettingsService::begin()
 {
-    _socket->registerEvent(EVENT_RSSI);
+    _socket->registerEvent(EVENT_RSSI, true);
 
     _httpEndpoint.begin();
 }
@@ -20,15 +20,17 @@ AppSettingsService::AppSettingsService(PsychicHttpServer *server, FS *fs, Securi
                                                                                                                                         server,
                                                                                                                                         APP_SETTINGS_ENDPOINT_PATH,
                                                                                                                                         securityManager,
-                                                                                                                                        AuthenticationPredicates::IS_AUTHENTICATED),
-                                                                                                                          _fsPersistence(AppSettings::read, AppSettings::update, this, fs, APP_SETTINGS_FILE),
+                                                                                                                                        AuthenticationPredicates::IS_AUTHENTICATED,
+                                                                                                                                        APP_SETTINGS_BUFFER_SIZE),
+                                                                                                                          _fsPersistence(AppSettings::read, AppSettings::update, this, fs, APP_SETTINGS_FILE, APP_SETTINGS_BUFFER_SIZE, PersistenceFormat::BINARY),
                                                                                            _webSocketServer(AppSettings::read,
                                                                                                             AppSettings::update,
                                                                                                             this,
                                                                                                             server,
                                                                                                             APP_SETTINGS_SOCKET_PATH,
                                                                                                             securityManager,
-                                                                                                            AuthenticationPredicates::IS_AUTHENTICATED)
+                                                                                                            AuthenticationPredicates::IS_AUTHENTICATED,
+                                                                                                            APP_SETTINGS_BUFFER_SIZE)
 {
     _server = server;
     _securityManager = securityManager;
@@ -79,9 +81,22 @@ void AppSettingsService::begin()
                     return response.send();
                 }
 
+                // fans out to every registered shocker, within its own limits
+                OpenShock::ShockerCommand commands[MAX_SHOCKERS];
+                size_t count = 0;
+                read([&](AppSettings &settings) {
+                    count = AppSettings::mapShockerCommands(settings, action, intensity, commands);
+                });
+
+                if (count == 0)
+                {
+                    responseObject["res"] = "no shocker enabled";
+                    return response.send();
+                }
+
                 responseObject["res"] = 
-                    OpenShock::CommandHandler::HandleCommand(
-                        OpenShock::ShockerModelType::CaiXianlin, 0, action, intensity, duration
+                    OpenShock::CommandHandler::HandleGroupCommand(
+                        commands, count, action, duration
                     ) ? "ok" : "failed";
 
                 return response.send();
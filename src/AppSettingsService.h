@@ -18,15 +18,23 @@
 #include <HttpEndpoint.h>
 #include <WebSocketServer.h>
 #include <FSPersistence.h>
+#include <StateFields.h>
 // #include <SettingValue.h>
 #include <vector>
 #include <CommandHandler.h>
+#include <ConditionProgram.h>
 
 #define APP_SETTINGS_FILE "/config/appSettings.json"
 #define APP_SETTINGS_ENDPOINT_PATH "/rest/appSettings"
 #define TEST_COLLAR_ENDPOINT_PATH "/rest/testCollar"
 #define APP_SETTINGS_SOCKET_PATH "/ws/appSettings"
 
+// the shocker registry does not fit the default 1KB document
+#define APP_SETTINGS_BUFFER_SIZE 4096
+
+// upper bound of registered shockers, a group command is built on the stack
+#define MAX_SHOCKERS 16
+
 enum class AlertType {
     NONE,
     COLLAR_BEEP,
@@ -60,6 +68,29 @@ struct EventStep {
     std::vector<double> time_range;
     RangeType strength_range_type;
     std::vector<double> strength_range;
+
+    bool operator==(const EventStep &other) const
+    {
+        return type == other.type && start_delay == other.start_delay && end_delay == other.end_delay &&
+               time_range_type == other.time_range_type && time_range == other.time_range &&
+               strength_range_type == other.strength_range_type && strength_range == other.strength_range;
+    }
+    bool operator!=(const EventStep &other) const { return !(*this == other); }
+};
+
+// A registered shocker and its own limits, applied on top of the global collar limits
+struct ShockerConfig {
+    OpenShock::ShockerModelType model = OpenShock::ShockerModelType::CaiXianlin;
+    uint16_t id = 0;
+    bool enabled = true;
+    int maxShock = 100;
+    int maxVibe = 100;
+
+    bool operator==(const ShockerConfig &other) const
+    {
+        return model == other.model && id == other.id && enabled == other.enabled && maxShock == other.maxShock && maxVibe == other.maxVibe;
+    }
+    bool operator!=(const ShockerConfig &other) const { return !(*this == other); }
 };
 
 class AppSettings
@@ -86,25 +117,68 @@ public:
     PassType passType = PassType::FIRST_PASS;
     double passThreshold = 0;
 
+    // block rate detection: smoothing time constant of the block level and
+    // hysteresis of the default threshold condition
+    int detectSmoothingMs = 0;
+    double detectHysteresisDb = 0;
+
     std::vector<EventStep> correctionSteps;
     std::vector<EventStep> affirmationSteps;
 
+    std::vector<ConditionTerm> conditions;
+
+    // without any registered shocker, commands go to a CaiXianlin with id 0
+    std::vector<ShockerConfig> shockers;
+
+    // scalar settings, the step, condition and shocker arrays are mapped by hand
+    static constexpr auto fields()
+    {
+        return std::make_tuple(
+            stateField("idle_period_min_ms", &AppSettings::idlePeriodMinMs),
+            stateField("idle_period_max_ms", &AppSettings::idlePeriodMaxMs),
+            stateField("action_period_min_ms", &AppSettings::actionPeriodMinMs),
+            stateField("action_period_max_ms", &AppSettings::actionPeriodMaxMs),
+            stateField("decibel_threshold_min", &AppSettings::decibelThresholdMin),
+            stateField("decibel_threshold_max", &AppSettings::decibelThresholdMax),
+            stateField("mic_sensitivity", &AppSettings::micSensitivity),
+            stateField("collar_min_shock", &AppSettings::collarMinShock),
+            stateField("collar_max_shock", &AppSettings::collarMaxShock),
+            stateField("collar_min_vibe", &AppSettings::collarMinVibe),
+            stateField("collar_max_vibe", &AppSettings::collarMaxVibe),
+            stateField("alert_type", &AppSettings::alertType),
+            stateField("alert_duration", &AppSettings::alertDuration),
+            stateField("alert_strength", &AppSettings::alertStrength),
+            stateField("pass_type", &AppSettings::passType),
+            stateField("pass_threshold", &AppSettings::passThreshold),
+            stateField("detect_smoothing_ms", &AppSettings::detectSmoothingMs),
+            stateField("detect_hysteresis_db", &AppSettings::detectHysteresisDb));
+    }
+
+    // what the last update changed, handlers use it to skip unaffected work
+    uint32_t changedFields = 0;
+    uint8_t changedArrays = 0;
+
+    bool changedInLastUpdate(const char *field) const
+    {
+        return (changedFields & StateFields<AppSettings>::mask(field)) != 0 || (changedArrays & arrayMask(field)) != 0;
+    }
+
+    static uint8_t arrayMask(const char *field)
+    {
+        static const char *const names[] = {"correction_steps", "affirmation_steps", "conditions", "shockers"};
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        {
+            if (strcmp(names[i], field) == 0)
+            {
+                return 1 << i;
+            }
+        }
+        return 0;
+    }
+
     static void read(AppSettings &settings, JsonObject &root)
     {
-        root["idle_period_min_ms"] = settings.idlePeriodMinMs;
-        root["idle_period_max_ms"] = settings.idlePeriodMaxMs;
-        root["action_period_min_ms"] = settings.actionPeriodMinMs;
-        root["action_period_max_ms"] = settings.actionPeriodMaxMs;
-        root["decibel_threshold_min"] = settings.decibelThresholdMin;
-        root["decibel_threshold_max"] = settings.decibelThresholdMax;
-        root["mic_sensitivity"] = settings.micSensitivity;
-        root["collar_min_shock"] = settings.collarMinShock;
-        root["collar_max_shock"] = settings.collarMaxShock;
-        root["alert_type"] = static_cast<int>(settings.alertType);
-        root["alert_duration"] = settings.alertDuration;
-        root["alert_strength"] = settings.alertStrength;
-        root["pass_type"] = static_cast<int>(settings.passType);
-        root["pass_threshold"] = settings.passThreshold;
+        StateFields<AppSettings>::read(settings, root);
 
         JsonArray correctionStepsArray = root.createNestedArray("correction_steps");
         for (const auto &step : settings.correctionSteps)
@@ -121,28 +195,31 @@ public:
             AppSettings::mapStepToJson(step, stepObject);
         }
 
+        JsonArray conditionsArray = root.createNestedArray("conditions");
+        for (const auto &term : settings.conditions)
+        {
+            JsonObject termObject = conditionsArray.createNestedObject();
+            AppSettings::mapConditionToJson(term, termObject);
+        }
+
+        JsonArray shockersArray = root.createNestedArray("shockers");
+        for (const auto &shocker : settings.shockers)
+        {
+            JsonObject shockerObject = shockersArray.createNestedObject();
+            AppSettings::mapShockerToJson(shocker, shockerObject);
+        }
+
         // root["correction_steps"] = correctionStepsArray;
         // root["affirmation_steps"] = affirmationStepsArray;
     }
 
     static StateUpdateResult update(JsonObject &root, AppSettings &settings)
     {
-        settings.idlePeriodMinMs = root["idle_period_min_ms"] | settings.idlePeriodMinMs;
-        settings.idlePeriodMaxMs = root["idle_period_max_ms"] | settings.idlePeriodMaxMs;
-        settings.actionPeriodMinMs = root["action_period_min_ms"] | settings.actionPeriodMinMs;
-        settings.actionPeriodMaxMs = root["action_period_max_ms"] | settings.actionPeriodMaxMs;
-        settings.decibelThresholdMin = root["decibel_threshold_min"] | settings.decibelThresholdMin;
-        settings.decibelThresholdMax = root["decibel_threshold_max"] | settings.decibelThresholdMax;
-        settings.micSensitivity = root["mic_sensitivity"] | settings.micSensitivity;
-        settings.collarMinShock = root["collar_min_shock"] | settings.collarMinShock;
-        settings.collarMaxShock = root["collar_max_shock"] | settings.collarMaxShock;
-        settings.collarMinVibe = root["collar_min_vibe"] | settings.collarMinVibe;
-        settings.collarMaxVibe = root["collar_max_vibe"] | settings.collarMaxVibe;
-        settings.alertType = static_cast<AlertType>(root["alert_type"].as<int>());
-        settings.alertDuration = root["alert_duration"] | settings.alertDuration;
-        settings.alertStrength = root["alert_strength"] | settings.alertStrength;
-        settings.passType = static_cast<PassType>(root["pass_type"].as<int>());
-        settings.passThreshold = root["pass_threshold"] | settings.passThreshold;
+        // compared member by member afterwards, a serialized comparison misses changes past the document size
+        AppSettings before = settings;
+
+        // one pass over the scalar keys, the arrays below are looked up by name
+        StateFields<AppSettings>::update(root, settings);
 
         JsonArray correctionStepsArray = root["correction_steps"];
         settings.correctionSteps.clear();
@@ -156,9 +233,88 @@ public:
             AppSettings::mapStepFromJson(stepObject, settings.affirmationSteps);
         }
 
+        // keep the conditions if the client does not know about them
+        if (root.containsKey("conditions"))
+        {
+            JsonArray conditionsArray = root["conditions"];
+            settings.conditions.clear();
+            for (JsonObject termObject : conditionsArray) {
+                AppSettings::mapConditionFromJson(termObject, settings.conditions);
+            }
+        }
+
+        // keep the registry if the client does not know about it
+        if (root.containsKey("shockers"))
+        {
+            JsonArray shockersArray = root["shockers"];
+            settings.shockers.clear();
+            for (JsonObject shockerObject : shockersArray) {
+                if (settings.shockers.size() >= MAX_SHOCKERS) {
+                    break;
+                }
+                AppSettings::mapShockerFromJson(shockerObject, settings.shockers);
+            }
+        }
+
+        // re-sending identical settings must not rewrite the file or rebroadcast
+        uint32_t changedFields = StateFields<AppSettings>::diff(before, settings);
+        uint8_t changedArrays = (settings.correctionSteps != before.correctionSteps ? arrayMask("correction_steps") : 0) |
+                                (settings.affirmationSteps != before.affirmationSteps ? arrayMask("affirmation_steps") : 0) |
+                                (settings.conditions != before.conditions ? arrayMask("conditions") : 0) |
+                                (settings.shockers != before.shockers ? arrayMask("shockers") : 0);
+        if (changedFields == 0 && changedArrays == 0)
+        {
+            return StateUpdateResult::UNCHANGED;
+        }
+        settings.changedFields = changedFields;
+        settings.changedArrays = changedArrays;
         return StateUpdateResult::CHANGED;
     }
 
+    /**
+     * Fills commands with one entry per enabled shocker, the intensity clamped to the device limit of the
+     * command type. Returns the number of entries, at most MAX_SHOCKERS.
+     */
+    static size_t mapShockerCommands(const AppSettings &settings, OpenShock::ShockerCommandType type, int intensity, OpenShock::ShockerCommand *commands) {
+        if (settings.shockers.empty()) {
+            commands[0] = {OpenShock::ShockerModelType::CaiXianlin, 0, static_cast<uint8_t>(constrain(intensity, 0, 100))};
+            return 1;
+        }
+
+        size_t count = 0;
+        for (const auto &shocker : settings.shockers) {
+            if (!shocker.enabled || count >= MAX_SHOCKERS) {
+                continue;
+            }
+            int limit = 100;
+            if (type == OpenShock::ShockerCommandType::Shock) {
+                limit = shocker.maxShock;
+            } else if (type == OpenShock::ShockerCommandType::Vibrate) {
+                limit = shocker.maxVibe;
+            }
+            commands[count++] = {shocker.model, shocker.id, static_cast<uint8_t>(constrain(intensity, 0, limit))};
+        }
+        return count;
+    }
+
+    static void mapShockerFromJson(JsonObject &shockerObject, std::vector<ShockerConfig> &destination) {
+        ShockerConfig shocker;
+        shocker.model = static_cast<OpenShock::ShockerModelType>(shockerObject["model"] | static_cast<int>(shocker.model));
+        shocker.id = shockerObject["id"] | shocker.id;
+        shocker.enabled = shockerObject["enabled"] | shocker.enabled;
+        shocker.maxShock = constrain(shockerObject["max_shock"] | shocker.maxShock, 0, 100);
+        shocker.maxVibe = constrain(shockerObject["max_vibe"] | shocker.maxVibe, 0, 100);
+        destination.push_back(shocker);
+    }
+
+    static void mapShockerToJson(const ShockerConfig &shocker, JsonObject &shockerObject) {
+        shockerObject["model"] = static_cast<int>(shocker.model);
+        shockerObject["id"] = shocker.id;
+        shockerObject["enabled"] = shocker.enabled;
+        shockerObject["max_shock"] = shocker.maxShock;
+        shockerObject["max_vibe"] = shocker.maxVibe;
+    }
+
     static void mapStepFromJson(JsonObject &stepObject, std::vector<EventStep> &destination) {
         EventStep step;
         step.type = static_cast<EventType>(stepObject["type"].as<int>());
@@ -193,6 +349,30 @@ public:
             strengthRangeArray.add(strength);
         }
     }
+
+    static void mapConditionFromJson(JsonObject &termObject, std::vector<ConditionTerm> &destination) {
+        ConditionTerm term;
+        term.source = static_cast<ConditionSource>(termObject["source"] | static_cast<int>(term.source));
+        term.compare = static_cast<ConditionCompare>(termObject["compare"] | static_cast<int>(term.compare));
+        term.logic = static_cast<ConditionLogic>(termObject["logic"] | static_cast<int>(term.logic));
+        term.band = termObject["band"] | term.band;
+        term.routineThreshold = termObject["routine_threshold"] | term.routineThreshold;
+        term.threshold = termObject["threshold"] | term.threshold;
+        term.hysteresis = termObject["hysteresis"] | term.hysteresis;
+        term.holdMs = termObject["hold_ms"] | term.holdMs;
+        destination.push_back(term);
+    }
+
+    static void mapConditionToJson(const ConditionTerm &term, JsonObject &termObject) {
+        termObject["source"] = static_cast<int>(term.source);
+        termObject["compare"] = static_cast<int>(term.compare);
+        termObject["logic"] = static_cast<int>(term.logic);
+        termObject["band"] = term.band;
+        termObject["routine_threshold"] = term.routineThreshold;
+        termObject["threshold"] = term.threshold;
+        termObject["hysteresis"] = term.hysteresis;
+        termObject["hold_ms"] = term.holdMs;
+    }
 };
 
 
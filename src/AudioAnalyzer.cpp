@@ -141,17 +141,23 @@ void AudioAnalyzer::task() {
     i2s_read(I2S_PORT, &samples, SAMPLES_SHORT * sizeof(SAMPLE_T), &bytes_read, portMAX_DELAY);
 
     TickType_t start_tick = xTaskGetTickCount();
+    int64_t timestamp = esp_timer_get_time();
     
     // Convert (including shifting) integer microphone values to floats, 
     // using the same buffer (assumed sample size is same as size of float), 
     // to save a bit of memory
+    bool spectrum = _spectrumEnabled;
     SAMPLE_T* int_samples = (SAMPLE_T*)&samples;
     for(int i=0; i<SAMPLES_SHORT; i++) {
-      // intSamples[i] = static_cast<int32_t>(samples[i]);
-      samples[i] = MIC_CONVERT(int_samples[i]);
+      SAMPLE_T sample = MIC_CONVERT(int_samples[i]);
+      if (spectrum) {
+        intSamples[i] = sample;
+      }
+      samples[i] = sample;
     }
 
     sum_queue_t q;
+    q.timestamp = timestamp;
     // Apply equalization and calculate Z-weighted sum of squares, 
     // writes filtered samples back to the same buffer.
     q.sum_sqr_SPL = MIC_EQUALIZER.filter(samples, samples, SAMPLES_SHORT);
@@ -162,9 +168,15 @@ void AudioAnalyzer::task() {
     // Debug only. Ticks we spent filtering and summing block of I2S data
     // q.proc_ticks = xTaskGetTickCount() - start_tick;
 
-    // Calculate pitch
-    q.pitch = 0;
-    // q.pitch = calculatePitch();
+    // Pitch and band levels are only needed by spectral conditions
+    if (spectrum) {
+      q.pitch = calculatePitch(q.bands);
+    } else {
+      q.pitch = 0;
+      for (int i = 0; i < SPECTRUM_BANDS; i++) {
+        q.bands[i] = NAN;
+      }
+    }
 
     // analogRead PIEZO_PIN
     // Serial.println(analogRead(PIEZO_PIN));
@@ -204,31 +216,39 @@ double AudioAnalyzer::getDecibels(sum_queue_t q) {
   return output;
 }
 
-float AudioAnalyzer::calculatePitch() {
-  // int N = samples.size();
-  // std::vector<double> fftInput(N);
+double AudioAnalyzer::getBlockDecibels(const sum_queue_t &q, float smoothingMs) {
+  double sum_sqr = double(q.sum_sqr_weighted) / SAMPLES_SHORT;
 
-  // // Convert samples to complex numbers for FFT
-  // for (int i = 0; i < SAMPLES_SHORT; i++) {
-  //   intSamples[i] = static_cast<int32_t>(samples[i]);
-  // }
+  // Exponential smoothing of the mean square, a time constant of 0 disables it
+  if (smoothingMs > 0 && isfinite(Block_sum_sqr)) {
+    double alpha = 1 - exp(-blockDurationMs() / smoothingMs);
+    Block_sum_sqr += alpha * (sum_sqr - Block_sum_sqr);
+  } else {
+    Block_sum_sqr = sum_sqr;
+  }
 
-  // Serial.println("Calculating pitch...");
+  return MIC_OFFSET_DB + MIC_REF_DB + 20 * log10(sqrt(Block_sum_sqr) / MIC_REF_AMPL);
+}
 
-  _audioInfo.computeFFT(intSamples, SAMPLES_SHORT, SAMPLE_RATE);
-  _audioInfo.computeFrequencies(8);
+float AudioAnalyzer::blockDurationMs() {
+  return SAMPLES_SHORT * 1000.0f / SAMPLE_RATE;
+}
+
+uint32_t AudioAnalyzer::blockDurationUs() {
+  return (SAMPLES_SHORT * 1000000ULL + SAMPLE_RATE / 2) / SAMPLE_RATE;
+}
 
-  // // float *bands = _audioInfo.getBands();
-  float *peaks = _audioInfo.getPeaks();
+float AudioAnalyzer::calculatePitch(float *bands) {
+  _audioInfo.computeFFT(intSamples, SAMPLES_SHORT, SAMPLE_RATE);
+  _audioInfo.computeFrequencies(SPECTRUM_BANDS);
 
-    for (int i = 0; i < 8; i++)
-  {
-    // Serial.printf("%d:%.1f,", i, peaks[i]);
-    Serial.printf(">peak%d:%.1f", i, peaks[i]);
-    Serial.println();
+  float *levels = _audioInfo.getBands();
+  for (int i = 0; i < SPECTRUM_BANDS; i++) {
+    // +1 keeps silent bands at 0 dB instead of -inf
+    bands[i] = 20 * log10(levels[i] + 1);
   }
 
-  return 0;
+  return _audioInfo.getMajorPeak();
   // if (_fft == nullptr) {
   //   _fft = new ArduinoFFT<float>(_real, _imag, SAMPLES_SHORT, SAMPLE_RATE, _weighingFactors);
   // }
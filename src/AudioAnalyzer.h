@@ -21,7 +21,10 @@
 #include <AudioAnalysis.h>
 #include <ArduinoFFT.h>
 
+#include <atomic>
+
 const int SAMPLES_SHORT = 1024;
+const int SPECTRUM_BANDS = 8;
 
 // Data we push to 'samplesQueue'
 struct sum_queue_t {
@@ -33,6 +36,10 @@ struct sum_queue_t {
 //   uint32_t proc_ticks;
 
   float pitch;
+  // Band levels in dB, only filled while the spectrum is enabled
+  float bands[SPECTRUM_BANDS];
+  // esp_timer time at which the block finished DMA
+  int64_t timestamp;
 };
 
 class AudioAnalyzer
@@ -43,7 +50,11 @@ public:
     void begin();
     QueueHandle_t samplesQueue;
     double getDecibels(sum_queue_t q);
-    float calculatePitch();
+    double getBlockDecibels(const sum_queue_t &q, float smoothingMs);
+    static float blockDurationMs();
+    static uint32_t blockDurationUs();
+    float calculatePitch(float *bands);
+    void setSpectrumEnabled(bool enabled) { _spectrumEnabled = enabled; }
 
 protected:
     void task();
@@ -55,9 +66,11 @@ protected:
 private:
     uint32_t Leq_samples = 0;
     double Leq_sum_sqr = 0;
+    double Block_sum_sqr = 0;
     unsigned long startTime = millis();
     ArduinoFFT<float> *_fft;
     AudioAnalysis _audioInfo;
+    std::atomic<bool> _spectrumEnabled{false};
 };
 
 #endif
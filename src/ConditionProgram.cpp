@@ -0,0 +1,168 @@
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <ConditionProgram.h>
+
+#include <cmath>
+
+ConditionProgram::ConditionProgram() : _length(0), _usesSpectrum(false)
+{
+    compile(std::vector<ConditionTerm>());
+}
+
+bool ConditionProgram::compile(const std::vector<ConditionTerm> &terms, float defaultHysteresis)
+{
+    _length = 0;
+    _usesSpectrum = false;
+    bool complete = true;
+
+    if (terms.empty())
+    {
+        ConditionTerm term;
+        term.hysteresis = defaultHysteresis;
+        emitTerm(term);
+    }
+
+    size_t count = 0;
+    for (const ConditionTerm &term : terms)
+    {
+        if (count == CONDITION_MAX_TERMS)
+        {
+            complete = false;
+            break;
+        }
+
+        emitTerm(term);
+        if (count > 0)
+        {
+            OpCode join = term.logic == ConditionLogic::OR ? OpCode::OR : OpCode::AND;
+            emit({join, term.source, 0, 0, 0, 0});
+        }
+        count++;
+    }
+
+    reset();
+    return complete;
+}
+
+bool ConditionProgram::emit(const Op &op)
+{
+    if (_length >= CONDITION_MAX_OPS)
+    {
+        return false;
+    }
+    _ops[_length++] = op;
+    return true;
+}
+
+bool ConditionProgram::emitTerm(const ConditionTerm &term)
+{
+    Op compare = {OpCode::COMPARE, term.source, 0, 0, term.threshold, std::fabs(term.hysteresis)};
+    if (term.compare == ConditionCompare::BELOW)
+    {
+        compare.flags |= FLAG_BELOW;
+    }
+    if (term.source == ConditionSource::DECIBELS && term.routineThreshold)
+    {
+        compare.flags |= FLAG_ROUTINE;
+    }
+    if (term.source == ConditionSource::BAND)
+    {
+        compare.band = term.band < CONDITION_BANDS ? term.band : CONDITION_BANDS - 1;
+    }
+    if (term.source != ConditionSource::DECIBELS)
+    {
+        _usesSpectrum = true;
+    }
+
+    if (!emit(compare))
+    {
+        return false;
+    }
+    if (term.holdMs > 0)
+    {
+        return emit({OpCode::HOLD, term.source, 0, 0, static_cast<float>(term.holdMs), 0});
+    }
+    return true;
+}
+
+void ConditionProgram::reset()
+{
+    for (uint8_t i = 0; i < CONDITION_MAX_OPS; i++)
+    {
+        _latched[i] = false;
+        _heldMs[i] = 0;
+    }
+}
+
+float ConditionProgram::sourceValue(const Op &op, const ConditionInputs &inputs) const
+{
+    switch (op.source)
+    {
+    case ConditionSource::DECIBELS:
+        return inputs.decibels;
+    case ConditionSource::PITCH:
+        return inputs.pitch;
+    case ConditionSource::BAND:
+        return inputs.bands ? inputs.bands[op.band] : NAN;
+    }
+    return NAN;
+}
+
+bool ConditionProgram::evaluate(const ConditionInputs &inputs)
+{
+    // Terms are joined left to right, so the stack never holds more than two values
+    bool stack[CONDITION_MAX_TERMS];
+    uint8_t sp = 0;
+
+    for (uint8_t i = 0; i < _length; i++)
+    {
+        const Op &op = _ops[i];
+        switch (op.code)
+        {
+        case OpCode::COMPARE:
+        {
+            float value = sourceValue(op, inputs);
+            float threshold = (op.flags & FLAG_ROUTINE) ? inputs.thresholdDb : op.a;
+            bool below = op.flags & FLAG_BELOW;
+
+            // NaN compares false, so a missing value never passes a term
+            if (_latched[i])
+            {
+                _latched[i] = below ? value < threshold + op.b : value > threshold - op.b;
+            }
+            else
+            {
+                _latched[i] = below ? value <= threshold : value >= threshold;
+            }
+            stack[sp++] = _latched[i];
+            break;
+        }
+        case OpCode::HOLD:
+            _heldMs[i] = stack[sp - 1] ? _heldMs[i] + inputs.elapsedMs : 0;
+            stack[sp - 1] = _heldMs[i] >= op.a;
+            break;
+        case OpCode::AND:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] && stack[sp];
+            break;
+        case OpCode::OR:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] || stack[sp];
+            break;
+        }
+    }
+
+    return sp > 0 && stack[sp - 1];
+}
@@ -0,0 +1,132 @@
+#ifndef ConditionProgram_h
+#define ConditionProgram_h
+
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <cstdint>
+#include <vector>
+
+// Upper bounds of a compiled program. Evaluation cost is bounded by CONDITION_MAX_OPS.
+#define CONDITION_MAX_TERMS 8
+#define CONDITION_MAX_OPS (CONDITION_MAX_TERMS * 3)
+#define CONDITION_BANDS 8
+
+enum class ConditionSource : uint8_t {
+    DECIBELS,
+    PITCH,
+    BAND,
+};
+
+enum class ConditionCompare : uint8_t {
+    ABOVE,
+    BELOW,
+};
+
+enum class ConditionLogic : uint8_t {
+    AND,
+    OR,
+};
+
+// A single user configured condition, as stored in AppSettings.
+struct ConditionTerm {
+    ConditionSource source = ConditionSource::DECIBELS;
+    ConditionCompare compare = ConditionCompare::ABOVE;
+    // how this term is joined with the result of the terms before it
+    ConditionLogic logic = ConditionLogic::AND;
+    // band index, only used with ConditionSource::BAND
+    uint8_t band = 0;
+    // decibel terms only: compare against the randomized threshold of the current routine
+    bool routineThreshold = true;
+    float threshold = 0;
+    // once reached, the value has to fall back by this much before the term resets
+    float hysteresis = 0;
+    // the term only passes after it has been reached continuously for this long
+    uint16_t holdMs = 0;
+
+    bool operator==(const ConditionTerm &other) const
+    {
+        return source == other.source && compare == other.compare && logic == other.logic && band == other.band &&
+               routineThreshold == other.routineThreshold && threshold == other.threshold &&
+               hysteresis == other.hysteresis && holdMs == other.holdMs;
+    }
+    bool operator!=(const ConditionTerm &other) const { return !(*this == other); }
+};
+
+// Values sampled for one evaluation step
+struct ConditionInputs {
+    float decibels;
+    float pitch;
+    float thresholdDb;
+    // CONDITION_BANDS band levels in dB, or nullptr when no spectrum is available
+    const float *bands;
+    // time covered by this step, used by hold terms
+    uint16_t elapsedMs;
+};
+
+/**
+ * Condition terms compiled into a flat postfix program. Compilation happens once whenever the
+ * settings change, evaluation runs at block rate out of fixed size arrays and never allocates.
+ */
+class ConditionProgram
+{
+public:
+    ConditionProgram();
+
+    // Compiles the terms, an empty list compiles to "dB above routine threshold" with the given hysteresis.
+    // Terms beyond CONDITION_MAX_TERMS are dropped and false is returned.
+    bool compile(const std::vector<ConditionTerm> &terms, float defaultHysteresis = 0);
+
+    bool evaluate(const ConditionInputs &inputs);
+
+    // Clears hysteresis latches and hold timers, call when a new action window starts
+    void reset();
+
+    bool usesSpectrum() const { return _usesSpectrum; }
+    uint8_t size() const { return _length; }
+
+private:
+    enum class OpCode : uint8_t {
+        COMPARE,
+        HOLD,
+        AND,
+        OR,
+    };
+
+    static const uint8_t FLAG_BELOW = 0x01;
+    static const uint8_t FLAG_ROUTINE = 0x02;
+
+    struct Op {
+        OpCode code;
+        ConditionSource source;
+        uint8_t flags;
+        uint8_t band;
+        // COMPARE: threshold, HOLD: hold time in ms
+        float a;
+        // COMPARE: hysteresis
+        float b;
+    };
+
+    Op _ops[CONDITION_MAX_OPS];
+    bool _latched[CONDITION_MAX_OPS];
+    uint32_t _heldMs[CONDITION_MAX_OPS];
+    uint8_t _length;
+    bool _usesSpectrum;
+
+    bool emit(const Op &op);
+    bool emitTerm(const ConditionTerm &term);
+    float sourceValue(const Op &op, const ConditionInputs &inputs) const;
+};
+
+#endif
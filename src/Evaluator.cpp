@@ -5,9 +5,21 @@
 #endif
 
 Evaluator::Evaluator(
-  AppSettingsService *appSettingsService) : 
-    _appSettingsService(appSettingsService)
+  AppSettingsService *appSettingsService,
+  SessionStatsService *sessionStats) : 
+    _appSettingsService(appSettingsService),
+    _sessionStats(sessionStats),
+    _conditionsDirty(true)
 {
+  // recompile the conditions lazily on the reader thread, never while evaluating
+  _appSettingsService->addUpdateHandler([&](const StateOrigin &origin) {
+    _appSettingsService->read([&](AppSettings &settings) {
+      if (settings.changedInLastUpdate("conditions") || settings.changedInLastUpdate("detect_hysteresis_db")) {
+        _conditionsDirty = true;
+      }
+    });
+  }, false, true);
+
   pinMode(RF_PIN, OUTPUT);
   if (!OpenShock::CommandHandler::Init()) {
     ESP_LOGW(TAG, "Unable to initialize OpenShock");
@@ -25,54 +37,112 @@ void Evaluator::begin() {
     2048,
     this,
     (tskIDLE_PRIORITY),
-    NULL,
+    &_taskHandle,
     ESP32SVELTEKIT_RUNNING_CORE
   );
 }
 
 void Evaluator::task() {
   event_queue_t eq;
-  while (xQueueReceive(eventsQueue, &eq, portMAX_DELAY)) {
+  uint32_t notification;
+  while (true) {
+    xTaskNotifyWait(0, ULONG_MAX, &notification, portMAX_DELAY);
 
-    if (eq.alertType != AlertType::NONE) {
-      Serial.println("Alerting user");
+    // A pass detected on the block rate path skips the queue
+    if (notification & EVALUATOR_NOTIFY_PASS) {
+      portENTER_CRITICAL(&_passMux);
+      int64_t sampleTimestamp = _passTimestamp;
+      portEXIT_CRITICAL(&_passMux);
 
-      if (eq.alertType == AlertType::COLLAR_VIBRATION) {
-        vibrateCollar(eq.alertStrength, eq.alertDuration);
-      } else if (eq.alertType == AlertType::COLLAR_BEEP) {
-        beepCollar(eq.alertDuration);
-      }
+      evaluate(1, sampleTimestamp);
+    }
 
-      vTaskDelay(eq.alertDuration / portTICK_PERIOD_MS);
-      stopCollar(); 
+    while (xQueueReceive(eventsQueue, &eq, 0) == pdTRUE) {
+      if (eq.alertType != AlertType::NONE) {
+        Serial.println("Alerting user");
 
-      continue;
-    }
+        if (eq.alertType == AlertType::COLLAR_VIBRATION) {
+          vibrateCollar(eq.alertStrength, eq.alertDuration);
+        } else if (eq.alertType == AlertType::COLLAR_BEEP) {
+          beepCollar(eq.alertDuration);
+        }
 
-    std::vector<EventStep> steps = std::vector<EventStep>();
-    if (evaluatePassed(eq.dbPassRate)) {
-      assignAffirmationSteps(steps);
-    } else {
-      assignCorrectionSteps(steps);
-    }
+        vTaskDelay(eq.alertDuration / portTICK_PERIOD_MS);
+        stopCollar(); 
+
+        continue;
+      }
 
-    for (EventStep step : steps) {
-      processStep(step, eq.dbPassRate);
+      evaluate(eq.dbPassRate, eq.sampleTimestamp);
     }
   }
 }
 
-void Evaluator::queueEvaluation(float dbPassRate) {
+void Evaluator::evaluate(float passRate, int64_t sampleTimestamp) {
+  recordDecision(sampleTimestamp);
+
+  bool passed = evaluatePassed(passRate);
+  if (_sessionStats) {
+    _sessionStats->recordEvaluation(passRate, passed);
+  }
+
+  std::vector<EventStep> steps = std::vector<EventStep>();
+  if (passed) {
+    assignAffirmationSteps(steps);
+  } else {
+    assignCorrectionSteps(steps);
+  }
+
+  for (EventStep step : steps) {
+    processStep(step, passRate);
+  }
+  _commandTimestamp = 0;
+}
+
+void Evaluator::recordDecision(int64_t sampleTimestamp) {
+  if (sampleTimestamp == 0) {
+    return;
+  }
+  _lastDecisionLatencyUs = static_cast<uint32_t>(esp_timer_get_time() - sampleTimestamp);
+  _commandTimestamp = sampleTimestamp;
+  LatencyService::record(LatencyStage::DECISION, sampleTimestamp);
+  ESP_LOGD(TAG, "Sample to decision latency: %u us", _lastDecisionLatencyUs);
+}
+
+bool Evaluator::sendCommand(OpenShock::ShockerCommandType type, int strength, int duration) {
+  // only the first command after a decision is attributed to the sample
+  int64_t sampleTimestamp = _commandTimestamp;
+  _commandTimestamp = 0;
+  LatencyService::record(LatencyStage::COMMAND, sampleTimestamp);
+
+  OpenShock::ShockerCommand commands[MAX_SHOCKERS];
+  size_t count = 0;
+  _appSettingsService->read([&](AppSettings &settings) {
+    count = AppSettings::mapShockerCommands(settings, type, strength, commands);
+  });
+
+  return OpenShock::CommandHandler::HandleGroupCommand(
+    commands,
+    count,
+    type,
+    duration,
+    sampleTimestamp
+  );
+}
+
+void Evaluator::queueEvaluation(float dbPassRate, int64_t sampleTimestamp) {
   event_queue_t eq = {
     alertType: AlertType::NONE,
     alertDuration: 0,
     alertStrength: 0,
-    dbPassRate: dbPassRate
+    dbPassRate: dbPassRate,
+    sampleTimestamp: sampleTimestamp
   };
 
   Serial.println("Queueing evaluation");
 
   xQueueSend(eventsQueue, &eq, portMAX_DELAY);
+  xTaskNotify(_taskHandle, EVALUATOR_NOTIFY_QUEUE, eSetBits);
 }
 
 void Evaluator::queueAlert(AlertType alertType, int alertDuration, int alertStrength) {
@@ -80,66 +150,74 @@ void Evaluator::queueAlert(AlertType alertType, int alertDuration, int alertStre
     alertType: alertType,
     alertDuration: alertDuration,
     alertStrength: alertStrength,
-    dbPassRate: 0
+    dbPassRate: 0,
+    sampleTimestamp: 0
   };
 
   // TODO: limit strength by settings if vibration
 
   xQueueSend(eventsQueue, &eq, portMAX_DELAY);
+  xTaskNotify(_taskHandle, EVALUATOR_NOTIFY_QUEUE, eSetBits);
+}
+
+void Evaluator::signalPass(int64_t sampleTimestamp) {
+  portENTER_CRITICAL(&_passMux);
+  _passTimestamp = sampleTimestamp;
+  portEXIT_CRITICAL(&_passMux);
+
+  xTaskNotify(_taskHandle, EVALUATOR_NOTIFY_PASS, eSetBits);
 }
 
 bool Evaluator::vibrateCollar(int strength, int duration) {
   ESP_LOGI(TAG, "Vibrating collar: %d, %d", strength, duration);
-  return OpenShock::CommandHandler::HandleCommand(
-    OpenShock::ShockerModelType::CaiXianlin, 
-    0, 
-    OpenShock::ShockerCommandType::Vibrate,
-    strength,
-    duration
-  );
+  return sendCommand(OpenShock::ShockerCommandType::Vibrate, strength, duration);
 }
 
 bool Evaluator::beepCollar(int duration) {
   ESP_LOGI(TAG, "Beeping collar: %d", duration);
-  return OpenShock::CommandHandler::HandleCommand(
-    OpenShock::ShockerModelType::CaiXianlin, 
-    0, 
-    OpenShock::ShockerCommandType::Sound,
-    100, 
-    duration
-  );
+  return sendCommand(OpenShock::ShockerCommandType::Sound, 100, duration);
 }
 
 bool Evaluator::shockCollar(int strength, int duration) {
   ESP_LOGI(TAG, "Shocking collar: %d", duration);
-  return OpenShock::CommandHandler::HandleCommand(
-    OpenShock::ShockerModelType::CaiXianlin, 
-    0, 
-    OpenShock::ShockerCommandType::Shock,
-    strength,
-    duration
-  );
+  return sendCommand(OpenShock::ShockerCommandType::Shock, strength, duration);
 }
 
 bool Evaluator::stopCollar() {
   ESP_LOGI(TAG, "Stopping collar");
-  return OpenShock::CommandHandler::HandleCommand(
-    OpenShock::ShockerModelType::CaiXianlin, 
-    0, 
-    OpenShock::ShockerCommandType::Stop,
-    0, 
-    0
-  );
+  return sendCommand(OpenShock::ShockerCommandType::Stop, 0, 0);
 }
 
-ConditionState Evaluator::evaluateConditions(double currentDb, int thresholdDb) {
+ConditionState Evaluator::evaluateConditions(const ConditionInputs &inputs) {
+  if (_conditionsDirty) {
+    compileConditions();
+  }
+
+  return _conditions.evaluate(inputs) ? ConditionState::REACHED : ConditionState::NOT_REACHED;
+}
 
-  // TODO: different evaluation methods
-  if (currentDb >= thresholdDb) {
-      return ConditionState::REACHED;
+void Evaluator::resetConditions() {
+  if (_conditionsDirty) {
+    compileConditions();
   }
+  _conditions.reset();
+}
 
-  return ConditionState::NOT_REACHED;
+bool Evaluator::needsSpectrum() {
+  if (_conditionsDirty) {
+    compileConditions();
+  }
+  return _conditions.usesSpectrum();
+}
+
+void Evaluator::compileConditions() {
+  _conditionsDirty = false;
+  _appSettingsService->read([&](AppSettings &settings) {
+    if (!_conditions.compile(settings.conditions, settings.detectHysteresisDb)) {
+      ESP_LOGW(TAG, "Only the first %d conditions are evaluated", CONDITION_MAX_TERMS);
+    }
+  });
+  ESP_LOGD(TAG, "Compiled conditions into %u ops", _conditions.size());
 }
 
 bool Evaluator::evaluatePassed(float passRate) {
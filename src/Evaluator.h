@@ -16,14 +16,25 @@
  **/
 
 #include <AppSettingsService.h>
+#include <ConditionProgram.h>
+#include <LatencyService.h>
+#include <SessionStatsService.h>
+
+#include <atomic>
 
 struct event_queue_t {
   AlertType alertType;
   int alertDuration;
   int alertStrength;
   float dbPassRate;
+  // esp_timer time of the audio block that triggered the event, 0 if none
+  int64_t sampleTimestamp;
 };
 
+// Task notification bits of the evaluator task
+#define EVALUATOR_NOTIFY_QUEUE  (1 << 0)
+#define EVALUATOR_NOTIFY_PASS   (1 << 1)
+
 enum ConditionState {
   NOT_EVALUATED,
   REACHED,
@@ -33,16 +44,20 @@ enum ConditionState {
 class Evaluator
 {
 public:
-    Evaluator(AppSettingsService *appSettingsService);
-    ConditionState evaluateConditions(double currentDb, int thresholdDb);
+    Evaluator(AppSettingsService *appSettingsService, SessionStatsService *sessionStats = nullptr);
+    ConditionState evaluateConditions(const ConditionInputs &inputs);
+    void resetConditions();
+    bool needsSpectrum();
     bool vibrateCollar(int strength, int duration);
     bool shockCollar(int strength, int duration);
     bool beepCollar(int duration);
     bool stopCollar();
     QueueHandle_t eventsQueue;
     void begin();
-    void queueEvaluation(float dbPassRate);
+    void queueEvaluation(float dbPassRate, int64_t sampleTimestamp = 0);
     void queueAlert(AlertType alertType, int alertDuration, int alertStrength);
+    void signalPass(int64_t sampleTimestamp);
+    uint32_t lastDecisionLatencyUs() const { return _lastDecisionLatencyUs; }
 
 protected:
     void task();
@@ -50,6 +65,16 @@ protected:
 
 private:
     AppSettingsService *_appSettingsService;
+    SessionStatsService *_sessionStats;
+    TaskHandle_t _taskHandle = nullptr;
+    portMUX_TYPE _passMux = portMUX_INITIALIZER_UNLOCKED;
+    int64_t _passTimestamp = 0;
+    volatile uint32_t _lastDecisionLatencyUs = 0;
+    // sample time carried by the first collar command of the current evaluation
+    int64_t _commandTimestamp = 0;
+    ConditionProgram _conditions;
+    std::atomic<bool> _conditionsDirty;
+    void compileConditions();
     void assignPassDetails(double &passThreshold);
     bool evaluatePassed(float passRate);
     void assignAffirmationSteps(
@@ -58,6 +83,9 @@ private:
     void assignCorrectionSteps(
         std::vector<EventStep> &correctionSteps
     );
+    void evaluate(float passRate, int64_t sampleTimestamp);
+    void recordDecision(int64_t sampleTimestamp);
+    bool sendCommand(OpenShock::ShockerCommandType type, int strength, int duration);
     void processStep(EventStep step, float passRate);
     void processCollarStep(EventStep step, float passRate);
     double valueFromRangeType(RangeType rangeType, std::vector<double> range, float passRate);
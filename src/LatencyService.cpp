@@ -0,0 +1,224 @@
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <LatencyService.h>
+#include <CommandHandler.h>
+#include <esp_timer.h>
+
+// values above this are clamped into the last bucket
+#define LATENCY_MAX_TRACKED_US ((1UL << 24) - 1)
+
+static const char *LATENCY_STAGE_NAMES[] = {"detect", "decision", "command", "transmit", "total", "stop"};
+
+LatencyHistogram LatencyService::_histograms[(uint8_t)LatencyStage::COUNT];
+portMUX_TYPE LatencyService::_mux = portMUX_INITIALIZER_UNLOCKED;
+
+uint8_t LatencyHistogram::bucketOf(uint32_t us)
+{
+  if (us > LATENCY_MAX_TRACKED_US)
+  {
+    us = LATENCY_MAX_TRACKED_US;
+  }
+  if (us < 4)
+  {
+    return us;
+  }
+  uint8_t msb = 31 - __builtin_clz(us);
+  uint8_t sub = (us >> (msb - 2)) & 0x03;
+  return (msb - 1) * 4 + sub;
+}
+
+uint32_t LatencyHistogram::upperBound(uint8_t bucket)
+{
+  if (bucket < 4)
+  {
+    return bucket;
+  }
+  uint8_t shift = bucket / 4 - 1;
+  uint32_t lower = (4UL + bucket % 4) << shift;
+  return lower + (1UL << shift) - 1;
+}
+
+void LatencyHistogram::record(uint32_t us)
+{
+  _buckets[bucketOf(us)]++;
+  _count++;
+  if (us > _max)
+  {
+    _max = us;
+  }
+}
+
+void LatencyHistogram::clear()
+{
+  for (uint8_t i = 0; i < BUCKETS; i++)
+  {
+    _buckets[i] = 0;
+  }
+  _count = 0;
+  _max = 0;
+}
+
+uint32_t LatencyHistogram::percentile(float p) const
+{
+  if (_count == 0)
+  {
+    return 0;
+  }
+
+  uint32_t rank = ceilf(p * _count);
+  if (rank == 0)
+  {
+    rank = 1;
+  }
+
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < BUCKETS; i++)
+  {
+    seen += _buckets[i];
+    if (seen >= rank)
+    {
+      uint32_t bound = upperBound(i);
+      return bound < _max ? bound : _max;
+    }
+  }
+  return _max;
+}
+
+LatencyService::LatencyService(PsychicHttpServer *server,
+                               SecurityManager *securityManager,
+                               AnalyticsService *analyticsService) : _server(server),
+                                                                     _securityManager(securityManager),
+                                                                     _analyticsService(analyticsService)
+{
+}
+
+void LatencyService::begin()
+{
+  _server->on(LATENCY_SERVICE_PATH,
+              HTTP_GET,
+              _securityManager->wrapRequest(std::bind(&LatencyService::latencyStatus, this, std::placeholders::_1),
+                                            AuthenticationPredicates::IS_AUTHENTICATED));
+
+  _server->on(LATENCY_SERVICE_PATH,
+              HTTP_POST,
+              _securityManager->wrapRequest(std::bind(&LatencyService::latencyReset, this, std::placeholders::_1),
+                                            AuthenticationPredicates::IS_ADMIN));
+
+  ESP_LOGV("LatencyService", "Registered GET and POST endpoint: %s", LATENCY_SERVICE_PATH);
+
+  if (_analyticsService)
+  {
+    _analyticsService->addAnalytics([](JsonObject &root) {
+      JsonObject latency = root.createNestedObject("latency");
+      read(latency);
+    });
+  }
+
+  OpenShock::CommandHandler::SetTransmitHook(onTransmit);
+  OpenShock::CommandHandler::SetStopHook(onStop);
+}
+
+void LatencyService::record(LatencyStage stage, int64_t sampleTimestamp)
+{
+  if (sampleTimestamp == 0)
+  {
+    return;
+  }
+  recordValue(stage, esp_timer_get_time() - sampleTimestamp);
+}
+
+void LatencyService::recordValue(LatencyStage stage, int64_t us)
+{
+  if (us < 0)
+  {
+    return;
+  }
+
+  portENTER_CRITICAL(&_mux);
+  _histograms[(uint8_t)stage].record(us > UINT32_MAX ? UINT32_MAX : us);
+  portEXIT_CRITICAL(&_mux);
+}
+
+void LatencyService::onTransmit(int64_t sampleTimestamp, int64_t queuedAt, int64_t transmittedAt)
+{
+  // keep-alives and manual commands carry no sample
+  if (sampleTimestamp == 0)
+  {
+    return;
+  }
+  recordValue(LatencyStage::TRANSMIT, transmittedAt - queuedAt);
+  recordValue(LatencyStage::TOTAL, transmittedAt - sampleTimestamp);
+}
+
+void LatencyService::onStop(int64_t requestedAt, int64_t transmittedAt)
+{
+  recordValue(LatencyStage::STOP, transmittedAt - requestedAt);
+}
+
+void LatencyService::read(JsonObject &root)
+{
+  // summarize inside the critical section, the JSON allocations must not run with interrupts disabled
+  uint32_t summary[(uint8_t)LatencyStage::COUNT][4];
+  portENTER_CRITICAL(&_mux);
+  for (uint8_t i = 0; i < (uint8_t)LatencyStage::COUNT; i++)
+  {
+    summary[i][0] = _histograms[i].count();
+    summary[i][1] = _histograms[i].percentile(0.5);
+    summary[i][2] = _histograms[i].percentile(0.99);
+    summary[i][3] = _histograms[i].max();
+  }
+  portEXIT_CRITICAL(&_mux);
+
+  for (uint8_t i = 0; i < (uint8_t)LatencyStage::COUNT; i++)
+  {
+    JsonObject stage = root.createNestedObject(LATENCY_STAGE_NAMES[i]);
+    stage["n"] = summary[i][0];
+    stage["p50"] = summary[i][1];
+    stage["p99"] = summary[i][2];
+    stage["max"] = summary[i][3];
+  }
+
+  uint32_t queued, dropped;
+  if (OpenShock::CommandHandler::GetTransmitterCounters(queued, dropped))
+  {
+    JsonObject rf = root.createNestedObject("rf");
+    rf["queued"] = queued;
+    rf["dropped"] = dropped;
+  }
+}
+
+void LatencyService::clear()
+{
+  portENTER_CRITICAL(&_mux);
+  for (uint8_t i = 0; i < (uint8_t)LatencyStage::COUNT; i++)
+  {
+    _histograms[i].clear();
+  }
+  portEXIT_CRITICAL(&_mux);
+}
+
+esp_err_t LatencyService::latencyStatus(PsychicRequest *request)
+{
+  PsychicJsonResponse response = PsychicJsonResponse(request, false, MAX_LATENCY_STATUS_SIZE);
+  JsonObject root = response.getRoot();
+  read(root);
+  return response.send();
+}
+
+esp_err_t LatencyService::latencyReset(PsychicRequest *request)
+{
+  clear();
+  return request->reply(200);
+}
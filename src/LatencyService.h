@@ -0,0 +1,94 @@
+#ifndef LatencyService_h
+#define LatencyService_h
+
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <ArduinoJson.h>
+#include <PsychicHttp.h>
+#include <SecurityManager.h>
+#include <AnalyticsService.h>
+
+#define MAX_LATENCY_STATUS_SIZE 1024
+#define LATENCY_SERVICE_PATH "/rest/latency"
+
+// Measured stages, relative to the DMA completion time of the audio block unless noted
+enum class LatencyStage : uint8_t {
+  // block read until the reader task has evaluated it
+  DETECT,
+  // block read until the evaluator task acts on a decision
+  DECISION,
+  // block read until the command is handed to the RF transmitter
+  COMMAND,
+  // command queued until its first frame is written to the RMT peripheral
+  TRANSMIT,
+  // block read until the first RF frame goes out
+  TOTAL,
+  // stop requested until the first RF frame after it goes out
+  STOP,
+  COUNT
+};
+
+/**
+ * Log linear histogram of microsecond values, four buckets per power of two.
+ * Values are exact below 8us and within 25% above, everything beyond ~16s is clamped.
+ */
+class LatencyHistogram
+{
+public:
+  static const uint8_t BUCKETS = 92;
+
+  void record(uint32_t us);
+  void clear();
+  uint32_t percentile(float p) const;
+  uint32_t count() const { return _count; }
+  uint32_t max() const { return _max; }
+
+private:
+  uint32_t _buckets[BUCKETS] = {0};
+  uint32_t _count = 0;
+  uint32_t _max = 0;
+
+  static uint8_t bucketOf(uint32_t us);
+  static uint32_t upperBound(uint8_t bucket);
+};
+
+class LatencyService
+{
+public:
+  LatencyService(PsychicHttpServer *server, SecurityManager *securityManager, AnalyticsService *analyticsService);
+
+  void begin();
+
+  // Records the time elapsed since sampleTimestamp, a zero timestamp is ignored
+  static void record(LatencyStage stage, int64_t sampleTimestamp);
+  static void read(JsonObject &root);
+  static void clear();
+
+private:
+  PsychicHttpServer *_server;
+  SecurityManager *_securityManager;
+  AnalyticsService *_analyticsService;
+
+  static LatencyHistogram _histograms[(uint8_t)LatencyStage::COUNT];
+  static portMUX_TYPE _mux;
+
+  static void recordValue(LatencyStage stage, int64_t us);
+  static void onTransmit(int64_t sampleTimestamp, int64_t queuedAt, int64_t transmittedAt);
+  static void onStop(int64_t requestedAt, int64_t transmittedAt);
+  esp_err_t latencyStatus(PsychicRequest *request);
+  esp_err_t latencyReset(PsychicRequest *request);
+};
+
+#endif
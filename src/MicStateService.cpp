@@ -44,7 +44,8 @@ MicStateService::MicStateService(
   PsychicHttpServer *server,
   SecurityManager *securityManager,
   PsychicMqttClient *mqttClient,
-  AppSettingsService *appSettingsService) : 
+  AppSettingsService *appSettingsService,
+  SessionStatsService *sessionStatsService) : 
     _httpEndpoint(
       MicState::read,
       MicState::update,
@@ -64,19 +65,43 @@ MicStateService::MicStateService(
       securityManager,
       AuthenticationPredicates::IS_AUTHENTICATED
     ),
+    _webSocketFrameServer(
+      MicState::readFrame,
+      this,
+      server,
+      MIC_STATE_FRAME_SOCKET_PATH,
+      securityManager,
+      AuthenticationPredicates::IS_AUTHENTICATED
+    ),
     _mqttClient(mqttClient),
-    _appSettingsService(appSettingsService)
-{}
+    _appSettingsService(appSettingsService),
+    _sessionStatsService(sessionStatsService)
+{
+  // a session lasts from enabling the mic state until it is disabled again
+  addUpdateHandler([&](const StateOrigin &origin) { onStateUpdated(); }, false);
+}
 
 void MicStateService::begin()
 {
     _httpEndpoint.begin();
     _webSocketServer.begin();
+    _webSocketFrameServer.begin();
+
+    // state updates serialize JSON and hit the network, keep them off the reader
+    xTaskCreatePinnedToCore(
+      this->_telemetryTaskRunner,
+      "micTelemetry",
+      4096,
+      this,
+      (tskIDLE_PRIORITY + 1),
+      &_telemetryTaskHandle,
+      ESP32SVELTEKIT_RUNNING_CORE
+    );
 
     _audioAnalyzer = new AudioAnalyzer();
     _audioAnalyzer->begin();
 
-    _evaluator = new Evaluator(_appSettingsService);
+    _evaluator = new Evaluator(_appSettingsService, _sessionStatsService);
     _evaluator->begin();
 
     setupReader();
@@ -111,6 +136,8 @@ void MicStateService::setupReader() {
     );
     // int sequenceDuration = actDuration;
     int eventCountdown = actDuration;
+    float smoothingMs = 0;
+    assignDetectionValues(smoothingMs);
 
     unsigned long currentTime = millis();
     unsigned long elapsedTime = currentTime - startTime;
@@ -124,10 +151,92 @@ void MicStateService::setupReader() {
     bool hasAlerted = false;
     bool doAlert = false;
     double decibels = -1;
+    double blockDecibels = 0;
+    unsigned long lastConditionTime = startTime;
+    unsigned long alertedTime = startTime;
+    unsigned long windowStartTime = startTime;
 
     // Read sum of samaples, calculated by 'i2s_reader_task'
     while (xQueueReceive(_audioAnalyzer->samplesQueue, &q, portMAX_DELAY)) {
+        // Leq over LEQ_PERIOD is only used for display, detection runs on every block
         decibels = _audioAnalyzer->getDecibels(q);
+        blockDecibels = _audioAnalyzer->getBlockDecibels(q, smoothingMs);
+
+        currentTime = millis();
+        elapsedTime = currentTime - startTime;  
+        
+        eventCountdown = actDuration - elapsedTime + idleDuration + (alertType == AlertType::NONE ? 0 : alertTime);
+
+        if (_state.enabled) {
+
+          // proceed to evaluation
+          if (eventCountdown <= 0) {
+            doEvaluation = true;
+            resetConditions = true;
+
+          // start evaluation window
+          } else if (eventCountdown <= actDuration) {
+            if (ticks == 0) {
+              ESP_LOGV(TAG, "Action window started");
+              _evaluator->resetConditions();
+              lastConditionTime = currentTime;
+              windowStartTime = currentTime;
+            }
+            ticks += 1;
+
+            ConditionInputs inputs = {
+              decibels: static_cast<float>(blockDecibels),
+              pitch: q.pitch,
+              thresholdDb: static_cast<float>(thresholdDb),
+              bands: isnan(q.bands[0]) ? nullptr : q.bands,
+              elapsedMs: static_cast<uint16_t>(currentTime - lastConditionTime)
+            };
+            lastConditionTime = currentTime;
+
+            bool reached = _evaluator->evaluateConditions(inputs) == ConditionState::REACHED;
+            _sessionStatsService->recordBlock(blockDecibels >= thresholdDb, AudioAnalyzer::blockDurationUs());
+
+            if (reached) {
+              // reaction time is taken from the alert, or from the window start if there was none
+              if (ticksPassed == 0) {
+                _sessionStatsService->recordReaction(currentTime - (hasAlerted ? alertedTime : windowStartTime));
+              }
+              ticksPassed += 1;
+
+              // if setup to stop on the first pass, signal the evaluator right away,
+              // otherwise, continue to accumulate ticks and evaluate at the end
+              if (passType == PassType::FIRST_PASS) {
+                dbPassRate = 1;
+                _evaluator->signalPass(q.timestamp);
+                resetConditions = true;
+              }
+            }
+
+            if (!resetConditions) {
+              dbPassRate = (float)ticksPassed / ticks;
+            }
+
+          // start alert window
+          } else if (!hasAlerted && eventCountdown <= actDuration + alertTime) {
+            hasAlerted = true;
+            doAlert = true;
+            alertedTime = currentTime;
+          }
+
+
+        } else {
+            startTime = currentTime;
+        }
+
+        LatencyService::record(LatencyStage::DETECT, q.timestamp);
+
+        if (doEvaluation) {
+          _evaluator->queueEvaluation(dbPassRate, q.timestamp);
+          doEvaluation = false;
+        } else if (doAlert) {
+          _evaluator->queueAlert(alertType, alertDuration, alertStrength);
+          doAlert = false;
+        }
 
         // When we gather enough samples, calculate new Leq value
         if (decibels != -1) {
@@ -137,88 +246,41 @@ void MicStateService::setupReader() {
             
             // Serial output, customize (or remove) as needed
             // Serial.printf("%.1fdB\n", decibels);
-            currentTime = millis();
-            elapsedTime = currentTime - startTime;  
-            
-            eventCountdown = actDuration - elapsedTime + idleDuration + (alertType == AlertType::NONE ? 0 : alertTime);
-            
-            if (_state.enabled) {
 
-              // proceed to evaluation
-              if (eventCountdown <= 0) {
-                doEvaluation = true;
-                resetConditions = true;
-
-              // start evaluation window
-              } else if (eventCountdown <= actDuration) {
-                Serial.println("--------- ACTION WINDOW --------------");
-                ticks += 1;
-
-                if (_evaluator->evaluateConditions(decibels, thresholdDb) == ConditionState::REACHED) {
-                  ticksPassed += 1;
-
-                  // if setup to stop on the first pass, proceed to evaluation
-                  // otherwise, continue to accumulate ticks and evaluate at the end
-                  if (passType == PassType::FIRST_PASS) {
-                    dbPassRate = 1;
-                    doEvaluation = true;
-                    resetConditions = true;
-                  }
-                }
-
-                if (!doEvaluation) {
-                  dbPassRate = (float)ticksPassed / ticks;
-                }
-
-              // start alert window
-              } else if (!hasAlerted && eventCountdown <= actDuration + alertTime) {
-                hasAlerted = true;
-                doAlert = true;
-              }
+            // only run the FFT when a pitch or band condition needs it
+            _audioAnalyzer->setSpectrumEnabled(_evaluator->needsSpectrum());
 
-
-            } else {
-                startTime = currentTime;
-            }
-
-            // Update the state, emitting change event if value changed
-            updateState(
+            // Hand the values to the telemetry task, emitting change event if value changed
+            publishState(
               decibels, 
               q.pitch, 
               elapsedTime <= (idleDuration + alertTime) ? -1 : eventCountdown,
               thresholdDb,
               dbPassRate
             );
+        }
 
-            if (doEvaluation) {
-              _evaluator->queueEvaluation(dbPassRate);
-              doEvaluation = false;
-            } else if (doAlert) {
-              _evaluator->queueAlert(alertType, alertDuration, alertStrength);
-              doAlert = false;
-            }
+        if (resetConditions) {
+            resetConditions = false;
 
-            if (resetConditions) {
-                resetConditions = false;
-
-                // NOTE: maybe delay accordingly
-                startTime = currentTime;
-
-                assignRoutineConditionValues(
-                  thresholdDb, 
-                  idleDuration, 
-                  actDuration, 
-                  alertType, 
-                  alertDuration, 
-                  alertStrength,
-                  passType
-                );
-                // sequenceDuration = actDuration;
-                ticks = 0;
-                ticksPassed = 0;
-                dbPassRate = 0;
-                hasAlerted = false;
-            }
+            // NOTE: maybe delay accordingly
+            startTime = currentTime;
+
+            assignRoutineConditionValues(
+              thresholdDb, 
+              idleDuration, 
+              actDuration, 
+              alertType, 
+              alertDuration, 
+              alertStrength,
+              passType
+            );
+            assignDetectionValues(smoothingMs);
+            // sequenceDuration = actDuration;
+            ticks = 0;
+            ticksPassed = 0;
+            dbPassRate = 0;
+            hasAlerted = false;
         }
     
         // Debug only
@@ -226,6 +288,61 @@ void MicStateService::setupReader() {
     }
 }
 
+void MicStateService::onStateUpdated() {
+  bool enabled = false;
+  read([&](MicState &state) { enabled = state.enabled; });
+  if (enabled == _sessionEnabled) {
+    return;
+  }
+
+  _sessionEnabled = enabled;
+  if (enabled) {
+    _sessionStatsService->beginSession();
+  } else {
+    _sessionStatsService->endSession();
+  }
+}
+
+void MicStateService::publishState(
+  float dbValue, 
+  float pitchValue, 
+  int eventCountdown,
+  int thresholdDb,
+  float dbPassRate
+) {
+  // only the latest values are kept, a busy telemetry task skips intermediate ones
+  portENTER_CRITICAL(&_telemetryMux);
+  _telemetry = {
+    dbValue: dbValue,
+    pitchValue: pitchValue,
+    eventCountdown: eventCountdown,
+    thresholdDb: thresholdDb,
+    dbPassRate: dbPassRate
+  };
+  portEXIT_CRITICAL(&_telemetryMux);
+
+  xTaskNotifyGive(_telemetryTaskHandle);
+}
+
+void MicStateService::telemetryTask() {
+  mic_telemetry_t telemetry;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    portENTER_CRITICAL(&_telemetryMux);
+    telemetry = _telemetry;
+    portEXIT_CRITICAL(&_telemetryMux);
+
+    updateState(
+      telemetry.dbValue,
+      telemetry.pitchValue,
+      telemetry.eventCountdown,
+      telemetry.thresholdDb,
+      telemetry.dbPassRate
+    );
+  }
+}
+
 void MicStateService::updateState(
   float dbValue, 
   float pitchValue, 
@@ -233,15 +350,20 @@ void MicStateService::updateState(
   int thresholdDb,
   float dbPassRate
 ) {
+  uint32_t decisionLatencyUs = _evaluator->lastDecisionLatencyUs();
   update([&](MicState& state) {
-    if (state.dbValue == dbValue && state.eventCountdown == eventCountdown) {
-      return StateUpdateResult::UNCHANGED;
-    }
+    // every published field takes part, not only the level and countdown
+    MicState before = state;
     state.dbValue = dbValue;
     state.dbThreshold = eventCountdown == -1 ? 0 : thresholdDb;
     state.dbPassRate = dbPassRate;
     state.pitchValue = pitchValue;
     state.eventCountdown = eventCountdown;
+    state.decisionLatencyUs = decisionLatencyUs;
+    if (!StateFields<MicState>::diff(before, state)) {
+      return StateUpdateResult::UNCHANGED;
+    }
+    state.sequence++;
     return StateUpdateResult::CHANGED;
   }, "db_set");
 }
@@ -280,3 +402,9 @@ void MicStateService::assignRoutineConditionValues(
     passType = settings.passType;
   });
 }
+
+void MicStateService::assignDetectionValues(float &smoothingMs) {
+  _appSettingsService->read([&](AppSettings &settings) {
+    smoothingMs = settings.detectSmoothingMs;
+  });
+}
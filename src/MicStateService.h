@@ -20,11 +20,45 @@
 #include <HttpEndpoint.h>
 #include <MqttPubSub.h>
 #include <WebSocketServer.h>
+#include <WebSocketFrameServer.h>
 #include <AudioAnalyzer.h>
+#include <LatencyService.h>
+#include <SessionStatsService.h>
+#include <StateFields.h>
 // #include <WebSocketClient.h>
 
 #define MIC_STATE_ENDPOINT_PATH "/rest/micState"
 #define MIC_STATE_SOCKET_PATH "/ws/micState"
+#define MIC_STATE_FRAME_SOCKET_PATH "/ws/micStateFrame"
+
+#define MIC_STATE_FRAME_VERSION 1
+#define MIC_STATE_FRAME_ENABLED 0x01
+
+// Fixed layout, little endian binary form of MicState streamed on MIC_STATE_FRAME_SOCKET_PATH
+struct __attribute__((packed)) MicStateFrame
+{
+    uint8_t version;
+    uint8_t flags;
+    uint16_t sequence;
+    float dbValue;
+    float dbThreshold;
+    float pitchValue;
+    float pitchThreshold;
+    int32_t eventCountdown;
+    float dbPassRate;
+    float pitchPassRate;
+    uint32_t decisionLatencyUs;
+};
+
+// Latest values produced by the reader, published by the telemetry task
+struct mic_telemetry_t
+{
+    float dbValue;
+    float pitchValue;
+    int eventCountdown;
+    int thresholdDb;
+    float dbPassRate;
+};
 
 class MicState
 {
@@ -36,29 +70,57 @@ public:
     int eventCountdown = 0;
     float dbPassRate = 0;
     float pitchPassRate = 0;
+    // time from the deciding audio block to the evaluator acting on it
+    uint32_t decisionLatencyUs = 0;
 
     bool enabled = false;
 
+    // counts the changes of the state, every frame of the same state carries the same number
+    uint16_t sequence = 0;
+
+    // only the enabled flag is taken from clients, the rest is telemetry
+    static constexpr auto fields()
+    {
+        return std::make_tuple(
+            stateField("dbt", &MicState::dbThreshold, FieldAccess::READ_ONLY),
+            stateField("dbv", &MicState::dbValue, FieldAccess::READ_ONLY),
+            stateField("ecd", &MicState::eventCountdown, FieldAccess::READ_ONLY),
+            stateField("pv", &MicState::pitchValue, FieldAccess::READ_ONLY),
+            stateField("pt", &MicState::pitchThreshold, FieldAccess::READ_ONLY),
+            stateField("en", &MicState::enabled),
+            stateField("dpr", &MicState::dbPassRate, FieldAccess::READ_ONLY),
+            stateField("ppr", &MicState::pitchPassRate, FieldAccess::READ_ONLY),
+            stateField("dlu", &MicState::decisionLatencyUs, FieldAccess::READ_ONLY));
+    }
+
     static void read(MicState &settings, JsonObject &root)
     {
-        root["dbt"] = settings.dbThreshold;
-        root["dbv"] = settings.dbValue;
-        root["ecd"] = settings.eventCountdown;
-        root["pv"] = settings.pitchValue;
-        root["pt"] = settings.pitchThreshold;
-        root["en"] = settings.enabled;
-        root["dpr"] = settings.dbPassRate;
-        root["ppr"] = settings.pitchPassRate;
+        StateFields<MicState>::read(settings, root);
+    }
+
+    static void readFrame(MicState &settings, MicStateFrame &frame)
+    {
+        frame.version = MIC_STATE_FRAME_VERSION;
+        frame.flags = settings.enabled ? MIC_STATE_FRAME_ENABLED : 0;
+        frame.sequence = settings.sequence;
+        frame.dbValue = settings.dbValue;
+        frame.dbThreshold = settings.dbThreshold;
+        frame.pitchValue = settings.pitchValue;
+        frame.pitchThreshold = settings.pitchThreshold;
+        frame.eventCountdown = settings.eventCountdown;
+        frame.dbPassRate = settings.dbPassRate;
+        frame.pitchPassRate = settings.pitchPassRate;
+        frame.decisionLatencyUs = settings.decisionLatencyUs;
     }
 
     static StateUpdateResult update(JsonObject &root, MicState &micState)
     {
-        boolean newEnabled = root["en"] | micState.enabled;
-        if (micState.enabled != newEnabled) {
-            micState.enabled = newEnabled;
-            return StateUpdateResult::CHANGED;
+        if (!StateFields<MicState>::update(root, micState))
+        {
+            return StateUpdateResult::UNCHANGED;
         }
-        return StateUpdateResult::UNCHANGED;
+        micState.sequence++;
+        return StateUpdateResult::CHANGED;
     }
 };
 
@@ -69,7 +131,8 @@ public:
         PsychicHttpServer *server,
         SecurityManager *securityManager,
         PsychicMqttClient *mqttClient,
-        AppSettingsService *appSettingsService
+        AppSettingsService *appSettingsService,
+        SessionStatsService *sessionStatsService
     );
     void begin();
     void setupReader();
@@ -86,14 +149,32 @@ protected:
         int &alertStrength,
         PassType &passType
     );
+    void assignDetectionValues(float &smoothingMs);
 
 private:
     HttpEndpoint<MicState> _httpEndpoint;
     MqttPubSub<MicState> _mqttPubSub;
     WebSocketServer<MicState> _webSocketServer;
+    WebSocketFrameServer<MicState, MicStateFrame> _webSocketFrameServer;
     PsychicMqttClient *_mqttClient;
     AppSettingsService *_appSettingsService;
+    SessionStatsService *_sessionStatsService;
+    bool _sessionEnabled = false;
 
+    void onStateUpdated();
+    TaskHandle_t _telemetryTaskHandle = nullptr;
+    portMUX_TYPE _telemetryMux = portMUX_INITIALIZER_UNLOCKED;
+    mic_telemetry_t _telemetry;
+
+    static void _telemetryTaskRunner(void *_this) { static_cast<MicStateService *>(_this)->telemetryTask(); }
+    void telemetryTask();
+    void publishState(
+        float dbValue, 
+        float pitchValue, 
+        int actCountdown,
+        int thresholdDb,
+        float dbPassRate
+    );
     void registerConfig();
     void updateState(
         float dbValue, 
@@ -0,0 +1,166 @@
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <SessionHistory.h>
+
+void SessionAggregate::begin(uint32_t startedAt)
+{
+    _record = {};
+    _record.version = SESSION_RECORD_VERSION;
+    _record.startedAt = startedAt;
+    _windowUs = 0;
+    _aboveUs = 0;
+}
+
+void SessionAggregate::recordBlock(bool above, uint32_t blockUs)
+{
+    _windowUs += blockUs;
+    if (above)
+    {
+        _aboveUs += blockUs;
+    }
+}
+
+void SessionAggregate::recordReaction(uint32_t reactionMs)
+{
+    if (_record.reactions == UINT16_MAX)
+    {
+        return;
+    }
+    _record.reactions++;
+    _record.reactionMeanMs += (reactionMs - _record.reactionMeanMs) / _record.reactions;
+    if (_record.reactions == 1 || reactionMs < _record.reactionMinMs)
+    {
+        _record.reactionMinMs = reactionMs;
+    }
+    if (reactionMs > _record.reactionMaxMs)
+    {
+        _record.reactionMaxMs = reactionMs;
+    }
+}
+
+void SessionAggregate::recordEvaluation(float passRate, bool passed)
+{
+    if (_record.evaluations == UINT16_MAX)
+    {
+        return;
+    }
+
+    passRate = constrain(passRate, 0.0f, 1.0f);
+    uint8_t bin = passRate * SESSION_PASS_RATE_BINS;
+    if (bin >= SESSION_PASS_RATE_BINS)
+    {
+        bin = SESSION_PASS_RATE_BINS - 1;
+    }
+
+    _record.evaluations++;
+    _record.passRateMean += (passRate - _record.passRateMean) / _record.evaluations;
+    _record.passRateBins[bin]++;
+    if (passed)
+    {
+        _record.affirmations++;
+    }
+    else
+    {
+        _record.corrections++;
+    }
+}
+
+SessionRecord SessionAggregate::finish(uint32_t durationS) const
+{
+    SessionRecord record = _record;
+    record.durationS = durationS;
+    record.windowMs = _windowUs / 1000;
+    record.aboveMs = _aboveUs / 1000;
+    return record;
+}
+
+void SessionHistory::begin()
+{
+    // power was lost before the rename, the old history is still valid
+    String tempPath = String(SESSION_HISTORY_FILE) + ".tmp";
+    if (_fs->exists(tempPath))
+    {
+        _fs->remove(tempPath);
+    }
+
+    forEach([this](const SessionRecord &record)
+            {
+        if (record.id >= _nextId)
+        {
+            _nextId = record.id + 1;
+        } });
+}
+
+bool SessionHistory::append(SessionRecord &record)
+{
+    record.id = _nextId++;
+
+    // until the ring is full every record is appended, slots lost with an unreadable file stay empty and are skipped
+    std::vector<uint8_t> ring = readRing();
+    size_t offset = (record.id % SESSION_HISTORY_MAX) * sizeof(SessionRecord);
+    if (ring.size() < offset + sizeof(SessionRecord))
+    {
+        ring.resize(offset + sizeof(SessionRecord), 0);
+    }
+    memcpy(ring.data() + offset, &record, sizeof(SessionRecord));
+
+    String tempPath = String(SESSION_HISTORY_FILE) + ".tmp";
+    File file = _fs->open(tempPath, "w", true);
+    if (!file)
+    {
+        return false;
+    }
+    size_t written = file.write(ring.data(), ring.size());
+    file.close();
+
+    if (written != ring.size() || !_fs->rename(tempPath, SESSION_HISTORY_FILE))
+    {
+        _fs->remove(tempPath);
+        return false;
+    }
+    return true;
+}
+
+void SessionHistory::forEach(std::function<void(const SessionRecord &record)> callback)
+{
+    std::vector<uint8_t> ring = readRing();
+    for (size_t offset = 0; offset < ring.size(); offset += sizeof(SessionRecord))
+    {
+        SessionRecord record;
+        memcpy(&record, ring.data() + offset, sizeof(SessionRecord));
+        if (record.version == SESSION_RECORD_VERSION)
+        {
+            callback(record);
+        }
+    }
+}
+
+std::vector<uint8_t> SessionHistory::readRing()
+{
+    std::vector<uint8_t> ring;
+    File file = _fs->open(SESSION_HISTORY_FILE, "r");
+    if (!file)
+    {
+        return ring;
+    }
+
+    ring.resize(file.size() / sizeof(SessionRecord) * sizeof(SessionRecord));
+    if (file.read(ring.data(), ring.size()) != ring.size())
+    {
+        ring.clear();
+    }
+    file.close();
+    return ring;
+}
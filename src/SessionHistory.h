@@ -0,0 +1,105 @@
+#ifndef SessionHistory_h
+#define SessionHistory_h
+
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <Arduino.h>
+#include <FS.h>
+#include <functional>
+#include <vector>
+
+#define SESSION_HISTORY_FILE "/config/sessionHistory.dat"
+#define SESSION_HISTORY_MAX 32
+
+#define SESSION_RECORD_VERSION 1
+#define SESSION_PASS_RATE_BINS 10
+
+// Summary of one session, stored as a fixed size record in a ring of SESSION_HISTORY_MAX entries
+struct __attribute__((packed)) SessionRecord
+{
+    uint8_t version;
+    uint32_t id;
+    // unix time, 0 if the clock was not synchronized
+    uint32_t startedAt;
+    uint32_t durationS;
+    // time spent in action windows, and how much of it was above the threshold
+    uint32_t windowMs;
+    uint32_t aboveMs;
+    uint16_t evaluations;
+    uint16_t affirmations;
+    uint16_t corrections;
+    float passRateMean;
+    uint16_t passRateBins[SESSION_PASS_RATE_BINS];
+    // time from the alert (or window start without alert) to the first pass
+    uint16_t reactions;
+    float reactionMeanMs;
+    uint32_t reactionMinMs;
+    uint32_t reactionMaxMs;
+};
+
+/**
+ * Statistics of the running session, updated in O(1) per call. The raw events are never stored.
+ * Not synchronized, SessionStatsService guards it.
+ */
+class SessionAggregate
+{
+public:
+    void begin(uint32_t startedAt);
+
+    void recordBlock(bool above, uint32_t blockUs);
+    void recordReaction(uint32_t reactionMs);
+    void recordEvaluation(float passRate, bool passed);
+
+    // the record of the session so far, without an id
+    SessionRecord finish(uint32_t durationS) const;
+
+private:
+    SessionRecord _record = {};
+    // blocks are summed in microseconds, a block does not have to last a whole number of milliseconds
+    uint64_t _windowUs = 0;
+    uint64_t _aboveUs = 0;
+};
+
+/**
+ * The ring of session records in SESSION_HISTORY_FILE, record id modulo SESSION_HISTORY_MAX is its slot.
+ *
+ * The file is small, every append rewrites it through a temporary file and a rename. A power loss
+ * therefore leaves either the old or the new history, never a half written record.
+ */
+class SessionHistory
+{
+public:
+    explicit SessionHistory(FS *fs) : _fs(fs) {}
+
+    // drops a temporary file left by a lost write and continues after the highest stored id
+    void begin();
+
+    // stores the record under the next id, replacing the oldest record once the ring is full
+    bool append(SessionRecord &record);
+
+    // every record of the current version, in slot order
+    void forEach(std::function<void(const SessionRecord &record)> callback);
+
+    uint32_t nextId() const { return _nextId; }
+
+private:
+    FS *_fs;
+    uint32_t _nextId = 0;
+
+    // the whole records in the file, a partial one at the end is dropped
+    std::vector<uint8_t> readRing();
+};
+
+#endif
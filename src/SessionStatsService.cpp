@@ -0,0 +1,137 @@
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <SessionStatsService.h>
+#include <time.h>
+
+// anything earlier means NTP has not set the clock yet
+#define SESSION_MIN_VALID_TIME 1600000000
+
+SessionStatsService::SessionStatsService(PsychicHttpServer *server,
+                                         FS *fs,
+                                         SecurityManager *securityManager) : _server(server),
+                                                                             _securityManager(securityManager),
+                                                                             _history(fs)
+{
+}
+
+void SessionStatsService::begin()
+{
+    _history.begin();
+
+    _server->on(SESSION_HISTORY_SERVICE_PATH,
+                HTTP_GET,
+                _securityManager->wrapRequest(std::bind(&SessionStatsService::sessionHistory, this, std::placeholders::_1),
+                                              AuthenticationPredicates::IS_AUTHENTICATED));
+
+    ESP_LOGV("SessionStatsService", "Registered GET endpoint: %s", SESSION_HISTORY_SERVICE_PATH);
+}
+
+void SessionStatsService::beginSession()
+{
+    time_t now = time(nullptr);
+
+    portENTER_CRITICAL(&_mux);
+    _current.begin(now >= SESSION_MIN_VALID_TIME ? now : 0);
+    _startedMs = millis();
+    _active = true;
+    portEXIT_CRITICAL(&_mux);
+}
+
+void SessionStatsService::endSession()
+{
+    SessionRecord record;
+
+    portENTER_CRITICAL(&_mux);
+    bool active = _active;
+    _active = false;
+    record = _current.finish((millis() - _startedMs) / 1000);
+    portEXIT_CRITICAL(&_mux);
+
+    // nothing was evaluated, not worth a history entry
+    if (!active || record.windowMs == 0)
+    {
+        return;
+    }
+
+    if (!_history.append(record))
+    {
+        ESP_LOGW("SessionStatsService", "Failed to persist session %u", record.id);
+    }
+}
+
+void SessionStatsService::recordBlock(bool above, uint32_t blockUs)
+{
+    portENTER_CRITICAL(&_mux);
+    if (_active)
+    {
+        _current.recordBlock(above, blockUs);
+    }
+    portEXIT_CRITICAL(&_mux);
+}
+
+void SessionStatsService::recordReaction(uint32_t reactionMs)
+{
+    portENTER_CRITICAL(&_mux);
+    if (_active)
+    {
+        _current.recordReaction(reactionMs);
+    }
+    portEXIT_CRITICAL(&_mux);
+}
+
+void SessionStatsService::recordEvaluation(float passRate, bool passed)
+{
+    portENTER_CRITICAL(&_mux);
+    if (_active)
+    {
+        _current.recordEvaluation(passRate, passed);
+    }
+    portEXIT_CRITICAL(&_mux);
+}
+
+void SessionStatsService::readRecord(const SessionRecord &record, JsonObject &root)
+{
+    root["id"] = record.id;
+    root["started_at"] = record.startedAt;
+    root["duration_s"] = record.durationS;
+    root["window_ms"] = record.windowMs;
+    root["above_ms"] = record.aboveMs;
+    root["evaluations"] = record.evaluations;
+    root["affirmations"] = record.affirmations;
+    root["corrections"] = record.corrections;
+    root["pass_rate_mean"] = record.passRateMean;
+    JsonArray bins = root.createNestedArray("pass_rate_bins");
+    for (uint8_t i = 0; i < SESSION_PASS_RATE_BINS; i++)
+    {
+        bins.add(record.passRateBins[i]);
+    }
+    root["reactions"] = record.reactions;
+    root["reaction_mean_ms"] = record.reactionMeanMs;
+    root["reaction_min_ms"] = record.reactionMinMs;
+    root["reaction_max_ms"] = record.reactionMaxMs;
+}
+
+esp_err_t SessionStatsService::sessionHistory(PsychicRequest *request)
+{
+    PsychicJsonResponse response = PsychicJsonResponse(request, true, MAX_SESSION_HISTORY_SIZE);
+    JsonArray root = response.getRoot().as<JsonArray>();
+
+    _history.forEach([&root](const SessionRecord &record)
+                     {
+        JsonObject entry = root.createNestedObject();
+        readRecord(record, entry); });
+
+    return response.send();
+}
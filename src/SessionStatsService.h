@@ -0,0 +1,61 @@
+#ifndef SessionStatsService_h
+#define SessionStatsService_h
+
+/**
+ *   ESP32 SvelteKit
+ *
+ *   A simple, secure and extensible framework for IoT projects for ESP32 platforms
+ *   with responsive Sveltekit front-end built with TailwindCSS and DaisyUI.
+ *   https://github.com/theelims/ESP32-sveltekit
+ *
+ *   Copyright (C) 2018 - 2023 rjwats
+ *   Copyright (C) 2023 theelims
+ *
+ *   All Rights Reserved. This software may be modified and distributed under
+ *   the terms of the LGPL v3 license. See the LICENSE file for details.
+ **/
+
+#include <ArduinoJson.h>
+#include <PsychicHttp.h>
+#include <SecurityManager.h>
+#include <FS.h>
+#include <SessionHistory.h>
+
+#define SESSION_HISTORY_SERVICE_PATH "/rest/sessionHistory"
+#define MAX_SESSION_HISTORY_SIZE 16384
+
+/**
+ * Aggregates statistics of the running session incrementally and appends a record to the session
+ * history when it ends. The record calls come from the audio and evaluator tasks, _mux guards them.
+ */
+class SessionStatsService
+{
+public:
+    SessionStatsService(PsychicHttpServer *server, FS *fs, SecurityManager *securityManager);
+
+    void begin();
+
+    void beginSession();
+    void endSession();
+
+    // called by the reader for every audio block inside an action window
+    void recordBlock(bool above, uint32_t blockUs);
+    void recordReaction(uint32_t reactionMs);
+    // called by the evaluator for every graded or first pass decision
+    void recordEvaluation(float passRate, bool passed);
+
+private:
+    PsychicHttpServer *_server;
+    SecurityManager *_securityManager;
+    SessionHistory _history;
+
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+    bool _active = false;
+    uint32_t _startedMs = 0;
+    SessionAggregate _current;
+
+    static void readRecord(const SessionRecord &record, JsonObject &root);
+    esp_err_t sessionHistory(PsychicRequest *request);
+};
+
+#endif
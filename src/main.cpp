@@ -15,6 +15,9 @@
 #include <ESP32SvelteKit.h>
 #include <AppSettingsService.h>
 #include <MicStateService.h>
+#include <LatencyService.h>
+#include <SessionStatsService.h>
+#include <EStopManager.h>
 // #include <PsychicHttpServer.h>
 
 // -------------
@@ -25,10 +28,23 @@ ESP32SvelteKit esp32sveltekit(&server, 115);
 AppSettingsService appSettingsService =
     AppSettingsService(&server, esp32sveltekit.getFS(), esp32sveltekit.getSecurityManager());
 
+SessionStatsService sessionStatsService =
+    SessionStatsService(&server, esp32sveltekit.getFS(), esp32sveltekit.getSecurityManager());
+
 MicStateService micStateService = MicStateService(&server,
                                                         esp32sveltekit.getSecurityManager(),
                                                         esp32sveltekit.getMqttClient(),
-                                                        &appSettingsService);
+                                                        &appSettingsService,
+                                                        &sessionStatsService);
+
+LatencyService latencyService = LatencyService(&server,
+                                               esp32sveltekit.getSecurityManager(),
+#if FT_ENABLED(FT_ANALYTICS)
+                                               esp32sveltekit.getAnalyticsService()
+#else
+                                               nullptr
+#endif
+);
 
 
 
@@ -42,7 +58,11 @@ void setup()
   delay(1000); // Safety
     
   esp32sveltekit.begin();
+  // the e-stop task and interrupt need the scheduler, so not from a constructor during static init
+  OpenShock::EStopManager::Init(20);
   appSettingsService.begin();
+  latencyService.begin();
+  sessionStatsService.begin();
   micStateService.begin();
 }
 
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <esp32-hal-log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+class String : public std::string {
+public:
+  String() { }
+  String(const char* value) : std::string(value) { }
+  String(const std::string& value) : std::string(value) { }
+  explicit String(int value) : std::string(std::to_string(value)) { }
+
+  int indexOf(const char* value) const {
+    std::size_t index = find(value);
+    return index == npos ? -1 : static_cast<int>(index);
+  }
+  int indexOf(char value, int from = 0) const {
+    std::size_t index = find(value, from);
+    return index == npos ? -1 : static_cast<int>(index);
+  }
+  String substring(int from, int to) const { return substr(from, to - from); }
+  bool concat(const char* value, unsigned int length) {
+    append(value, length);
+    return true;
+  }
+};
+
+inline String operator+(const char* left, const String& right) {
+  return String(left) += right;
+}
+
+inline unsigned long micros() {
+  return static_cast<unsigned long>(esp_timer_get_time());
+}
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+using std::max;
+using std::min;
@@ -0,0 +1,1282 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A small stand-in for ArduinoJson 6. Values are kept, so state can be written and read back, and documents
+// account for the memory a real document would take, so pooling and overflow handling can be tested. The
+// JSON and MessagePack codecs follow the formats, their speed is not the one of ArduinoJson.
+
+class JsonArray;
+class JsonDocument;
+class JsonObject;
+
+struct JsonNode {
+  enum Type {
+    NUL,
+    BOOLEAN,
+    INTEGER,
+    FLOAT,
+    STRING,
+    ARRAY,
+    OBJECT
+  };
+
+  Type type = NUL;
+  bool boolean = false;
+  std::int64_t integer = 0;
+  double real = 0;
+  // Set for values assigned as float, they are written with float precision
+  bool single = false;
+  std::string string;
+  std::vector<JsonNode*> elements;
+  std::vector<std::pair<std::string, JsonNode*>> members;
+
+  void reset(Type to) {
+    type    = to;
+    boolean = false;
+    integer = 0;
+    real    = 0;
+    single  = false;
+    string.clear();
+    elements.clear();
+    members.clear();
+  }
+
+  JsonNode* member(const char* key) const {
+    for (const auto& member : members) {
+      if (member.first == key) {
+        return member.second;
+      }
+    }
+    return nullptr;
+  }
+};
+
+class JsonDocument {
+public:
+  // What a real document takes for one member or element
+  static constexpr std::size_t SLOT_SIZE = 16;
+  // Deeper input is refused, like ArduinoJson's default nesting limit
+  static constexpr int NESTING_LIMIT = 10;
+
+  JsonDocument(const JsonDocument&)            = delete;
+  JsonDocument& operator=(const JsonDocument&) = delete;
+
+  std::size_t capacity() const { return m_capacity; }
+  std::size_t memoryUsage() const { return m_used; }
+  bool overflowed() const { return m_overflowed; }
+
+  void clear() {
+    m_nodes.clear();
+    m_root.reset(JsonNode::NUL);
+    m_used       = 0;
+    m_overflowed = false;
+  }
+
+  template<typename T>
+  T to();
+  template<typename T>
+  T as();
+  template<typename T>
+  bool is();
+
+  class JsonVariant operator[](const char* key);
+  class JsonVariant operator[](const String& key);
+  bool containsKey(const char* key) const { return m_root.type == JsonNode::OBJECT && m_root.member(key) != nullptr; }
+
+  // Takes bytes from the pool, false and marked overflowed once the capacity is exceeded
+  bool allocate(std::size_t bytes) {
+    if (m_used + bytes > m_capacity) {
+      m_overflowed = true;
+      return false;
+    }
+    m_used += bytes;
+    return true;
+  }
+
+  // A new member or element, nullptr once the pool is exhausted
+  JsonNode* newNode() {
+    if (!allocate(SLOT_SIZE)) {
+      return nullptr;
+    }
+    m_nodes.emplace_back();
+    return &m_nodes.back();
+  }
+
+  JsonNode* root() { return &m_root; }
+  const JsonNode* root() const { return &m_root; }
+
+protected:
+  explicit JsonDocument(std::size_t capacity) : m_capacity(capacity), m_used(0), m_overflowed(false) { }
+  ~JsonDocument() = default;
+
+private:
+  std::size_t m_capacity;
+  std::size_t m_used;
+  bool m_overflowed;
+  JsonNode m_root;
+  // A deque keeps the nodes in place while it grows
+  std::deque<JsonNode> m_nodes;
+};
+
+class DynamicJsonDocument : public JsonDocument {
+public:
+  explicit DynamicJsonDocument(std::size_t capacity) : JsonDocument(capacity), m_pool(new char[capacity]) {
+    allocations++;
+    liveBytes += capacity;
+  }
+  ~DynamicJsonDocument() {
+    liveBytes -= capacity();
+    delete[] m_pool;
+  }
+
+  // Documents constructed so far, each one is a heap allocation of its capacity
+  static inline std::atomic<std::size_t> allocations {0};
+  // Capacity of the documents that currently exist
+  static inline std::atomic<std::size_t> liveBytes {0};
+
+private:
+  char* m_pool;
+};
+
+namespace JsonStub {
+  template<typename T>
+  using Plain = std::remove_cv_t<std::remove_reference_t<T>>;
+
+  template<typename T>
+  constexpr bool isInteger = std::is_integral<Plain<T>>::value && !std::is_same<Plain<T>, bool>::value;
+
+  template<typename T>
+  constexpr bool isText = std::is_base_of<std::string, Plain<T>>::value;
+
+  // The shortest text that reads back as the same value
+  inline std::string formatReal(double value, bool single) {
+    char buffer[32];
+    for (int precision = 1; precision <= 17; ++precision) {
+      std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+      double parsed = std::strtod(buffer, nullptr);
+      if (single ? static_cast<float>(parsed) == static_cast<float>(value) : parsed == value) {
+        break;
+      }
+    }
+    return buffer;
+  }
+
+  std::string writeJson(const JsonNode* node);
+}  // namespace JsonStub
+
+class JsonString {
+public:
+  explicit JsonString(const char* value) : m_value(value) { }
+  const char* c_str() const { return m_value; }
+  bool operator==(const char* other) const { return std::strcmp(m_value, other) == 0; }
+
+private:
+  const char* m_value;
+};
+
+// A value in a document. Members looked up by key are only created once a value is assigned to them,
+// like ArduinoJson's MemberProxy, so reading a missing key leaves the document as it is.
+class JsonVariant {
+public:
+  JsonVariant() = default;
+  JsonVariant(JsonDocument* document, JsonNode* node) : m_document(document), m_node(node) { }
+  JsonVariant(JsonDocument* document, JsonNode* parent, std::string key, bool copiedKey) : m_document(document), m_parent(parent), m_key(std::move(key)), m_copiedKey(copiedKey) { }
+
+  bool isNull() const {
+    const JsonNode* value = node();
+    return value == nullptr || value->type == JsonNode::NUL;
+  }
+
+  template<typename T>
+  bool is() const {
+    const JsonNode* value = node();
+    if (value == nullptr) {
+      return false;
+    }
+    if constexpr (std::is_same<JsonStub::Plain<T>, bool>::value) {
+      return value->type == JsonNode::BOOLEAN;
+    } else if constexpr (JsonStub::isInteger<T>) {
+      return value->type == JsonNode::INTEGER && value->integer >= static_cast<std::int64_t>(std::numeric_limits<T>::min())
+          && (value->integer <= 0 || static_cast<std::uint64_t>(value->integer) <= static_cast<std::uint64_t>(std::numeric_limits<T>::max()));
+    } else if constexpr (std::is_floating_point<T>::value) {
+      return value->type == JsonNode::INTEGER || value->type == JsonNode::FLOAT;
+    } else if constexpr (std::is_same<T, const char*>::value || std::is_same<T, char*>::value || JsonStub::isText<T>) {
+      return value->type == JsonNode::STRING;
+    } else if constexpr (std::is_same<T, JsonObject>::value) {
+      return value->type == JsonNode::OBJECT;
+    } else if constexpr (std::is_same<T, JsonArray>::value) {
+      return value->type == JsonNode::ARRAY;
+    } else {
+      static_assert(std::is_same<T, JsonVariant>::value, "unsupported type");
+      return true;
+    }
+  }
+
+  template<typename T>
+  T as() const;
+
+  template<typename T, typename = std::enable_if_t<!std::is_same<T, JsonVariant>::value && !std::is_array<T>::value>>
+  operator T() const {
+    return as<T>();
+  }
+
+  // The value if it has the type of the fallback, the fallback otherwise
+  template<typename T>
+  std::enable_if_t<!std::is_array<T>::value, T> operator|(const T& fallback) const {
+    return is<T>() ? as<T>() : fallback;
+  }
+  const char* operator|(const char* fallback) const { return is<const char*>() ? as<const char*>() : fallback; }
+
+  template<typename T>
+  std::enable_if_t<!std::is_same<JsonStub::Plain<T>, JsonVariant>::value, JsonVariant&> operator=(const T& value) {
+    set(value);
+    return *this;
+  }
+  JsonVariant& operator=(const char* value) {
+    set(value);
+    return *this;
+  }
+
+  template<typename T>
+  bool set(const T& value) {
+    JsonNode* target = materialize();
+    if (target == nullptr) {
+      return false;
+    }
+    if constexpr (std::is_same<JsonStub::Plain<T>, bool>::value) {
+      target->reset(JsonNode::BOOLEAN);
+      target->boolean = value;
+    } else if constexpr (JsonStub::isInteger<T>) {
+      target->reset(JsonNode::INTEGER);
+      target->integer = static_cast<std::int64_t>(value);
+    } else if constexpr (std::is_floating_point<T>::value) {
+      target->reset(JsonNode::FLOAT);
+      target->real   = value;
+      target->single = std::is_same<T, float>::value;
+    } else if constexpr (std::is_enum<T>::value) {
+      static_assert(!std::is_enum<T>::value, "cast enums to an integer first");
+    } else if constexpr (JsonStub::isText<T>) {
+      // Copied into the document, unlike string literals
+      if (!m_document->allocate(value.size() + 1)) {
+        return false;
+      }
+      target->reset(JsonNode::STRING);
+      target->string = value;
+    } else {
+      static_assert(std::is_same<T, std::nullptr_t>::value, "unsupported type");
+      target->reset(JsonNode::NUL);
+    }
+    return true;
+  }
+  bool set(const char* value) {
+    JsonNode* target = materialize();
+    if (target == nullptr) {
+      return false;
+    }
+    target->reset(value == nullptr ? JsonNode::NUL : JsonNode::STRING);
+    if (value != nullptr) {
+      target->string = value;
+    }
+    return true;
+  }
+  bool set(char* value) { return set(static_cast<const char*>(value)); }
+
+  JsonVariant operator[](const char* key) const {
+    JsonNode* value = node();
+    if (value == nullptr || (value->type != JsonNode::OBJECT && value->type != JsonNode::NUL)) {
+      return JsonVariant();
+    }
+    return JsonVariant(m_document, value, key, false);
+  }
+  JsonVariant operator[](const String& key) const {
+    JsonVariant member = (*this)[key.c_str()];
+    member.m_copiedKey = true;
+    return member;
+  }
+  JsonVariant operator[](int index) const {
+    JsonNode* value = node();
+    if (value == nullptr || value->type != JsonNode::ARRAY || index < 0 || static_cast<std::size_t>(index) >= value->elements.size()) {
+      return JsonVariant();
+    }
+    return JsonVariant(m_document, value->elements[index]);
+  }
+
+  bool containsKey(const char* key) const {
+    const JsonNode* value = node();
+    return value != nullptr && value->type == JsonNode::OBJECT && value->member(key) != nullptr;
+  }
+
+  std::size_t size() const {
+    const JsonNode* value = node();
+    if (value == nullptr) {
+      return 0;
+    }
+    return value->type == JsonNode::OBJECT ? value->members.size() : value->type == JsonNode::ARRAY ? value->elements.size() : 0;
+  }
+
+  template<typename T>
+  T to();
+
+  JsonObject createNestedObject(const char* key) const;
+  JsonArray createNestedArray(const char* key) const;
+
+  bool operator==(const char* other) const {
+    const JsonNode* value = node();
+    return value != nullptr && value->type == JsonNode::STRING && value->string == other;
+  }
+  bool operator!=(const char* other) const { return !(*this == other); }
+
+  JsonNode* node() const {
+    if (m_node == nullptr && m_parent != nullptr && m_parent->type == JsonNode::OBJECT) {
+      m_node = m_parent->member(m_key.c_str());
+    }
+    return m_node;
+  }
+
+  JsonDocument* document() const { return m_document; }
+
+private:
+  // The node to write to, adding the member first where it does not exist yet
+  JsonNode* materialize() {
+    if (node() != nullptr || m_parent == nullptr) {
+      return m_node;
+    }
+    if (m_parent->type == JsonNode::NUL) {
+      m_parent->reset(JsonNode::OBJECT);
+    }
+    if (m_parent->type != JsonNode::OBJECT || (m_copiedKey && !m_document->allocate(m_key.size() + 1))) {
+      return nullptr;
+    }
+    m_node = m_document->newNode();
+    if (m_node != nullptr) {
+      m_parent->members.emplace_back(m_key, m_node);
+    }
+    return m_node;
+  }
+
+  JsonDocument* m_document = nullptr;
+  mutable JsonNode* m_node = nullptr;
+  JsonNode* m_parent       = nullptr;
+  std::string m_key;
+  bool m_copiedKey = false;
+};
+
+class JsonPair {
+public:
+  JsonPair(JsonDocument* document, std::pair<std::string, JsonNode*>& member) : m_key(member.first.c_str()), m_value(document, member.second) { }
+
+  JsonString key() const { return m_key; }
+  JsonVariant value() const { return m_value; }
+
+private:
+  JsonString m_key;
+  JsonVariant m_value;
+};
+
+class JsonObject {
+public:
+  class iterator {
+  public:
+    iterator(JsonDocument* document, std::vector<std::pair<std::string, JsonNode*>>::iterator position) : m_document(document), m_position(position) { }
+
+    JsonPair operator*() const { return JsonPair(m_document, *m_position); }
+    iterator& operator++() {
+      ++m_position;
+      return *this;
+    }
+    bool operator!=(const iterator& other) const { return m_position != other.m_position; }
+
+  private:
+    JsonDocument* m_document;
+    std::vector<std::pair<std::string, JsonNode*>>::iterator m_position;
+  };
+
+  JsonObject() : m_document(nullptr), m_node(nullptr) { }
+  JsonObject(JsonDocument* document, JsonNode* node) : m_document(document), m_node(node) { }
+
+  bool isNull() const { return m_node == nullptr; }
+  std::size_t size() const { return m_node == nullptr ? 0 : m_node->members.size(); }
+  bool containsKey(const char* key) const { return m_node != nullptr && m_node->member(key) != nullptr; }
+
+  JsonVariant operator[](const char* key) const {
+    if (m_node == nullptr) {
+      return JsonVariant();
+    }
+    return JsonVariant(m_document, m_node, key, false);
+  }
+  JsonVariant operator[](const String& key) const {
+    if (m_node == nullptr) {
+      return JsonVariant();
+    }
+    return JsonVariant(m_document, m_node, key, true);
+  }
+
+  JsonObject createNestedObject(const char* key) const { return (*this)[key].to<JsonObject>(); }
+  JsonArray createNestedArray(const char* key) const;
+
+  iterator begin() const { return m_node == nullptr ? iterator(nullptr, s_none.begin()) : iterator(m_document, m_node->members.begin()); }
+  iterator end() const { return m_node == nullptr ? iterator(nullptr, s_none.end()) : iterator(m_document, m_node->members.end()); }
+
+  JsonNode* node() const { return m_node; }
+
+private:
+  static inline std::vector<std::pair<std::string, JsonNode*>> s_none;
+
+  JsonDocument* m_document;
+  JsonNode* m_node;
+};
+
+class JsonArray {
+public:
+  class iterator {
+  public:
+    iterator(JsonDocument* document, std::vector<JsonNode*>::iterator position) : m_document(document), m_position(position) { }
+
+    JsonVariant operator*() const { return JsonVariant(m_document, *m_position); }
+    iterator& operator++() {
+      ++m_position;
+      return *this;
+    }
+    bool operator!=(const iterator& other) const { return m_position != other.m_position; }
+
+  private:
+    JsonDocument* m_document;
+    std::vector<JsonNode*>::iterator m_position;
+  };
+
+  JsonArray() : m_document(nullptr), m_node(nullptr) { }
+  JsonArray(JsonDocument* document, JsonNode* node) : m_document(document), m_node(node) { }
+
+  bool isNull() const { return m_node == nullptr; }
+  std::size_t size() const { return m_node == nullptr ? 0 : m_node->elements.size(); }
+
+  JsonVariant operator[](int index) const { return JsonVariant(m_document, m_node)[index]; }
+
+  // The new element, null once the document is full
+  JsonVariant add() const {
+    JsonNode* element = m_node == nullptr ? nullptr : m_document->newNode();
+    if (element == nullptr) {
+      return JsonVariant();
+    }
+    m_node->elements.push_back(element);
+    return JsonVariant(m_document, element);
+  }
+  template<typename T>
+  bool add(const T& value) const {
+    JsonVariant element = add();
+    return element.node() != nullptr && element.set(value);
+  }
+  bool add(const char* value) const {
+    JsonVariant element = add();
+    return element.node() != nullptr && element.set(value);
+  }
+
+  JsonObject createNestedObject() const { return add().to<JsonObject>(); }
+  JsonArray createNestedArray() const;
+
+  iterator begin() const { return m_node == nullptr ? iterator(nullptr, s_none.begin()) : iterator(m_document, m_node->elements.begin()); }
+  iterator end() const { return m_node == nullptr ? iterator(nullptr, s_none.end()) : iterator(m_document, m_node->elements.end()); }
+
+  JsonNode* node() const { return m_node; }
+
+private:
+  static inline std::vector<JsonNode*> s_none;
+
+  JsonDocument* m_document;
+  JsonNode* m_node;
+};
+
+template<typename T>
+T JsonVariant::as() const {
+  const JsonNode* value = node();
+  if constexpr (std::is_same<T, JsonObject>::value) {
+    return value != nullptr && value->type == JsonNode::OBJECT ? JsonObject(m_document, const_cast<JsonNode*>(value)) : JsonObject();
+  } else if constexpr (std::is_same<T, JsonArray>::value) {
+    return value != nullptr && value->type == JsonNode::ARRAY ? JsonArray(m_document, const_cast<JsonNode*>(value)) : JsonArray();
+  } else if constexpr (std::is_same<T, JsonVariant>::value) {
+    return *this;
+  } else if constexpr (std::is_same<T, const char*>::value) {
+    return value != nullptr && value->type == JsonNode::STRING ? value->string.c_str() : nullptr;
+  } else if constexpr (JsonStub::isText<T>) {
+    if (value != nullptr && value->type == JsonNode::STRING) {
+      return T(value->string);
+    }
+    return T(JsonStub::writeJson(value));
+  } else if constexpr (std::is_same<T, bool>::value) {
+    if (value == nullptr) {
+      return false;
+    }
+    return value->type == JsonNode::BOOLEAN ? value->boolean : value->type == JsonNode::INTEGER ? value->integer != 0 : value->type == JsonNode::FLOAT ? value->real != 0 : false;
+  } else if constexpr (JsonStub::isInteger<T> || std::is_floating_point<T>::value) {
+    if (value == nullptr) {
+      return T();
+    }
+    switch (value->type) {
+    case JsonNode::BOOLEAN:
+      return static_cast<T>(value->boolean);
+    case JsonNode::INTEGER:
+      return static_cast<T>(value->integer);
+    case JsonNode::FLOAT:
+      return static_cast<T>(value->real);
+    case JsonNode::STRING:
+      return static_cast<T>(std::strtod(value->string.c_str(), nullptr));
+    default:
+      return T();
+    }
+  } else {
+    static_assert(sizeof(T) == 0, "unsupported type");
+  }
+}
+
+template<typename T>
+T JsonVariant::to() {
+  JsonNode* target = materialize();
+  if (target == nullptr) {
+    return T();
+  }
+  if constexpr (std::is_same<T, JsonObject>::value) {
+    target->reset(JsonNode::OBJECT);
+    return JsonObject(m_document, target);
+  } else {
+    static_assert(std::is_same<T, JsonArray>::value, "unsupported type");
+    target->reset(JsonNode::ARRAY);
+    return JsonArray(m_document, target);
+  }
+}
+
+inline JsonObject JsonVariant::createNestedObject(const char* key) const {
+  return (*this)[key].to<JsonObject>();
+}
+
+inline JsonArray JsonVariant::createNestedArray(const char* key) const {
+  return (*this)[key].to<JsonArray>();
+}
+
+inline JsonArray JsonObject::createNestedArray(const char* key) const {
+  return (*this)[key].to<JsonArray>();
+}
+
+inline JsonArray JsonArray::createNestedArray() const {
+  return add().to<JsonArray>();
+}
+
+template<typename T>
+T JsonDocument::to() {
+  clear();
+  return JsonVariant(this, &m_root).to<T>();
+}
+
+template<typename T>
+T JsonDocument::as() {
+  return JsonVariant(this, &m_root).as<T>();
+}
+
+template<typename T>
+bool JsonDocument::is() {
+  return JsonVariant(this, &m_root).is<T>();
+}
+
+inline JsonVariant JsonDocument::operator[](const char* key) {
+  return JsonVariant(this, &m_root)[key];
+}
+
+inline JsonVariant JsonDocument::operator[](const String& key) {
+  return JsonVariant(this, &m_root)[key];
+}
+
+class DeserializationError {
+public:
+  enum Code {
+    Ok,
+    EmptyInput,
+    IncompleteInput,
+    InvalidInput,
+    NoMemory,
+    NotSupported,
+    TooDeep
+  };
+
+  DeserializationError(Code code) : m_code(code) { }
+
+  explicit operator bool() const { return m_code != Ok; }
+  bool operator==(Code code) const { return m_code == code; }
+  bool operator!=(Code code) const { return m_code != code; }
+  Code code() const { return m_code; }
+
+  const char* c_str() const {
+    static const char* const names[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "NotSupported", "TooDeep"};
+    return names[m_code];
+  }
+
+private:
+  Code m_code;
+};
+
+namespace JsonStub {
+  inline void writeJson(const JsonNode* node, std::string& output) {
+    if (node == nullptr) {
+      output += "null";
+      return;
+    }
+    switch (node->type) {
+    case JsonNode::NUL:
+      output += "null";
+      break;
+    case JsonNode::BOOLEAN:
+      output += node->boolean ? "true" : "false";
+      break;
+    case JsonNode::INTEGER:
+      output += std::to_string(node->integer);
+      break;
+    case JsonNode::FLOAT:
+      output += std::isfinite(node->real) ? formatReal(node->real, node->single) : "null";
+      break;
+    case JsonNode::STRING:
+      output += '"';
+      for (char c : node->string) {
+        switch (c) {
+        case '"':
+          output += "\\\"";
+          break;
+        case '\\':
+          output += "\\\\";
+          break;
+        case '\b':
+          output += "\\b";
+          break;
+        case '\f':
+          output += "\\f";
+          break;
+        case '\n':
+          output += "\\n";
+          break;
+        case '\r':
+          output += "\\r";
+          break;
+        case '\t':
+          output += "\\t";
+          break;
+        default:
+          if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            output += escaped;
+          } else {
+            output += c;
+          }
+        }
+      }
+      output += '"';
+      break;
+    case JsonNode::ARRAY:
+      output += '[';
+      for (std::size_t i = 0; i < node->elements.size(); ++i) {
+        if (i > 0) {
+          output += ',';
+        }
+        writeJson(node->elements[i], output);
+      }
+      output += ']';
+      break;
+    case JsonNode::OBJECT:
+      output += '{';
+      for (std::size_t i = 0; i < node->members.size(); ++i) {
+        if (i > 0) {
+          output += ',';
+        }
+        JsonNode key;
+        key.reset(JsonNode::STRING);
+        key.string = node->members[i].first;
+        writeJson(&key, output);
+        output += ':';
+        writeJson(node->members[i].second, output);
+      }
+      output += '}';
+      break;
+    }
+  }
+
+  inline std::string writeJson(const JsonNode* node) {
+    std::string output;
+    writeJson(node, output);
+    return output;
+  }
+
+  inline void writeBigEndian(std::string& output, std::uint8_t marker, std::uint64_t value, int bytes) {
+    output += static_cast<char>(marker);
+    for (int i = bytes - 1; i >= 0; --i) {
+      output += static_cast<char>(value >> (i * 8));
+    }
+  }
+
+  // Picks the smallest of the fix, 8, 16 and 32 bit forms, the markers are those of the 8 bit form
+  inline void writeLength(std::string& output, std::size_t length, std::uint8_t fix, std::size_t fixLimit, std::uint8_t marker8, std::uint8_t marker16) {
+    if (length < fixLimit) {
+      output += static_cast<char>(fix | length);
+    } else if (marker8 != 0 && length <= 0xff) {
+      writeBigEndian(output, marker8, length, 1);
+    } else if (length <= 0xffff) {
+      writeBigEndian(output, marker16, length, 2);
+    } else {
+      writeBigEndian(output, marker16 + 1, length, 4);
+    }
+  }
+
+  inline void writeMsgPack(const JsonNode* node, std::string& output) {
+    if (node == nullptr) {
+      output += '\xc0';
+      return;
+    }
+    switch (node->type) {
+    case JsonNode::NUL:
+      output += '\xc0';
+      break;
+    case JsonNode::BOOLEAN:
+      output += node->boolean ? '\xc3' : '\xc2';
+      break;
+    case JsonNode::INTEGER: {
+      std::int64_t value = node->integer;
+      if (value >= 0) {
+        if (value < 0x80) {
+          output += static_cast<char>(value);
+        } else if (value <= 0xff) {
+          writeBigEndian(output, 0xcc, value, 1);
+        } else if (value <= 0xffff) {
+          writeBigEndian(output, 0xcd, value, 2);
+        } else if (value <= 0xffffffffLL) {
+          writeBigEndian(output, 0xce, value, 4);
+        } else {
+          writeBigEndian(output, 0xcf, value, 8);
+        }
+      } else if (value >= -32) {
+        output += static_cast<char>(value);
+      } else if (value >= -0x80) {
+        writeBigEndian(output, 0xd0, static_cast<std::uint64_t>(value), 1);
+      } else if (value >= -0x8000) {
+        writeBigEndian(output, 0xd1, static_cast<std::uint64_t>(value), 2);
+      } else if (value >= -0x80000000LL) {
+        writeBigEndian(output, 0xd2, static_cast<std::uint64_t>(value), 4);
+      } else {
+        writeBigEndian(output, 0xd3, static_cast<std::uint64_t>(value), 8);
+      }
+      break;
+    }
+    case JsonNode::FLOAT: {
+      // float32 wherever it holds the value
+      float narrow = static_cast<float>(node->real);
+      if (node->single || static_cast<double>(narrow) == node->real || std::isnan(node->real)) {
+        std::uint32_t bits;
+        std::memcpy(&bits, &narrow, sizeof(bits));
+        writeBigEndian(output, 0xca, bits, 4);
+      } else {
+        std::uint64_t bits;
+        std::memcpy(&bits, &node->real, sizeof(bits));
+        writeBigEndian(output, 0xcb, bits, 8);
+      }
+      break;
+    }
+    case JsonNode::STRING:
+      writeLength(output, node->string.size(), 0xa0, 32, 0xd9, 0xda);
+      output += node->string;
+      break;
+    case JsonNode::ARRAY:
+      writeLength(output, node->elements.size(), 0x90, 16, 0, 0xdc);
+      for (const JsonNode* element : node->elements) {
+        writeMsgPack(element, output);
+      }
+      break;
+    case JsonNode::OBJECT:
+      writeLength(output, node->members.size(), 0x80, 16, 0, 0xde);
+      for (const auto& member : node->members) {
+        writeLength(output, member.first.size(), 0xa0, 32, 0xd9, 0xda);
+        output += member.first;
+        writeMsgPack(member.second, output);
+      }
+      break;
+    }
+  }
+
+  // Copies the text with a terminator where it fits, like ArduinoJson does for char buffers
+  inline std::size_t copyOut(const std::string& text, void* buffer, std::size_t size) {
+    if (size == 0) {
+      return 0;
+    }
+    std::size_t length = std::min(text.size(), size - 1);
+    std::memcpy(buffer, text.data(), length);
+    static_cast<char*>(buffer)[length] = '\0';
+    return length;
+  }
+
+  class Reader {
+  public:
+    Reader(JsonDocument& document, const char* input, std::size_t length) : m_document(document), m_position(input), m_end(input + length) { }
+
+    DeserializationError json(JsonNode* node, int depth) {
+      skipSpaces();
+      if (m_position == m_end) {
+        return DeserializationError::IncompleteInput;
+      }
+      if (depth > JsonDocument::NESTING_LIMIT) {
+        return DeserializationError::TooDeep;
+      }
+
+      char c = *m_position;
+      if (c == '{') {
+        m_position++;
+        node->reset(JsonNode::OBJECT);
+        skipSpaces();
+        if (m_position != m_end && *m_position == '}') {
+          m_position++;
+          return DeserializationError::Ok;
+        }
+        while (true) {
+          skipSpaces();
+          std::string key;
+          DeserializationError error = jsonString(key);
+          if (error) {
+            return error;
+          }
+          skipSpaces();
+          if (m_position == m_end) {
+            return DeserializationError::IncompleteInput;
+          }
+          if (*m_position++ != ':') {
+            return DeserializationError::InvalidInput;
+          }
+          JsonNode* value = m_document.newNode();
+          if (value == nullptr || !m_document.allocate(key.size() + 1)) {
+            return DeserializationError::NoMemory;
+          }
+          node->members.emplace_back(std::move(key), value);
+          error = json(value, depth + 1);
+          if (error) {
+            return error;
+          }
+          DeserializationError next = separator('}');
+          if (next != DeserializationError::Ok || m_closed) {
+            return next;
+          }
+        }
+      }
+      if (c == '[') {
+        m_position++;
+        node->reset(JsonNode::ARRAY);
+        skipSpaces();
+        if (m_position != m_end && *m_position == ']') {
+          m_position++;
+          return DeserializationError::Ok;
+        }
+        while (true) {
+          JsonNode* element = m_document.newNode();
+          if (element == nullptr) {
+            return DeserializationError::NoMemory;
+          }
+          node->elements.push_back(element);
+          DeserializationError error = json(element, depth + 1);
+          if (error) {
+            return error;
+          }
+          DeserializationError next = separator(']');
+          if (next != DeserializationError::Ok || m_closed) {
+            return next;
+          }
+        }
+      }
+      if (c == '"') {
+        node->reset(JsonNode::STRING);
+        DeserializationError error = jsonString(node->string);
+        if (error) {
+          return error;
+        }
+        return m_document.allocate(node->string.size() + 1) ? DeserializationError::Ok : DeserializationError::NoMemory;
+      }
+      if (literal("true")) {
+        node->reset(JsonNode::BOOLEAN);
+        node->boolean = true;
+        return DeserializationError::Ok;
+      }
+      if (literal("false")) {
+        node->reset(JsonNode::BOOLEAN);
+        return DeserializationError::Ok;
+      }
+      if (literal("null")) {
+        node->reset(JsonNode::NUL);
+        return DeserializationError::Ok;
+      }
+      return jsonNumber(node);
+    }
+
+    DeserializationError msgPack(JsonNode* node, int depth) {
+      if (m_position == m_end) {
+        return DeserializationError::IncompleteInput;
+      }
+      if (depth > JsonDocument::NESTING_LIMIT) {
+        return DeserializationError::TooDeep;
+      }
+
+      std::uint8_t marker = *m_position++;
+      std::uint64_t value = 0;
+      if (marker < 0x80 || marker >= 0xe0) {
+        node->reset(JsonNode::INTEGER);
+        node->integer = static_cast<std::int8_t>(marker);
+        return DeserializationError::Ok;
+      }
+      if ((marker & 0xf0) == 0x80) {
+        return msgPackObject(node, marker & 0x0f, depth);
+      }
+      if ((marker & 0xf0) == 0x90) {
+        return msgPackArray(node, marker & 0x0f, depth);
+      }
+      if ((marker & 0xe0) == 0xa0) {
+        return msgPackString(node->string, marker & 0x1f, node);
+      }
+
+      switch (marker) {
+      case 0xc0:
+        node->reset(JsonNode::NUL);
+        return DeserializationError::Ok;
+      case 0xc2:
+      case 0xc3:
+        node->reset(JsonNode::BOOLEAN);
+        node->boolean = marker == 0xc3;
+        return DeserializationError::Ok;
+      case 0xcc:
+      case 0xcd:
+      case 0xce:
+      case 0xcf:
+        if (!bigEndian(value, 1 << (marker - 0xcc))) {
+          return DeserializationError::IncompleteInput;
+        }
+        node->reset(JsonNode::INTEGER);
+        node->integer = static_cast<std::int64_t>(value);
+        return DeserializationError::Ok;
+      case 0xd0:
+      case 0xd1:
+      case 0xd2:
+      case 0xd3: {
+        int bytes = 1 << (marker - 0xd0);
+        if (!bigEndian(value, bytes)) {
+          return DeserializationError::IncompleteInput;
+        }
+        // Sign extension from the width of the value
+        int shift = 64 - bytes * 8;
+        node->reset(JsonNode::INTEGER);
+        node->integer = static_cast<std::int64_t>(value << shift) >> shift;
+        return DeserializationError::Ok;
+      }
+      case 0xca: {
+        if (!bigEndian(value, 4)) {
+          return DeserializationError::IncompleteInput;
+        }
+        std::uint32_t bits = static_cast<std::uint32_t>(value);
+        float real;
+        std::memcpy(&real, &bits, sizeof(real));
+        node->reset(JsonNode::FLOAT);
+        node->real   = real;
+        node->single = true;
+        return DeserializationError::Ok;
+      }
+      case 0xcb:
+        if (!bigEndian(value, 8)) {
+          return DeserializationError::IncompleteInput;
+        }
+        node->reset(JsonNode::FLOAT);
+        std::memcpy(&node->real, &value, sizeof(node->real));
+        return DeserializationError::Ok;
+      case 0xd9:
+      case 0xda:
+      case 0xdb:
+        if (!bigEndian(value, 1 << (marker - 0xd9))) {
+          return DeserializationError::IncompleteInput;
+        }
+        return msgPackString(node->string, value, node);
+      case 0xdc:
+      case 0xdd:
+        if (!bigEndian(value, marker == 0xdc ? 2 : 4)) {
+          return DeserializationError::IncompleteInput;
+        }
+        return msgPackArray(node, value, depth);
+      case 0xde:
+      case 0xdf:
+        if (!bigEndian(value, marker == 0xde ? 2 : 4)) {
+          return DeserializationError::IncompleteInput;
+        }
+        return msgPackObject(node, value, depth);
+      default:
+        // bin, ext and the unused marker
+        return DeserializationError::NotSupported;
+      }
+    }
+
+    void skipSpaces() {
+      while (m_position != m_end && (*m_position == ' ' || *m_position == '\t' || *m_position == '\n' || *m_position == '\r')) {
+        m_position++;
+      }
+    }
+
+    bool atEnd() const { return m_position == m_end; }
+
+  private:
+    // After a member or element, either the next one or the end of the container
+    DeserializationError separator(char close) {
+      skipSpaces();
+      m_closed = false;
+      if (m_position == m_end) {
+        return DeserializationError::IncompleteInput;
+      }
+      char c = *m_position++;
+      if (c == close) {
+        m_closed = true;
+        return DeserializationError::Ok;
+      }
+      return c == ',' ? DeserializationError::Ok : DeserializationError::InvalidInput;
+    }
+
+    bool literal(const char* word) {
+      std::size_t length = std::strlen(word);
+      if (static_cast<std::size_t>(m_end - m_position) < length || std::strncmp(m_position, word, length) != 0) {
+        return false;
+      }
+      m_position += length;
+      return true;
+    }
+
+    DeserializationError jsonString(std::string& output) {
+      if (m_position == m_end) {
+        return DeserializationError::IncompleteInput;
+      }
+      if (*m_position++ != '"') {
+        return DeserializationError::InvalidInput;
+      }
+      while (m_position != m_end) {
+        char c = *m_position++;
+        if (c == '"') {
+          return DeserializationError::Ok;
+        }
+        if (c != '\\') {
+          output += c;
+          continue;
+        }
+        if (m_position == m_end) {
+          return DeserializationError::IncompleteInput;
+        }
+        char escaped = *m_position++;
+        switch (escaped) {
+        case 'b':
+          output += '\b';
+          break;
+        case 'f':
+          output += '\f';
+          break;
+        case 'n':
+          output += '\n';
+          break;
+        case 'r':
+          output += '\r';
+          break;
+        case 't':
+          output += '\t';
+          break;
+        case 'u': {
+          if (m_end - m_position < 4) {
+            return DeserializationError::IncompleteInput;
+          }
+          unsigned code = std::strtoul(std::string(m_position, 4).c_str(), nullptr, 16);
+          m_position += 4;
+          // Basic plane only, as UTF-8
+          if (code < 0x80) {
+            output += static_cast<char>(code);
+          } else if (code < 0x800) {
+            output += static_cast<char>(0xc0 | code >> 6);
+            output += static_cast<char>(0x80 | (code & 0x3f));
+          } else {
+            output += static_cast<char>(0xe0 | code >> 12);
+            output += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            output += static_cast<char>(0x80 | (code & 0x3f));
+          }
+          break;
+        }
+        default:
+          output += escaped;
+        }
+      }
+      return DeserializationError::IncompleteInput;
+    }
+
+    DeserializationError jsonNumber(JsonNode* node) {
+      const char* start = m_position;
+      bool real         = false;
+      while (m_position != m_end && std::strchr("+-0123456789.eE", *m_position) != nullptr) {
+        real = real || *m_position == '.' || *m_position == 'e' || *m_position == 'E';
+        m_position++;
+      }
+      if (m_position == start) {
+        return DeserializationError::InvalidInput;
+      }
+
+      std::string text(start, m_position);
+      char* parsedEnd = nullptr;
+      if (!real) {
+        errno           = 0;
+        long long value = std::strtoll(text.c_str(), &parsedEnd, 10);
+        if (errno == 0 && *parsedEnd == '\0') {
+          node->reset(JsonNode::INTEGER);
+          node->integer = value;
+          return DeserializationError::Ok;
+        }
+      }
+      double value = std::strtod(text.c_str(), &parsedEnd);
+      if (*parsedEnd != '\0') {
+        return DeserializationError::InvalidInput;
+      }
+      node->reset(JsonNode::FLOAT);
+      node->real = value;
+      return DeserializationError::Ok;
+    }
+
+    bool bigEndian(std::uint64_t& value, int bytes) {
+      if (m_end - m_position < bytes) {
+        return false;
+      }
+      value = 0;
+      for (int i = 0; i < bytes; ++i) {
+        value = value << 8 | static_cast<std::uint8_t>(*m_position++);
+      }
+      return true;
+    }
+
+    DeserializationError msgPackString(std::string& output, std::uint64_t length, JsonNode* node) {
+      if (static_cast<std::uint64_t>(m_end - m_position) < length) {
+        return DeserializationError::IncompleteInput;
+      }
+      if (!m_document.allocate(length + 1)) {
+        return DeserializationError::NoMemory;
+      }
+      std::string text(m_position, length);
+      m_position += length;
+      if (node != nullptr) {
+        node->reset(JsonNode::STRING);
+      }
+      output = std::move(text);
+      return DeserializationError::Ok;
+    }
+
+    DeserializationError msgPackArray(JsonNode* node, std::uint64_t count, int depth) {
+      node->reset(JsonNode::ARRAY);
+      for (std::uint64_t i = 0; i < count; ++i) {
+        JsonNode* element = m_document.newNode();
+        if (element == nullptr) {
+          return DeserializationError::NoMemory;
+        }
+        node->elements.push_back(element);
+        DeserializationError error = msgPack(element, depth + 1);
+        if (error) {
+          return error;
+        }
+      }
+      return DeserializationError::Ok;
+    }
+
+    DeserializationError msgPackObject(JsonNode* node, std::uint64_t count, int depth) {
+      node->reset(JsonNode::OBJECT);
+      for (std::uint64_t i = 0; i < count; ++i) {
+        if (m_position == m_end) {
+          return DeserializationError::IncompleteInput;
+        }
+        // Keys have to be strings
+        JsonNode key;
+        DeserializationError error = msgPack(&key, depth + 1);
+        if (error) {
+          return error;
+        }
+        if (key.type != JsonNode::STRING) {
+          return DeserializationError::InvalidInput;
+        }
+        JsonNode* value = m_document.newNode();
+        if (value == nullptr) {
+          return DeserializationError::NoMemory;
+        }
+        node->members.emplace_back(std::move(key.string), value);
+        error = msgPack(value, depth + 1);
+        if (error) {
+          return error;
+        }
+      }
+      return DeserializationError::Ok;
+    }
+
+    JsonDocument& m_document;
+    const char* m_position;
+    const char* m_end;
+    bool m_closed = false;
+  };
+}  // namespace JsonStub
+
+inline std::size_t measureJson(const JsonDocument& document) {
+  return JsonStub::writeJson(document.root()).size();
+}
+
+inline std::size_t serializeJson(const JsonDocument& document, String& output) {
+  output = JsonStub::writeJson(document.root());
+  return output.size();
+}
+
+inline std::size_t serializeJson(const JsonDocument& document, char* buffer, std::size_t size) {
+  return JsonStub::copyOut(JsonStub::writeJson(document.root()), buffer, size);
+}
+
+inline std::size_t measureMsgPack(const JsonDocument& document) {
+  std::string output;
+  JsonStub::writeMsgPack(document.root(), output);
+  return output.size();
+}
+
+inline std::size_t serializeMsgPack(const JsonDocument& document, void* buffer, std::size_t size) {
+  std::string output;
+  JsonStub::writeMsgPack(document.root(), output);
+  return JsonStub::copyOut(output, buffer, size);
+}
+
+// Only the first value is read, anything after it is ignored like ArduinoJson does
+inline DeserializationError deserializeJson(JsonDocument& document, const char* input, std::size_t length) {
+  document.clear();
+  JsonStub::Reader reader(document, input, length);
+  reader.skipSpaces();
+  if (reader.atEnd()) {
+    return DeserializationError::EmptyInput;
+  }
+  return reader.json(document.root(), 0);
+}
+
+inline DeserializationError deserializeJson(JsonDocument& document, const char* input) {
+  return deserializeJson(document, input, std::strlen(input));
+}
+
+inline DeserializationError deserializeJson(JsonDocument& document, const String& input) {
+  return deserializeJson(document, input.c_str(), input.size());
+}
+
+inline DeserializationError deserializeMsgPack(JsonDocument& document, const char* input, std::size_t length) {
+  document.clear();
+  if (length == 0) {
+    return DeserializationError::EmptyInput;
+  }
+  JsonStub::Reader reader(document, input, length);
+  return reader.msgPack(document.root(), 0);
+}
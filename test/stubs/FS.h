@@ -0,0 +1,110 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class FS;
+
+class File {
+public:
+  File() : m_fs(nullptr), m_position(0) { }
+  File(FS* fs, std::string path) : m_fs(fs), m_path(std::move(path)), m_position(0) { }
+
+  explicit operator bool() const { return m_fs != nullptr; }
+
+  std::size_t size() const;
+  std::size_t read(std::uint8_t* buffer, std::size_t size);
+  std::size_t write(const std::uint8_t* buffer, std::size_t size);
+  void close() { m_fs = nullptr; }
+
+private:
+  FS* m_fs;
+  std::string m_path;
+  std::size_t m_position;
+};
+
+// Keeps the files in memory and counts what a flash file system would have to do
+class FS {
+public:
+  File open(const String& path, const char* mode = "r", bool create = false) {
+    bool write = mode[0] == 'w';
+    if (!write && files.count(path) == 0) {
+      return File();
+    }
+    if (write) {
+      opensForWrite++;
+      files[path].clear();
+    }
+    return File(this, path);
+  }
+
+  bool exists(const String& path) const { return files.count(path) != 0 || directories.count(path) != 0; }
+
+  bool remove(const String& path) {
+    removes++;
+    return files.erase(path) != 0;
+  }
+
+  bool rename(const String& from, const String& to) {
+    auto file = files.find(from);
+    if (failRenames || file == files.end()) {
+      return false;
+    }
+    renames++;
+    files[to] = std::move(file->second);
+    files.erase(from);
+    return true;
+  }
+
+  bool mkdir(const String& path) {
+    directories.insert(path);
+    return true;
+  }
+
+  std::map<std::string, std::vector<std::uint8_t>> files;
+  std::set<std::string> directories;
+
+  std::size_t opensForWrite = 0;
+  std::size_t bytesWritten  = 0;
+  std::size_t renames       = 0;
+  std::size_t removes       = 0;
+
+  // Bytes that still fit before the file system is full, and whether renames fail, to test failed writes
+  std::size_t freeBytes = std::numeric_limits<std::size_t>::max();
+  bool failRenames      = false;
+};
+
+inline std::size_t File::size() const {
+  return m_fs == nullptr ? 0 : m_fs->files[m_path].size();
+}
+
+inline std::size_t File::read(std::uint8_t* buffer, std::size_t size) {
+  if (m_fs == nullptr) {
+    return 0;
+  }
+  const std::vector<std::uint8_t>& data = m_fs->files[m_path];
+  std::size_t length = std::min(size, data.size() - std::min(m_position, data.size()));
+  std::copy(data.begin() + m_position, data.begin() + m_position + length, buffer);
+  m_position += length;
+  return length;
+}
+
+inline std::size_t File::write(const std::uint8_t* buffer, std::size_t size) {
+  if (m_fs == nullptr) {
+    return 0;
+  }
+  std::size_t length = std::min(size, m_fs->freeBytes);
+  m_fs->freeBytes -= length;
+  m_fs->bytesWritten += length;
+  std::vector<std::uint8_t>& data = m_fs->files[m_path];
+  data.insert(data.end(), buffer, buffer + length);
+  return length;
+}
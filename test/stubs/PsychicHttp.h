@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <esp_err.h>
+#include <lwip/sockets.h>
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef void* httpd_handle_t;
+typedef void (*httpd_work_fn_t)(void* arg);
+
+typedef enum {
+  HTTPD_WS_TYPE_TEXT = 1,
+} httpd_ws_type_t;
+
+typedef struct {
+  bool final;
+  bool fragmented;
+  httpd_ws_type_t type;
+  std::uint8_t* payload;
+  std::size_t len;
+} httpd_ws_frame_t;
+
+// The http server task. Work items run when the test calls run(), sends either deliver the frame or, for
+// a stalled socket, block for the socket's send timeout and fail.
+namespace FakeHttpd {
+  // The server's send_wait_timeout, what a socket without its own timeout blocks for
+  const long SERVER_SEND_TIMEOUT_MS = 5000;
+
+  inline std::deque<std::pair<httpd_work_fn_t, void*>> work;
+  inline std::map<int, std::vector<std::string>> received;
+  inline std::map<int, bool> stalled;
+  inline std::vector<int> sends;
+  inline std::vector<int> closed;
+  inline long blockedMs = 0;
+  // The next work items the full work queue turns away
+  inline std::size_t rejectWork = 0;
+
+  inline void reset() {
+    work.clear();
+    received.clear();
+    stalled.clear();
+    sends.clear();
+    closed.clear();
+    blockedMs = 0;
+    rejectWork = 0;
+    FakeSockets::sendTimeoutMs.clear();
+  }
+
+  // Runs queued work items in order until the queue is empty or limit items ran
+  inline void run(std::size_t limit = SIZE_MAX) {
+    for (; limit > 0 && !work.empty(); --limit) {
+      std::pair<httpd_work_fn_t, void*> item = work.front();
+      work.pop_front();
+      item.first(item.second);
+    }
+  }
+}  // namespace FakeHttpd
+
+inline esp_err_t httpd_queue_work(httpd_handle_t, httpd_work_fn_t work, void* arg) {
+  if (FakeHttpd::rejectWork > 0) {
+    FakeHttpd::rejectWork--;
+    return ESP_FAIL;
+  }
+  FakeHttpd::work.push_back({work, arg});
+  return ESP_OK;
+}
+
+inline esp_err_t httpd_ws_send_frame_async(httpd_handle_t, int socket, httpd_ws_frame_t* frame) {
+  FakeHttpd::sends.push_back(socket);
+  if (FakeHttpd::stalled[socket]) {
+    auto timeout = FakeSockets::sendTimeoutMs.find(socket);
+    FakeHttpd::blockedMs += timeout != FakeSockets::sendTimeoutMs.end() ? timeout->second : FakeHttpd::SERVER_SEND_TIMEOUT_MS;
+    return ESP_FAIL;
+  }
+  FakeHttpd::received[socket].push_back(std::string(reinterpret_cast<char*>(frame->payload), frame->len));
+  return ESP_OK;
+}
+
+inline esp_err_t httpd_sess_trigger_close(httpd_handle_t, int socket) {
+  FakeHttpd::closed.push_back(socket);
+  return ESP_OK;
+}
+
+class PsychicWebSocketClient {
+public:
+  explicit PsychicWebSocketClient(int socket) : m_socket(socket) { }
+
+  int socket() { return m_socket; }
+  httpd_handle_t server() { return nullptr; }
+
+private:
+  int m_socket;
+};
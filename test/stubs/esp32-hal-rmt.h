@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+typedef struct {
+  std::uint32_t duration0 : 15;
+  std::uint32_t level0 : 1;
+  std::uint32_t duration1 : 15;
+  std::uint32_t level1 : 1;
+} rmt_data_t;
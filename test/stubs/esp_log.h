@@ -0,0 +1,3 @@
+#pragma once
+
+#include <esp32-hal-log.h>
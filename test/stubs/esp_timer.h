@@ -0,0 +1,101 @@
+#pragma once
+
+#include <esp_err.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum {
+  ESP_TIMER_TASK,
+} esp_timer_dispatch_t;
+
+typedef struct {
+  esp_timer_cb_t callback;
+  void* arg;
+  esp_timer_dispatch_t dispatch_method;
+  const char* name;
+  bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+struct FakeTimer {
+  esp_timer_cb_t callback;
+  void* arg;
+  bool armed;
+  std::int64_t due;
+};
+
+typedef FakeTimer* esp_timer_handle_t;
+
+// Timers never fire on their own, a test that uses them runs the clock by hand and advances it
+namespace FakeTimers {
+  inline bool manual       = false;
+  inline std::int64_t now  = 0;
+  inline std::vector<FakeTimer*> created;
+}  // namespace FakeTimers
+
+inline std::int64_t esp_timer_get_time() {
+  if (FakeTimers::manual) {
+    return FakeTimers::now;
+  }
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+  *handle = new FakeTimer {args->callback, args->arg, false, 0};
+  FakeTimers::created.push_back(*handle);
+  return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, std::uint64_t timeoutUs) {
+  if (timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = true;
+  timer->due   = esp_timer_get_time() + static_cast<std::int64_t>(timeoutUs);
+  return ESP_OK;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (!timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = false;
+  return ESP_OK;
+}
+
+inline esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  if (timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  FakeTimers::created.erase(std::find(FakeTimers::created.begin(), FakeTimers::created.end(), timer));
+  delete timer;
+  return ESP_OK;
+}
+
+namespace FakeTimers {
+  // Moves the manual clock forward, firing the timers that fall due on the way in the order of their deadlines
+  inline void advance(std::int64_t us) {
+    std::int64_t until = now + us;
+    while (true) {
+      FakeTimer* next = nullptr;
+      for (FakeTimer* timer : created) {
+        if (timer->armed && timer->due <= until && (next == nullptr || timer->due < next->due)) {
+          next = timer;
+        }
+      }
+      if (next == nullptr) {
+        break;
+      }
+      if (next->due > now) {
+        now = next->due;
+      }
+      next->armed = false;
+      next->callback(next->arg);
+    }
+    now = until;
+  }
+}  // namespace FakeTimers
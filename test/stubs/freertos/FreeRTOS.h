@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+typedef int BaseType_t;
+typedef std::uint32_t TickType_t;
+
+#define pdTRUE           1
+#define pdFALSE          0
+#define pdPASS           1
+#define portMAX_DELAY    0xffffffff
+#define tskIDLE_PRIORITY 0
+
+typedef std::mutex portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) (mux)->lock()
+#define portEXIT_CRITICAL(mux)  (mux)->unlock()
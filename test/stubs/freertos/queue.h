@@ -0,0 +1,43 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Queue that never blocks, a receive on an empty queue fails right away whatever the timeout
+struct FakeQueue {
+  std::size_t length;
+  std::size_t itemSize;
+  std::deque<std::vector<std::uint8_t>> items;
+  std::mutex mutex;
+};
+
+typedef FakeQueue* QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(int length, int itemSize) {
+  return new FakeQueue {static_cast<std::size_t>(length), static_cast<std::size_t>(itemSize), {}, {}};
+}
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  if (queue->items.size() >= queue->length) {
+    return pdFALSE;
+  }
+  const std::uint8_t* bytes = static_cast<const std::uint8_t*>(item);
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  return pdTRUE;
+}
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  if (queue->items.empty()) {
+    return pdFALSE;
+  }
+  std::memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  return pdTRUE;
+}
+inline void vQueueDelete(QueueHandle_t queue) {
+  delete queue;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+#include <mutex>
+
+typedef std::recursive_mutex* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return new std::recursive_mutex();
+}
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+  return new std::recursive_mutex();
+}
+inline void vSemaphoreDelete(SemaphoreHandle_t mutex) {
+  delete mutex;
+}
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t) {
+  mutex->lock();
+  return pdTRUE;
+}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+  mutex->unlock();
+  return pdTRUE;
+}
+inline BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t mutex, TickType_t ticks) {
+  return xSemaphoreTake(mutex, ticks);
+}
+inline BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t mutex) {
+  return xSemaphoreGive(mutex);
+}
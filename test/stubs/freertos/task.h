@@ -0,0 +1,21 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+#include <vector>
+
+typedef void* TaskHandle_t;
+
+// Tasks are recorded but never started, a test runs their work itself
+namespace FakeTasks {
+  struct Task {
+    void (*fn)(void*);
+    void* arg;
+  };
+  inline std::vector<Task> created;
+}  // namespace FakeTasks
+
+inline BaseType_t xTaskCreatePinnedToCore(void (*fn)(void*), const char*, int, void* arg, int, TaskHandle_t*, int) {
+  FakeTasks::created.push_back({fn, arg});
+  return pdPASS;
+}
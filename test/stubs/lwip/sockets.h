@@ -0,0 +1,22 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <map>
+
+// Like lwIP with LWIP_COMPAT_SOCKETS, setsockopt is a macro. Send timeouts are recorded per socket.
+namespace FakeSockets {
+  inline std::map<int, long> sendTimeoutMs;
+
+  inline int setsockopt(int socket, int level, int option, const void* value, socklen_t length) {
+    if (level != SOL_SOCKET || option != SO_SNDTIMEO || length != sizeof(timeval)) {
+      return -1;
+    }
+    const timeval* timeout = static_cast<const timeval*>(value);
+    sendTimeoutMs[socket]  = timeout->tv_sec * 1000 + timeout->tv_usec / 1000;
+    return 0;
+  }
+}  // namespace FakeSockets
+
+#define setsockopt(socket, level, option, value, length) FakeSockets::setsockopt(socket, level, option, value, length)
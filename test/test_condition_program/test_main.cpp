@@ -0,0 +1,216 @@
+#include <ConditionProgram.h>
+// The application sources are not built as a library in the native env
+#include <ConditionProgram.cpp>
+
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Evaluates the terms directly, one term after the other, as the settings describe them
+class Reference {
+public:
+  Reference(const std::vector<ConditionTerm>& terms, float defaultHysteresis) : m_terms(terms) {
+    if (m_terms.empty()) {
+      ConditionTerm term;
+      term.hysteresis = defaultHysteresis;
+      m_terms.push_back(term);
+    }
+    if (m_terms.size() > CONDITION_MAX_TERMS) {
+      m_terms.resize(CONDITION_MAX_TERMS);
+    }
+    m_latched.assign(m_terms.size(), false);
+    m_heldMs.assign(m_terms.size(), 0);
+  }
+
+  bool evaluate(const ConditionInputs& inputs) {
+    bool result = false;
+    for (std::size_t i = 0; i < m_terms.size(); ++i) {
+      bool passed = term(i, inputs);
+      if (i == 0) {
+        result = passed;
+      } else if (m_terms[i].logic == ConditionLogic::OR) {
+        result = result || passed;
+      } else {
+        result = result && passed;
+      }
+    }
+    return result;
+  }
+
+  void reset() {
+    m_latched.assign(m_terms.size(), false);
+    m_heldMs.assign(m_terms.size(), 0);
+  }
+
+private:
+  bool term(std::size_t i, const ConditionInputs& inputs) {
+    const ConditionTerm& term = m_terms[i];
+
+    float value = NAN;
+    if (term.source == ConditionSource::DECIBELS) {
+      value = inputs.decibels;
+    } else if (term.source == ConditionSource::PITCH) {
+      value = inputs.pitch;
+    } else if (inputs.bands != nullptr) {
+      value = inputs.bands[std::min<int>(term.band, CONDITION_BANDS - 1)];
+    }
+
+    float threshold  = term.source == ConditionSource::DECIBELS && term.routineThreshold ? inputs.thresholdDb : term.threshold;
+    float hysteresis = std::fabs(term.hysteresis);
+    bool below       = term.compare == ConditionCompare::BELOW;
+
+    // Once reached, the value has to fall back past the hysteresis before the term resets
+    if (m_latched[i]) {
+      m_latched[i] = below ? value < threshold + hysteresis : value > threshold - hysteresis;
+    } else {
+      m_latched[i] = below ? value <= threshold : value >= threshold;
+    }
+
+    if (term.holdMs == 0) {
+      return m_latched[i];
+    }
+    m_heldMs[i] = m_latched[i] ? m_heldMs[i] + inputs.elapsedMs : 0;
+    return m_heldMs[i] >= term.holdMs;
+  }
+
+  std::vector<ConditionTerm> m_terms;
+  std::vector<bool> m_latched;
+  std::vector<std::uint32_t> m_heldMs;
+};
+
+static ConditionTerm randomTerm(std::mt19937& rng) {
+  ConditionTerm term;
+  term.source           = static_cast<ConditionSource>(rng() % 3);
+  term.compare          = static_cast<ConditionCompare>(rng() % 2);
+  term.logic            = static_cast<ConditionLogic>(rng() % 2);
+  term.band             = rng() % (CONDITION_BANDS + 4);
+  term.routineThreshold = rng() % 2;
+  term.threshold        = static_cast<float>(rng() % 120) - 20;
+  // Negative values are taken by their magnitude
+  term.hysteresis = static_cast<float>(static_cast<int>(rng() % 21) - 5);
+  term.holdMs     = rng() % 3 == 0 ? rng() % 500 : 0;
+  return term;
+}
+
+// Values around the thresholds, with the occasional missing one
+static float randomValue(std::mt19937& rng) {
+  if (rng() % 50 == 0) {
+    return NAN;
+  }
+  return static_cast<float>(rng() % 1200) / 10 - 20;
+}
+
+void setUp() { }
+void tearDown() { }
+
+void test_empty_program_is_the_routine_threshold() {
+  ConditionProgram program;
+  program.compile(std::vector<ConditionTerm>(), 3);
+
+  ConditionInputs inputs {60, 0, 60, nullptr, 10};
+  TEST_ASSERT_TRUE(program.evaluate(inputs));
+
+  // Held by the hysteresis until the level falls 3 dB below the threshold
+  inputs.decibels = 57.5f;
+  TEST_ASSERT_TRUE(program.evaluate(inputs));
+  inputs.decibels = 57;
+  TEST_ASSERT_FALSE(program.evaluate(inputs));
+  TEST_ASSERT_FALSE(program.usesSpectrum());
+}
+
+void test_too_many_terms_are_dropped() {
+  std::vector<ConditionTerm> terms(CONDITION_MAX_TERMS + 3);
+  ConditionProgram program;
+
+  TEST_ASSERT_FALSE(program.compile(terms));
+  TEST_ASSERT_TRUE(program.size() <= CONDITION_MAX_OPS);
+}
+
+void test_matches_the_reference() {
+  std::mt19937 rng(26);
+  float bands[CONDITION_BANDS];
+  ConditionProgram program;
+  int mismatches = 0;
+
+  for (int round = 0; round < 5000; ++round) {
+    std::vector<ConditionTerm> terms;
+    std::size_t count = rng() % (CONDITION_MAX_TERMS + 3);
+    for (std::size_t i = 0; i < count; ++i) {
+      terms.push_back(randomTerm(rng));
+    }
+    float defaultHysteresis = static_cast<float>(rng() % 6);
+
+    TEST_ASSERT_EQUAL(count <= CONDITION_MAX_TERMS, program.compile(terms, defaultHysteresis));
+    TEST_ASSERT_TRUE(program.size() <= CONDITION_MAX_OPS);
+    Reference reference(terms, defaultHysteresis);
+
+    // Slowly drifting values, so latches and hold timers get to run for a while
+    float decibels = randomValue(rng), pitch = randomValue(rng);
+    for (float& band : bands) {
+      band = randomValue(rng);
+    }
+    for (int step = 0; step < 200; ++step) {
+      decibels += static_cast<float>(static_cast<int>(rng() % 11) - 5);
+      pitch += static_cast<float>(static_cast<int>(rng() % 11) - 5);
+      bands[rng() % CONDITION_BANDS] = randomValue(rng);
+
+      ConditionInputs inputs {rng() % 40 == 0 ? NAN : decibels, pitch, randomValue(rng), rng() % 10 == 0 ? nullptr : bands, static_cast<std::uint16_t>(rng() % 100)};
+      mismatches += program.evaluate(inputs) != reference.evaluate(inputs);
+
+      if (rng() % 100 == 0) {
+        program.reset();
+        reference.reset();
+      }
+    }
+  }
+
+  TEST_ASSERT_EQUAL(0, mismatches);
+}
+
+void test_evaluation_throughput() {
+  // The largest program, every term with a hold so every slot is used
+  std::vector<ConditionTerm> terms;
+  for (int i = 0; i < CONDITION_MAX_TERMS; ++i) {
+    ConditionTerm term;
+    term.source    = static_cast<ConditionSource>(i % 3);
+    term.band      = i;
+    term.logic     = i % 2 == 0 ? ConditionLogic::AND : ConditionLogic::OR;
+    term.threshold = 40;
+    term.holdMs    = 100;
+    terms.push_back(term);
+  }
+  ConditionProgram program;
+  program.compile(terms);
+  TEST_ASSERT_EQUAL(CONDITION_MAX_TERMS * 3 - 1, program.size());
+
+  float bands[CONDITION_BANDS] = {30, 35, 40, 45, 50, 55, 60, 65};
+  const int evaluations        = 1000000;
+  int passed                   = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < evaluations; ++i) {
+    ConditionInputs inputs {static_cast<float>(i % 80), static_cast<float>(i % 60), 50, bands, 10};
+    passed += program.evaluate(inputs);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  double nsPerEvaluation = seconds * 1e9 / evaluations;
+  printf("%d evaluations of %u ops: %.1f ns each, %d passed\n", evaluations, program.size(), nsPerEvaluation, passed);
+  // Blocks arrive every few milliseconds, even a slow host is orders of magnitude faster than that
+  TEST_ASSERT_TRUE(nsPerEvaluation < 2000);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_program_is_the_routine_threshold);
+  RUN_TEST(test_too_many_terms_are_dropped);
+  RUN_TEST(test_matches_the_reference);
+  RUN_TEST(test_evaluation_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,298 @@
+#include "EStopLatch.h"
+#include "radio/TransmitEngine.h"
+// The OpenShock sources are not built as a library in the native env
+#include "radio/TransmitEngine.cpp"
+#include "radio/rmt/MainEncoder.cpp"
+
+#include <unity.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace OpenShock;
+using EStopStatus = EStopManager::EStopStatus;
+
+// Same interval Init is called with, the task samples the button this often unless it is idle
+const std::int64_t UPDATE_INTERVAL_MS = 20;
+
+// A button level from a point in time on, true is pressed
+struct Level {
+  std::int64_t at;
+  bool pressed;
+};
+
+// Runs the e-stop one millisecond at a time. A press edge calls the interrupt and wakes the task right
+// away, otherwise the task samples every UPDATE_INTERVAL_MS while it is not idle.
+class Simulation {
+public:
+  explicit Simulation(std::vector<Level> levels) : m_levels(levels) { m_latch.Begin(false, 0); }
+
+  void RunUntil(std::int64_t untilMs) {
+    for (; m_now < untilMs; ++m_now) {
+      bool pressed = levelAt(m_now);
+      bool edge    = pressed && !m_pressed;
+      m_pressed    = pressed;
+
+      if (edge) {
+        m_latch.Latch();
+      }
+      if (edge || (!m_latch.IsIdle() && m_now >= m_nextUpdate)) {
+        m_latch.Update(pressed, m_now);
+        m_nextUpdate = m_now + UPDATE_INTERVAL_MS;
+      }
+    }
+  }
+
+  EStopStatus Status() const { return m_latch.Status(); }
+
+  EStopLatch m_latch;
+
+private:
+  bool levelAt(std::int64_t now) const {
+    bool pressed = false;
+    for (const Level& level : m_levels) {
+      if (level.at <= now) {
+        pressed = level.pressed;
+      }
+    }
+    return pressed;
+  }
+
+  std::vector<Level> m_levels;
+  std::int64_t m_now        = 0;
+  std::int64_t m_nextUpdate = 0;
+  bool m_pressed            = false;
+};
+
+void setUp() { }
+void tearDown() { }
+
+void test_interrupt_latches_before_the_task_runs() {
+  EStopLatch latch;
+  latch.Begin(false, 0);
+
+  TEST_ASSERT_TRUE(latch.Latch());
+  TEST_ASSERT_TRUE(latch.IsEStopped());
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(EStopStatus::ESTOPPED_AND_HELD), static_cast<int>(latch.Status()));
+
+  // Bounces of the same press fire the interrupt again without effect
+  TEST_ASSERT_FALSE(latch.Latch());
+}
+
+void test_bouncing_release_stays_held_until_stable() {
+  // Contact bounce for 30ms after letting go, each bounce back to pressed is another interrupt
+  Simulation sim({{100, true}, {300, false}, {305, true}, {310, false}, {320, true}, {330, false}});
+
+  sim.RunUntil(101);
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(EStopStatus::ESTOPPED_AND_HELD), static_cast<int>(sim.Status()));
+
+  sim.RunUntil(330 + EStopLatch::DEBOUNCE_MS - 1);
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(EStopStatus::ESTOPPED_AND_HELD), static_cast<int>(sim.Status()));
+
+  // The task sees the release at its next sample and acts at the first sample after the debounce
+  sim.RunUntil(330 + UPDATE_INTERVAL_MS + EStopLatch::DEBOUNCE_MS + UPDATE_INTERVAL_MS);
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(EStopStatus::ESTOPPED), static_cast<int>(sim.Status()));
+}
+
+void test_short_press_does_not_clear() {
+  Simulation sim({{100, true}, {300, false}, {1000, true}, {2000, false}});
+
+  sim.RunUntil(3000);
+
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(EStopStatus::ESTOPPED), static_cast<int>(sim.Status()));
+}
+
+void test_press_shorter_than_the_hold_does_not_clear() {
+  Simulation sim({{100, true}, {300, false}, {1000, true}, {1000 + EStopLatch::HOLD_TO_CLEAR_MS - 100, false}});
+
+  // The press is seen, but the e-stop stays as it is while the button is held
+  sim.RunUntil(1000 + EStopLatch::HOLD_TO_CLEAR_MS - 101);
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(EStopStatus::ESTOPPED), static_cast<int>(sim.Status()));
+
+  sim.RunUntil(1000 + EStopLatch::HOLD_TO_CLEAR_MS + 1000);
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(EStopStatus::ESTOPPED), static_cast<int>(sim.Status()));
+}
+
+void test_long_press_clears_once_released() {
+  Simulation sim({{100, true}, {300, false}, {1000, true}, {1000 + EStopLatch::HOLD_TO_CLEAR_MS + 100, false}});
+
+  sim.RunUntil(1000 + EStopLatch::HOLD_TO_CLEAR_MS - 1);
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(EStopStatus::ESTOPPED), static_cast<int>(sim.Status()));
+
+  // Held long enough, but the e-stop stays until the button is let go
+  sim.RunUntil(1000 + EStopLatch::HOLD_TO_CLEAR_MS + UPDATE_INTERVAL_MS);
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(EStopStatus::ESTOPPED_CLEARED), static_cast<int>(sim.Status()));
+  TEST_ASSERT_TRUE(sim.m_latch.IsEStopped());
+
+  sim.RunUntil(1000 + EStopLatch::HOLD_TO_CLEAR_MS + 300);
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(EStopStatus::ALL_CLEAR), static_cast<int>(sim.Status()));
+  TEST_ASSERT_TRUE(sim.m_latch.IsIdle());
+}
+
+void test_task_latches_an_edge_the_interrupt_missed() {
+  EStopLatch latch;
+  latch.Begin(false, 0);
+
+  // No interrupt, the task only sees the pressed level
+  std::int64_t now = 0;
+  for (; now < EStopLatch::DEBOUNCE_MS && !latch.IsEStopped(); now += UPDATE_INTERVAL_MS) {
+    latch.Update(true, now);
+  }
+  TEST_ASSERT_FALSE(latch.IsEStopped());
+
+  TEST_ASSERT_TRUE(latch.Update(true, now));
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(EStopStatus::ESTOPPED_AND_HELD), static_cast<int>(latch.Status()));
+}
+
+void test_latch_is_never_lost_to_the_task() {
+  // The interrupt fires at an arbitrary point while the task keeps sampling a released button
+  for (int round = 0; round < 200; ++round) {
+    EStopLatch latch;
+    latch.Begin(false, 0);
+
+    std::atomic<bool> latched {false};
+    std::thread task([&] {
+      for (std::int64_t now = 0; now < 2000; ++now) {
+        latch.Update(false, now);
+      }
+    });
+    std::thread isr([&] { latched = latch.Latch(); });
+    isr.join();
+    task.join();
+
+    TEST_ASSERT_TRUE(latched);
+    TEST_ASSERT_TRUE(latch.IsEStopped());
+  }
+}
+
+static bool samePulses(const Rmt::Sequence& a, const Rmt::Sequence& b) {
+  if (a.length != b.length) {
+    return false;
+  }
+  for (std::uint8_t i = 0; i < a.length; ++i) {
+    if (a.pulses[i].duration0 != b.pulses[i].duration0 || a.pulses[i].level0 != b.pulses[i].level0 || a.pulses[i].duration1 != b.pulses[i].duration1 || a.pulses[i].level1 != b.pulses[i].level1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The transmit task with the e-stop check before every frame, against a peripheral that records the frames.
+// Wakeups are rounded up to whole FreeRTOS ticks like the task's sleep.
+class Transmission : public TransmitEngine::Backend {
+public:
+  static constexpr std::int64_t TICK_US = 1000;
+
+  Transmission() : m_engine(*this, 16) { }
+
+  void Send(ShockerModelType model, std::uint16_t shockerId, std::int64_t durationMs) {
+    m_slots.emplace_back(new command_t());
+    command_t* cmd   = m_slots.back().get();
+    cmd->until       = m_now / 1000 + durationMs;
+    cmd->model       = model;
+    cmd->shockerId   = shockerId;
+    cmd->overwrite   = true;
+    cmd->keepAlive   = false;
+    cmd->queuedAt    = m_now;
+    cmd->transmitted = false;
+    Rmt::GetSequence(cmd->sequence, model, shockerId, ShockerCommandType::Shock, 50);
+    cmd->repeatUs = cmd->sequence.durationTicks();
+    m_engine.Add(cmd, m_now);
+  }
+
+  /// @param pressAt When the interrupt latches the e-stop, in microseconds
+  void RunUntil(std::int64_t untilUs, std::int64_t pressAt) {
+    while (m_now < untilUs) {
+      if (!m_latch.IsEStopped() && m_now >= pressAt) {
+        // The interrupt fired while the task slept, it recorded the time of the press itself
+        m_latch.Latch();
+        m_estoppedAtMs = pressAt / 1000;
+      }
+      if (m_latch.IsEStopped()) {
+        m_engine.EStop(m_estoppedAtMs);
+      }
+      m_engine.Service(m_now);
+
+      std::int64_t wakeAt = m_engine.WakeAt();
+      if (wakeAt == INT64_MAX) {
+        return;
+      }
+      m_now = wakeAt <= m_now ? m_now : m_now + (wakeAt - m_now + TICK_US - 1) / TICK_US * TICK_US;
+    }
+  }
+
+  bool Write(Rmt::Sequence& frame) override {
+    bool live = false;
+    for (const std::unique_ptr<command_t>& slot : m_slots) {
+      live = live || samePulses(frame, slot->sequence);
+    }
+
+    std::int64_t end = m_now + frame.durationTicks();
+    if (live) {
+      lastLiveStart = m_now;
+      lastLiveEnd   = end;
+    }
+    lastEnd  = end;
+    maxAirUs = std::max<std::int64_t>(maxAirUs, frame.durationTicks());
+    frames++;
+    return true;
+  }
+  void Release(command_t* cmd) override { }
+
+  std::int64_t frames        = 0;
+  std::int64_t lastLiveStart = 0;
+  std::int64_t lastLiveEnd   = 0;
+  std::int64_t lastEnd       = 0;
+  std::int64_t maxAirUs      = 0;
+
+private:
+  TransmitEngine m_engine;
+  EStopLatch m_latch;
+  // The tick grid of the task is not aligned with the milliseconds of the clock
+  std::int64_t m_now          = 337;
+  std::int64_t m_estoppedAtMs = 0;
+  std::vector<std::unique_ptr<command_t>> m_slots;
+};
+
+void test_no_live_frame_starts_after_the_press() {
+  // The press lands at every point of the frames of three shockers on air, up to 2 seconds in
+  std::int64_t worstLive = 0;
+  std::int64_t worstAny  = 0;
+  std::int64_t maxAirUs  = 0;
+  for (std::int64_t pressAt = 100000; pressAt < 2100000; pressAt += 7919) {
+    Transmission tx;
+    tx.Send(ShockerModelType::CaiXianlin, 1, 10000);
+    tx.Send(ShockerModelType::Petrainer, 2, 10000);
+    tx.Send(ShockerModelType::Petrainer998DR, 3, 10000);
+    tx.RunUntil(20000000, pressAt);
+
+    TEST_ASSERT_GREATER_THAN(0, tx.frames);
+    TEST_ASSERT_TRUE(tx.lastLiveStart < pressAt);
+    worstLive = std::max(worstLive, tx.lastLiveEnd - pressAt);
+    worstAny  = std::max(worstAny, tx.lastEnd - pressAt);
+    maxAirUs  = std::max(maxAirUs, tx.maxAirUs);
+  }
+
+  // Only the frame already on air finishes, no live frame starts after the press
+  TEST_ASSERT_GREATER_THAN(0, worstLive);
+  TEST_ASSERT_LESS_OR_EQUAL(maxAirUs, worstLive);
+  // After that the shockers get their zero sequence for the end duration, then the channel is silent
+  TEST_ASSERT_LESS_OR_EQUAL(TransmitEngine::END_DURATION_MS * 1000 + maxAirUs + Transmission::TICK_US, worstAny);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_interrupt_latches_before_the_task_runs);
+  RUN_TEST(test_bouncing_release_stays_held_until_stable);
+  RUN_TEST(test_short_press_does_not_clear);
+  RUN_TEST(test_press_shorter_than_the_hold_does_not_clear);
+  RUN_TEST(test_long_press_clears_once_released);
+  RUN_TEST(test_task_latches_an_edge_the_interrupt_missed);
+  RUN_TEST(test_latch_is_never_lost_to_the_task);
+  RUN_TEST(test_no_live_frame_starts_after_the_press);
+  return UNITY_END();
+}
@@ -0,0 +1,256 @@
+#include <FSPersistence.h>
+// The framework is not built as a library in the native env. FactoryResetService only gives the store its
+// directory, its guard keeps the web server out.
+#define FactoryResetService_h
+#define FS_CONFIG_DIRECTORY "/config"
+#include <ConfigStore.cpp>
+#include <FSPersistence.cpp>
+#include <StatefulService.cpp>
+
+#include <unity.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static const char* const SETTINGS_FILE = "/config/settings.json";
+static const char* const TEMP_FILE     = "/config/settings.json.tmp";
+
+struct Settings {
+  int level   = 0;
+  String name = "shocker";
+
+  static void read(Settings& settings, JsonObject& root) {
+    root["level"] = settings.level;
+    root["name"]  = settings.name;
+  }
+
+  static StateUpdateResult update(JsonObject& root, Settings& settings) {
+    settings.level = root["level"] | 5;
+    settings.name  = root["name"] | "default";
+    return StateUpdateResult::CHANGED;
+  }
+};
+
+// The dispatcher task is never started on the host, the test drains its queue instead
+static int runDispatcher() {
+  QueueHandle_t queue = static_cast<QueueHandle_t>(FakeTasks::created.front().arg);
+  UpdateDispatchTarget* target;
+  int dispatched = 0;
+  while (xQueueReceive(queue, &target, 0) == pdTRUE) {
+    target->dispatchUpdate();
+    dispatched++;
+  }
+  return dispatched;
+}
+
+static void setLevel(StatefulService<Settings>& service, int level) {
+  service.update(
+    [level](Settings& settings) {
+      settings.level = level;
+      return StateUpdateResult::CHANGED;
+    },
+    "test"
+  );
+  runDispatcher();
+}
+
+// Lets time pass in steps, running what the timers queued on the dispatcher after every step
+static void advanceMs(int ms, int stepMs = 10) {
+  for (int elapsed = 0; elapsed < ms; elapsed += stepMs) {
+    FakeTimers::advance(stepMs * 1000LL);
+    runDispatcher();
+  }
+}
+
+static std::string contents(FS& fs, const char* path) {
+  const std::vector<std::uint8_t>& data = fs.files[path];
+  return std::string(data.begin(), data.end());
+}
+
+template<class T>
+static std::uint32_t stat(FSPersistence<T>& persistence, const char* name) {
+  DynamicJsonDocument document(256);
+  JsonObject root = document.to<JsonObject>();
+  persistence.readStats(root);
+  return root[name];
+}
+
+void setUp() {
+  FakeTimers::manual = true;
+  UpdateDispatcher::begin();
+}
+void tearDown() { }
+
+void test_without_a_delay_every_update_is_written() {
+  FS fs;
+  StatefulService<Settings> service;
+  FSPersistence<Settings> persistence(Settings::read, Settings::update, &service, &fs, SETTINGS_FILE);
+  persistence.setWriteDelay(0, 0);
+
+  for (int level = 1; level <= 10; ++level) {
+    setLevel(service, level);
+  }
+
+  TEST_ASSERT_EQUAL(10, fs.opensForWrite);
+  TEST_ASSERT_EQUAL(10, stat(persistence, "writes"));
+  TEST_ASSERT_EQUAL_STRING("{\"level\":10,\"name\":\"shocker\"}", contents(fs, SETTINGS_FILE).c_str());
+}
+
+void test_burst_is_written_once() {
+  FS fs;
+  StatefulService<Settings> service;
+  FSPersistence<Settings> persistence(Settings::read, Settings::update, &service, &fs, SETTINGS_FILE);
+
+  // A slider dragged for a second, an update every 20 ms
+  for (int level = 1; level <= 50; ++level) {
+    setLevel(service, level);
+    advanceMs(20);
+  }
+  TEST_ASSERT_EQUAL(0, fs.opensForWrite);
+
+  // Written once the updates paused for the quiet period, 20 ms of it passed in the loop
+  advanceMs(FS_PERSISTENCE_QUIET_MS - 30);
+  TEST_ASSERT_EQUAL(0, fs.opensForWrite);
+  advanceMs(10);
+  TEST_ASSERT_EQUAL(1, fs.opensForWrite);
+  TEST_ASSERT_EQUAL(1, stat(persistence, "writes"));
+  TEST_ASSERT_EQUAL(49, stat(persistence, "coalesced"));
+  TEST_ASSERT_EQUAL_STRING("{\"level\":50,\"name\":\"shocker\"}", contents(fs, SETTINGS_FILE).c_str());
+
+  printf("50 updates: %u flash writes, %u bytes, %u erases estimated\n", stat(persistence, "writes"), stat(persistence, "bytes"), stat(persistence, "erases"));
+}
+
+void test_latency_is_bounded_by_the_max_delay() {
+  FS fs;
+  StatefulService<Settings> service;
+  FSPersistence<Settings> persistence(Settings::read, Settings::update, &service, &fs, SETTINGS_FILE);
+
+  // Updates every half quiet period never pause long enough, the max delay forces the writes
+  const int intervalMs = FS_PERSISTENCE_QUIET_MS / 2;
+  const int updates    = 25;
+  std::int64_t oldestUnwritten = -1;
+  std::int64_t worstLatencyMs  = 0;
+  std::size_t writes           = 0;
+  for (int i = 0; i < updates + FS_PERSISTENCE_QUIET_MS / intervalMs + 1; ++i) {
+    if (i < updates) {
+      setLevel(service, i + 1);
+      if (oldestUnwritten < 0) {
+        oldestUnwritten = FakeTimers::now;
+      }
+    }
+    for (int elapsed = 0; elapsed < intervalMs; elapsed += 10) {
+      advanceMs(10);
+      if (fs.opensForWrite != writes) {
+        writes          = fs.opensForWrite;
+        worstLatencyMs  = std::max(worstLatencyMs, (FakeTimers::now - oldestUnwritten) / 1000);
+        oldestUnwritten = -1;
+      }
+    }
+  }
+
+  printf("%d updates over %d ms: %zu writes, worst latency %lld ms\n", updates, updates * intervalMs, writes, static_cast<long long>(worstLatencyMs));
+  TEST_ASSERT_EQUAL(-1, oldestUnwritten);
+  TEST_ASSERT_EQUAL(FS_PERSISTENCE_MAX_DELAY_MS, worstLatencyMs);
+  TEST_ASSERT_EQUAL(updates * intervalMs / FS_PERSISTENCE_MAX_DELAY_MS + 1, writes);
+  TEST_ASSERT_EQUAL_STRING("{\"level\":25,\"name\":\"shocker\"}", contents(fs, SETTINGS_FILE).c_str());
+}
+
+void test_flush_writes_a_pending_update_right_away() {
+  FS fs;
+  StatefulService<Settings> service;
+  FSPersistence<Settings> persistence(Settings::read, Settings::update, &service, &fs, SETTINGS_FILE);
+
+  setLevel(service, 3);
+  persistence.flush();
+  TEST_ASSERT_EQUAL(1, fs.opensForWrite);
+
+  // Nothing left for the timer
+  advanceMs(FS_PERSISTENCE_MAX_DELAY_MS);
+  TEST_ASSERT_EQUAL(1, fs.opensForWrite);
+}
+
+void test_file_is_replaced_through_a_temporary_file() {
+  FS fs;
+  StatefulService<Settings> service;
+  FSPersistence<Settings> persistence(Settings::read, Settings::update, &service, &fs, SETTINGS_FILE);
+  persistence.setWriteDelay(0, 0);
+
+  setLevel(service, 1);
+  TEST_ASSERT_EQUAL(1, fs.renames);
+  TEST_ASSERT_TRUE(fs.exists("/config"));
+  TEST_ASSERT_FALSE(fs.exists(TEMP_FILE));
+  std::string written = contents(fs, SETTINGS_FILE);
+
+  // A short write on a full file system leaves the old file
+  fs.freeBytes = 5;
+  setLevel(service, 2);
+  TEST_ASSERT_EQUAL_STRING(written.c_str(), contents(fs, SETTINGS_FILE).c_str());
+  TEST_ASSERT_FALSE(fs.exists(TEMP_FILE));
+  fs.freeBytes = SIZE_MAX;
+
+  // So does a failed rename
+  fs.failRenames = true;
+  setLevel(service, 3);
+  TEST_ASSERT_EQUAL_STRING(written.c_str(), contents(fs, SETTINGS_FILE).c_str());
+  TEST_ASSERT_FALSE(fs.exists(TEMP_FILE));
+  TEST_ASSERT_EQUAL(1, stat(persistence, "writes"));
+}
+
+void test_temporary_file_of_a_lost_write_is_ignored() {
+  FS fs;
+  fs.files[SETTINGS_FILE] = {'{', '"', 'l', 'e', 'v', 'e', 'l', '"', ':', '7', '}'};
+  // Power was lost while the next version was written
+  fs.files[TEMP_FILE] = {'{', '"', 'l', 'e'};
+
+  StatefulService<Settings> service;
+  FSPersistence<Settings> persistence(Settings::read, Settings::update, &service, &fs, SETTINGS_FILE);
+  persistence.readFromFS();
+
+  int level = 0;
+  service.read([&](Settings& settings) { level = settings.level; });
+  TEST_ASSERT_EQUAL(7, level);
+  TEST_ASSERT_FALSE(fs.exists(TEMP_FILE));
+  TEST_ASSERT_EQUAL(0, fs.opensForWrite);
+}
+
+void test_store_takes_over_the_files() {
+  // The store keeps the file system until the restart, so this runs last
+  static FS fs;
+  fs.files[SETTINGS_FILE] = {'{', '"', 'l', 'e', 'v', 'e', 'l', '"', ':', '7', '}'};
+  ConfigStore::begin(&fs);
+
+  StatefulService<Settings> service;
+  FSPersistence<Settings> persistence(Settings::read, Settings::update, &service, &fs, SETTINGS_FILE);
+  persistence.readFromFS();
+
+  // Moved into the store, which is replaced through its own temporary file
+  TEST_ASSERT_FALSE(fs.exists(SETTINGS_FILE));
+  TEST_ASSERT_TRUE(fs.exists(CONFIG_STORE_FILE));
+  TEST_ASSERT_FALSE(fs.exists(String(CONFIG_STORE_FILE) + ".tmp"));
+  TEST_ASSERT_EQUAL(1, fs.renames);
+
+  for (int level = 1; level <= 20; ++level) {
+    setLevel(service, level);
+    advanceMs(100);
+  }
+  advanceMs(FS_PERSISTENCE_QUIET_MS);
+  TEST_ASSERT_EQUAL(2, fs.renames);
+
+  std::vector<std::uint8_t> slice;
+  TEST_ASSERT_TRUE(ConfigStore::get(SETTINGS_FILE, slice));
+  TEST_ASSERT_EQUAL_STRING("{\"level\":20,\"name\":\"default\"}", std::string(slice.begin(), slice.end()).c_str());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_without_a_delay_every_update_is_written);
+  RUN_TEST(test_burst_is_written_once);
+  RUN_TEST(test_latency_is_bounded_by_the_max_delay);
+  RUN_TEST(test_flush_writes_a_pending_update_right_away);
+  RUN_TEST(test_file_is_replaced_through_a_temporary_file);
+  RUN_TEST(test_temporary_file_of_a_lost_write_is_ignored);
+  RUN_TEST(test_store_takes_over_the_files);
+  return UNITY_END();
+}
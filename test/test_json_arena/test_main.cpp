@@ -0,0 +1,181 @@
+#include <JsonArena.h>
+// The framework is not built as a library in the native env
+#include <JsonArena.cpp>
+
+#include <unity.h>
+
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What {"v":""} takes, a member slot plus the copied key and value
+static constexpr std::size_t MIN_INPUT = JsonDocument::SLOT_SIZE + 3;
+
+// A document that takes exactly memory bytes once parsed
+static std::string input(std::size_t memory) {
+  return "{\"v\":\"" + std::string(memory - MIN_INPUT, 'x') + "\"}";
+}
+
+// Waits until every thread arrived, so the threads hold their leases at the same time
+class Rendezvous {
+public:
+  explicit Rendezvous(int count) : m_waiting(count) { }
+
+  void arrive() {
+    m_waiting--;
+    while (m_waiting.load() > 0) {
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  std::atomic<int> m_waiting;
+};
+
+void setUp() { }
+void tearDown() { }
+
+void test_lease_reuses_the_pooled_document() {
+  JsonArenaStats stats("reuse", 1024);
+
+  JsonDocument* first;
+  {
+    JsonArena arena(stats);
+    first = &arena.document();
+  }
+  std::size_t allocations = DynamicJsonDocument::allocations;
+  {
+    JsonArena arena(stats);
+    TEST_ASSERT_TRUE(first == &arena.document());
+    TEST_ASSERT_EQUAL(0, arena.document().memoryUsage());
+  }
+  TEST_ASSERT_EQUAL(allocations, DynamicJsonDocument::allocations);
+}
+
+void test_nested_lease_takes_another_document() {
+  JsonArenaStats stats("nested", 1024);
+
+  JsonArena outer(stats);
+  JsonArena inner(stats);
+  TEST_ASSERT_TRUE(&outer.document() != &inner.document());
+}
+
+void test_overflow_grows_the_service() {
+  JsonArenaStats stats("grow", 1024);
+  std::string payload = input(3000);
+  int handled = 0;
+
+  DeserializationError error = JsonArena::deserialize(stats, payload.c_str(), payload.size(), [&](JsonDocument& document) {
+    TEST_ASSERT_TRUE(document.capacity() >= 3000);
+    handled++;
+  });
+
+  TEST_ASSERT_TRUE(error == DeserializationError::Ok);
+  TEST_ASSERT_EQUAL(1, handled);
+  TEST_ASSERT_EQUAL(4096, stats.capacity);
+  TEST_ASSERT_EQUAL(2, stats.overflows);
+  TEST_ASSERT_EQUAL(3000, stats.highWater);
+}
+
+void test_released_documents_stay_within_the_budget() {
+  JsonArenaStats stats("large", JSON_ARENA_MAX_SIZE);
+  {
+    JsonArena first(stats);
+    JsonArena second(stats);
+    JsonArena third(stats);
+    TEST_ASSERT_TRUE(DynamicJsonDocument::liveBytes >= 3 * JSON_ARENA_MAX_SIZE);
+  }
+
+  // One large service must not pin its peak in every slot it ever used
+  TEST_ASSERT_TRUE(DynamicJsonDocument::liveBytes <= JSON_ARENA_POOL_BUDGET);
+}
+
+void test_documents_of_finished_threads_are_reused() {
+  JsonArenaStats stats("threads", 512);
+
+  // Short-lived tasks, every wave holds the whole pool at once
+  auto wave = [&]() {
+    Rendezvous rendezvous(JSON_ARENA_POOL_SIZE);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < JSON_ARENA_POOL_SIZE; ++i) {
+      threads.emplace_back([&]() {
+        JsonArena arena(stats);
+        rendezvous.arrive();
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  };
+
+  wave();
+  std::size_t allocations = DynamicJsonDocument::allocations;
+  wave();
+  TEST_ASSERT_EQUAL(allocations, DynamicJsonDocument::allocations);
+}
+
+void test_fragmentation_stress() {
+  // A small, a medium and a large service, each growing from a too small start
+  JsonArenaStats small("small", 256);
+  JsonArenaStats medium("medium", 512);
+  JsonArenaStats large("large", 1024);
+  JsonArenaStats* services[] = {&small, &medium, &large};
+  const std::size_t longest[] = {400, 1800, 6000};
+  const int leases           = 20000;
+
+  std::atomic<int> failures {0};
+  auto run = [&](int seed) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < JSON_ARENA_POOL_SIZE; ++t) {
+      threads.emplace_back([&, t]() {
+        std::mt19937 rng(seed * 100 + t);
+        for (int i = 0; i < leases; ++i) {
+          int service         = rng() % 3;
+          std::string payload = input(MIN_INPUT + rng() % (longest[service] - MIN_INPUT + 1));
+          DeserializationError error = JsonArena::deserialize(*services[service], payload.c_str(), payload.size(), [](JsonDocument&) { });
+          failures += error != DeserializationError::Ok;
+          if (i % 64 == 0) {
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  };
+
+  // Warm-up settles the service capacities, the measured run should live off the pool
+  run(1);
+  std::size_t allocations = DynamicJsonDocument::allocations;
+  run(2);
+  std::size_t steady = DynamicJsonDocument::allocations - allocations;
+
+  printf("%d leases: %zu allocations after warm-up, %zu bytes pooled\n", JSON_ARENA_POOL_SIZE * leases, steady, DynamicJsonDocument::liveBytes.load());
+  TEST_ASSERT_EQUAL(0, failures.load());
+  // A lease is held while the input is parsed. A thread preempted meanwhile now and then leaves more large
+  // documents out at once than the budget keeps, those are trimmed and allocated again later.
+  TEST_ASSERT_TRUE(steady * 20 < JSON_ARENA_POOL_SIZE * leases);
+  TEST_ASSERT_TRUE(DynamicJsonDocument::liveBytes <= JSON_ARENA_POOL_BUDGET);
+
+  // Concurrent leases of one service must not lose updates of its stats. A service can get by with a
+  // smaller capacity when it was handed larger documents, it never doubles past what it needed.
+  for (int i = 0; i < 3; ++i) {
+    TEST_ASSERT_EQUAL(longest[i], services[i]->highWater);
+    TEST_ASSERT_TRUE(services[i]->capacity <= 2 * longest[i]);
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_lease_reuses_the_pooled_document);
+  RUN_TEST(test_nested_lease_takes_another_document);
+  RUN_TEST(test_overflow_grows_the_service);
+  RUN_TEST(test_released_documents_stay_within_the_budget);
+  RUN_TEST(test_documents_of_finished_threads_are_reused);
+  RUN_TEST(test_fragmentation_stress);
+  return UNITY_END();
+}
@@ -0,0 +1,162 @@
+#include "util/MpmcRing.h"
+
+#include <unity.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace OpenShock;
+
+// Values carry their producer in the upper bits and a per-producer counter in the lower bits
+const int PRODUCERS               = 4;
+const std::uint64_t ITEMS         = 200000;
+const int PRODUCER_SHIFT          = 40;
+const std::uint64_t SEQUENCE_MASK = (1ull << PRODUCER_SHIFT) - 1;
+
+void setUp() { }
+void tearDown() { }
+
+void test_empty_ring_pops_nothing() {
+  MpmcRing<int, 4> ring;
+  int value;
+
+  TEST_ASSERT_FALSE(ring.pop(value));
+}
+
+void test_full_ring_rejects_the_newest_value() {
+  MpmcRing<int, 4> ring;
+
+  for (int i = 0; i < 4; ++i) {
+    TEST_ASSERT_TRUE(ring.push(i));
+  }
+  TEST_ASSERT_FALSE(ring.push(4));
+
+  // The queued values are untouched by the rejected push
+  int value;
+  for (int i = 0; i < 4; ++i) {
+    TEST_ASSERT_TRUE(ring.pop(value));
+    TEST_ASSERT_EQUAL_INT(i, value);
+  }
+  TEST_ASSERT_FALSE(ring.pop(value));
+}
+
+void test_order_holds_across_wraparound() {
+  MpmcRing<int, 4> ring;
+  int value;
+
+  // Keeps the ring partially filled so head and tail pass the end of the cells many times
+  int next = 0;
+  for (int i = 0; i < 1000; ++i) {
+    TEST_ASSERT_TRUE(ring.push(i));
+    if (i - next == 3 || i % 2 != 0) {
+      TEST_ASSERT_TRUE(ring.pop(value));
+      TEST_ASSERT_EQUAL_INT(next++, value);
+    }
+  }
+  while (ring.pop(value)) {
+    TEST_ASSERT_EQUAL_INT(next++, value);
+  }
+  TEST_ASSERT_EQUAL_INT(1000, next);
+}
+
+void test_producers_lose_nothing_and_keep_their_order() {
+  MpmcRing<std::uint64_t, 16> ring;
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < PRODUCERS; ++p) {
+    producers.emplace_back([&ring, p] {
+      for (std::uint64_t i = 0; i < ITEMS; ++i) {
+        std::uint64_t value = (static_cast<std::uint64_t>(p) << PRODUCER_SHIFT) | i;
+        while (!ring.push(value)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  std::uint64_t next[PRODUCERS] = {};
+  std::uint64_t received        = 0;
+  bool ordered                  = true;
+  while (received < PRODUCERS * ITEMS) {
+    std::uint64_t value;
+    if (!ring.pop(value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    int producer = static_cast<int>(value >> PRODUCER_SHIFT);
+    ordered      = ordered && (value & SEQUENCE_MASK) == next[producer];
+    next[producer]++;
+    received++;
+  }
+
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+
+  std::uint64_t value;
+  TEST_ASSERT_TRUE(ordered);
+  TEST_ASSERT_FALSE(ring.pop(value));
+  for (int p = 0; p < PRODUCERS; ++p) {
+    TEST_ASSERT_EQUAL_UINT64(ITEMS, next[p]);
+  }
+}
+
+void test_consumers_take_every_value_once() {
+  // Mirrors the transmit task and ClearPendingCommands popping the same ring
+  MpmcRing<std::uint32_t, 16> ring;
+  const std::uint32_t total = PRODUCERS * ITEMS;
+
+  std::vector<std::atomic<std::uint8_t>> seen(total);
+  std::atomic<std::uint32_t> received {0};
+
+  std::vector<std::thread> consumers;
+  for (int c = 0; c < 2; ++c) {
+    consumers.emplace_back([&] {
+      while (received.load() < total) {
+        std::uint32_t value;
+        if (ring.pop(value)) {
+          seen[value].fetch_add(1);
+          received.fetch_add(1);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < PRODUCERS; ++p) {
+    producers.emplace_back([&ring, p] {
+      for (std::uint32_t i = p; i < total; i += PRODUCERS) {
+        while (!ring.push(i)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+  for (std::thread& consumer : consumers) {
+    consumer.join();
+  }
+
+  std::uint32_t once = 0;
+  for (std::atomic<std::uint8_t>& count : seen) {
+    once += count.load() == 1;
+  }
+  TEST_ASSERT_EQUAL_UINT32(total, once);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_ring_pops_nothing);
+  RUN_TEST(test_full_ring_rejects_the_newest_value);
+  RUN_TEST(test_order_holds_across_wraparound);
+  RUN_TEST(test_producers_lose_nothing_and_keep_their_order);
+  RUN_TEST(test_consumers_take_every_value_once);
+  return UNITY_END();
+}
@@ -0,0 +1,237 @@
+#include <FSPersistence.h>
+#include <StateFields.h>
+// The framework is not built as a library in the native env. FactoryResetService only gives the store its
+// directory, its guard keeps the web server out.
+#define FactoryResetService_h
+#define FS_CONFIG_DIRECTORY "/config"
+#include <ConfigStore.cpp>
+#include <FSPersistence.cpp>
+#include <StatefulService.cpp>
+
+#include <unity.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char* const SETTINGS_FILE = "/config/settings.json";
+// The buffer of the application settings
+static const std::size_t APP_BUFFER_SIZE = 4096;
+
+// Shaped like the application settings, the largest file kept in the binary format
+struct Step {
+  int type;
+  int startDelay;
+  int endDelay;
+  std::vector<double> timeRange;
+  std::vector<double> strengthRange;
+};
+
+struct Shocker {
+  int model;
+  std::uint16_t id;
+  bool enabled;
+  int maxShock;
+  int maxVibe;
+};
+
+class Routine {
+public:
+  int idlePeriodMinMs       = 10000;
+  int idlePeriodMaxMs       = 10000;
+  int actionPeriodMinMs     = 1000;
+  int actionPeriodMaxMs     = 1000;
+  int decibelThresholdMin   = 80;
+  int decibelThresholdMax   = 80;
+  int micSensitivity        = 26;
+  int collarMinShock        = 5;
+  int collarMaxShock        = 75;
+  int collarMinVibe         = 5;
+  int collarMaxVibe         = 100;
+  int alertDuration         = 1000;
+  int alertStrength         = 100;
+  double passThreshold      = 0;
+  double detectHysteresisDb = 0;
+
+  std::vector<Step> steps;
+  std::vector<Shocker> shockers;
+
+  static constexpr auto fields() {
+    return std::make_tuple(
+      stateField("idle_period_min_ms", &Routine::idlePeriodMinMs),
+      stateField("idle_period_max_ms", &Routine::idlePeriodMaxMs),
+      stateField("action_period_min_ms", &Routine::actionPeriodMinMs),
+      stateField("action_period_max_ms", &Routine::actionPeriodMaxMs),
+      stateField("decibel_threshold_min", &Routine::decibelThresholdMin),
+      stateField("decibel_threshold_max", &Routine::decibelThresholdMax),
+      stateField("mic_sensitivity", &Routine::micSensitivity),
+      stateField("collar_min_shock", &Routine::collarMinShock),
+      stateField("collar_max_shock", &Routine::collarMaxShock),
+      stateField("collar_min_vibe", &Routine::collarMinVibe),
+      stateField("collar_max_vibe", &Routine::collarMaxVibe),
+      stateField("alert_duration", &Routine::alertDuration),
+      stateField("alert_strength", &Routine::alertStrength),
+      stateField("pass_threshold", &Routine::passThreshold),
+      stateField("detect_hysteresis_db", &Routine::detectHysteresisDb)
+    );
+  }
+
+  static void read(Routine& routine, JsonObject& root) {
+    StateFields<Routine>::read(routine, root);
+
+    JsonArray steps = root.createNestedArray("correction_steps");
+    for (const Step& step : routine.steps) {
+      JsonObject object   = steps.createNestedObject();
+      object["type"]        = step.type;
+      object["start_delay"] = step.startDelay;
+      object["end_delay"]   = step.endDelay;
+      JsonArray timeRange = object.createNestedArray("time_range");
+      for (double time : step.timeRange) {
+        timeRange.add(time);
+      }
+      JsonArray strengthRange = object.createNestedArray("strength_range");
+      for (double strength : step.strengthRange) {
+        strengthRange.add(strength);
+      }
+    }
+
+    JsonArray shockers = root.createNestedArray("shockers");
+    for (const Shocker& shocker : routine.shockers) {
+      JsonObject object   = shockers.createNestedObject();
+      object["model"]     = shocker.model;
+      object["id"]        = shocker.id;
+      object["enabled"]   = shocker.enabled;
+      object["max_shock"] = shocker.maxShock;
+      object["max_vibe"]  = shocker.maxVibe;
+    }
+  }
+
+  static StateUpdateResult update(JsonObject& root, Routine& routine) {
+    StateFields<Routine>::update(root, routine);
+
+    routine.steps.clear();
+    for (JsonObject object : root["correction_steps"].as<JsonArray>()) {
+      Step step {object["type"], object["start_delay"], object["end_delay"], {}, {}};
+      for (double time : object["time_range"].as<JsonArray>()) {
+        step.timeRange.push_back(time);
+      }
+      for (double strength : object["strength_range"].as<JsonArray>()) {
+        step.strengthRange.push_back(strength);
+      }
+      routine.steps.push_back(step);
+    }
+
+    routine.shockers.clear();
+    for (JsonObject object : root["shockers"].as<JsonArray>()) {
+      routine.shockers.push_back({object["model"], object["id"], object["enabled"], object["max_shock"], object["max_vibe"]});
+    }
+    return StateUpdateResult::CHANGED;
+  }
+};
+
+static StateUpdateResult configure(Routine& routine) {
+  routine.passThreshold      = 0.65;
+  routine.detectHysteresisDb = 3.5;
+  for (int i = 0; i < 8; ++i) {
+    routine.steps.push_back({i % 3, 250 * i, 500, {1.5, 2.25 + i}, {10, 35.5 + i * 5}});
+  }
+  for (int i = 0; i < 8; ++i) {
+    routine.shockers.push_back({i % 3, static_cast<std::uint16_t>(0x1234 + i * 977), i != 5, 60 + i, 100});
+  }
+  return StateUpdateResult::CHANGED;
+}
+
+static std::string asJson(StatefulService<Routine>& service) {
+  DynamicJsonDocument document(APP_BUFFER_SIZE);
+  JsonObject root = document.to<JsonObject>();
+  service.read(root, Routine::read);
+  String output;
+  serializeJson(document, output);
+  return output;
+}
+
+struct Measurement {
+  std::size_t bytes;
+  double writeUs;
+  double loadUs;
+  bool restored;
+};
+
+static Measurement measure(PersistenceFormat format, int rounds) {
+  FS fs;
+  StatefulService<Routine> source;
+  source.updateWithoutPropagation(configure);
+  FSPersistence<Routine> writer(Routine::read, Routine::update, &source, &fs, SETTINGS_FILE, APP_BUFFER_SIZE, format);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; ++i) {
+    writer.writeToFS();
+  }
+  double writeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  StatefulService<Routine> target;
+  FSPersistence<Routine> reader(Routine::read, Routine::update, &target, &fs, SETTINGS_FILE, APP_BUFFER_SIZE, format);
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; ++i) {
+    reader.readFromFS();
+  }
+  double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  return {fs.files[SETTINGS_FILE].size(), writeSeconds * 1e6 / rounds, loadSeconds * 1e6 / rounds, asJson(target) == asJson(source)};
+}
+
+void setUp() { }
+void tearDown() { }
+
+void test_binary_is_smaller_and_restores_the_same_state() {
+  Measurement json   = measure(PersistenceFormat::JSON, 1);
+  Measurement binary = measure(PersistenceFormat::BINARY, 1);
+
+  TEST_ASSERT_TRUE(json.restored);
+  TEST_ASSERT_TRUE(binary.restored);
+  printf("%zu bytes as JSON, %zu bytes binary\n", json.bytes, binary.bytes);
+  // Keys are the same in both, the values and the structure shrink
+  TEST_ASSERT_TRUE(binary.bytes * 10 < json.bytes * 9);
+  // Both stay in a single LittleFS block, so the erase estimate is the same
+  TEST_ASSERT_TRUE(json.bytes <= FS_PERSISTENCE_BLOCK_SIZE);
+}
+
+void test_json_file_is_migrated_to_binary() {
+  FS fs;
+  StatefulService<Routine> source;
+  source.updateWithoutPropagation(configure);
+  FSPersistence<Routine> jsonWriter(Routine::read, Routine::update, &source, &fs, SETTINGS_FILE, APP_BUFFER_SIZE, PersistenceFormat::JSON);
+  jsonWriter.writeToFS();
+  TEST_ASSERT_EQUAL('{', fs.files[SETTINGS_FILE][0]);
+
+  StatefulService<Routine> target;
+  FSPersistence<Routine> binaryReader(Routine::read, Routine::update, &target, &fs, SETTINGS_FILE, APP_BUFFER_SIZE, PersistenceFormat::BINARY);
+  binaryReader.readFromFS();
+
+  TEST_ASSERT_EQUAL_STRING(asJson(source).c_str(), asJson(target).c_str());
+  TEST_ASSERT_EQUAL(0, memcmp(FS_PERSISTENCE_BINARY_MAGIC, fs.files[SETTINGS_FILE].data(), 3));
+  TEST_ASSERT_EQUAL(FS_PERSISTENCE_BINARY_VERSION, fs.files[SETTINGS_FILE][3]);
+}
+
+void test_load_and_write_throughput() {
+  const int rounds = 2000;
+  Measurement json   = measure(PersistenceFormat::JSON, rounds);
+  Measurement binary = measure(PersistenceFormat::BINARY, rounds);
+
+  printf("JSON:   %4zu bytes, write %6.1f us, load %6.1f us\n", json.bytes, json.writeUs, json.loadUs);
+  printf("binary: %4zu bytes, write %6.1f us, load %6.1f us\n", binary.bytes, binary.writeUs, binary.loadUs);
+  // Numbers are copied as they are instead of being printed and parsed as text
+  TEST_ASSERT_TRUE(binary.loadUs < json.loadUs);
+  TEST_ASSERT_TRUE(binary.writeUs < json.writeUs);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_binary_is_smaller_and_restores_the_same_state);
+  RUN_TEST(test_json_file_is_migrated_to_binary);
+  RUN_TEST(test_load_and_write_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,179 @@
+#include "util/MpmcRing.h"
+#include "util/QuiescentPtr.h"
+
+#include <unity.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace OpenShock;
+
+// The producer path of the command handler: producers push to the current transmitter's ring while the
+// pin is changed underneath them. Values carry their producer in the upper bits and a per-producer counter
+// in the lower bits.
+const int PRODUCERS               = 4;
+const std::uint64_t ITEMS         = 100000;
+const int PRODUCER_SHIFT          = 40;
+const std::uint64_t SEQUENCE_MASK = (1ull << PRODUCER_SHIFT) - 1;
+
+// Stands in for the transmitter, the ring is drained by its task and once more when it is destroyed
+struct Target {
+  MpmcRing<std::uint64_t, 16> ring;
+  std::atomic<bool> retired {false};
+};
+
+static void yield() {
+  std::this_thread::yield();
+}
+
+void setUp() { }
+void tearDown() { }
+
+void test_reader_sees_the_published_pointer() {
+  QuiescentPtr<int> ptr;
+  int value = 5;
+
+  TEST_ASSERT_FALSE(static_cast<bool>(QuiescentPtr<int>::Ref(ptr)));
+
+  ptr.Publish(&value);
+  {
+    QuiescentPtr<int>::Ref ref(ptr);
+    TEST_ASSERT_TRUE(ref.get() == &value);
+  }
+
+  TEST_ASSERT_TRUE(ptr.Retire(yield) == &value);
+  TEST_ASSERT_FALSE(static_cast<bool>(QuiescentPtr<int>::Ref(ptr)));
+}
+
+void test_retire_waits_for_the_reader() {
+  QuiescentPtr<int> ptr;
+  int value = 5;
+  ptr.Publish(&value);
+
+  std::atomic<bool> holding {false};
+  std::atomic<bool> release {false};
+  std::thread reader([&] {
+    QuiescentPtr<int>::Ref ref(ptr);
+    holding = true;
+    while (!release) {
+      yield();
+    }
+  });
+  while (!holding) {
+    yield();
+  }
+
+  std::atomic<bool> retired {false};
+  std::thread writer([&] {
+    ptr.Retire(yield);
+    retired = true;
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  TEST_ASSERT_FALSE(retired);
+
+  release = true;
+  reader.join();
+  writer.join();
+  TEST_ASSERT_TRUE(retired);
+}
+
+void test_producers_never_touch_a_retired_target() {
+  QuiescentPtr<Target> current;
+  current.Publish(new Target());
+
+  std::atomic<int> producing {PRODUCERS};
+  std::atomic<std::uint64_t> usedRetired {0};
+  std::atomic<std::uint64_t> pushed {0};
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < PRODUCERS; ++p) {
+    producers.emplace_back([&, p] {
+      for (std::uint64_t i = 0; i < ITEMS;) {
+        bool accepted = false;
+        {
+          // Between two transmitters the command handler reports the command as not sent, the test retries
+          QuiescentPtr<Target>::Ref target(current);
+          if (target) {
+            usedRetired += target->retired.load();
+            accepted = target->ring.push((static_cast<std::uint64_t>(p) << PRODUCER_SHIFT) | i);
+          }
+        }
+        if (accepted) {
+          pushed++;
+          ++i;
+        } else {
+          yield();
+        }
+      }
+      producing--;
+    });
+  }
+
+  // Per producer, the lowest counter that may come next, pops never go backwards across targets either
+  std::vector<std::uint64_t> last(PRODUCERS, 0);
+  std::uint64_t popped = 0;
+  std::uint32_t swaps  = 0;
+  bool ordered         = true;
+  auto drain           = [&](Target* target) {
+    std::uint64_t value;
+    std::uint64_t before = popped;
+    while (target->ring.pop(value)) {
+      std::uint64_t producer = value >> PRODUCER_SHIFT;
+      std::uint64_t sequence = value & SEQUENCE_MASK;
+      ordered                = ordered && sequence >= last[producer];
+      last[producer]         = sequence + 1;
+      popped++;
+    }
+    return popped != before;
+  };
+
+  // The consumer drains the live target and changes the pin every few hundred values
+  while (producing > 0) {
+    bool drained;
+    {
+      QuiescentPtr<Target>::Ref target(current);
+      drained = drain(target.get());
+    }
+    if (!drained) {
+      yield();
+    }
+
+    if (popped / 500 > swaps) {
+      Target* old = current.Retire(yield);
+      old->retired = true;
+      // Values pushed before the retire are still in the ring, none can arrive after it
+      drain(old);
+      std::uint64_t value;
+      TEST_ASSERT_FALSE(old->ring.pop(value));
+      delete old;
+
+      current.Publish(new Target());
+      swaps++;
+    }
+  }
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+
+  Target* old = current.Retire(yield);
+  drain(old);
+  delete old;
+
+  TEST_ASSERT_GREATER_THAN(10, swaps);
+  TEST_ASSERT_EQUAL_UINT64(0, usedRetired.load());
+  TEST_ASSERT_EQUAL_UINT64(PRODUCERS * ITEMS, pushed.load());
+  TEST_ASSERT_EQUAL_UINT64(pushed.load(), popped);
+  TEST_ASSERT_TRUE(ordered);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_reader_sees_the_published_pointer);
+  RUN_TEST(test_retire_waits_for_the_reader);
+  RUN_TEST(test_producers_never_touch_a_retired_target);
+  return UNITY_END();
+}
@@ -0,0 +1,204 @@
+#include "radio/rmt/MainEncoder.h"
+// The OpenShock sources are not built as a library in the native env
+#include "radio/rmt/MainEncoder.cpp"
+
+#include <unity.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace OpenShock;
+
+// More distinct commands than the cache holds, so entries are evicted and encoded again
+const std::uint8_t INTENSITIES = 20;
+
+// The pulse timings of a model, spelled out so the goldens do not depend on the encoders
+struct Alphabet {
+  const char* symbols;
+  rmt_data_t timings[4];
+};
+
+static const Alphabet CAIXIANLIN     = {"P10", {{1400, 1, 800, 0}, {800, 1, 300, 0}, {300, 1, 800, 0}}};
+static const Alphabet PETRAINER      = {"P10E", {{750, 1, 750, 0}, {200, 1, 1500, 0}, {200, 1, 750, 0}, {200, 1, 7000, 0}}};
+static const Alphabet PETRAINER998DR = {"P10", {{1500, 1, 750, 0}, {750, 1, 250, 0}, {250, 1, 750, 0}}};
+
+// The sequence a golden frame spells out with one symbol per pulse, spaces only group the fields
+static Rmt::Sequence golden(const Alphabet& alphabet, const std::string& spelled) {
+  Rmt::Sequence sequence;
+  for (char symbol : spelled) {
+    if (symbol != ' ') {
+      sequence.pulses[sequence.length++] = alphabet.timings[std::strchr(alphabet.symbols, symbol) - alphabet.symbols];
+    }
+  }
+  return sequence;
+}
+
+// The lowest width bits of value, most significant first
+static std::string bits(unsigned value, int width) {
+  std::string spelled;
+  for (int bit = width - 1; bit >= 0; --bit) {
+    spelled += (value >> bit) & 1 ? '1' : '0';
+  }
+  return spelled;
+}
+
+static bool samePulses(const Rmt::Sequence& a, const Rmt::Sequence& b) {
+  if (a.length != b.length) {
+    return false;
+  }
+  for (std::uint8_t i = 0; i < a.length; ++i) {
+    if (a.pulses[i].duration0 != b.pulses[i].duration0 || a.pulses[i].level0 != b.pulses[i].level0 || a.pulses[i].duration1 != b.pulses[i].duration1 || a.pulses[i].level1 != b.pulses[i].level1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A Petrainer shock, the type and its checksum are fixed so id and intensity can be filled in
+static Rmt::Sequence petrainerShock(std::uint16_t shockerId, std::uint8_t intensity) {
+  return golden(PETRAINER, "P 10000001 " + bits(shockerId, 16) + " " + bits(intensity, 8) + " 01111110 E");
+}
+
+void setUp() { }
+void tearDown() { }
+
+void test_sequences_fit_inline() {
+  Rmt::Sequence sequence;
+
+  TEST_ASSERT_TRUE(Rmt::GetSequence(sequence, ShockerModelType::CaiXianlin, 1234, ShockerCommandType::Shock, 50));
+  TEST_ASSERT_EQUAL(Rmt::CaiXianlinEncoder::kSequenceLength, sequence.length);
+  TEST_ASSERT_TRUE(Rmt::GetSequence(sequence, ShockerModelType::Petrainer, 1234, ShockerCommandType::Shock, 50));
+  TEST_ASSERT_EQUAL(Rmt::PetrainerEncoder::kSequenceLength, sequence.length);
+  TEST_ASSERT_TRUE(Rmt::GetSequence(sequence, ShockerModelType::Petrainer998DR, 1234, ShockerCommandType::Shock, 50));
+  TEST_ASSERT_EQUAL(Rmt::Petrainer998DREncoder::kSequenceLength, sequence.length);
+  TEST_ASSERT_GREATER_THAN(0, sequence.durationTicks());
+}
+
+void test_every_model_matches_its_golden() {
+  Rmt::Sequence sequence;
+
+  TEST_ASSERT_TRUE(Rmt::GetSequence(sequence, ShockerModelType::CaiXianlin, 1234, ShockerCommandType::Shock, 50));
+  TEST_ASSERT_TRUE(samePulses(golden(CAIXIANLIN, "P 0000010011010010 0000 0001 00110010 00001001 000"), sequence));
+  TEST_ASSERT_TRUE(Rmt::GetSequence(sequence, ShockerModelType::Petrainer, 1234, ShockerCommandType::Shock, 50));
+  TEST_ASSERT_TRUE(samePulses(golden(PETRAINER, "P 10000001 0000010011010010 00110010 01111110 E"), sequence));
+  TEST_ASSERT_TRUE(Rmt::GetSequence(sequence, ShockerModelType::Petrainer998DR, 1234, ShockerCommandType::Shock, 50));
+  TEST_ASSERT_TRUE(samePulses(golden(PETRAINER998DR, "P 1 000 0001 00000010011010010 0110010 0111 111 00"), sequence));
+}
+
+void test_cached_sequence_matches_the_golden() {
+  Rmt::Sequence first, second;
+  Rmt::Sequence expected = golden(CAIXIANLIN, "P 0001000011100001 0000 0010 00011110 00010001 000");
+
+  TEST_ASSERT_TRUE(Rmt::GetSequence(first, ShockerModelType::CaiXianlin, 4321, ShockerCommandType::Vibrate, 30));
+  TEST_ASSERT_TRUE(Rmt::GetSequence(second, ShockerModelType::CaiXianlin, 4321, ShockerCommandType::Vibrate, 30));
+
+  TEST_ASSERT_TRUE(samePulses(expected, first));
+  TEST_ASSERT_TRUE(samePulses(expected, second));
+}
+
+void test_models_sharing_an_id_do_not_collide() {
+  Rmt::Sequence caiXianlin, petrainer;
+
+  TEST_ASSERT_TRUE(Rmt::GetSequence(caiXianlin, ShockerModelType::CaiXianlin, 77, ShockerCommandType::Vibrate, 0));
+  TEST_ASSERT_TRUE(Rmt::GetZeroSequence(petrainer, ShockerModelType::Petrainer, 77));
+
+  TEST_ASSERT_TRUE(samePulses(golden(CAIXIANLIN, "P 0000000001001101 0000 0010 00000000 01001111 000"), caiXianlin));
+  TEST_ASSERT_TRUE(samePulses(golden(PETRAINER, "P 10000010 0000000001001101 00000000 10111110 E"), petrainer));
+}
+
+void test_evicted_entries_are_encoded_again() {
+  Rmt::Sequence sequence;
+
+  for (int round = 0; round < 3; ++round) {
+    for (std::uint8_t intensity = 0; intensity < INTENSITIES; ++intensity) {
+      TEST_ASSERT_TRUE(Rmt::GetSequence(sequence, ShockerModelType::Petrainer998DR, 9, ShockerCommandType::Shock, intensity));
+      TEST_ASSERT_TRUE(samePulses(golden(PETRAINER998DR, "P 1 000 0001 " + bits(9, 17) + " " + bits(intensity, 7) + " 0111 111 00"), sequence));
+    }
+  }
+}
+
+void test_invalid_command_leaves_an_empty_sequence() {
+  Rmt::Sequence sequence;
+  TEST_ASSERT_TRUE(Rmt::GetSequence(sequence, ShockerModelType::CaiXianlin, 1, ShockerCommandType::Shock, 10));
+
+  TEST_ASSERT_FALSE(Rmt::GetSequence(sequence, ShockerModelType::CaiXianlin, 1, ShockerCommandType::Stop, 0));
+  TEST_ASSERT_TRUE(sequence.empty());
+}
+
+void test_concurrent_lookups_get_their_own_sequence() {
+  // The transmit task and the command producers encode at the same time
+  std::vector<Rmt::Sequence> expected;
+  for (std::uint16_t shockerId = 1; shockerId <= 4; ++shockerId) {
+    for (std::uint8_t intensity = 0; intensity < INTENSITIES; ++intensity) {
+      expected.push_back(petrainerShock(shockerId, intensity));
+    }
+  }
+
+  std::atomic<int> wrong {0};
+  std::vector<std::thread> threads;
+  for (std::uint16_t shockerId = 1; shockerId <= 4; ++shockerId) {
+    threads.emplace_back([&wrong, &expected, shockerId] {
+      for (int i = 0; i < 2000; ++i) {
+        std::uint8_t intensity = i % INTENSITIES;
+        Rmt::Sequence sequence;
+        Rmt::GetSequence(sequence, ShockerModelType::Petrainer, shockerId, ShockerCommandType::Shock, intensity);
+        wrong += !samePulses(expected[(shockerId - 1) * INTENSITIES + intensity], sequence);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  TEST_ASSERT_EQUAL(0, wrong.load());
+}
+
+static volatile std::uint32_t s_airTicks = 0;
+
+// Commands per second through the cache, for repeated commands and for more distinct ones than it holds
+static double commandsPerSecond(std::uint8_t distinct, int commands) {
+  Rmt::Sequence sequence;
+  std::uint32_t ticks = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < commands; ++i) {
+    Rmt::GetSequence(sequence, ShockerModelType::CaiXianlin, 4242, ShockerCommandType::Shock, i % distinct);
+    ticks += sequence.durationTicks();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // Keeps the loop from being optimized away
+  s_airTicks += ticks;
+  return commands / seconds;
+}
+
+void test_encoding_throughput() {
+  const int commands = 200000;
+
+  double hits   = commandsPerSecond(4, commands);
+  double misses = commandsPerSecond(INTENSITIES, commands);
+  printf("%d commands: %.0f/s from the cache, %.0f/s encoded\n", commands, hits, misses);
+
+  // A frame is on air for tens of milliseconds, encoding must never be what limits the command rate
+  TEST_ASSERT_TRUE(hits > 100000);
+  TEST_ASSERT_TRUE(misses > 100000);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_sequences_fit_inline);
+  RUN_TEST(test_every_model_matches_its_golden);
+  RUN_TEST(test_cached_sequence_matches_the_golden);
+  RUN_TEST(test_models_sharing_an_id_do_not_collide);
+  RUN_TEST(test_evicted_entries_are_encoded_again);
+  RUN_TEST(test_invalid_command_leaves_an_empty_sequence);
+  RUN_TEST(test_concurrent_lookups_get_their_own_sequence);
+  RUN_TEST(test_encoding_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,187 @@
+#include <SessionHistory.h>
+// The application is not built as a library in the native env
+#include <SessionHistory.cpp>
+
+#include <unity.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+static const char* const TEMP_FILE = SESSION_HISTORY_FILE ".tmp";
+
+static SessionRecord session(uint32_t windowMs) {
+  SessionAggregate aggregate;
+  aggregate.begin(1700000000);
+  aggregate.recordBlock(true, windowMs * 1000);
+  return aggregate.finish(60);
+}
+
+static std::vector<uint32_t> storedIds(FS& fs) {
+  SessionHistory history(&fs);
+  std::vector<uint32_t> ids;
+  history.forEach([&ids](const SessionRecord& record) { ids.push_back(record.id); });
+  return ids;
+}
+
+void setUp() { }
+void tearDown() { }
+
+void test_blocks_are_summed_without_rounding_each_one() {
+  SessionAggregate aggregate;
+  aggregate.begin(1700000000);
+
+  // 1000 samples at 16 kHz, a block a millisecond would cut to 62 ms
+  for (int i = 0; i < 1000; ++i) {
+    aggregate.recordBlock(i % 4 == 0, 62500);
+  }
+
+  SessionRecord record = aggregate.finish(125);
+  TEST_ASSERT_EQUAL(SESSION_RECORD_VERSION, record.version);
+  TEST_ASSERT_EQUAL(1700000000, record.startedAt);
+  TEST_ASSERT_EQUAL(125, record.durationS);
+  TEST_ASSERT_EQUAL(62500, record.windowMs);
+  TEST_ASSERT_EQUAL(15625, record.aboveMs);
+}
+
+void test_reactions_and_evaluations_are_aggregated() {
+  SessionAggregate aggregate;
+  aggregate.begin(0);
+
+  aggregate.recordReaction(300);
+  aggregate.recordReaction(100);
+  aggregate.recordReaction(500);
+
+  aggregate.recordEvaluation(0.05f, false);
+  aggregate.recordEvaluation(0.55f, true);
+  aggregate.recordEvaluation(1.0f, true);
+  // Out of range rates are clamped into the first and the last bin
+  aggregate.recordEvaluation(-0.5f, false);
+  aggregate.recordEvaluation(1.5f, true);
+
+  SessionRecord record = aggregate.finish(10);
+  TEST_ASSERT_EQUAL(3, record.reactions);
+  TEST_ASSERT_EQUAL_FLOAT(300.0f, record.reactionMeanMs);
+  TEST_ASSERT_EQUAL(100, record.reactionMinMs);
+  TEST_ASSERT_EQUAL(500, record.reactionMaxMs);
+
+  TEST_ASSERT_EQUAL(5, record.evaluations);
+  TEST_ASSERT_EQUAL(3, record.affirmations);
+  TEST_ASSERT_EQUAL(2, record.corrections);
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, 0.52f, record.passRateMean);
+  TEST_ASSERT_EQUAL(2, record.passRateBins[0]);
+  TEST_ASSERT_EQUAL(1, record.passRateBins[5]);
+  TEST_ASSERT_EQUAL(2, record.passRateBins[SESSION_PASS_RATE_BINS - 1]);
+
+  // A new session starts from nothing
+  aggregate.begin(0);
+  record = aggregate.finish(0);
+  TEST_ASSERT_EQUAL(0, record.reactions);
+  TEST_ASSERT_EQUAL(0, record.evaluations);
+  TEST_ASSERT_EQUAL(0, record.passRateBins[0]);
+}
+
+void test_ring_keeps_the_latest_sessions() {
+  FS fs;
+  SessionHistory history(&fs);
+  history.begin();
+
+  for (uint32_t i = 0; i < SESSION_HISTORY_MAX + 8; ++i) {
+    SessionRecord record = session(i + 1);
+    TEST_ASSERT_TRUE(history.append(record));
+    TEST_ASSERT_EQUAL(i, record.id);
+  }
+
+  TEST_ASSERT_EQUAL(SESSION_HISTORY_MAX * sizeof(SessionRecord), fs.files[SESSION_HISTORY_FILE].size());
+  TEST_ASSERT_EQUAL(SESSION_HISTORY_MAX + 8, fs.renames);
+  TEST_ASSERT_FALSE(fs.exists(TEMP_FILE));
+
+  // The oldest eight were replaced in place of their slots
+  std::vector<uint32_t> ids = storedIds(fs);
+  TEST_ASSERT_EQUAL(SESSION_HISTORY_MAX, ids.size());
+  for (uint32_t slot = 0; slot < SESSION_HISTORY_MAX; ++slot) {
+    TEST_ASSERT_EQUAL(slot < 8 ? slot + SESSION_HISTORY_MAX : slot, ids[slot]);
+  }
+}
+
+void test_failed_write_keeps_the_history() {
+  FS fs;
+  SessionHistory history(&fs);
+  history.begin();
+  for (uint32_t i = 0; i < 3; ++i) {
+    SessionRecord record = session(i + 1);
+    history.append(record);
+  }
+  std::vector<std::uint8_t> written = fs.files[SESSION_HISTORY_FILE];
+
+  // The file system fills up in the middle of the record
+  fs.freeBytes = written.size() + sizeof(SessionRecord) / 2;
+  SessionRecord record = session(4);
+  TEST_ASSERT_FALSE(history.append(record));
+  TEST_ASSERT_TRUE(written == fs.files[SESSION_HISTORY_FILE]);
+  TEST_ASSERT_FALSE(fs.exists(TEMP_FILE));
+  fs.freeBytes = SIZE_MAX;
+
+  fs.failRenames = true;
+  record = session(5);
+  TEST_ASSERT_FALSE(history.append(record));
+  TEST_ASSERT_TRUE(written == fs.files[SESSION_HISTORY_FILE]);
+  TEST_ASSERT_FALSE(fs.exists(TEMP_FILE));
+}
+
+void test_restart_continues_the_ids() {
+  FS fs;
+  {
+    SessionHistory history(&fs);
+    history.begin();
+    for (uint32_t i = 0; i < 5; ++i) {
+      SessionRecord record = session(i + 1);
+      history.append(record);
+    }
+  }
+  // Power was lost while the next history was written
+  fs.files[TEMP_FILE] = {1, 2, 3};
+  // and an older firmware left half a record behind
+  fs.files[SESSION_HISTORY_FILE].resize(fs.files[SESSION_HISTORY_FILE].size() + sizeof(SessionRecord) / 2, 0xAA);
+
+  SessionHistory history(&fs);
+  history.begin();
+  TEST_ASSERT_FALSE(fs.exists(TEMP_FILE));
+  TEST_ASSERT_EQUAL(5, history.nextId());
+
+  SessionRecord record = session(6);
+  TEST_ASSERT_TRUE(history.append(record));
+  TEST_ASSERT_EQUAL(5, record.id);
+  TEST_ASSERT_EQUAL(6 * sizeof(SessionRecord), fs.files[SESSION_HISTORY_FILE].size());
+}
+
+void test_missing_slots_are_skipped() {
+  FS fs;
+  SessionHistory history(&fs);
+  history.begin();
+  for (uint32_t i = 0; i < 3; ++i) {
+    SessionRecord record = session(i + 1);
+    history.append(record);
+  }
+
+  // The file is lost, the ids keep counting and the slots before them stay empty
+  fs.files.erase(SESSION_HISTORY_FILE);
+  SessionRecord record = session(4);
+  TEST_ASSERT_TRUE(history.append(record));
+
+  std::vector<uint32_t> ids = storedIds(fs);
+  TEST_ASSERT_EQUAL(1, ids.size());
+  TEST_ASSERT_EQUAL(3, ids[0]);
+  TEST_ASSERT_EQUAL(4 * sizeof(SessionRecord), fs.files[SESSION_HISTORY_FILE].size());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_blocks_are_summed_without_rounding_each_one);
+  RUN_TEST(test_reactions_and_evaluations_are_aggregated);
+  RUN_TEST(test_ring_keeps_the_latest_sessions);
+  RUN_TEST(test_failed_write_keeps_the_history);
+  RUN_TEST(test_restart_continues_the_ids);
+  RUN_TEST(test_missing_slots_are_skipped);
+  return UNITY_END();
+}
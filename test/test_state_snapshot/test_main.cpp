@@ -0,0 +1,180 @@
+#include <StatefulService.h>
+// The framework is not built as a library in the native env, the service statics live here
+#include <StatefulService.cpp>
+
+#include <unity.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Every update writes the same value to all fields, a snapshot with differing fields is torn
+struct Samples {
+  std::uint32_t values[16];
+};
+
+static StateUpdateResult fill(Samples& samples, std::uint32_t value) {
+  for (std::uint32_t& sample : samples.values) {
+    sample = value;
+  }
+  return StateUpdateResult::CHANGED;
+}
+
+static bool consistent(const Samples& samples) {
+  for (std::uint32_t sample : samples.values) {
+    if (sample != samples.values[0]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void setUp() { }
+void tearDown() { }
+
+void test_snapshot_follows_updates() {
+  StatefulService<Samples> service;
+  Samples snapshot;
+
+  service.update([](Samples& samples) { return fill(samples, 7); }, "test");
+  service.readSnapshot(snapshot);
+  TEST_ASSERT_EQUAL_UINT32(7, snapshot.values[0]);
+  TEST_ASSERT_TRUE(consistent(snapshot));
+
+  service.updateWithoutPropagation([](Samples& samples) { return fill(samples, 8); });
+  service.readSnapshot(snapshot);
+  TEST_ASSERT_EQUAL_UINT32(8, snapshot.values[15]);
+}
+
+void test_snapshot_does_not_wait_for_a_running_update() {
+  StatefulService<Samples> service;
+  service.update([](Samples& samples) { return fill(samples, 1); }, "test");
+
+  // The writer holds the access mutex until the reader is done
+  std::atomic<bool> writing {false};
+  std::atomic<bool> read {false};
+  std::thread writer([&] {
+    service.update(
+      [&](Samples& samples) {
+        writing = true;
+        while (!read) {
+          std::this_thread::yield();
+        }
+        return fill(samples, 2);
+      },
+      "test");
+  });
+
+  while (!writing) {
+    std::this_thread::yield();
+  }
+  Samples snapshot;
+  service.readSnapshot(snapshot);
+  read = true;
+  writer.join();
+
+  // The last published state, the update in progress is not visible yet
+  TEST_ASSERT_EQUAL_UINT32(1, snapshot.values[0]);
+  TEST_ASSERT_TRUE(consistent(snapshot));
+}
+
+void test_snapshots_are_never_torn() {
+  StatefulService<Samples> service;
+  const std::uint32_t updates = 200000;
+
+  std::atomic<bool> done {false};
+  std::thread writer([&] {
+    for (std::uint32_t i = 1; i <= updates; ++i) {
+      service.update([i](Samples& samples) { return fill(samples, i); }, "test");
+    }
+    done = true;
+  });
+
+  std::uint32_t reads = 0;
+  std::uint32_t torn  = 0;
+  std::uint32_t last  = 0;
+  bool monotonic      = true;
+  while (!done) {
+    Samples snapshot;
+    service.readSnapshot(snapshot);
+    reads++;
+    torn += !consistent(snapshot);
+    monotonic = monotonic && snapshot.values[0] >= last;
+    last      = snapshot.values[0];
+  }
+  writer.join();
+
+  TEST_ASSERT_GREATER_THAN(0, reads);
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  // A reader never sees an older state after a newer one
+  TEST_ASSERT_TRUE(monotonic);
+}
+
+struct ReadRate {
+  double perSecond;
+  double writesPerSecond;
+  double p99Ns;
+};
+
+// Reads against a writer that updates without pause, as the telemetry task does
+template<typename Read>
+static ReadRate contendedReads(StatefulService<Samples>& service, Read read) {
+  typedef std::chrono::steady_clock Clock;
+  const std::size_t reads = 500000;
+
+  std::atomic<bool> done {false};
+  std::atomic<std::uint32_t> writes {0};
+  std::thread writer([&] {
+    for (std::uint32_t i = 1; !done; ++i) {
+      service.update([i](Samples& samples) { return fill(samples, i); }, "test");
+      writes++;
+    }
+  });
+
+  std::vector<std::int64_t> latencies(reads);
+  Clock::time_point start = Clock::now();
+  Clock::time_point now   = start;
+  for (std::size_t i = 0; i < reads; ++i) {
+    Samples samples;
+    read(samples);
+    Clock::time_point after = Clock::now();
+    latencies[i]            = std::chrono::duration_cast<std::chrono::nanoseconds>(after - now).count();
+    now                     = after;
+  }
+  done = true;
+  writer.join();
+
+  // The worst reads are the ones the scheduler preempted, the percentile shows the waits on the writer
+  std::sort(latencies.begin(), latencies.end());
+  double seconds = std::chrono::duration<double>(now - start).count();
+  return {reads / seconds, writes / seconds, static_cast<double>(latencies[reads * 99 / 100])};
+}
+
+void test_snapshot_read_under_a_concurrent_writer() {
+  StatefulService<Samples> service;
+
+  ReadRate locked = contendedReads(service, [&](Samples& samples) {
+    service.read([&](Samples& state) { samples = state; });
+  });
+  ReadRate snapshot = contendedReads(service, [&](Samples& samples) {
+    service.readSnapshot(samples);
+  });
+
+  printf("mutex read: %.0f/s, p99 %.0f ns, %.0f writes/s\n", locked.perSecond, locked.p99Ns, locked.writesPerSecond);
+  printf("snapshot read: %.0f/s, p99 %.0f ns, %.0f writes/s\n", snapshot.perSecond, snapshot.p99Ns, snapshot.writesPerSecond);
+  // Skipping the mutex must never make reads slower, a generous margin keeps a busy host from failing it
+  TEST_ASSERT_TRUE(snapshot.perSecond * 2 > locked.perSecond);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_snapshot_follows_updates);
+  RUN_TEST(test_snapshot_does_not_wait_for_a_running_update);
+  RUN_TEST(test_snapshots_are_never_torn);
+  RUN_TEST(test_snapshot_read_under_a_concurrent_writer);
+  return UNITY_END();
+}
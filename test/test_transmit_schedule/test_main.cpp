@@ -0,0 +1,348 @@
+#include "radio/TransmitEngine.h"
+#include "radio/TransmitSchedule.h"
+// The OpenShock sources are not built as a library in the native env
+#include "radio/TransmitEngine.cpp"
+#include "radio/rmt/MainEncoder.cpp"
+
+#include <unity.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace OpenShock;
+
+// The task sleeps in whole FreeRTOS ticks, rounded up
+const std::int64_t TICK_US = 1000;
+
+struct Entry {
+  int id;
+  std::int64_t nextDue;
+  std::uint32_t repeatUs;
+};
+
+struct Frame {
+  std::uint16_t shockerId;
+  bool live;
+  std::int64_t at;
+  std::uint32_t airUs;
+};
+
+static bool samePulses(const Rmt::Sequence& a, const Rmt::Sequence& b) {
+  if (a.length != b.length) {
+    return false;
+  }
+  for (std::uint8_t i = 0; i < a.length; ++i) {
+    if (a.pulses[i].duration0 != b.pulses[i].duration0 || a.pulses[i].level0 != b.pulses[i].level0 || a.pulses[i].duration1 != b.pulses[i].duration1 || a.pulses[i].level1 != b.pulses[i].level1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Stands in for the RMT peripheral and the command pool. Every written frame is recorded with the shocker it
+// belongs to, and the task's wake loop is played with time jumping to the end of each sleep.
+class SimulatedRmt : public TransmitEngine::Backend {
+public:
+  SimulatedRmt() : m_engine(*this, 16) { }
+
+  /// @brief Queues a command the way RFTransmitter::SendCommands fills a slot
+  command_t* Send(ShockerModelType model, std::uint16_t shockerId, std::uint8_t intensity, std::int64_t durationMs, bool overwrite = true, bool keepAlive = false) {
+    m_slots.emplace_back(new command_t());
+    command_t* cmd       = m_slots.back().get();
+    cmd->until           = m_now / 1000 + durationMs;
+    cmd->model           = model;
+    cmd->shockerId       = shockerId;
+    cmd->overwrite       = overwrite;
+    cmd->keepAlive       = keepAlive;
+    cmd->sampleTimestamp = m_now;
+    cmd->queuedAt        = m_now;
+    cmd->transmitted     = false;
+    Rmt::GetSequence(cmd->sequence, model, shockerId, ShockerCommandType::Shock, intensity);
+    cmd->repeatUs = cmd->sequence.durationTicks();
+
+    Rmt::Sequence zero;
+    Rmt::GetZeroSequence(zero, model, shockerId);
+    m_known.push_back({shockerId, cmd->sequence, zero});
+
+    m_engine.Add(cmd, m_now);
+    m_engine.Service(m_now);
+    return cmd;
+  }
+
+  void Stop() {
+    m_engine.Stop(m_now, m_now);
+    m_engine.Service(m_now);
+  }
+
+  /// @param estopAt The e-stop is checked on every wakeup from this time on, like the task does
+  void RunUntil(std::int64_t untilUs, std::int64_t estopAt = INT64_MAX) {
+    while (true) {
+      std::int64_t wakeAt = m_engine.WakeAt();
+      if (wakeAt == INT64_MAX || wakeAt >= untilUs) {
+        m_now = untilUs;
+        return;
+      }
+      if (wakeAt > m_now) {
+        m_now += (wakeAt - m_now + TICK_US - 1) / TICK_US * TICK_US;
+      }
+
+      if (m_now >= estopAt) {
+        m_engine.EStop(estopAt / 1000);
+      }
+      m_engine.Service(m_now);
+    }
+  }
+
+  bool Write(Rmt::Sequence& frame) override {
+    for (const Known& known : m_known) {
+      if (samePulses(frame, known.live) || samePulses(frame, known.zero)) {
+        frames.push_back({known.shockerId, samePulses(frame, known.live), m_now, frame.durationTicks()});
+        return true;
+      }
+    }
+    // Not a frame of any queued command, shocker 0 is never used by the tests
+    frames.push_back({0, false, m_now, frame.durationTicks()});
+    return true;
+  }
+  void Release(command_t* cmd) override { released.push_back(cmd); }
+  void OnTransmitted(const command_t* cmd, std::int64_t now) override { firstFrames.push_back(now - cmd->queuedAt); }
+  void OnStopped(std::int64_t requestedAt, std::int64_t now) override { stopLatency = now - requestedAt; }
+
+  std::int64_t Now() const { return m_now; }
+  const TransmitEngine& Engine() const { return m_engine; }
+
+  std::vector<Frame> frames;
+  std::vector<command_t*> released;
+  std::vector<std::int64_t> firstFrames;
+  std::int64_t stopLatency = -1;
+
+private:
+  struct Known {
+    std::uint16_t shockerId;
+    Rmt::Sequence live;
+    Rmt::Sequence zero;
+  };
+
+  TransmitEngine m_engine;
+  std::int64_t m_now = 0;
+  std::vector<std::unique_ptr<command_t>> m_slots;
+  std::vector<Known> m_known;
+};
+
+// Largest gap between two frames of the shocker while it was active
+static std::int64_t maxGap(const std::vector<Frame>& frames, std::uint16_t shockerId) {
+  std::int64_t last = -1;
+  std::int64_t gap  = 0;
+  for (const Frame& frame : frames) {
+    if (frame.shockerId != shockerId) {
+      continue;
+    }
+    if (last >= 0 && frame.at - last > gap) {
+      gap = frame.at - last;
+    }
+    last = frame.at;
+  }
+  return gap;
+}
+
+// Share of the time the channel was on air between the first frame and the end of the last one
+static double utilization(const std::vector<Frame>& frames) {
+  std::int64_t air = 0;
+  for (const Frame& frame : frames) {
+    air += frame.airUs;
+  }
+  std::int64_t span = frames.back().at + frames.back().airUs - frames.front().at;
+  return static_cast<double>(air) / span;
+}
+
+void setUp() { }
+void tearDown() { }
+
+void test_empty_schedule_has_nothing_due() {
+  std::vector<Entry*> entries;
+
+  TEST_ASSERT_TRUE(TransmitSchedule::PickDue(entries.begin(), entries.end(), 0) == entries.end());
+  TEST_ASSERT_EQUAL_INT64(INT64_MAX, TransmitSchedule::NextDue(entries.begin(), entries.end()));
+}
+
+void test_entry_is_not_due_before_its_deadline() {
+  Entry a {0, 0, 1000};
+  std::vector<Entry*> entries {&a};
+
+  TransmitSchedule::Start(&a, 500);
+
+  TEST_ASSERT_TRUE(TransmitSchedule::PickDue(entries.begin(), entries.end(), 499) == entries.end());
+  TEST_ASSERT_TRUE(TransmitSchedule::PickDue(entries.begin(), entries.end(), 500) == entries.begin());
+}
+
+void test_late_entry_does_not_burst() {
+  Entry a {0, 0, 1000};
+
+  TransmitSchedule::Start(&a, 0);
+  // Served 5 intervals late, the next deadline is now and not four frames in the past
+  TransmitSchedule::Advance(&a, 5000);
+
+  TEST_ASSERT_EQUAL_INT64(5000, a.nextDue);
+}
+
+void test_equal_shockers_interleave() {
+  SimulatedRmt rmt;
+  for (std::uint16_t id = 1; id <= 3; ++id) {
+    rmt.Send(ShockerModelType::CaiXianlin, id, 50, 2000);
+  }
+  rmt.RunUntil(2000000);
+
+  // Round robin, no shocker ever gets two frames in a row
+  TEST_ASSERT_GREATER_THAN(30, rmt.frames.size());
+  for (std::size_t i = 1; i < rmt.frames.size(); ++i) {
+    TEST_ASSERT_NOT_EQUAL(rmt.frames[i - 1].shockerId, rmt.frames[i].shockerId);
+  }
+}
+
+void test_saturated_channel_stays_on_air() {
+  // Different models have different air times, the channel is never left idle for more than the margin
+  // and the wake-up rounding to a whole tick
+  SimulatedRmt rmt;
+  rmt.Send(ShockerModelType::CaiXianlin, 1, 50, 3000);
+  rmt.Send(ShockerModelType::Petrainer, 2, 50, 3000);
+  rmt.Send(ShockerModelType::Petrainer998DR, 3, 50, 3000);
+  rmt.RunUntil(3000000);
+
+  for (std::size_t i = 1; i < rmt.frames.size(); ++i) {
+    const Frame& previous = rmt.frames[i - 1];
+    TEST_ASSERT_LESS_OR_EQUAL(TransmitEngine::TX_MARGIN_US + TICK_US, rmt.frames[i].at - previous.at - previous.airUs);
+  }
+  TEST_ASSERT_TRUE(utilization(rmt.frames) > 0.97);
+}
+
+void test_every_shocker_meets_its_deadline() {
+  // Each shocker waits for at most one frame of every other one between two of its own
+  SimulatedRmt rmt;
+  rmt.Send(ShockerModelType::CaiXianlin, 1, 50, 3000);
+  rmt.Send(ShockerModelType::Petrainer, 2, 50, 3000);
+  rmt.Send(ShockerModelType::Petrainer998DR, 3, 50, 3000);
+  rmt.Send(ShockerModelType::CaiXianlin, 4, 10, 3000);
+  rmt.RunUntil(3000000);
+
+  std::int64_t round = 0;
+  for (std::uint16_t id = 1; id <= 4; ++id) {
+    const Frame* first = nullptr;
+    for (const Frame& frame : rmt.frames) {
+      if (frame.shockerId == id) {
+        first = &frame;
+        break;
+      }
+    }
+    TEST_ASSERT_NOT_NULL(first);
+    round += first->airUs + TransmitEngine::TX_MARGIN_US + TICK_US;
+  }
+  for (std::uint16_t id = 1; id <= 4; ++id) {
+    TEST_ASSERT_GREATER_THAN(0, maxGap(rmt.frames, id));
+    TEST_ASSERT_LESS_OR_EQUAL(round, maxGap(rmt.frames, id));
+  }
+}
+
+void test_frame_counts_are_fair() {
+  SimulatedRmt rmt;
+  rmt.Send(ShockerModelType::CaiXianlin, 1, 50, 5000);
+  rmt.Send(ShockerModelType::Petrainer, 2, 50, 5000);
+  rmt.Send(ShockerModelType::Petrainer998DR, 3, 50, 5000);
+  rmt.RunUntil(4000000);
+
+  // The channel is saturated, so the shockers take turns and their live frame counts differ by at most one
+  int counts[4] = {0, 0, 0, 0};
+  for (const Frame& frame : rmt.frames) {
+    counts[frame.shockerId] += frame.live;
+  }
+  for (int id = 1; id <= 3; ++id) {
+    TEST_ASSERT_GREATER_THAN(0, counts[id]);
+    TEST_ASSERT_INT_WITHIN(1, counts[1], counts[id]);
+  }
+}
+
+void test_idle_channel_follows_repeat_interval() {
+  // A single shocker is sent as soon as the peripheral is free again
+  SimulatedRmt rmt;
+  command_t* cmd = rmt.Send(ShockerModelType::CaiXianlin, 1, 50, 1000);
+  rmt.RunUntil(1000000);
+
+  std::int64_t interval = (cmd->repeatUs + TransmitEngine::TX_MARGIN_US + TICK_US - 1) / TICK_US * TICK_US;
+  for (std::size_t i = 1; i < rmt.frames.size(); ++i) {
+    TEST_ASSERT_EQUAL_INT64(interval, rmt.frames[i].at - rmt.frames[i - 1].at);
+  }
+}
+
+void test_expired_command_sends_its_zero_sequence_then_ends() {
+  SimulatedRmt rmt;
+  command_t* cmd = rmt.Send(ShockerModelType::Petrainer, 1, 50, 500);
+  rmt.RunUntil(2000000);
+
+  // Live frames up to the deadline, the zero sequence for the end duration, then nothing
+  bool zero = false;
+  for (const Frame& frame : rmt.frames) {
+    if (!frame.live) {
+      zero = true;
+    }
+    TEST_ASSERT_TRUE(frame.live != zero);
+    TEST_ASSERT_TRUE(frame.at <= (500 + TransmitEngine::END_DURATION_MS + 1) * 1000);
+  }
+  TEST_ASSERT_TRUE(zero);
+  TEST_ASSERT_EQUAL(0, rmt.Engine().ActiveCount());
+  TEST_ASSERT_EQUAL(1, rmt.released.size());
+  TEST_ASSERT_TRUE(rmt.released[0] == cmd);
+  TEST_ASSERT_EQUAL(1, rmt.firstFrames.size());
+}
+
+void test_keep_alive_never_displaces_a_command() {
+  SimulatedRmt rmt;
+  rmt.Send(ShockerModelType::CaiXianlin, 1, 50, 1000);
+  command_t* keepAlive = rmt.Send(ShockerModelType::CaiXianlin, 1, 0, 300, false, true);
+
+  TEST_ASSERT_EQUAL(1, rmt.released.size());
+  TEST_ASSERT_TRUE(rmt.released[0] == keepAlive);
+
+  // A real command displaces a keep-alive, even without overwrite
+  keepAlive = rmt.Send(ShockerModelType::CaiXianlin, 2, 0, 300, false, true);
+  rmt.Send(ShockerModelType::CaiXianlin, 2, 50, 300, false);
+
+  TEST_ASSERT_EQUAL(2, rmt.released.size());
+  TEST_ASSERT_TRUE(rmt.released[1] == keepAlive);
+  TEST_ASSERT_EQUAL(2, rmt.Engine().ActiveCount());
+}
+
+void test_stop_sends_zero_sequences_on_the_next_frame() {
+  SimulatedRmt rmt;
+  rmt.Send(ShockerModelType::CaiXianlin, 1, 50, 5000);
+  rmt.Send(ShockerModelType::Petrainer, 2, 50, 5000);
+  rmt.RunUntil(500000);
+
+  std::size_t before = rmt.frames.size();
+  std::int64_t stopAt = rmt.Now();
+  rmt.Stop();
+  rmt.RunUntil(2000000);
+
+  // The frame on air finishes, every frame after it is a zero sequence
+  TEST_ASSERT_GREATER_THAN(before, rmt.frames.size());
+  for (std::size_t i = before; i < rmt.frames.size(); ++i) {
+    TEST_ASSERT_FALSE(rmt.frames[i].live);
+  }
+  const Frame& onAir = rmt.frames[before - 1];
+  TEST_ASSERT_LESS_OR_EQUAL(onAir.at + onAir.airUs + TransmitEngine::TX_MARGIN_US + TICK_US - stopAt, rmt.stopLatency);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_schedule_has_nothing_due);
+  RUN_TEST(test_entry_is_not_due_before_its_deadline);
+  RUN_TEST(test_late_entry_does_not_burst);
+  RUN_TEST(test_equal_shockers_interleave);
+  RUN_TEST(test_saturated_channel_stays_on_air);
+  RUN_TEST(test_every_shocker_meets_its_deadline);
+  RUN_TEST(test_frame_counts_are_fair);
+  RUN_TEST(test_idle_channel_follows_repeat_interval);
+  RUN_TEST(test_expired_command_sends_its_zero_sequence_then_ends);
+  RUN_TEST(test_keep_alive_never_displaces_a_command);
+  RUN_TEST(test_stop_sends_zero_sequences_on_the_next_frame);
+  return UNITY_END();
+}
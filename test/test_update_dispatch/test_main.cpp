@@ -0,0 +1,107 @@
+#include <StatefulService.h>
+// The framework is not built as a library in the native env, the service statics live here
+#include <StatefulService.cpp>
+
+#include <unity.h>
+
+#include <vector>
+
+struct Counter {
+  int value;
+};
+
+static StateUpdateResult increment(Counter& counter) {
+  counter.value++;
+  return StateUpdateResult::CHANGED;
+}
+
+// The dispatcher task is never started on the host, the test drains its queue instead
+static int runDispatcher() {
+  QueueHandle_t queue = static_cast<QueueHandle_t>(FakeTasks::created.front().arg);
+  UpdateDispatchTarget* target;
+  int dispatched = 0;
+  while (xQueueReceive(queue, &target, 0) == pdTRUE) {
+    target->dispatchUpdate();
+    dispatched++;
+  }
+  return dispatched;
+}
+
+class Recorder {
+public:
+  explicit Recorder(StatefulService<Counter>& service) {
+    service.addUpdateHandler([this](const StateOrigin& origin) { origins.push_back(origin); }, false);
+  }
+
+  std::vector<StateOrigin> origins;
+};
+
+void setUp() {
+  UpdateDispatcher::begin();
+}
+void tearDown() { }
+
+void test_updates_run_on_the_dispatcher() {
+  StatefulService<Counter> service;
+  Recorder recorder(service);
+
+  service.update(increment, StateOrigin(OriginTransport::WEB_SOCKET, 3));
+  TEST_ASSERT_EQUAL(0, recorder.origins.size());
+
+  TEST_ASSERT_EQUAL(1, runDispatcher());
+  TEST_ASSERT_EQUAL(1, recorder.origins.size());
+  TEST_ASSERT_TRUE(recorder.origins[0] == StateOrigin(OriginTransport::WEB_SOCKET, 3));
+}
+
+void test_burst_from_one_origin_keeps_it() {
+  StatefulService<Counter> service;
+  Recorder recorder(service);
+
+  for (int i = 0; i < 10; ++i) {
+    service.update(increment, StateOrigin(OriginTransport::EVENT_SOCKET, 7));
+  }
+
+  TEST_ASSERT_EQUAL(1, runDispatcher());
+  TEST_ASSERT_EQUAL(1, recorder.origins.size());
+  TEST_ASSERT_TRUE(recorder.origins[0] == StateOrigin(OriginTransport::EVENT_SOCKET, 7));
+}
+
+void test_burst_from_several_origins_is_neutral() {
+  StatefulService<Counter> service;
+  Recorder recorder(service);
+
+  // The event socket would skip client 7 for an update attributed to it, and client 7 would miss the update of client 8
+  service.update(increment, StateOrigin(OriginTransport::EVENT_SOCKET, 8));
+  service.update(increment, StateOrigin(OriginTransport::EVENT_SOCKET, 7));
+  service.update(increment, StateOrigin(OriginTransport::EVENT_SOCKET, 7));
+
+  TEST_ASSERT_EQUAL(1, runDispatcher());
+  TEST_ASSERT_EQUAL(1, recorder.origins.size());
+  TEST_ASSERT_TRUE(recorder.origins[0].transport == OriginTransport::INTERNAL);
+  TEST_ASSERT_EQUAL(-1, recorder.origins[0].id);
+  TEST_ASSERT_FALSE(recorder.origins[0] == StateOrigin(OriginTransport::EVENT_SOCKET, 7));
+}
+
+void test_next_burst_starts_with_its_own_origin() {
+  StatefulService<Counter> service;
+  Recorder recorder(service);
+
+  service.update(increment, StateOrigin(OriginTransport::HTTP));
+  service.update(increment, StateOrigin(OriginTransport::MQTT));
+  runDispatcher();
+
+  service.update(increment, StateOrigin(OriginTransport::WEB_SOCKET, 2));
+  runDispatcher();
+
+  TEST_ASSERT_EQUAL(2, recorder.origins.size());
+  TEST_ASSERT_TRUE(recorder.origins[1] == StateOrigin(OriginTransport::WEB_SOCKET, 2));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_updates_run_on_the_dispatcher);
+  RUN_TEST(test_burst_from_one_origin_keeps_it);
+  RUN_TEST(test_burst_from_several_origins_is_neutral);
+  RUN_TEST(test_next_burst_starts_with_its_own_origin);
+  return UNITY_END();
+}
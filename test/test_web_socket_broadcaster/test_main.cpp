@@ -0,0 +1,201 @@
+#include <WebSocketBroadcaster.h>
+// The framework is not built as a library in the native env
+#include <WebSocketBroadcaster.cpp>
+
+#include <unity.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+const int TELEMETRY = 1;
+
+static SerializedState frame(const std::string& payload) {
+  return std::make_shared<const String>(payload);
+}
+
+static std::uint32_t stat(const char* broadcaster, const char* name) {
+  DynamicJsonDocument document(1024);
+  JsonObject root = document.to<JsonObject>();
+  WebSocketBroadcaster::readStats(root);
+  return root[broadcaster][name];
+}
+
+void setUp() {
+  FakeHttpd::reset();
+  FakeTimers::manual = true;
+}
+void tearDown() { }
+
+void test_frames_arrive_in_order() {
+  WebSocketBroadcaster broadcaster("order");
+  PsychicWebSocketClient client(1);
+  broadcaster.addClient(&client);
+
+  for (int i = 0; i < 5; ++i) {
+    broadcaster.sendAll(frame("m" + std::to_string(i)));
+  }
+  FakeHttpd::run();
+
+  TEST_ASSERT_EQUAL(5, FakeHttpd::received[1].size());
+  for (int i = 0; i < 5; ++i) {
+    TEST_ASSERT_EQUAL_STRING(("m" + std::to_string(i)).c_str(), FakeHttpd::received[1][i].c_str());
+  }
+}
+
+void test_clients_take_turns() {
+  WebSocketBroadcaster broadcaster("turns");
+  PsychicWebSocketClient a(1), b(2);
+  broadcaster.addClient(&a);
+  broadcaster.addClient(&b);
+
+  for (int i = 0; i < 4; ++i) {
+    broadcaster.sendAll(frame("m" + std::to_string(i)));
+  }
+  FakeHttpd::run();
+
+  // One frame per work item, a backlog of one client never delays the other by more than a frame
+  TEST_ASSERT_EQUAL(8, FakeHttpd::sends.size());
+  for (std::size_t i = 1; i < FakeHttpd::sends.size(); ++i) {
+    TEST_ASSERT_NOT_EQUAL(FakeHttpd::sends[i - 1], FakeHttpd::sends[i]);
+  }
+}
+
+void test_lagging_client_gets_the_latest_telemetry() {
+  WebSocketBroadcaster broadcaster("latest");
+  PsychicWebSocketClient client(1);
+  broadcaster.addClient(&client);
+
+  // The server task does not get to the client while 100 values are produced
+  for (int i = 0; i < 100; ++i) {
+    broadcaster.send(1, frame("v" + std::to_string(i)), TELEMETRY);
+  }
+  FakeHttpd::run();
+
+  TEST_ASSERT_EQUAL(1, FakeHttpd::received[1].size());
+  TEST_ASSERT_EQUAL_STRING("v99", FakeHttpd::received[1][0].c_str());
+}
+
+void test_lagging_client_keeps_the_newest_frames() {
+  WebSocketBroadcaster broadcaster("bounded");
+  PsychicWebSocketClient client(1);
+  broadcaster.addClient(&client);
+
+  for (int i = 0; i < 100; ++i) {
+    broadcaster.send(1, frame("m" + std::to_string(i)));
+  }
+  FakeHttpd::run();
+
+  // The queue is bounded, the oldest frames were dropped
+  TEST_ASSERT_EQUAL(WEB_SOCKET_BROADCAST_QUEUE_SIZE, FakeHttpd::received[1].size());
+  TEST_ASSERT_EQUAL_STRING("m99", FakeHttpd::received[1].back().c_str());
+}
+
+void test_stalled_client_blocks_the_server_once() {
+  WebSocketBroadcaster broadcaster("stalled");
+  PsychicWebSocketClient fast(1), stalled(2), other(3);
+  broadcaster.addClient(&fast);
+  broadcaster.addClient(&stalled);
+  broadcaster.addClient(&other);
+  FakeHttpd::stalled[2] = true;
+
+  for (int i = 0; i < 10; ++i) {
+    broadcaster.sendAll(frame("m" + std::to_string(i)));
+    FakeHttpd::run(3);
+  }
+  FakeHttpd::run();
+
+  // A single send ran into the short timeout, then the client was closed and takes no more frames
+  TEST_ASSERT_EQUAL(WEB_SOCKET_BROADCAST_SEND_TIMEOUT_MS, FakeHttpd::blockedMs);
+  TEST_ASSERT_EQUAL(1, FakeHttpd::closed.size());
+  TEST_ASSERT_EQUAL(2, FakeHttpd::closed[0]);
+  TEST_ASSERT_FALSE(broadcaster.send(2, frame("late")));
+
+  // The other clients got everything
+  TEST_ASSERT_EQUAL(10, FakeHttpd::received[1].size());
+  TEST_ASSERT_EQUAL(10, FakeHttpd::received[3].size());
+}
+
+void test_slot_is_reused_after_close() {
+  WebSocketBroadcaster broadcaster("reuse");
+  PsychicWebSocketClient stalled(1), next(2);
+  broadcaster.addClient(&stalled);
+  FakeHttpd::stalled[1] = true;
+
+  broadcaster.sendAll(frame("m"));
+  FakeHttpd::run();
+  broadcaster.removeClient(1);
+
+  broadcaster.addClient(&next);
+  broadcaster.sendAll(frame("n"));
+  FakeHttpd::run();
+
+  TEST_ASSERT_EQUAL(1, FakeHttpd::received[2].size());
+  TEST_ASSERT_EQUAL(WEB_SOCKET_BROADCAST_SEND_TIMEOUT_MS, FakeSockets::sendTimeoutMs[2]);
+}
+
+void test_frames_are_retried_when_the_work_queue_is_full() {
+  WebSocketBroadcaster broadcaster("retry");
+  PsychicWebSocketClient client(1);
+  broadcaster.addClient(&client);
+
+  // The end of a burst, no further send would pick the frames up
+  FakeHttpd::rejectWork = 3;
+  for (int i = 0; i < 3; ++i) {
+    broadcaster.sendAll(frame("m" + std::to_string(i)));
+  }
+  FakeHttpd::run();
+  TEST_ASSERT_EQUAL(0, FakeHttpd::received[1].size());
+  TEST_ASSERT_EQUAL(3, stat("retry", "queue_failures"));
+  TEST_ASSERT_EQUAL(1, stat("retry", "stranded"));
+
+  FakeTimers::advance((WEB_SOCKET_BROADCAST_RETRY_MS - 1) * 1000LL);
+  TEST_ASSERT_TRUE(FakeHttpd::work.empty());
+  FakeTimers::advance(1000);
+  FakeHttpd::run();
+
+  TEST_ASSERT_EQUAL(3, FakeHttpd::received[1].size());
+  TEST_ASSERT_EQUAL_STRING("m2", FakeHttpd::received[1].back().c_str());
+  TEST_ASSERT_EQUAL(0, stat("retry", "stranded"));
+}
+
+void test_tail_of_a_burst_is_not_stranded_by_a_failed_reschedule() {
+  WebSocketBroadcaster broadcaster("tail");
+  PsychicWebSocketClient a(1), b(2);
+  broadcaster.addClient(&a);
+  broadcaster.addClient(&b);
+
+  for (int i = 0; i < 5; ++i) {
+    broadcaster.sendAll(frame("m" + std::to_string(i)));
+  }
+  // The drains after the first frame cannot be queued, and neither can the first retry
+  FakeHttpd::rejectWork = 3;
+  FakeHttpd::run();
+  TEST_ASSERT_EQUAL(1, FakeHttpd::received[1].size());
+  TEST_ASSERT_EQUAL(1, FakeHttpd::received[2].size());
+  TEST_ASSERT_EQUAL(2, stat("tail", "stranded"));
+
+  for (int retry = 0; retry < 2; ++retry) {
+    FakeTimers::advance(WEB_SOCKET_BROADCAST_RETRY_MS * 1000LL);
+    FakeHttpd::run();
+  }
+
+  TEST_ASSERT_EQUAL(5, FakeHttpd::received[1].size());
+  TEST_ASSERT_EQUAL(5, FakeHttpd::received[2].size());
+  TEST_ASSERT_EQUAL(3, stat("tail", "queue_failures"));
+  TEST_ASSERT_EQUAL(0, stat("tail", "stranded"));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_frames_arrive_in_order);
+  RUN_TEST(test_clients_take_turns);
+  RUN_TEST(test_lagging_client_gets_the_latest_telemetry);
+  RUN_TEST(test_lagging_client_keeps_the_newest_frames);
+  RUN_TEST(test_stalled_client_blocks_the_server_once);
+  RUN_TEST(test_slot_is_reused_after_close);
+  RUN_TEST(test_frames_are_retried_when_the_work_queue_is_full);
+  RUN_TEST(test_tail_of_a_burst_is_not_stranded_by_a_failed_reschedule);
+  return UNITY_END();
+}